@@ -0,0 +1,268 @@
+/***************************************************************************//**
+ * @file main-adaptive-rate-demo.c
+ * @brief libmonarco - Adaptive Cycle Rate Example
+ *
+ * This example runs a cycle against the simulated HAT with a plant which is
+ * idle most of the time - AIN1 only shows noise within the deadband - and
+ * every 1..3 s has a burst of activity: an AIN1 step and DIN1 edges 10..50 ms
+ * apart for 300 ms. Each cycle costs the simulated transfer and the control
+ * logic of the application (busy waits).
+ *
+ * The plant is run three times - at the fixed fast period, at the fixed idle
+ * period and with `monarco_rate.h` attached, switching between them, together
+ * with a process data watchdog (`monarco_wdt.h`). Reported are CPU use,
+ * the response time from a DIN1 edge to its first appearance in `rx_data`,
+ * watchdog trips of the HAT and the time spent in each mode. Halfway through
+ * the adaptive run, the host stalls once for STALL_NS at the fast rate, the
+ * watchdog should take it as an overrun in the very next cycle.
+ *
+ * Usage: monarco-adaptive-rate-demo [-f fast_us] [-i idle_us] [-w dwell_ms] [-t seconds] [-v]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "src/monarco.h"
+#include "src/monarco_rate.h"
+#include "src/monarco_wdt.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error and warning debug prints for monarco_platform.h, verbose prints by -v */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING;
+
+/* Simulated transfer and control logic per cycle (ns) */
+#define TRANSFER_NS 40000
+#define LOGIC_NS 60000
+
+/* Plant activity */
+#define BURST_NS 300000000LL
+#define AIN_NOISE 8
+
+/* Host stall injected at the fast rate in the adaptive run (ns), well below the idle period */
+#define STALL_NS 5000000LL
+
+/* Plant - idle with AIN noise, bursts of DIN1 edges and AIN1 steps */
+typedef struct {
+    uint32_t rng;
+    int64_t burst_start; /* Start of the next or current burst */
+    int64_t next_edge; /* Next DIN1 edge in the current burst */
+    int64_t edge_ns; /* Latest DIN1 edge waiting for detection, 0 = none */
+    uint8_t edge_level; /* DIN1 level after `edge_ns` */
+    uint16_t ain_level; /* AIN1 level without noise */
+    uint32_t edges; /* DIN1 edges */
+    uint32_t superseded; /* Edges replaced by the next one before detection */
+} plant_t;
+
+static inline int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline int64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void busy_ns(int64_t ns)
+{
+    int64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+    }
+}
+
+static void sleep_until(struct timespec *ts, int64_t add_ns)
+{
+    ts->tv_nsec += add_ns;
+    while (ts->tv_nsec >= 1000000000) {
+        ts->tv_nsec -= 1000000000;
+        ts->tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL);
+}
+
+static inline uint32_t plant_rand(plant_t *plant, uint32_t range)
+{
+    plant->rng = plant->rng * 1103515245 + 12345;
+    return (plant->rng >> 16) % range;
+}
+
+/* Apply plant events up to `now` to the simulated HAT inputs */
+static void plant_step(plant_t *plant, monarco_sim_t *sim, int64_t now)
+{
+    while (now >= plant->burst_start + BURST_NS) {
+        plant->burst_start += BURST_NS + 1000000000LL + plant_rand(plant, 2000) * 1000000LL;
+        plant->next_edge = plant->burst_start;
+    }
+
+    while ((now >= plant->next_edge) && (plant->next_edge < plant->burst_start + BURST_NS)) {
+        if (plant->next_edge == plant->burst_start) {
+            plant->ain_level = 500 + plant_rand(plant, 3000);
+        }
+        if (plant->edge_ns != 0) {
+            plant->superseded++;
+        }
+        sim->din ^= 0x01;
+        plant->edge_ns = plant->next_edge;
+        plant->edge_level = sim->din & 0x01;
+        plant->edges++;
+        plant->next_edge += (10 + plant_rand(plant, 40)) * 1000000LL;
+    }
+
+    sim->ain1 = plant->ain_level + plant_rand(plant, 2 * AIN_NOISE + 1) - AIN_NOISE;
+}
+
+static void run(const char *name, int adaptive, int fast_us, int idle_us, int dwell_ms, int seconds)
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    monarco_wdt_t wdt;
+    monarco_rate_t rate;
+    plant_t plant = { .rng = 1, .ain_level = 2000 };
+    int64_t period_ns = fast_us * 1000LL;
+    int64_t resp_max = 0;
+    int64_t resp_sum = 0;
+    uint32_t resp_count = 0;
+    uint32_t cycles = 0;
+    int stall = 0; /* 0 = not yet, 1 = stalled before this cycle, 2 = done */
+    int stall_detected = 0;
+
+    monarco_sim_init(&sim);
+    sim.transfer_ns = TRANSFER_NS;
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_init(&cxt, 4);
+
+    if (adaptive) {
+        // re-based on the idle period by monarco_rate_init()
+        monarco_wdt_init(&wdt, &cxt, fast_us, NULL);
+        wdt.learn_cycles = 100;
+        wdt.recover_cycles = 10;
+
+        monarco_rate_init(&rate, &cxt, fast_us, idle_us);
+        rate.dwell_ns = dwell_ms * 1000000LL;
+        period_ns = rate.period_ns;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t start = now_ns();
+    int64_t end = start + seconds * 1000000000LL;
+    int64_t cpu_start = cpu_ns();
+    plant.burst_start = start + 500000000LL;
+    plant.next_edge = plant.burst_start;
+
+    while (now_ns() < end) {
+        sleep_until(&ts, period_ns);
+
+        plant_step(&plant, &sim, now_ns());
+
+        // host stall at the fast rate, e.g. a page fault storm
+        if (adaptive && (stall == 0) && (rate.mode == MONARCO_RATE_FAST) && (now_ns() - start > (end - start) / 2)) {
+            struct timespec st = { .tv_sec = 0, .tv_nsec = STALL_NS };
+            nanosleep(&st, NULL);
+            stall = 1;
+        }
+
+        // control logic
+        busy_ns(LOGIC_NS);
+
+        cxt.tx_data.dout = 0x01;
+        uint32_t overruns = adaptive ? wdt.overruns : 0;
+        monarco_main(&cxt);
+        cycles++;
+
+        if (stall == 1) {
+            stall_detected = (wdt.overruns != overruns);
+            stall = 2;
+        }
+
+        if ((plant.edge_ns != 0) && ((cxt.rx_data->din & 0x01) == plant.edge_level)) {
+            int64_t resp = now_ns() - plant.edge_ns;
+            resp_sum += resp;
+            resp_count++;
+            if (resp > resp_max) {
+                resp_max = resp;
+            }
+            plant.edge_ns = 0;
+        }
+
+        if (adaptive) {
+            period_ns = rate.period_ns;
+        }
+    }
+
+    int64_t wall = now_ns() - start;
+    int64_t cpu = cpu_ns() - cpu_start;
+
+    printf("%s:\n", name);
+    printf("  cycles %u, CPU %.2f %%, DIN1 response mean %.2f ms, max %.2f ms (%u edges, %u superseded)\n",
+        cycles, 100.0 * cpu / wall, resp_count ? resp_sum / 1e6 / resp_count : 0.0, resp_max / 1e6,
+        plant.edges, plant.superseded);
+    printf("  WDTIMEOUT %u ms, HAT watchdog trips %u\n", sim.regs[MONARCO_SDC_REG_WDTIMEOUT], sim.wdt_trips);
+
+    if (adaptive) {
+        printf("  watchdog overruns %u, safe-state frames %u, host stall %lli ms at fast rate %s\n", wdt.overruns,
+            wdt.safe_cycles, STALL_NS / 1000000, (stall == 0) ? "not injected" : (stall_detected ? "detected" : "missed"));
+        printf("  idle %.2f s in %u cycles, fast %.2f s in %u cycles, %u bursts\n",
+            rate.mode_ns[MONARCO_RATE_IDLE] / 1e9, rate.mode_cycles[MONARCO_RATE_IDLE],
+            rate.mode_ns[MONARCO_RATE_FAST] / 1e9, rate.mode_cycles[MONARCO_RATE_FAST], rate.bursts);
+        monarco_rate_exit(&cxt);
+        monarco_wdt_exit(&cxt);
+    }
+    printf("\n");
+
+    monarco_exit(&cxt);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    int fast_us = 1000;
+    int idle_us = 20000;
+    int dwell_ms = 200;
+    int seconds = 8;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:i:w:t:vh")) != -1) {
+        switch (opt) {
+        case 'f': fast_us = atoi(optarg); break;
+        case 'i': idle_us = atoi(optarg); break;
+        case 'w': dwell_ms = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'v': monarco_platform_dprint_flags |= MONARCO_DPF_INFO | MONARCO_DPF_VERB; break;
+        default: printf("Usage: %s [-f fast_us] [-i idle_us] [-w dwell_ms] [-t seconds] [-v]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((fast_us < 200) || (idle_us < fast_us) || (dwell_ms < 0) || (seconds <= 0)) {
+        printf("Usage: %s [-f fast_us] [-i idle_us] [-w dwell_ms] [-t seconds] [-v]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) adaptive cycle rate demo v1.5\n\n");
+    printf("fast %i us, idle %i us, dwell %i ms, transfer %i us + control logic %i us per cycle, %i s each\n\n",
+        fast_us, idle_us, dwell_ms, TRANSFER_NS / 1000, LOGIC_NS / 1000, seconds);
+
+    run("fixed fast period", 0, fast_us, fast_us, dwell_ms, seconds);
+    run("fixed idle period", 0, idle_us, idle_us, dwell_ms, seconds);
+    run("adaptive rate", 1, fast_us, idle_us, dwell_ms, seconds);
+
+    return 0;
+}
@@ -40,7 +40,7 @@ int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING | MO
 static monarco_cxt_t cxt;
 
 /* Helper macros for digital inputs, outputs and LEDs */
-#define GET_DIN(n) ((cxt.rx_data.din & (1 << n)) ? 1 : 0)
+#define GET_DIN(n) ((cxt.rx_data->din & (1 << n)) ? 1 : 0)
 #define GET_DOUT(n) ((cxt.tx_data.dout & (1 << n)) ? 1 : 0)
 #define SET_DOUT(n, value) cxt.tx_data.dout = (cxt.tx_data.dout & ~(1 << n)) | ((value) ? (1 << n) : 0)
 #define GET_LED(n) ((cxt.tx_data.led_value & (1 << n)) ? 1 : 0)
@@ -115,8 +115,8 @@ void application_loop(int tick)
             GET_DIN(1),
             GET_DIN(2),
             GET_DIN(3),
-            monarco_util_ain_10v_to_real(cxt.rx_data.ain1),
-            monarco_util_ain_10v_to_real(cxt.rx_data.ain2)
+            monarco_util_ain_10v_to_real(cxt.rx_data->ain1),
+            monarco_util_ain_10v_to_real(cxt.rx_data->ain2)
         );
     }
 }
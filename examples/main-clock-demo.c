@@ -0,0 +1,164 @@
+/***************************************************************************//**
+ * @file main-clock-demo.c
+ * @brief libmonarco - Frame Timestamps and Sample Clock Model Example
+ *
+ * This example runs a periodic cycle against the simulated HAT with the clock
+ * model of `monarco_clock.h` attached. The simulated transfer records the true
+ * instant when the HAT latches inputs and then returns after a random delay,
+ * as a cycle thread preempted right after the SPI transfer would. Some frames
+ * are corrupted to show numbering by HAT transfer count across lost frames.
+ *
+ * Reported is the error of sample spacing - nominal period, difference of
+ * raw transfer midpoints and `monarco_clock_dt()` - against the true spacing,
+ * and the estimated period and drift on CLOCK_MONOTONIC_RAW.
+ *
+ * Usage: monarco-clock-demo [-p period_us] [-n cycles] [-j max_delay_us]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "src/monarco.h"
+#include "src/monarco_clock.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Debug prints disabled, frames are corrupted on purpose */
+int monarco_platform_dprint_flags = 0;
+
+#define TRUTH_SIZE 1024
+
+static monarco_sim_t sim;
+static int64_t truth_ns[TRUTH_SIZE]; /* True latch instant by transfer number */
+static uint32_t transfers;
+static int max_delay_us = 200;
+
+/* Simulated HAT latching inputs at a known instant, return to the host delayed */
+static int demo_transfer(void *arg, const monarco_struct_tx_t *tx, monarco_struct_rx_t *rx)
+{
+    truth_ns[transfers % TRUTH_SIZE] = monarco_clock_now();
+    transfers++;
+
+    int rc = monarco_sim_transfer(arg, tx, rx);
+
+    int64_t until = monarco_clock_now() + (int64_t)(rand() % (max_delay_us + 1)) * 1000;
+    while (monarco_clock_now() < until) {
+    }
+
+    return rc;
+}
+
+/* Accumulated squared error of spacing estimate (ns) */
+typedef struct {
+    double sum2;
+    double max;
+} err_t;
+
+static void err_add(err_t *e, double err_ns)
+{
+    e->sum2 += err_ns * err_ns;
+    if (fabs(err_ns) > e->max) {
+        e->max = fabs(err_ns);
+    }
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_cxt_t cxt;
+    monarco_clock_t clk;
+    int period_us = 1000;
+    int cycles = 5000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:j:h")) != -1) {
+        switch (opt) {
+        case 'p': period_us = atoi(optarg); break;
+        case 'n': cycles = atoi(optarg); break;
+        case 'j': max_delay_us = atoi(optarg); break;
+        default: printf("Usage: %s [-p period_us] [-n cycles] [-j max_delay_us]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((period_us <= 0) || (cycles <= 500) || (max_delay_us < 0) || (max_delay_us >= period_us)) {
+        printf("Usage: %s [-p period_us] [-n cycles] [-j max_delay_us]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) clock model demo v1.4\n\n");
+
+    monarco_sim_init(&sim);
+    sim.fault_crc_rate = 0.01;
+    monarco_init_transfer(&cxt, demo_transfer, &sim, NULL);
+    monarco_clock_init(&clk, &cxt, period_us);
+
+    err_t err_nominal = { 0 }, err_mid = { 0 }, err_model = { 0 };
+    int64_t truth_offset = -1;
+    int samples = 0;
+    int i;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    for (i = 0; i < cycles; i++) {
+        ts.tv_nsec += period_us * 1000;
+        while (ts.tv_nsec >= 1000000000) {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        if (monarco_main(&cxt) != 0) {
+            continue;
+        }
+
+        const monarco_clock_stamp_t *cur = monarco_clock_stamp(&cxt);
+        const monarco_clock_stamp_t *prev = monarco_clock_stamp_prev(&cxt);
+
+        if (truth_offset < 0) {
+            truth_offset = (int64_t)transfers - 1 - cur->seq;
+            continue;
+        }
+
+        // skip tracker settling, compare consecutive HAT transfers only
+        if ((i < 500) || (cur->seq != prev->seq + 1)) {
+            continue;
+        }
+
+        double true_dt = (double)(truth_ns[(cur->seq + truth_offset) % TRUTH_SIZE] - truth_ns[(prev->seq + truth_offset) % TRUTH_SIZE]);
+
+        err_add(&err_nominal, period_us * 1000.0 - true_dt);
+        err_add(&err_mid, (double)(cur->mid_ns - prev->mid_ns) - true_dt);
+        err_add(&err_model, monarco_clock_dt(&cxt) * 1e9 - true_dt);
+        samples++;
+    }
+
+    printf("%-18s %12s %12s\n", "sample spacing", "RMS err us", "max err us");
+    printf("%-18s %12.2f %12.2f\n", "nominal period", sqrt(err_nominal.sum2 / samples) / 1000, err_nominal.max / 1000);
+    printf("%-18s %12.2f %12.2f\n", "raw midpoints", sqrt(err_mid.sum2 / samples) / 1000, err_mid.max / 1000);
+    printf("%-18s %12.2f %12.2f\n", "clock model", sqrt(err_model.sum2 / samples) / 1000, err_model.max / 1000);
+
+    printf("\nframes %u, compared %i, HAT transfers %u, CRC errors %u, slips %u, resyncs %u\n",
+        clk.frames, samples, clk.seq + 1, cxt.stats.crc_errors, clk.slips, clk.resyncs);
+    printf("estimated period %.3f us, drift %.1f ppm, grid residual %.2f us\n",
+        clk.period_ns / 1000, monarco_clock_drift_ppm(&clk), clk.jitter_ns / 1000);
+
+    monarco_clock_exit(&cxt);
+    monarco_exit(&cxt);
+
+    return 0;
+}
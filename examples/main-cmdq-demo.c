@@ -0,0 +1,208 @@
+/***************************************************************************//**
+ * @file main-cmdq-demo.c
+ * @brief libmonarco - Output Command Queue Example
+ *
+ * This example shows how several threads can change outputs of Monarco HAT
+ * without racing on read-modify-write of `cxt.tx_data` fields.
+ *
+ * Three producer threads push output commands (see monarco_cmdq.h) - one
+ * toggles DOUT1 and DOUT2 bits, one ramps analog output AOUT1 and one drives
+ * user LEDs. The cycle thread calls `monarco_main()` each 1 ms, which applies
+ * all queued commands to the output frame just before it is sent.
+ *
+ * At the end, the last value requested by each producer is compared with the
+ * output frame, so a lost update would be reported.
+ *
+ * Without the Monarco HAT, use `-s` to run against the simulated HAT.
+ *
+ * Usage: monarco-cmdq-demo [-s] [-t seconds] [-d /dev/spidev0.0]
+ *
+ * See also https://www.monarco.io/
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "src/monarco.h"
+#include "src/monarco_cmdq.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING;
+
+/* Context data for libmonarco. */
+static monarco_cxt_t cxt;
+
+/* Simulated HAT, used with `-s` option */
+static monarco_sim_t sim;
+
+/* Producers run while set */
+static atomic_int running = 1;
+
+/* Number of finished producers */
+static atomic_int finished;
+
+/* Last values requested by producers */
+static uint8_t last_dout;
+static uint16_t last_aout1;
+static uint8_t last_leds;
+
+/* Push with retry - the producer yields when the queue is full, the cycle is never blocked */
+#define PUSH(call) do { while ((call) == -1) { sched_yield(); } } while (0)
+
+static void *producer_dout(void *arg)
+{
+    uint32_t n = 0;
+
+    while (atomic_load(&running)) {
+        n++;
+        if (n & 1) {
+            PUSH(monarco_cmdq_set_bits(&cxt, MONARCO_CMD_FIELD(dout), 0x01));
+            PUSH(monarco_cmdq_clear_bits(&cxt, MONARCO_CMD_FIELD(dout), 0x02));
+        }
+        else {
+            PUSH(monarco_cmdq_clear_bits(&cxt, MONARCO_CMD_FIELD(dout), 0x01));
+            PUSH(monarco_cmdq_set_bits(&cxt, MONARCO_CMD_FIELD(dout), 0x02));
+        }
+        last_dout = (n & 1) ? 0x01 : 0x02;
+        usleep(100);
+    }
+
+    atomic_fetch_add(&finished, 1);
+    return NULL;
+}
+
+static void *producer_aout(void *arg)
+{
+    uint16_t value = 0;
+
+    while (atomic_load(&running)) {
+        value = (value + 7) % 4096;
+        PUSH(monarco_cmdq_set_u16(&cxt, MONARCO_CMD_FIELD(aout1), value));
+        last_aout1 = value;
+        usleep(50);
+    }
+
+    atomic_fetch_add(&finished, 1);
+    return NULL;
+}
+
+static void *producer_leds(void *arg)
+{
+    int led = 0;
+
+    PUSH(monarco_cmdq_write_bits(&cxt, MONARCO_CMD_FIELD(led_mask), 0xF0, 0xF0));
+
+    while (atomic_load(&running)) {
+        led = (led + 1) % 4;
+        PUSH(monarco_cmdq_write_bits(&cxt, MONARCO_CMD_FIELD(led_value), 0xF0, 0x10 << led));
+        last_leds = 0x10 << led;
+        usleep(1000);
+    }
+
+    atomic_fetch_add(&finished, 1);
+    return NULL;
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    const char *spi_device = "/dev/spidev0.0";
+    int simulated = 0;
+    int seconds = 3;
+    pthread_t threads[3];
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "st:d:h")) != -1) {
+        switch (opt) {
+        case 's': simulated = 1; break;
+        case 't': seconds = atoi(optarg); break;
+        case 'd': spi_device = optarg; break;
+        default: printf("Usage: %s [-s] [-t seconds] [-d /dev/spidev0.0]\n", argv[0]); return -1;
+        }
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) output command queue demo v1.4\n\n");
+
+    if (simulated) {
+        monarco_sim_init(&sim);
+        monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, "monarco-cmdq: ");
+    }
+    else if (monarco_init(&cxt, spi_device, 4000000, "monarco-cmdq: ") != 0) {
+        return -1;
+    }
+
+    if (monarco_cmdq_init(&cxt, 64) != 0) {
+        return -1;
+    }
+
+    pthread_create(&threads[0], NULL, producer_dout, NULL);
+    pthread_create(&threads[1], NULL, producer_aout, NULL);
+    pthread_create(&threads[2], NULL, producer_leds, NULL);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    for (i = 0; i < seconds * 1000; i++) {
+        ts.tv_nsec += 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        monarco_main(&cxt);
+    }
+
+    // keep cycling until producers finish, they may wait for free space in the queue
+    atomic_store(&running, 0);
+    do {
+        usleep(1000);
+        monarco_main(&cxt);
+    } while (atomic_load(&finished) < 3);
+
+    for (i = 0; i < 3; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // one more cycle sends commands pushed after the last one
+    monarco_main(&cxt);
+
+    monarco_cmdq_stats_t stats;
+    monarco_cmdq_stats(&cxt, &stats);
+
+    printf("Commands pushed: %u, applied: %u, rejected (retried): %u, max per cycle: %u\n",
+        stats.pushed, stats.applied, stats.rejected, stats.max_batch);
+
+    int lost = ((cxt.tx_data.dout & 0x03) != last_dout) || (cxt.tx_data.aout1 != last_aout1)
+        || ((cxt.tx_data.led_value & 0xF0) != last_leds) || ((cxt.tx_data.led_mask & 0xF0) != 0xF0);
+
+    if (simulated) {
+        lost |= (sim.outputs.dout != cxt.tx_data.dout) || (sim.outputs.aout1 != cxt.tx_data.aout1)
+            || (sim.outputs.led_value != cxt.tx_data.led_value);
+    }
+
+    printf("Final outputs: DOUT=0x%02X AOUT1=%u LED=0x%02X - %s\n", cxt.tx_data.dout, cxt.tx_data.aout1,
+        cxt.tx_data.led_value, lost ? "LOST UPDATE" : "all updates applied");
+
+    monarco_exit(&cxt);
+
+    return lost ? 1 : 0;
+}
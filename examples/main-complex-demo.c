@@ -17,7 +17,8 @@
  * quadrature encoder signal. COUNTER1 is configured for pulse counting mode
  * with both active edges, COUNTER2 is configured for quadrature encoder.
  *
- * Analog output AOUT1 is driven by constant 2.0 Volts, AOUT2 by sinusoidal
+ * Analog output AOUT1 is driven by a PI control loop holding AIN1 at 2.0 Volts,
+ * run by libmonarco inside the I/O cycle. AOUT2 is driven by sinusoidal
  * signal between 1.0 Volts and 9.0 Volts.
  *
  * All input signals are dumped out with 500 ms period. 
@@ -43,6 +44,8 @@
 #include "src/monarco.h"
 #include "src/monarco_util.h"
 #include "src/monarco_sdc.h"
+#include "src/monarco_sched.h"
+#include "src/monarco_ctrl.h"
 #include "monarco_platform.h"
 
 /* Enable all debug print flags for monarco_platform.h */
@@ -52,104 +55,133 @@ int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING | MO
 static monarco_cxt_t cxt;
 
 /* Helper macros for digital inputs, outputs and LEDs */
-#define GET_DIN(n) ((cxt.rx_data.din & (1 << n)) ? 1 : 0)
+#define GET_DIN(n) ((cxt.rx_data->din & (1 << n)) ? 1 : 0)
 #define GET_DOUT(n) ((cxt.tx_data.dout & (1 << n)) ? 1 : 0)
 #define SET_DOUT(n, value) cxt.tx_data.dout = (cxt.tx_data.dout & ~(1 << n)) | ((value) ? (1 << n) : 0)
 #define GET_LED(n) ((cxt.tx_data.led_value & (1 << n)) ? 1 : 0)
 #define SET_LED(n, value) cxt.tx_data.led_value = (cxt.tx_data.led_value & ~(1 << n)) | ((value) ? (1 << n) : 0)
 
-/* Service Data Channel (SDC) registers data Items */
-monarco_sdc_item_t *sdc_item_status;
-monarco_sdc_item_t *sdc_item_fw_ver_lo, *sdc_item_fw_ver_hi;
-monarco_sdc_item_t *sdc_item_hw_ver_lo, *sdc_item_hw_ver_hi;
-monarco_sdc_item_t *sdc_item_mcu_id_1, *sdc_item_mcu_id_2, *sdc_item_mcu_id_3, *sdc_item_mcu_id_4;
-monarco_sdc_item_t *sdc_item_config1;
-monarco_sdc_item_t *sdc_item_rs485_baud, *sdc_item_rs485_mode;
-monarco_sdc_item_t *sdc_item_cnt1_mode, *sdc_item_cnt2_mode;
-
-/*
- * Application Initialization
- *   We define here our set of SDC (Service Data Channel) Registers and initialize corresponding Item structures
- */
-void application_init()
-{
-    int i = 0;
-
+/* Service Data Channel (SDC) registers data Items - indexes for monarco_sdc_*() functions */
+enum {
+    SDC_STATUS,
+    SDC_FW_VER_LO, SDC_FW_VER_HI,
+    SDC_HW_VER_LO, SDC_HW_VER_HI,
+    SDC_MCU_ID_1, SDC_MCU_ID_2, SDC_MCU_ID_3, SDC_MCU_ID_4,
+    SDC_CONFIG1,
+    SDC_RS485_BAUD, SDC_RS485_MODE,
+    SDC_CNT1_MODE, SDC_CNT2_MODE,
+    SDC_COUNT
+};
+
+/* Constant SDC Items table, access rights and values are checked at compile time */
+static const monarco_sdc_item_t sdc_table[SDC_COUNT] = {
     /* Status Code */
-    sdc_item_status = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_STATUS,
-        .factor = 1
-    };
+    [SDC_STATUS] = MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
     /* Firmware version */
-    sdc_item_fw_ver_lo = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_FWVERL,
-        .request = 1
-    };
-    sdc_item_fw_ver_hi = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_FWVERH,
-        .request = 1
-    };
+    [SDC_FW_VER_LO] = MONARCO_SDC_ITEM_READ(FWVERL),
+    [SDC_FW_VER_HI] = MONARCO_SDC_ITEM_READ(FWVERH),
     /* Hardware version */
-    sdc_item_hw_ver_lo = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_HWVERL,
-        .request = 1
-    };
-    sdc_item_hw_ver_hi = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_HWVERH,
-        .request = 1
-    };
+    [SDC_HW_VER_LO] = MONARCO_SDC_ITEM_READ(HWVERL),
+    [SDC_HW_VER_HI] = MONARCO_SDC_ITEM_READ(HWVERH),
     /* MCU ID */
-    sdc_item_mcu_id_1 = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_MCUID1,
-        .request = 1
-    };
-    sdc_item_mcu_id_2 = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_MCUID2,
-        .request = 1
-    };
-    sdc_item_mcu_id_3 = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_MCUID3,
-        .request = 1
-    };
-    sdc_item_mcu_id_4 = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_MCUID4,
-        .request = 1
-    };
+    [SDC_MCU_ID_1] = MONARCO_SDC_ITEM_READ(MCUID1),
+    [SDC_MCU_ID_2] = MONARCO_SDC_ITEM_READ(MCUID2),
+    [SDC_MCU_ID_3] = MONARCO_SDC_ITEM_READ(MCUID3),
+    [SDC_MCU_ID_4] = MONARCO_SDC_ITEM_READ(MCUID4),
     /* Hardware Configurarion Register 1 - enable RS-485 termination, both analog inputs in voltage mode */
-    sdc_item_config1 = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_HWCONFIG1,
-        .value = MONARCO_SDC_CONFIG1_RS485TERM | MONARCO_SDC_CONFIG1_AI1V | MONARCO_SDC_CONFIG1_AI2V,
-        .write = 1,
-        .request = 1
-    };
+    [SDC_CONFIG1] = MONARCO_SDC_ITEM_WRITE(HWCONFIG1, MONARCO_SDC_CONFIG1_RS485TERM | MONARCO_SDC_CONFIG1_AI1V | MONARCO_SDC_CONFIG1_AI2V),
     /* RS-485 Configuration - 38400 Baud, 8 data bits, 1 stop bit */
-    sdc_item_rs485_baud = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_RS485BAUD,
-        .value = 384,
-        .write = 1,
-        .request = 1
-    };
-    sdc_item_rs485_mode = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_RS485MODE,
-        .value = MONARCO_SDC_RS485_MODE_PARITY_NONE | MONARCO_SDC_RS485_MODE_DATABITS_8 | MONARCO_SDC_RS485_MODE_STOPBITS_1_0,
-        .write = 1,
-        .request = 1
-    };
+    [SDC_RS485_BAUD] = MONARCO_SDC_ITEM_WRITE(RS485BAUD, 384),
+    [SDC_RS485_MODE] = MONARCO_SDC_ITEM_WRITE(RS485MODE, MONARCO_SDC_RS485_MODE_PARITY_NONE | MONARCO_SDC_RS485_MODE_DATABITS_8 | MONARCO_SDC_RS485_MODE_STOPBITS_1_0),
     /* Counter 1, 2 Configuration */
-    sdc_item_cnt1_mode = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_CNT1CFG,
-        .value = MONARCO_SDC_COUNTER_MODE_PCNT | MONARCO_SDC_COUNTER_EDGE_BOTH,
-        .write = 1,
-        .request = 1
-    };
-    sdc_item_cnt2_mode = &cxt.sdc_items[i]; cxt.sdc_items[i++] = (monarco_sdc_item_t){
-        .address = MONARCO_SDC_REG_CNT2CFG,
-        .value = MONARCO_SDC_COUNTER_MODE_QUAD,
-        .write = 1,
-        .request = 1
-    };
-
-    cxt.sdc_size = i;
+    [SDC_CNT1_MODE] = MONARCO_SDC_ITEM_WRITE(CNT1CFG, MONARCO_SDC_COUNTER_MODE_PCNT | MONARCO_SDC_COUNTER_EDGE_BOTH),
+    [SDC_CNT2_MODE] = MONARCO_SDC_ITEM_WRITE(CNT2CFG, MONARCO_SDC_COUNTER_MODE_QUAD),
+};
+
+/*
+ * Application Tasks
+ *   Multi-rate application behaviour, run by libmonarco scheduler with automatically spread phases.
+ */
+
+// Each 16 ticks (0.32 s) - loop over LED1 - LED8
+static void task_led_chase(void *arg, uint32_t tick)
+{
+    if (cxt.tx_data.led_value == 0) {
+        cxt.tx_data.led_value = 1; // LED 1
+    } else {
+        cxt.tx_data.led_value = cxt.tx_data.led_value << 1; // Shift left by 1
+    }
+}
+
+// Each 50 ticks (1 s) - toggle DOUT1
+static void task_dout1_toggle(void *arg, uint32_t tick)
+{
+    if (GET_DOUT(0)) {
+        SET_DOUT(0, 0);
+    }
+    else {
+        SET_DOUT(0, 1);
+    }
+}
+
+// Each 25 ticks (0.5 s) - DOUT3, DOUT4 -- quadrature encoder emulation
+static void task_encoder(void *arg, uint32_t tick)
+{
+    if ((GET_DOUT(2) == 0) && (GET_DOUT(3) == 0)) { SET_DOUT(2, 0); SET_DOUT(3, 1); }
+    else if ((GET_DOUT(2) == 0) && (GET_DOUT(3) == 1)) { SET_DOUT(2, 1); SET_DOUT(3, 1); }
+    else if ((GET_DOUT(2) == 1) && (GET_DOUT(3) == 1)) { SET_DOUT(2, 1); SET_DOUT(3, 0); }
+    else if ((GET_DOUT(2) == 1) && (GET_DOUT(3) == 0)) { SET_DOUT(2, 0); SET_DOUT(3, 0); }
+}
+
+// Each 25 ticks (0.5 s), print status of inputs
+static void task_print_inputs(void *arg, uint32_t tick)
+{
+    printf("DI1..4: %u%u%u%u | CNT1: %05u | CNT2: %05u | AIN1: %02.03f | AIN2: %02.03f\n",
+        (cxt.rx_data->din & (1 << 0)) > 0,
+        (cxt.rx_data->din & (1 << 1)) > 0,
+        (cxt.rx_data->din & (1 << 2)) > 0,
+        (cxt.rx_data->din & (1 << 3)) > 0,
+        cxt.rx_data->cnt1, cxt.rx_data->cnt2,
+        monarco_util_ain_10v_to_real(cxt.rx_data->ain1),
+        monarco_util_ain_10v_to_real(cxt.rx_data->ain2)
+    );
+}
+
+/* Task table - period in ticks, phase assigned automatically, equal priority = rate-monotonic order */
+static monarco_task_t tasks[] = {
+    { .name = "led_chase", .fn = task_led_chase, .period = 16, .phase = MONARCO_SCHED_PHASE_AUTO },
+    { .name = "dout1_toggle", .fn = task_dout1_toggle, .period = 50, .phase = MONARCO_SCHED_PHASE_AUTO },
+    { .name = "encoder", .fn = task_encoder, .period = 25, .phase = MONARCO_SCHED_PHASE_AUTO },
+    { .name = "print_inputs", .fn = task_print_inputs, .period = 25, .phase = MONARCO_SCHED_PHASE_AUTO },
+};
+
+/* Scheduler for application tasks */
+static monarco_sched_t sched;
+
+/* AIN1 -> PI -> AOUT1 control loop, in Volts, run by monarco_main() right after inputs are received */
+static monarco_ctrl_pid_f_t aout1_pid;
+
+static monarco_ctrl_loop_t ctrl_loops[] = {
+    {
+        .input = MONARCO_CTRL_IN_AIN1, .output = MONARCO_CTRL_OUT_AOUT1, .enabled = 1,
+        .sp_f = 2.0, .in_scale = 10.0 / 4095, .out_scale = 4095 / 10.0,
+        .pid_f = &aout1_pid,
+    },
+};
+
+/*
+ * Application Initialization
+ *   We load our set of SDC (Service Data Channel) Registers from the constant Items table
+ *   and attach application tasks to the scheduler and the AOUT1 control loop to libmonarco.
+ */
+void application_init()
+{
+    monarco_sdc_load(&cxt, sdc_table, SDC_COUNT);
+
+    monarco_sched_init(&sched, tasks, sizeof(tasks) / sizeof(tasks[0]), 0);
+
+    monarco_ctrl_pid_f_init(&aout1_pid, 0.2, 5.0, 0.0, 0.0, 0.0, 10.0, 0.020);
+    monarco_ctrl_attach(&cxt, ctrl_loops, sizeof(ctrl_loops) / sizeof(ctrl_loops[0]));
 }
 
 /*
@@ -162,76 +194,34 @@ void application_loop(int tick)
     int i;
 
     /* ---
-     * 1) Calculate new Process Data Channel (PDC) outputs to the Monarco HAT - to cxt.tx_data
+     * 1) Call main function of libmonarco - do SPI transaction, dispatch SDC items
+     * --- */
+
+    monarco_main(&cxt);
+
+    /* ---
+     * 2) Run application tasks due in this cycle - handle new Process Data Channel (PDC) inputs
+     *    from cxt.rx_data, calculate new outputs to cxt.tx_data sent by the next monarco_main()
      * --- */
 
     // enable user control on LED1 - LED8, set mask bits to 1 for all LEDs (0xFF)
     cxt.tx_data.led_mask = 0xFF;
 
-    // Each 16 ticks (0.32 s) - loop over LED1 - LED8
-    if ((tick % 16) == 0) {
-        if (cxt.tx_data.led_value == 0) {
-            cxt.tx_data.led_value = 1; // LED 1
-        } else {
-            cxt.tx_data.led_value = cxt.tx_data.led_value << 1; // Shift left by 1
-        }
-    }
-
-    // AOUT1 = 2.0 V
-    cxt.tx_data.aout1 = monarco_util_aout_volts_to_u16(2.0);
+    // AOUT1 is driven by the control loop, AIN1 = 2.0 V
 
     // AOUT2 = 5.0 V + superimposed sinus with amplitude 4.0 V, period 2000 ticks * 20 ms = 40 s
     cxt.tx_data.aout2 = monarco_util_aout_volts_to_u16(5.0 + 4.0 * sin((tick % 2000) / 2000.0 * 2 * 3.141592));
 
-    //  Each 50 ticks (1 s) - toggle DOUT1
-    if ((tick % 50) == 0) {
-        if (GET_DOUT(0)) {
-            SET_DOUT(0, 0);
-        }
-        else {
-            SET_DOUT(0, 1);
-        }
-    }
-
-    //  Each 25 ticks (0.5 s) - DOUT3, DOUT4 -- quadrature encoder emulation
-    if ((tick % 25) == 0) {
-        if ((GET_DOUT(2) == 0) && (GET_DOUT(3) == 0)) { SET_DOUT(2, 0); SET_DOUT(3, 1); }
-        else if ((GET_DOUT(2) == 0) && (GET_DOUT(3) == 1)) { SET_DOUT(2, 1); SET_DOUT(3, 1); }
-        else if ((GET_DOUT(2) == 1) && (GET_DOUT(3) == 1)) { SET_DOUT(2, 1); SET_DOUT(3, 0); }
-        else if ((GET_DOUT(2) == 1) && (GET_DOUT(3) == 0)) { SET_DOUT(2, 0); SET_DOUT(3, 0); }
-    }
-
-    /* ---
-     * 2) Call main function of libmonarco - do SPI transaction, dispatch SDC items
-     * --- */
-
-    monarco_main(&cxt);
-
-    /* ---
-     * 3) Handle new Process Data Channel (PDC) inputs from the Monarco HAT - from cxt.rx_data
-     * --- */
-
-    // Each 25 tick (0.5 s), print status of inputs
-    if ((tick % 25) == 0) {
-        printf("DI1..4: %u%u%u%u | CNT1: %05u | CNT2: %05u | AIN1: %02.03f | AIN2: %02.03f\n",
-            (cxt.rx_data.din & (1 << 0)) > 0,
-            (cxt.rx_data.din & (1 << 1)) > 0,
-            (cxt.rx_data.din & (1 << 2)) > 0,
-            (cxt.rx_data.din & (1 << 3)) > 0,
-            cxt.rx_data.cnt1, cxt.rx_data.cnt2,
-            monarco_util_ain_10v_to_real(cxt.rx_data.ain1),
-            monarco_util_ain_10v_to_real(cxt.rx_data.ain2)
-        );
-    }
+    monarco_sched_run(&sched);
 
     /* ---
-     * 4) Check if all SDC Items read/write successfully completed
+     * 3) Check if all SDC Items read/write successfully completed
      * --- */
 
     if (sdc_done == 0) {
         int done = 1;
         for (i = 0; i < cxt.sdc_size; i++) {
-            if (cxt.sdc_items[i].done == 0) {
+            if (!monarco_sdc_done(&cxt, i)) {
                 done = 0;
                 break;
             }
@@ -239,10 +229,10 @@ void application_loop(int tick)
         if (done) {
             sdc_done = 1;
             printf("MONARCO SDC INIT DONE, FW=%04X%04X, HW=%04X%04X, CPUID=%04X%04X%04X%04X\n",
-                    sdc_item_fw_ver_hi->value, sdc_item_fw_ver_lo->value,
-                    sdc_item_hw_ver_hi->value, sdc_item_hw_ver_lo->value,
-                    sdc_item_mcu_id_4->value, sdc_item_mcu_id_3->value,
-                    sdc_item_mcu_id_2->value, sdc_item_mcu_id_1->value);
+                    monarco_sdc_value(&cxt, SDC_FW_VER_HI), monarco_sdc_value(&cxt, SDC_FW_VER_LO),
+                    monarco_sdc_value(&cxt, SDC_HW_VER_HI), monarco_sdc_value(&cxt, SDC_HW_VER_LO),
+                    monarco_sdc_value(&cxt, SDC_MCU_ID_4), monarco_sdc_value(&cxt, SDC_MCU_ID_3),
+                    monarco_sdc_value(&cxt, SDC_MCU_ID_2), monarco_sdc_value(&cxt, SDC_MCU_ID_1));
         }
     }
 }
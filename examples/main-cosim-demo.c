@@ -0,0 +1,181 @@
+/***************************************************************************//**
+ * @file main-cosim-demo.c
+ * @brief libmonarco - Virtual-Clock Co-Simulation Example
+ *
+ * This example runs the wiring of the 'complex' example against plant models
+ * on a virtual clock, faster than realtime:
+ *  - DOUT1..DOUT4 wired to DIN1..DIN4, AOUT2 wired to AIN2,
+ *  - AOUT1 drives a first-order lag process (gain 0.8, time constant 30 s)
+ *    measured by AIN1, e.g. a heater with temperature transmitter,
+ *  - AOUT2 drives a motor with encoder counted by COUNTER2 (50 counts/s per V).
+ *
+ * The PI control loop of `monarco_ctrl.h` holds AIN1 at a setpoint stepping
+ * between 2.0 V and 6.0 V every 10 minutes of process time, AOUT2 follows the
+ * sine of the 'complex' example and DOUT1 is toggled each second.
+ *
+ * Reported is the settling time (2 % band) and overshoot of the steps, the
+ * checks of the wiring, and process time against wall-clock time.
+ *
+ * Usage: monarco-cosim-demo [-t process_hours] [-p period_us]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "src/monarco.h"
+#include "src/monarco_ctrl.h"
+#include "src/monarco_cosim.h"
+#include "src/monarco_util.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+#define STEP_PERIOD_S 600.0
+
+static monarco_plant_t plants[] = {
+    { .type = MONARCO_PLANT_LOOPBACK, .dout_mask = 0x0F, .input = MONARCO_CTRL_OUT_AOUT2, .output = MONARCO_CTRL_IN_AIN2 },
+    { .type = MONARCO_PLANT_LAG, .input = MONARCO_CTRL_OUT_AOUT1, .output = MONARCO_CTRL_IN_AIN1, .gain = 0.8, .tau = 30.0 },
+    { .type = MONARCO_PLANT_ENCODER, .input = MONARCO_CTRL_OUT_AOUT2, .output = MONARCO_CTRL_IN_CNT2, .gain = 50.0 },
+};
+
+static monarco_ctrl_pid_f_t pid;
+
+static monarco_ctrl_loop_t loops[] = {
+    {
+        .input = MONARCO_CTRL_IN_AIN1, .output = MONARCO_CTRL_OUT_AOUT1, .enabled = 1,
+        .sp_f = 2.0, .in_scale = 10.0 / 4095, .out_scale = 4095 / 10.0,
+        .pid_f = &pid,
+    },
+};
+
+static inline double wall_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    monarco_cosim_t cs;
+    double hours = 10.0;
+    int period_us = 20000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:p:h")) != -1) {
+        switch (opt) {
+        case 't': hours = atof(optarg); break;
+        case 'p': period_us = atoi(optarg); break;
+        default: printf("Usage: %s [-t process_hours] [-p period_us]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((hours <= 0) || (period_us <= 0)) {
+        printf("Usage: %s [-t process_hours] [-p period_us]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) co-simulation demo v1.4\n\n");
+
+    monarco_sim_init(&sim);
+    monarco_cosim_init(&cs, &sim, plants, sizeof(plants) / sizeof(plants[0]), period_us);
+    monarco_init_transfer(&cxt, monarco_cosim_transfer, &cs, NULL);
+
+    monarco_ctrl_pid_f_init(&pid, 2.0, 0.1, 0.0, 0.5, 0.0, 10.0, period_us * 1e-6);
+    monarco_ctrl_attach(&cxt, loops, 1);
+
+    double end_s = hours * 3600.0;
+    double step_start = 0.0, step_from = 0.0, last_outside = 0.0, overshoot = 0.0;
+    double settle_sum = 0.0, settle_max = 0.0, overshoot_max = 0.0;
+    int steps = 0;
+    uint32_t din1_edges = 0, cnt2_wraps = 0;
+    uint8_t din_prev = 0;
+    uint16_t cnt2_prev = 0;
+
+    printf("%6s %8s %8s %12s %12s\n", "step", "time s", "sp V", "settling s", "overshoot %");
+
+    double wall_start = wall_s();
+
+    while (monarco_cosim_time(&cs) < end_s) {
+        double t = monarco_cosim_time(&cs);
+
+        monarco_main(&cxt);
+
+        double sp = loops[0].sp_f;
+        double pv = monarco_util_ain_10v_to_real(cxt.rx_data->ain1);
+
+        // step response evaluation of the previous setpoint
+        if (fabs(pv - sp) > 0.02 * fabs(sp - step_from)) {
+            last_outside = t;
+        }
+        if ((sp - step_from) * (pv - sp) > 0) {
+            double os = fabs(pv - sp) / fabs(sp - step_from) * 100.0;
+            if (os > overshoot) {
+                overshoot = os;
+            }
+        }
+
+        if (t - step_start >= STEP_PERIOD_S) {
+            if (steps > 0) {
+                double settle = last_outside - step_start;
+                settle_sum += settle;
+                settle_max = (settle > settle_max) ? settle : settle_max;
+                overshoot_max = (overshoot > overshoot_max) ? overshoot : overshoot_max;
+                if (steps <= 4) {
+                    printf("%6i %8.0f %8.1f %12.2f %12.2f\n", steps, step_start, sp, settle, overshoot);
+                }
+            }
+            step_from = sp;
+            loops[0].sp_f = (sp < 4.0) ? 6.0 : 2.0;
+            step_start = t;
+            last_outside = t;
+            overshoot = 0.0;
+            steps++;
+        }
+
+        // 'complex' example outputs - AOUT2 sine with 40 s period, DOUT1 toggled each second
+        cxt.tx_data.aout2 = monarco_util_aout_volts_to_u16(5.0 + 4.0 * sin(fmod(t, 40.0) / 40.0 * 2 * M_PI));
+        cxt.tx_data.dout = (cxt.tx_data.dout & ~0x01) | ((int)t & 1);
+
+        if ((cxt.rx_data->din ^ din_prev) & 0x01) {
+            din1_edges++;
+        }
+        din_prev = cxt.rx_data->din;
+        if ((uint16_t)cxt.rx_data->cnt2 < cnt2_prev) {
+            cnt2_wraps++;
+        }
+        cnt2_prev = (uint16_t)cxt.rx_data->cnt2;
+    }
+
+    double wall = wall_s() - wall_start;
+
+    printf("\nsteps %i, settling mean %.2f s, max %.2f s, max overshoot %.2f %%\n",
+        steps - 1, settle_sum / (steps - 1), settle_max, overshoot_max);
+    printf("DIN1 edges %u (DOUT1 toggles %.0f), COUNTER2 %u with %u wraps, HAT watchdog trips %u\n",
+        din1_edges, floor(end_s), cxt.rx_data->cnt2, cnt2_wraps, sim.wdt_trips);
+    printf("process time %.1f h in %.2f s wall-clock, %.0fx realtime, %llu cycles of %i us\n",
+        monarco_cosim_time(&cs) / 3600.0, wall, monarco_cosim_time(&cs) / wall, (unsigned long long)cs.frames, period_us);
+
+    monarco_ctrl_attach(&cxt, NULL, 0);
+    monarco_exit(&cxt);
+
+    return 0;
+}
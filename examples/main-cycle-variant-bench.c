@@ -0,0 +1,136 @@
+/***************************************************************************//**
+ * @file main-cycle-variant-bench.c
+ * @brief libmonarco - Cycle Variants Benchmark
+ *
+ * This tool compares compile-time specialized variants of the cycle:
+ *  - PDC-only - `monarco_main_pdc()`, library built with MONARCO_NO_DPRINT,
+ *  - PDC + SDC - `monarco_main()`, library built with MONARCO_NO_DPRINT,
+ *  - instrumented - both with debug prints and MONARCO_TRACE tracepoints
+ *    recording into an active trace ring.
+ * The Makefile builds the library into `monarco-cycle-variant-bench` and
+ * `monarco-cycle-variant-bench-trace` with -O2 and respective flags.
+ *
+ * Reported is the time from cycle entry to the frame transfer (the path
+ * between wake-up and ioctl) and the time of the whole cycle, the simulated
+ * HAT replaces the SPI transfer.
+ *
+ * Usage: monarco-cycle-variant-bench [-n cycles]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "src/monarco.h"
+#include "src/monarco_sim.h"
+#include "src/monarco_trace.h"
+#include "monarco_platform.h"
+
+/* Debug prints enabled at runtime, they are compiled out unless instrumented */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING;
+
+#ifdef MONARCO_TRACE
+#define BENCH_BUILD "instrumented"
+#elif defined(MONARCO_NO_DPRINT)
+#define BENCH_BUILD "specialized"
+#else
+#define BENCH_BUILD "default"
+#endif
+
+static const monarco_sdc_item_t sdc_table[] = {
+    MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
+    MONARCO_SDC_ITEM_READ_PERIODIC(FWVERL, 10),
+    MONARCO_SDC_ITEM_READ_PERIODIC(RS485RXCNT, 100),
+};
+
+static monarco_sim_t sim;
+static int64_t transfer_ns;
+
+static inline int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Simulated HAT with timestamp of the transfer start */
+static int bench_transfer(void *arg, const monarco_struct_tx_t *tx, monarco_struct_rx_t *rx)
+{
+    transfer_ns = now_ns();
+    return monarco_sim_transfer(arg, tx, rx);
+}
+
+static void run(const char *name, int (*cycle)(monarco_cxt_t *), int cycles)
+{
+    monarco_cxt_t cxt;
+    int64_t pre_sum = 0, pre_min = INT64_MAX, total_sum = 0;
+    int i;
+
+    monarco_sim_init(&sim);
+    monarco_init_transfer(&cxt, bench_transfer, &sim, NULL);
+    monarco_sdc_load(&cxt, sdc_table, sizeof(sdc_table) / sizeof(sdc_table[0]));
+#ifdef MONARCO_TRACE
+    monarco_trace_init(&cxt, 4096);
+#endif
+
+    for (i = 0; i < 1000; i++) {
+        cycle(&cxt);
+    }
+
+    for (i = 0; i < cycles; i++) {
+        int64_t t0 = now_ns();
+        cycle(&cxt);
+        int64_t t1 = now_ns();
+
+        int64_t pre = transfer_ns - t0;
+        pre_sum += pre;
+        total_sum += t1 - t0;
+        if (pre < pre_min) {
+            pre_min = pre;
+        }
+    }
+
+    printf("%-14s %-12s %12.1f %12lli %12.1f %10u\n", BENCH_BUILD, name, (double)pre_sum / cycles, (long long)pre_min,
+        (double)total_sum / cycles, cxt.stats.sdc_done);
+
+    monarco_exit(&cxt);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    int cycles = 1000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': cycles = atoi(optarg); break;
+        default: printf("Usage: %s [-n cycles]\n", argv[0]); return -1;
+        }
+    }
+
+    if (cycles <= 0) {
+        printf("Usage: %s [-n cycles]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) cycle variants benchmark v1.4\n\n");
+    printf("%-14s %-12s %12s %12s %12s %10s\n", "build", "cycle", "to xfer ns", "min ns", "cycle ns", "SDC done");
+
+    run("PDC-only", monarco_main_pdc, cycles);
+    run("PDC+SDC", monarco_main, cycles);
+
+    return 0;
+}
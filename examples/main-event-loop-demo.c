@@ -0,0 +1,182 @@
+/***************************************************************************//**
+ * @file main-event-loop-demo.c
+ * @brief libmonarco - Event Loop Integration Example
+ *
+ * This example drives the cycle from a single-threaded epoll loop, as a gateway
+ * application built around an event loop would. The loop watches three
+ * descriptors: cycle timer and result event of `monarco_event.h`, and a pipe
+ * standing for any other I/O of the application, fed by a periodic producer.
+ *
+ * Every few hundred cycles the loop is stalled on purpose, the missed
+ * deadlines are reported by `monarco_event_cycle()`.
+ *
+ * The example runs against the simulated HAT, so it works on any Linux host.
+ *
+ * Usage: monarco-event-loop-demo [-p period_us] [-n cycles] [-s stall_every]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#include "src/monarco.h"
+#include "src/monarco_event.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+enum {
+    SDC_STATUS, SDC_FWVERL, SDC_RXCNT,
+    SDC_COUNT
+};
+
+static const monarco_sdc_item_t sdc_table[SDC_COUNT] = {
+    [SDC_STATUS] = MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 10),
+    [SDC_FWVERL] = MONARCO_SDC_ITEM_READ(FWVERL),
+    [SDC_RXCNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485RXCNT, 100),
+};
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    monarco_event_t ev;
+    int period_us = 1000;
+    int cycles = 2000;
+    int stall_every = 500;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:s:h")) != -1) {
+        switch (opt) {
+        case 'p': period_us = atoi(optarg); break;
+        case 'n': cycles = atoi(optarg); break;
+        case 's': stall_every = atoi(optarg); break;
+        default: printf("Usage: %s [-p period_us] [-n cycles] [-s stall_every]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((period_us <= 0) || (cycles <= 0) || (stall_every < 0)) {
+        printf("Usage: %s [-p period_us] [-n cycles] [-s stall_every]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) event loop demo v1.4\n\n");
+
+    monarco_sim_init(&sim);
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_load(&cxt, sdc_table, SDC_COUNT);
+
+    if (monarco_event_init(&ev, &cxt, period_us) < 0) {
+        return 1;
+    }
+
+    // other application I/O - pipe written by the loop itself every 7th cycle
+    int app_pipe[2];
+    if (pipe(app_pipe) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    fcntl(app_pipe[0], F_SETFL, O_NONBLOCK);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ee = { .events = EPOLLIN };
+
+    ee.data.fd = ev.timer_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ev.timer_fd, &ee);
+    ee.data.fd = ev.event_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ev.event_fd, &ee);
+    ee.data.fd = app_pipe[0];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, app_pipe[0], &ee);
+
+    uint32_t wakeups = 0, rx_events = 0, sdc_events = 0, err_events = 0, app_msgs = 0;
+    int done = 0;
+
+    while (done < cycles) {
+        struct epoll_event events[4];
+        int n = epoll_wait(epfd, events, 4, -1);
+        int i;
+
+        wakeups++;
+
+        for (i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == ev.timer_fd) {
+                int missed = monarco_event_cycle(&ev);
+                if ((missed > 0) && (ev.overruns <= 10)) {
+                    printf("cycle %5i: %i deadlines missed%s\n", done, missed, ev.overruns == 10 ? ", further overruns not printed" : "");
+                }
+                done++;
+
+                if ((done % 7) == 0) {
+                    char c = 'x';
+                    if (write(app_pipe[1], &c, 1) < 0) {
+                        perror("write");
+                    }
+                }
+
+                // simulated long handler of some other event
+                if ((stall_every > 0) && ((done % stall_every) == 0)) {
+                    int64_t stall_ns = 5500LL * period_us;
+                    struct timespec stall = { .tv_sec = stall_ns / 1000000000, .tv_nsec = stall_ns % 1000000000 };
+                    nanosleep(&stall, NULL);
+                }
+            }
+            else if (fd == ev.event_fd) {
+                uint32_t mask = monarco_event_take(&ev);
+
+                if (mask & MONARCO_EVENT_RX) {
+                    rx_events++;
+                }
+                if (mask & MONARCO_EVENT_SDC) {
+                    sdc_events++;
+                    if (monarco_sdc_done(&cxt, SDC_FWVERL) && (sdc_events == 1)) {
+                        printf("cycle %5i: FWVERL = 0x%04X\n", done, monarco_sdc_value(&cxt, SDC_FWVERL));
+                    }
+                }
+                if (mask & MONARCO_EVENT_ERROR) {
+                    err_events++;
+                }
+            }
+            else if (fd == app_pipe[0]) {
+                char buf[64];
+                ssize_t len = read(app_pipe[0], buf, sizeof(buf));
+                if (len > 0) {
+                    app_msgs += len;
+                }
+            }
+        }
+    }
+
+    printf("\ncycles %i, period %i us, epoll wakeups %u (%.2f per cycle)\n", done, period_us, wakeups, (double)wakeups / done);
+    printf("timer expirations %llu, missed %llu, overruns %u, max missed in a row %u\n",
+        (unsigned long long)ev.expirations, (unsigned long long)ev.missed, ev.overruns, ev.max_missed);
+    printf("events: RX %u, SDC %u, ERROR %u, app messages %u\n", rx_events, sdc_events, err_events, app_msgs);
+    printf("STATUS 0x%04X, RS485RXCNT %u, SDC done %u\n", monarco_sdc_value(&cxt, SDC_STATUS),
+        monarco_sdc_value(&cxt, SDC_RXCNT), cxt.stats.sdc_done);
+
+    close(epfd);
+    close(app_pipe[0]);
+    close(app_pipe[1]);
+    monarco_event_exit(&ev);
+    monarco_exit(&cxt);
+
+    return 0;
+}
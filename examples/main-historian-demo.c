@@ -0,0 +1,300 @@
+/***************************************************************************//**
+ * @file main-historian-demo.c
+ * @brief libmonarco - Columnar Compressed Historian Example
+ *
+ * This example records days of 50 Hz process data into the historian. Data come
+ * from the co-simulation (`monarco_cosim.h`), so the run takes seconds:
+ *  - AIN1 - room temperature, first-order lag (15 min) of the daily heating profile on AOUT1,
+ *  - AIN2 - flow transmitter, lag (1 min) of the valve position on AOUT2 plus +-2 LSB noise,
+ *  - COUNTER1 - flow meter pulses, 5 counts/s per V of AOUT2,
+ *  - DIN1..DIN4 - wired to DOUT1..DOUT4, DOUT1 pump on for 5 min every 30 min.
+ * Timestamps are milliseconds of process time with +-1 ms jitter of a real cycle.
+ *
+ * Reported is the storage per column against raw frames, the projection for
+ * a month, and the duration of trend queries after reopening the historian -
+ * whole range and one day downsampled from block summaries, last hour
+ * downsampled by decoding, and raw read of the last minute. Finally, appending
+ * is checked with the file size limited to fail block writes, as on a full
+ * storage - samples are dropped without buffering until the limit is lifted.
+ *
+ * Usage: monarco-historian-demo [-d days] [-o path]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "src/monarco.h"
+#include "src/monarco_cosim.h"
+#include "src/monarco_hist.h"
+#include "src/monarco_util.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+#define PERIOD_US 20000
+#define T_START_MS 1700000000000LL
+
+static const char *column_names[MONARCO_HIST_COLUMNS] = {
+    "status", "reserved1", "din", "cnt1", "cnt2", "cnt3", "ain1", "ain2",
+};
+
+static uint32_t rng = 12345;
+
+static inline uint32_t rand_next(void)
+{
+    rng = rng * 1103515245 + 12345;
+    return rng >> 16;
+}
+
+/* Transmitter noise +-2 LSB on AIN2, evaluated after the lag model */
+static void noise_step(monarco_plant_t *plant, monarco_sim_t *sim, double dt)
+{
+    int v = sim->ain2 + (int)(rand_next() % 5) - 2;
+    sim->ain2 = (v < 0) ? 0 : ((v > 4095) ? 4095 : v);
+}
+
+static monarco_plant_t plants[] = {
+    { .type = MONARCO_PLANT_LOOPBACK, .dout_mask = 0x0F, .input = MONARCO_PLANT_NONE, .output = MONARCO_PLANT_NONE },
+    { .type = MONARCO_PLANT_LAG, .input = MONARCO_CTRL_OUT_AOUT1, .output = MONARCO_CTRL_IN_AIN1, .gain = 1.0, .tau = 900.0, .state = 3.0 },
+    { .type = MONARCO_PLANT_LAG, .input = MONARCO_CTRL_OUT_AOUT2, .output = MONARCO_CTRL_IN_AIN2, .gain = 1.0, .tau = 60.0 },
+    { .type = MONARCO_PLANT_CUSTOM, .step = noise_step },
+    { .type = MONARCO_PLANT_ENCODER, .input = MONARCO_CTRL_OUT_AOUT2, .output = MONARCO_CTRL_IN_CNT1, .gain = 5.0 },
+};
+
+static inline double wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static uint64_t file_size(const char *path, const char *ext)
+{
+    char name[256];
+    struct stat st;
+
+    snprintf(name, sizeof(name), "%s%s", path, ext);
+    return (stat(name, &st) == 0) ? st.st_size : 0;
+}
+
+/* Run query `repeat` times on a freshly opened historian, print mean duration */
+static void bench_query(monarco_hist_t *hist, const char *name, int column, int64_t t_from, int64_t t_to, int buckets)
+{
+    static monarco_hist_point_t out[1000];
+    const int repeat = 20;
+    uint64_t decoded = hist->decoded_blocks;
+    int64_t count = 0;
+    int i;
+
+    double t0 = wall_ms();
+    for (i = 0; i < repeat; i++) {
+        count = monarco_hist_query(hist, column, t_from, t_to, buckets, out);
+    }
+    double ms = (wall_ms() - t0) / repeat;
+
+    printf("  %-24s %4i buckets %10lli samples %8.3f ms, %3llu blocks decoded\n", name, buckets, (long long)count, ms,
+        (unsigned long long)(hist->decoded_blocks - decoded) / repeat);
+}
+
+/* Append with block writes failing by RLIMIT_FSIZE, returns 0 when the historian recovered without loss */
+static int check_storage_full(const char *path)
+{
+    const uint32_t block = 16;
+    monarco_hist_t hist;
+    monarco_struct_rx_t rx = { 0 };
+    struct rlimit lim, full;
+    char name[272];
+    int rc[4] = { 0 };
+    int i;
+
+    snprintf(name, sizeof(name), "%s.idx", path);
+    unlink(name);
+    snprintf(name, sizeof(name), "%s.dat", path);
+    unlink(name);
+
+    if (monarco_hist_open(&hist, path, block) != 0) {
+        return -1;
+    }
+
+    signal(SIGXFSZ, SIG_IGN);
+    getrlimit(RLIMIT_FSIZE, &lim);
+    full = lim;
+    full.rlim_cur = 8;
+    setrlimit(RLIMIT_FSIZE, &full);
+
+    // the first block fails to write, the following samples are dropped
+    for (i = 0; i < 4 * (int)block; i++) {
+        rx.ain1 = i;
+        rc[monarco_hist_append(&hist, i, &rx) + 2]++;
+    }
+    int buffered = (hist.pend_count == block) && (hist.samples == block) && (hist.dropped == 3 * block);
+
+    setrlimit(RLIMIT_FSIZE, &lim);
+
+    // the block is written by the next append
+    rx.ain1 = i;
+    int written = monarco_hist_append(&hist, i, &rx);
+    monarco_hist_close(&hist);
+
+    monarco_hist_open(&hist, path, block);
+    int64_t t[2 * 16];
+    uint32_t v[2 * 16];
+    int n = monarco_hist_read(&hist, MONARCO_HIST_AIN1, 0, 1000, t, v, 2 * block);
+    monarco_hist_close(&hist);
+
+    int ok = buffered && (rc[0] == 3 * (int)block + 1) && (written == 1) && (n == (int)block + 1)
+        && (v[block - 1] == block - 1) && (v[block] == 4 * block);
+
+    printf("check: storage full, %i appends failed, %i buffered, then %s, %i samples stored - %s\n", rc[0], rc[2],
+        (written == 1) ? "block written" : "not written", n, ok ? "OK" : "FAILED");
+
+    return ok ? 0 : -1;
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    monarco_cosim_t cs;
+    monarco_hist_t hist;
+    const char *path = "/tmp/monarco-hist";
+    double days = 2.0;
+    char name[256];
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "d:o:h")) != -1) {
+        switch (opt) {
+        case 'd': days = atof(optarg); break;
+        case 'o': path = optarg; break;
+        default: printf("Usage: %s [-d days] [-o path]\n", argv[0]); return -1;
+        }
+    }
+
+    if (days * 86400.0 < 3600.0) {
+        printf("Usage: %s [-d days] [-o path], at least one hour\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) historian demo v1.4\n\n");
+
+    snprintf(name, sizeof(name), "%s.idx", path);
+    unlink(name);
+    snprintf(name, sizeof(name), "%s.dat", path);
+    unlink(name);
+
+    if (monarco_hist_open(&hist, path, 0) != 0) {
+        printf("Failed to open historian %s\n", path);
+        return -1;
+    }
+
+    monarco_sim_init(&sim);
+    monarco_cosim_init(&cs, &sim, plants, sizeof(plants) / sizeof(plants[0]), PERIOD_US);
+    monarco_init_transfer(&cxt, monarco_cosim_transfer, &cs, NULL);
+
+    /* Record */
+
+    double end_s = days * 86400.0;
+    int64_t t_ms = 0;
+    double rec_ms = 0.0;
+    double t_run = wall_ms();
+
+    while (monarco_cosim_time(&cs) < end_s) {
+        double t = monarco_cosim_time(&cs);
+
+        cxt.tx_data.aout1 = monarco_util_aout_volts_to_u16(3.0 + 2.0 * sin(t / 86400.0 * 2 * M_PI));
+        cxt.tx_data.aout2 = monarco_util_aout_volts_to_u16(2.0 + (int)(t / 3600.0) % 5);
+        cxt.tx_data.dout = (fmod(t, 1800.0) < 300.0) ? 0x01 : 0x00;
+
+        monarco_main(&cxt);
+
+        // millisecond timestamp of the cycle, occasionally late by one
+        int64_t ts = T_START_MS + cs.now_ns / 1000000 - PERIOD_US / 1000 + ((rand_next() % 8) == 0);
+        t_ms = (ts > t_ms) ? ts : t_ms;
+
+        double t0 = wall_ms();
+        if (monarco_hist_append(&hist, t_ms, cxt.rx_data) < 0) {
+            printf("Append failed\n");
+            break;
+        }
+        rec_ms += wall_ms() - t0;
+    }
+
+    t_run = wall_ms() - t_run;
+    monarco_hist_close(&hist);
+    monarco_exit(&cxt);
+
+    /* Storage */
+
+    monarco_hist_open(&hist, path, 0);
+
+    uint64_t stored = file_size(path, ".dat") + file_size(path, ".idx");
+    uint64_t raw = hist.samples * (sizeof(monarco_struct_rx_t) + sizeof(int64_t));
+
+    printf("%.1f days at 50 Hz, %llu samples in %u blocks, recorded in %.1f s (append %.0f ns/sample)\n\n", days,
+        (unsigned long long)hist.samples, hist.block_count, t_run / 1e3, rec_ms * 1e6 / hist.samples);
+
+    printf("  %-10s %12s\n", "column", "bytes/sample");
+    printf("  %-10s %12.3f\n", "time", (double)hist.column_bytes[0] / hist.samples);
+    for (i = 0; i < MONARCO_HIST_COLUMNS; i++) {
+        printf("  %-10s %12.3f\n", column_names[i], (double)hist.column_bytes[i + 1] / hist.samples);
+    }
+    printf("  %-10s %12.3f\n\n", "index", (double)file_size(path, ".idx") / hist.samples);
+
+    printf("raw frames with timestamp %.1f MB, stored %.1f MB (%.1fx), 30 days %.0f MB\n\n", raw / 1e6, stored / 1e6,
+        (double)raw / stored, stored / days * 30.0 / 1e6);
+
+    /* Queries */
+
+    int64_t first, last;
+    monarco_hist_span(&hist, &first, &last);
+
+    printf("queries on reopened historian (mean of 20):\n");
+    bench_query(&hist, "ain1 whole range", MONARCO_HIST_AIN1, first, last + 1, 1000);
+    bench_query(&hist, "cnt1 last day", MONARCO_HIST_CNT1, last + 1 - 86400000LL, last + 1, 288);
+    bench_query(&hist, "ain2 last hour", MONARCO_HIST_AIN2, last + 1 - 3600000LL, last + 1, 360);
+
+    static int64_t raw_t[4000];
+    static uint32_t raw_v[4000];
+
+    double t0 = wall_ms();
+    int n = monarco_hist_read(&hist, MONARCO_HIST_DIN, last + 1 - 60000, last + 1, raw_t, raw_v, 4000);
+    printf("  %-24s %4s         %10i samples %8.3f ms\n", "din last minute raw", "", n, wall_ms() - t0);
+
+    // summaries against decoded samples - one bucket over the whole range equals the mean of raw samples
+    monarco_hist_point_t whole, tail;
+    int64_t count = monarco_hist_query(&hist, MONARCO_HIST_AIN2, first, last + 1, 1, &whole);
+    monarco_hist_query(&hist, MONARCO_HIST_AIN2, last + 1 - 60000, last + 1, 1, &tail);
+    n = monarco_hist_read(&hist, MONARCO_HIST_AIN2, last + 1 - 60000, last + 1, raw_t, raw_v, 4000);
+    double sum = 0.0;
+    for (i = 0; i < n; i++) {
+        sum += raw_v[i];
+    }
+
+    printf("\ncheck: %lli of %llu samples in range, last minute mean %.3f (summary) / %.3f (raw), ain2 %lli..%lli\n",
+        (long long)count, (unsigned long long)hist.samples, tail.mean, sum / n, (long long)whole.min, (long long)whole.max);
+
+    monarco_hist_close(&hist);
+
+    snprintf(name, sizeof(name), "%s-full", path);
+    return check_storage_full(name);
+}
@@ -0,0 +1,434 @@
+/***************************************************************************//**
+ * @file main-io-latency.c
+ * @brief libmonarco - I/O Round-Trip Latency Measurement Tool
+ *
+ * This tool measures the end-to-end latency from an output change to its first
+ * appearance in `rx_data` - through the driver, the SPI transfer, the HAT
+ * output stage, the wiring and the HAT input stage. Connect the loopback
+ * wiring recommended in `examples/main-complex-demo.c`:
+ *   DOUT3<>DIN3 and AOUT1<>AIN1 (AIN1 in voltage mode, the default).
+ *
+ * At each configuration (cycle period x SPI clock) DOUT3 and AOUT1 (2 V / 8 V)
+ * are toggled independently, each after a random pause of a few cycles so the
+ * change falls on varying phases of the HAT firmware loop. Latency is taken
+ * from right before the `monarco_main()` which sends the change to right after
+ * the `monarco_main()` which receives it, in microseconds and in frames of delay.
+ * The transfer plus the host overhead is the duration of the `monarco_main()`
+ * which receives the change - the loop catches up after late wake-ups, so the
+ * spacing of cycles is not always one period and is not subtracted.
+ *
+ * Without the Monarco HAT, use `-s` to run against the simulated HAT with
+ * loopback wiring and internal delays `-D` / `-A` / `-S`, the transfer time is
+ * derived from the SPI clock. Delay frames (the instant the change reaches the
+ * input) and the overhead (at least the simulated transfer time) are checked
+ * against the model of the simulated HAT, which validates the tool itself.
+ *
+ * Usage: monarco-io-latency [-p 1000,5000] [-f 1000000,4000000,8000000] [-n samples]
+ *            [-r prio] [-a cpu] [-s] [-D din_delay_us] [-A ain_delay_us]
+ *            [-S ain_sample_us] [-d /dev/spidev0.0]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "src/monarco.h"
+#include "src/monarco_sim.h"
+#include "src/monarco_util.h"
+#include "monarco_platform.h"
+
+/* Only errors and warnings, prints would distort the measurement */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING;
+
+/* Maximal number of tested periods and SPI clocks */
+#define LIST_MAX 16
+
+/* Loopback channels */
+#define DOUT_BIT 0x04 /* DOUT3 / DIN3 */
+#define AOUT_LOW 2.0 /* AOUT1 levels (V), change detected at the middle */
+#define AOUT_HIGH 8.0
+
+/* Cycles before the first change, inputs settle */
+#define SETTLE_CYCLES 50
+
+/* Change not seen within this time is lost (ns) */
+#define LOST_NS 1000000000LL
+
+/* Simulated transfer - SPI frame bits at the clock plus driver overhead (ns) */
+#define SIM_OVERHEAD_NS 20000
+
+/* Round trip of one channel */
+typedef struct {
+    const char *name;
+    int state; /* 0 = pause, 1 = change in flight */
+    int pause; /* Cycles to the next change */
+    int level; /* Current output level */
+    int64_t t_set; /* Instant before the monarco_main() sending the change */
+    uint64_t pin_ns; /* Simulated HAT - instant the change reaches the input */
+    int frames; /* monarco_main() calls since the change */
+    int count; /* Collected samples */
+    int lost; /* Changes not seen within LOST_NS */
+    int off_model; /* Simulated HAT - samples off the model */
+    int64_t *latency; /* Latency samples (ns) */
+    int64_t *delay; /* Delay frames of samples */
+    int64_t *overhead; /* Duration of the monarco_main() receiving the change - transfer + host overhead (ns) */
+} probe_t;
+
+static monarco_cxt_t cxt;
+static monarco_sim_t sim;
+static uint32_t rng = 1;
+
+static inline int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void ns_to_ts(int64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000LL;
+    ts->tv_nsec = ns % 1000000000LL;
+}
+
+static inline uint32_t rand_next(void)
+{
+    rng = rng * 1103515245 + 12345;
+    return rng >> 16;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Value at percentile `p` of sorted array `*v` with `n` items */
+static int64_t percentile(const int64_t *v, int n, double p)
+{
+    int idx = (int)(p / 100.0 * n + 0.999999) - 1;
+
+    if (idx < 0) {
+        idx = 0;
+    }
+    if (idx >= n) {
+        idx = n - 1;
+    }
+    return v[idx];
+}
+
+static int parse_list(const char *arg, int64_t *out)
+{
+    int count = 0;
+    char *list = strdup(arg);
+
+    for (char *tok = strtok(list, ","); tok && (count < LIST_MAX); tok = strtok(NULL, ",")) {
+        if (atoll(tok) > 0) {
+            out[count++] = atoll(tok);
+        }
+    }
+    free(list);
+
+    return count;
+}
+
+/* Input level of the channel in `rx_data` */
+static int probe_input(const probe_t *pr)
+{
+    if (pr == NULL) {
+        return 0;
+    }
+    if (pr->name[0] == 'D') {
+        return (cxt.rx_data->din & DOUT_BIT) ? 1 : 0;
+    }
+    return monarco_util_ain_10v_to_real(cxt.rx_data->ain1) > (AOUT_LOW + AOUT_HIGH) / 2;
+}
+
+static void probe_output(const probe_t *pr)
+{
+    if (pr->name[0] == 'D') {
+        cxt.tx_data.dout = pr->level ? DOUT_BIT : 0;
+    }
+    else {
+        cxt.tx_data.aout1 = monarco_util_aout_volts_to_u16(pr->level ? AOUT_HIGH : AOUT_LOW);
+    }
+}
+
+static void print_probe(probe_t *pr, int simulated)
+{
+    if (pr->count == 0) {
+        printf("  %-11s no samples, %i lost - check the loopback wiring\n", pr->name, pr->lost);
+        return;
+    }
+
+    qsort(pr->latency, pr->count, sizeof(int64_t), cmp_int64);
+    qsort(pr->delay, pr->count, sizeof(int64_t), cmp_int64);
+    qsort(pr->overhead, pr->count, sizeof(int64_t), cmp_int64);
+
+    printf("  %-11s latency min %8.1f | p50 %8.1f | p99 %8.1f | max %8.1f us, delay %lli..%lli frames, lost %i",
+        pr->name, pr->latency[0] / 1e3, percentile(pr->latency, pr->count, 50) / 1e3,
+        percentile(pr->latency, pr->count, 99) / 1e3, pr->latency[pr->count - 1] / 1e3,
+        (long long)pr->delay[0], (long long)pr->delay[pr->count - 1], pr->lost);
+    if (simulated) {
+        printf(", off model %i", pr->off_model);
+    }
+    printf("\n  %-11s overhd  min %8.1f | p50 %8.1f | p99 %8.1f | max %8.1f us (transfer + host overhead",
+        "", pr->overhead[0] / 1e3, percentile(pr->overhead, pr->count, 50) / 1e3,
+        percentile(pr->overhead, pr->count, 99) / 1e3, pr->overhead[pr->count - 1] / 1e3);
+    if (simulated) {
+        printf(", simulated transfer %.1f us", sim.transfer_ns / 1e3);
+    }
+    printf(")\n");
+}
+
+/* Measure `samples` round trips of both channels at one configuration */
+static int measure(probe_t *probes, int64_t period_ns, int samples, int simulated)
+{
+    int64_t lost_frames = LOST_NS / period_ns + 1;
+    struct timespec ts;
+    int i, k;
+
+    for (k = 0; k < 2; k++) {
+        probes[k].state = 0;
+        probes[k].pause = SETTLE_CYCLES + k;
+        probes[k].level = 0;
+        probes[k].count = 0;
+        probes[k].lost = 0;
+        probes[k].off_model = 0;
+        probe_output(&probes[k]);
+    }
+
+    int64_t next = now_ns() + period_ns;
+    int64_t t_prev = 0;
+
+    for (i = 0; (probes[0].count + probes[0].lost < samples) || (probes[1].count + probes[1].lost < samples); i++) {
+        ns_to_ts(next, &ts);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        next += period_ns;
+
+        int64_t t_before = now_ns();
+
+        for (k = 0; k < 2; k++) {
+            probe_t *pr = &probes[k];
+            if ((pr->state == 0) && (pr->count + pr->lost < samples) && (--pr->pause <= 0)) {
+                pr->level = !pr->level;
+                probe_output(pr);
+                pr->t_set = t_before;
+                pr->frames = 0;
+                pr->state = 1;
+            }
+        }
+
+        if (monarco_main(&cxt) < 0) {
+            t_prev = t_before;
+            continue;
+        }
+
+        int64_t t_after = now_ns();
+
+        for (k = 0; k < 2; k++) {
+            probe_t *pr = &probes[k];
+
+            if (pr->state != 1) {
+                continue;
+            }
+
+            // simulated HAT - instant the change reaches the pin, known after the sending frame
+            if (simulated && (pr->frames == 0)) {
+                pr->pin_ns = (k == 0) ? sim.loop_dout_ns : sim.loop_aout1_ns;
+                if ((k == 1) && sim.loop_ain_sample_ns) {
+                    pr->pin_ns = (pr->pin_ns + sim.loop_ain_sample_ns - 1) / sim.loop_ain_sample_ns * sim.loop_ain_sample_ns;
+                }
+            }
+
+            pr->frames++;
+
+            if (probe_input(pr) == pr->level) {
+                int delay = pr->frames - 1;
+                pr->latency[pr->count] = t_after - pr->t_set;
+                pr->delay[pr->count] = delay;
+                pr->overhead[pr->count] = t_after - t_before;
+                // model of the simulated HAT - the input is sampled within the transfer, so the change reached
+                // the pin after the previous cycle started and before this one ended, and the cycle took
+                // at least the transfer time
+                if (simulated && ((t_after < (int64_t)pr->pin_ns) || (t_prev >= (int64_t)pr->pin_ns)
+                        || (t_after - t_before < (int64_t)sim.transfer_ns))) {
+                    pr->off_model++;
+                }
+                pr->count++;
+                pr->state = 0;
+                pr->pause = 1 + rand_next() % 8;
+            }
+            else if (pr->frames > lost_frames) {
+                pr->lost++;
+                pr->state = 0;
+                pr->pause = 1;
+            }
+        }
+
+        t_prev = t_before;
+    }
+
+    return i;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n"
+        "  -p LIST   comma separated cycle periods in us (default 1000,5000)\n"
+        "  -f LIST   comma separated SPI clock frequencies in Hz (default 1000000,4000000,8000000)\n"
+        "  -n N      number of round trips per channel and configuration (default 200)\n"
+        "  -r PRIO   SCHED_FIFO priority, 0 = do not change scheduler (default 80)\n"
+        "  -a CPU    pin to CPU core (default no affinity)\n"
+        "  -s        use simulated HAT with loopback wiring instead of SPI device\n"
+        "  -D US     simulated HAT internal delay DOUT to DIN (default 150)\n"
+        "  -A US     simulated HAT internal delay AOUT to AIN (default 800)\n"
+        "  -S US     simulated HAT AIN sampling period (default 1000)\n"
+        "  -d DEV    SPI device (default /dev/spidev0.0)\n", prog);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    const char *periods_arg = "1000,5000";
+    const char *clocks_arg = "1000000,4000000,8000000";
+    const char *spi_device = "/dev/spidev0.0";
+    int samples = 200;
+    int rt_prio = 80;
+    int cpu = -1;
+    int simulated = 0;
+    int din_delay_us = 150;
+    int ain_delay_us = 800;
+    int ain_sample_us = 1000;
+    int64_t periods[LIST_MAX];
+    int64_t clocks[LIST_MAX];
+    int opt, p, c, k;
+
+    while ((opt = getopt(argc, argv, "p:f:n:r:a:sD:A:S:d:h")) != -1) {
+        switch (opt) {
+        case 'p': periods_arg = optarg; break;
+        case 'f': clocks_arg = optarg; break;
+        case 'n': samples = atoi(optarg); break;
+        case 'r': rt_prio = atoi(optarg); break;
+        case 'a': cpu = atoi(optarg); break;
+        case 's': simulated = 1; break;
+        case 'D': din_delay_us = atoi(optarg); break;
+        case 'A': ain_delay_us = atoi(optarg); break;
+        case 'S': ain_sample_us = atoi(optarg); break;
+        case 'd': spi_device = optarg; break;
+        default: usage(argv[0]); return -1;
+        }
+    }
+
+    int periods_count = parse_list(periods_arg, periods);
+    int clocks_count = parse_list(clocks_arg, clocks);
+
+    if ((periods_count == 0) || (clocks_count == 0) || (samples < 1) || (din_delay_us < 0) || (ain_delay_us < 0) || (ain_sample_us < 0)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) I/O round-trip latency v1.5\n\n");
+
+    // Pin to CPU core
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            perror("sched_setaffinity failed");
+            return -1;
+        }
+    }
+
+    // Enable realtime fifo scheduling
+    if (rt_prio > 0) {
+        struct sched_param rt_param;
+        rt_param.sched_priority = rt_prio;
+        if (sched_setscheduler(0, SCHED_FIFO, &rt_param) == -1) {
+           perror("sched_setscheduler failed");
+           return -1;
+        }
+    }
+
+    // Sample buffers allocated and touched before measurement
+    probe_t probes[2] = { { .name = "DOUT3>DIN3" }, { .name = "AOUT1>AIN1" } };
+    for (k = 0; k < 2; k++) {
+        probes[k].latency = calloc(samples, sizeof(int64_t));
+        probes[k].delay = calloc(samples, sizeof(int64_t));
+        probes[k].overhead = calloc(samples, sizeof(int64_t));
+        if ((probes[k].latency == NULL) || (probes[k].delay == NULL) || (probes[k].overhead == NULL)) {
+            perror("calloc failed");
+            return -1;
+        }
+    }
+
+    if (mlockall(MCL_CURRENT|MCL_FUTURE) == -1) {
+        perror("mlockall failed");
+        return -2;
+    }
+
+    printf("Transport: %s, round trips per channel: %i, priority: %i, CPU: %i\n", simulated ? "simulated HAT" : spi_device,
+        samples, rt_prio, cpu);
+    if (simulated) {
+        printf("Simulated HAT: DOUT>DIN delay %i us, AOUT>AIN delay %i us, AIN sampling %i us\n", din_delay_us,
+            ain_delay_us, ain_sample_us);
+    }
+    printf("\n");
+
+    for (c = 0; c < clocks_count; c++) {
+        if (simulated) {
+            monarco_sim_init(&sim);
+            sim.transfer_ns = MONARCO_STRUCT_SIZE * 8 * 1000000000LL / clocks[c] + SIM_OVERHEAD_NS;
+            sim.loop_din_mask = DOUT_BIT;
+            sim.loop_ain1 = 1;
+            sim.loop_din_delay_ns = din_delay_us * 1000;
+            sim.loop_ain_delay_ns = ain_delay_us * 1000;
+            sim.loop_ain_sample_ns = ain_sample_us * 1000;
+            monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, "monarco-io-latency: ");
+        }
+        else if (monarco_init(&cxt, spi_device, clocks[c], "monarco-io-latency: ") != 0) {
+            return -1;
+        }
+
+        for (p = 0; p < periods_count; p++) {
+            int64_t period_ns = periods[p] * 1000LL;
+
+            int cycles = measure(probes, period_ns, samples, simulated);
+
+            printf("Period %lli us, SPI clock %.1f MHz, %i cycles:\n", (long long)periods[p], clocks[c] / 1e6, cycles);
+            print_probe(&probes[0], simulated);
+            print_probe(&probes[1], simulated);
+            printf("\n");
+        }
+
+        monarco_exit(&cxt);
+    }
+
+    for (k = 0; k < 2; k++) {
+        free(probes[k].latency);
+        free(probes[k].delay);
+        free(probes[k].overhead);
+    }
+
+    return 0;
+}
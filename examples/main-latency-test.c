@@ -0,0 +1,370 @@
+/***************************************************************************//**
+ * @file main-latency-test.c
+ * @brief libmonarco - Cycle Latency Self-Test Tool
+ *
+ * This is a cyclictest-style diagnostic tool for Monarco HAT and C library
+ * libmonarco. It tells whether given Raspberry Pi and Linux kernel can hold
+ * required cycle period.
+ *
+ * Real `monarco_main()` path is run with absolute-time `clock_nanosleep()`
+ * wake-ups at each of given periods, with realtime priority and optional CPU
+ * affinity. Memory is locked and stack prefaulted before measurement.
+ * Wake-up latency (actual wake-up minus scheduled time) and transfer time
+ * (duration of `monarco_main()`) are measured separately and printed as
+ * percentiles and histograms, followed by the fastest safe cycle period.
+ *
+ * Without the Monarco HAT, use `-s` to run against the simulated HAT.
+ *
+ * When built with tracepoints (`make TRACE=1`), `-T file.json` records phases
+ * of the last cycles and exports them in Chrome trace event format, which can
+ * be opened by chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Usage: monarco-latency-test [-p 1000,5000] [-n cycles] [-r prio] [-a cpu]
+ *            [-s] [-t sim_transfer_us] [-d /dev/spidev0.0] [-f spi_clk_hz]
+ *            [-b bin_us] [-B bins] [-q] [-T trace.json]
+ *
+ * See also https://www.monarco.io/
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "src/monarco.h"
+#include "src/monarco_sdc.h"
+#include "src/monarco_sim.h"
+#include "src/monarco_trace.h"
+#include "monarco_platform.h"
+
+/* Only errors and warnings, prints would distort the measurement */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING;
+
+/* Context data for libmonarco. */
+static monarco_cxt_t cxt;
+
+/* Simulated HAT, used with `-s` option */
+static monarco_sim_t sim;
+
+/* Stack size to be prefaulted before measurement */
+#define MAX_SAFE_STACK (64 * 1024)
+
+/* Firmware of the Monarco HAT needs some time to prepare for next SPI transaction */
+#define HAT_PREPARE_NS 200000
+
+/* Number of trace events kept in the ring - last few thousand cycles */
+#define TRACE_EVENTS (64 * 1024)
+
+/* Maximal number of tested periods */
+#define PERIODS_MAX 16
+
+/* Representative SDC load - status and RS-485 diagnostics polled periodically */
+static const monarco_sdc_item_t sdc_table[] = {
+    MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
+    MONARCO_SDC_ITEM_READ_PERIODIC(RS485RXCNT, 10),
+    MONARCO_SDC_ITEM_READ_PERIODIC(RS485FECNT, 10),
+    MONARCO_SDC_ITEM_WRITE(WDTIMEOUT, 100),
+};
+
+static void prefault_stack(void)
+{
+    volatile unsigned char dummy[MAX_SAFE_STACK];
+
+    memset((void *)dummy, 0, MAX_SAFE_STACK);
+}
+
+static int64_t ts_to_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void ns_to_ts(int64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000LL;
+    ts->tv_nsec = ns % 1000000000LL;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Value at percentile `p` of sorted array `*v` with `n` items */
+static int64_t percentile(const int64_t *v, int n, double p)
+{
+    int idx = (int)(p / 100.0 * n + 0.999999) - 1;
+
+    if (idx < 0) {
+        idx = 0;
+    }
+    if (idx >= n) {
+        idx = n - 1;
+    }
+    return v[idx];
+}
+
+/* Sort samples and print percentiles in microseconds */
+static void print_percentiles(const char *name, int64_t *v, int n)
+{
+    qsort(v, n, sizeof(int64_t), cmp_int64);
+
+    printf("  %-10s min %8.1f | p50 %8.1f | p90 %8.1f | p99 %8.1f | p99.9 %8.1f | max %8.1f us\n", name,
+        v[0] / 1e3, percentile(v, n, 50) / 1e3, percentile(v, n, 90) / 1e3,
+        percentile(v, n, 99) / 1e3, percentile(v, n, 99.9) / 1e3, v[n - 1] / 1e3);
+}
+
+/* Print histogram of samples `*v` with bins of `bin_us` width, last bin collects overflows */
+static void print_histogram(const char *name, const int64_t *v, int n, int bin_us, int bins)
+{
+    int count[bins];
+    int max = 0;
+    int i;
+
+    memset(count, 0, sizeof(count));
+
+    for (i = 0; i < n; i++) {
+        int64_t b = v[i] / (bin_us * 1000LL);
+        if (b < 0) {
+            b = 0;
+        }
+        if (b >= bins) {
+            b = bins - 1;
+        }
+        count[b]++;
+    }
+    for (i = 0; i < bins; i++) {
+        if (count[i] > max) {
+            max = count[i];
+        }
+    }
+
+    printf("  %s histogram:\n", name);
+    for (i = 0; i < bins; i++) {
+        int width = max ? (int)((int64_t)count[i] * 50 / max) : 0;
+        if ((width == 0) && count[i]) {
+            width = 1;
+        }
+        printf("    %s%6i us %8i |%.*s\n", (i == bins - 1) ? ">=" : "  ", i * bin_us, count[i], width,
+            "##################################################");
+    }
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n"
+        "  -p LIST   comma separated cycle periods in us (default 1000,5000,20000)\n"
+        "  -n N      number of cycles per period (default 10000)\n"
+        "  -r PRIO   SCHED_FIFO priority, 0 = do not change scheduler (default 80)\n"
+        "  -a CPU    pin to CPU core (default no affinity)\n"
+        "  -s        use simulated HAT instead of SPI device\n"
+        "  -t US     simulated HAT transfer time (default 60)\n"
+        "  -d DEV    SPI device (default /dev/spidev0.0)\n"
+        "  -f HZ     SPI clock frequency (default 4000000)\n"
+        "  -b US     histogram bin width (default 10)\n"
+        "  -B N      number of histogram bins (default 20)\n"
+        "  -q        do not print histograms\n"
+        "  -T FILE   export trace of last cycles to FILE (Chrome trace JSON), needs `make TRACE=1`\n", prog);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    const char *periods_arg = "1000,5000,20000";
+    const char *spi_device = "/dev/spidev0.0";
+    uint32_t spi_clkfreq = 4000000;
+    int cycles = 10000;
+    int rt_prio = 80;
+    int cpu = -1;
+    int simulated = 0;
+    int sim_transfer_us = 60;
+    int bin_us = 10;
+    int bins = 20;
+    int histogram = 1;
+    const char *trace_file = NULL;
+    int periods[PERIODS_MAX];
+    int periods_count = 0;
+    int64_t worst_required_ns = 0;
+    int opt, p, i;
+
+    while ((opt = getopt(argc, argv, "p:n:r:a:st:d:f:b:B:qT:h")) != -1) {
+        switch (opt) {
+        case 'p': periods_arg = optarg; break;
+        case 'n': cycles = atoi(optarg); break;
+        case 'r': rt_prio = atoi(optarg); break;
+        case 'a': cpu = atoi(optarg); break;
+        case 's': simulated = 1; break;
+        case 't': sim_transfer_us = atoi(optarg); break;
+        case 'd': spi_device = optarg; break;
+        case 'f': spi_clkfreq = strtoul(optarg, NULL, 10); break;
+        case 'b': bin_us = atoi(optarg); break;
+        case 'B': bins = atoi(optarg); break;
+        case 'q': histogram = 0; break;
+        case 'T': trace_file = optarg; break;
+        default: usage(argv[0]); return -1;
+        }
+    }
+
+    char *list = strdup(periods_arg);
+    for (char *tok = strtok(list, ","); tok && (periods_count < PERIODS_MAX); tok = strtok(NULL, ",")) {
+        if (atoi(tok) > 0) {
+            periods[periods_count++] = atoi(tok);
+        }
+    }
+    free(list);
+
+    if ((periods_count == 0) || (cycles < 1) || (bin_us < 1) || (bins < 2)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) latency self-test v1.4\n\n");
+
+    // Pin to CPU core
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            perror("sched_setaffinity failed");
+            return -1;
+        }
+    }
+
+    // Enable realtime fifo scheduling
+    if (rt_prio > 0) {
+        struct sched_param rt_param;
+        rt_param.sched_priority = rt_prio;
+        if (sched_setscheduler(0, SCHED_FIFO, &rt_param) == -1) {
+           perror("sched_setscheduler failed");
+           return -1;
+        }
+    }
+
+    // Sample buffers allocated and touched before measurement
+    int64_t *wake = malloc(cycles * sizeof(int64_t));
+    int64_t *xfer = malloc(cycles * sizeof(int64_t));
+    if ((wake == NULL) || (xfer == NULL)) {
+        perror("malloc failed");
+        return -1;
+    }
+    memset(wake, 0, cycles * sizeof(int64_t));
+    memset(xfer, 0, cycles * sizeof(int64_t));
+
+    if (simulated) {
+        monarco_sim_init(&sim);
+        sim.transfer_ns = sim_transfer_us * 1000;
+        monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, "monarco-latency: ");
+    }
+    else if (monarco_init(&cxt, spi_device, spi_clkfreq, "monarco-latency: ") != 0) {
+        return -1;
+    }
+    monarco_sdc_load(&cxt, sdc_table, sizeof(sdc_table) / sizeof(sdc_table[0]));
+
+    if (trace_file != NULL) {
+#ifndef MONARCO_TRACE
+        printf("Warning: built without tracepoints, rebuild with `make TRACE=1` to record trace\n");
+#endif
+        monarco_trace_init(&cxt, TRACE_EVENTS);
+    }
+
+    // Lock memory allocations for realtime performance, prefault stack
+    if (mlockall(MCL_CURRENT|MCL_FUTURE) == -1) {
+        perror("mlockall failed");
+        return -2;
+    }
+    prefault_stack();
+
+    printf("Transport: %s, cycles per period: %i, priority: %i, CPU: %i\n\n",
+        simulated ? "simulated HAT" : spi_device, cycles, rt_prio, cpu);
+
+    for (p = 0; p < periods_count; p++) {
+        int64_t period_ns = periods[p] * 1000LL;
+        int64_t required_ns = 0;
+        int overruns = 0;
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        int64_t next = ts_to_ns(&ts) + period_ns;
+
+        for (i = 0; i < cycles; i++) {
+            ns_to_ts(next, &ts);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            int64_t t_wake = ts_to_ns(&ts);
+
+            monarco_main(&cxt);
+
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            int64_t t_done = ts_to_ns(&ts);
+
+            wake[i] = t_wake - next;
+            xfer[i] = t_done - t_wake;
+
+            if (wake[i] + xfer[i] + HAT_PREPARE_NS > required_ns) {
+                required_ns = wake[i] + xfer[i] + HAT_PREPARE_NS;
+            }
+            if (t_done - next + HAT_PREPARE_NS > period_ns) {
+                overruns++;
+            }
+
+            next += period_ns;
+        }
+
+        printf("Period %i us: %i overruns of %i cycles, worst cycle %.1f us\n", periods[p], overruns, cycles, required_ns / 1e3);
+        print_percentiles("wake-up", wake, cycles);
+        print_percentiles("transfer", xfer, cycles);
+        if (histogram) {
+            print_histogram("wake-up", wake, cycles, bin_us, bins);
+            print_histogram("transfer", xfer, cycles, bin_us, bins);
+        }
+        printf("\n");
+
+        if (required_ns > worst_required_ns) {
+            worst_required_ns = required_ns;
+        }
+    }
+
+    // Round up to 100 us
+    int64_t safe_us = (worst_required_ns / 1000 + 99) / 100 * 100;
+    printf("Fastest safe cycle period: %lli us (max wake-up latency + max transfer time + %i us HAT preparation)\n",
+        (long long)safe_us, HAT_PREPARE_NS / 1000);
+
+    if (trace_file != NULL) {
+        FILE *f = fopen(trace_file, "w");
+        if (f == NULL) {
+            perror("fopen trace file failed");
+        }
+        else {
+            int n = monarco_trace_export_chrome(&cxt, f, NULL, 0);
+            fclose(f);
+            printf("Trace: %i events exported to %s\n", n, trace_file);
+        }
+    }
+
+    monarco_exit(&cxt);
+
+    free(wake);
+    free(xfer);
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+/***************************************************************************//**
+ * @file main-lib-bench.c
+ * @brief libmonarco - Library Build Benchmark and Profile Training Workload
+ *
+ * This tool drives the simulated HAT through a representative mix of the cycle:
+ * startup SDC configuration, periodic SDC reads with one-shot writes, output
+ * commands queued each cycle, occasional corrupted frames and dropped SDC
+ * requests, and a process data only phase by `monarco_main_pdc()`.
+ *
+ * It serves both as the training workload of the profile-guided library build
+ * (`make lib PGO=1`) and as the benchmark comparing library builds - the
+ * Makefile links it with the unoptimized objects of the examples
+ * (`monarco-lib-bench-debug`) and with the optimized `libmonarco.a`
+ * (`monarco-lib-bench`), `make lib-report` runs both.
+ *
+ * Reported is the mean cost of one cycle including the simulated transfer.
+ *
+ * Usage: monarco-lib-bench [-n cycles]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "src/monarco.h"
+#include "src/monarco_cmdq.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Debug prints disabled, frames are corrupted on purpose */
+int monarco_platform_dprint_flags = 0;
+
+#ifndef LIB_BUILD
+#define LIB_BUILD "default"
+#endif
+
+enum {
+    ITEM_W_RS485BAUD, ITEM_W_RS485MODE, ITEM_W_CNT1CFG, ITEM_W_WDTIMEOUT,
+    ITEM_R_FWVERL, ITEM_R_HWVERL, ITEM_R_MCUID1, ITEM_R_MCUID2,
+    ITEM_R_STATUS, ITEM_R_RXCNT, ITEM_R_TXCNT, ITEM_R_FECNT,
+    ITEM_COUNT
+};
+
+static const monarco_sdc_item_t sdc_table[ITEM_COUNT] = {
+    [ITEM_W_RS485BAUD] = MONARCO_SDC_ITEM_WRITE(RS485BAUD, 96),
+    [ITEM_W_RS485MODE] = MONARCO_SDC_ITEM_WRITE(RS485MODE, 0),
+    [ITEM_W_CNT1CFG] = MONARCO_SDC_ITEM_WRITE(CNT1CFG, MONARCO_SDC_COUNTER_MODE_PCNT),
+    [ITEM_W_WDTIMEOUT] = MONARCO_SDC_ITEM_WRITE(WDTIMEOUT, 100),
+    [ITEM_R_FWVERL] = MONARCO_SDC_ITEM_READ(FWVERL),
+    [ITEM_R_HWVERL] = MONARCO_SDC_ITEM_READ(HWVERL),
+    [ITEM_R_MCUID1] = MONARCO_SDC_ITEM_READ(MCUID1),
+    [ITEM_R_MCUID2] = MONARCO_SDC_ITEM_READ(MCUID2),
+    [ITEM_R_STATUS] = MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 10),
+    [ITEM_R_RXCNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485RXCNT, 50),
+    [ITEM_R_TXCNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485TXCNT, 50),
+    [ITEM_R_FECNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485FECNT, 200),
+};
+
+static inline int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    int cycles = 1000000;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': cycles = atoi(optarg); break;
+        default: printf("Usage: %s [-n cycles]\n", argv[0]); return -1;
+        }
+    }
+
+    if (cycles < 100) {
+        printf("Usage: %s [-n cycles]\n", argv[0]);
+        return -1;
+    }
+
+    monarco_sim_init(&sim);
+    sim.fault_crc_rate = 0.001;
+    sim.fault_drop_rate = 0.001;
+
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_load(&cxt, sdc_table, ITEM_COUNT);
+    monarco_cmdq_init(&cxt, 64);
+
+    int pdc_from = cycles - cycles / 5;
+    int64_t sdc_ns = 0, pdc_ns = 0;
+
+    for (i = 0; i < cycles; i++) {
+        // application outputs by the command queue, PWM duty cycle write every 16th cycle
+        monarco_cmdq_write_bits(&cxt, MONARCO_CMD_FIELD(dout), 0x03, (uint8_t)i);
+        if ((i & 15) == 0) {
+            monarco_cmdq_set_u16(&cxt, MONARCO_CMD_FIELD(pwm1a_dc), (uint16_t)(i & 0xFFFF));
+        }
+
+        // occasional reconfiguration by one-shot writes
+        if ((i % 1000) == 999) {
+            monarco_sdc_write(&cxt, ITEM_W_WDTIMEOUT, 100 + (i / 1000) % 2);
+        }
+
+        int64_t t0 = now_ns();
+        if (i < pdc_from) {
+            monarco_main(&cxt);
+            sdc_ns += now_ns() - t0;
+        }
+        else {
+            monarco_main_pdc(&cxt);
+            pdc_ns += now_ns() - t0;
+        }
+    }
+
+    printf("%-10s PDC+SDC %8.1f ns/cycle, PDC-only %8.1f ns/cycle, SDC done %u, CRC errors %u\n", LIB_BUILD,
+        (double)sdc_ns / pdc_from, (double)pdc_ns / (cycles - pdc_from), cxt.stats.sdc_done, cxt.stats.crc_errors);
+
+    monarco_exit(&cxt);
+
+    return 0;
+}
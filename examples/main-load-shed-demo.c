@@ -0,0 +1,191 @@
+/***************************************************************************//**
+ * @file main-load-shed-demo.c
+ * @brief libmonarco - Adaptive Load Shedding Example
+ *
+ * This example runs a periodic cycle against the simulated HAT. Each cycle the
+ * application computes its control logic (busy wait) before the frame exchange
+ * and runs an optional task after it - a diagnostic export taking 30 % of
+ * the period. Every `burst_every` cycles the control logic takes longer for
+ * `burst_len` cycles, e.g. a recipe change or a page fault storm. Periodic SDC
+ * Items poll status registers in the background.
+ *
+ * The cycle is run twice - with the optional task called by the application
+ * unconditionally, and with `monarco_shed.h` attached, which defers periodic SDC
+ * Items, debug prints and the optional task while the cycle is under pressure.
+ * Reported are deadline misses (frame exchange finished after the end of the
+ * period) and the deferred work.
+ *
+ * Usage: monarco-load-shed-demo [-p period_us] [-n cycles] [-b burst_every] [-l burst_len] [-v]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "src/monarco.h"
+#include "src/monarco_shed.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error and warning debug prints for monarco_platform.h, verbose prints by -v */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING;
+
+static const monarco_sdc_item_t sdc_table[] = {
+    MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
+    MONARCO_SDC_ITEM_READ_PERIODIC(WDTIMEOUT, 10),
+    MONARCO_SDC_ITEM_READ_PERIODIC(FWVERL, 100),
+    MONARCO_SDC_ITEM_READ_PERIODIC(FWVERH, 100),
+};
+
+static inline int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void busy_ns(int64_t ns)
+{
+    int64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+    }
+}
+
+static void sleep_until(struct timespec *ts, int64_t add_ns)
+{
+    ts->tv_nsec += add_ns;
+    while (ts->tv_nsec >= 1000000000) {
+        ts->tv_nsec -= 1000000000;
+        ts->tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL);
+}
+
+/* Optional diagnostic export */
+static void export_task(void *arg, uint32_t tick)
+{
+    busy_ns(*(int64_t *)arg);
+}
+
+static void run(const char *name, int shedding, int period_us, int cycles, int burst_every, int burst_len)
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    monarco_shed_t shed;
+    int64_t period_ns = period_us * 1000LL;
+    int64_t logic_ns = period_ns * 30 / 100;
+    int64_t burst_ns = period_ns * 80 / 100;
+    int64_t export_ns = period_ns * 30 / 100;
+    uint32_t misses = 0;
+    uint32_t burst_misses = 0;
+    uint32_t exports = 0;
+    int64_t worst_ns = 0;
+    int i;
+
+    monarco_sim_init(&sim);
+    sim.transfer_ns = 50000;
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_load(&cxt, sdc_table, sizeof(sdc_table) / sizeof(sdc_table[0]));
+
+    if (shedding) {
+        monarco_shed_init(&shed, &cxt, period_us);
+        shed.sdc_min_factor = 10;
+        monarco_shed_task(&shed, export_task, &export_ns, MONARCO_SHED_TASKS);
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t start = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    for (i = 1; i <= cycles; i++) {
+        sleep_until(&ts, period_ns);
+        start += period_ns;
+
+        int burst = (i % burst_every) < burst_len;
+
+        // control logic
+        busy_ns(burst ? burst_ns : logic_ns);
+
+        cxt.tx_data.dout = i & 0x0F;
+        monarco_main(&cxt);
+
+        int64_t late = now_ns() - start;
+        if (late > worst_ns) {
+            worst_ns = late;
+        }
+        if (late > period_ns) {
+            misses++;
+            burst_misses += burst;
+        }
+
+        if (!shedding) {
+            export_task(&export_ns, i);
+            exports++;
+        }
+    }
+
+    printf("%s:\n", name);
+    printf("  deadline misses %u (%u in bursts), worst frame exchange end %.2f ms of %.2f ms period\n",
+        misses, burst_misses, worst_ns / 1e6, period_us / 1e3);
+
+    if (shedding) {
+        exports = shed.tasks[0].runs;
+        printf("  levels reached: none %u, sdc %u, log %u, tasks %u cycles, peak monarco_main() %.1f us\n",
+            shed.level_cycles[MONARCO_SHED_NONE], shed.level_cycles[MONARCO_SHED_SDC],
+            shed.level_cycles[MONARCO_SHED_LOG], shed.level_cycles[MONARCO_SHED_TASKS], shed.main_peak_ns / 1e3);
+        printf("  deferred: %u SDC requests, %u debug prints, %u optional task runs in %u shedding cycles\n",
+            cxt.stats.shed_sdc, cxt.stats.shed_prints, cxt.stats.shed_tasks, cxt.stats.shed_cycles);
+        monarco_shed_exit(&cxt);
+    }
+
+    printf("  diagnostic exports %u of %i cycles, SDC reads %u\n\n", exports, cycles, sim.sdc_reads);
+
+    monarco_exit(&cxt);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    int period_us = 2000;
+    int cycles = 5000;
+    int burst_every = 1000;
+    int burst_len = 200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:b:l:vh")) != -1) {
+        switch (opt) {
+        case 'p': period_us = atoi(optarg); break;
+        case 'n': cycles = atoi(optarg); break;
+        case 'b': burst_every = atoi(optarg); break;
+        case 'l': burst_len = atoi(optarg); break;
+        case 'v': monarco_platform_dprint_flags |= MONARCO_DPF_INFO | MONARCO_DPF_VERB; break;
+        default: printf("Usage: %s [-p period_us] [-n cycles] [-b burst_every] [-l burst_len] [-v]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((period_us < 500) || (cycles <= 0) || (burst_every <= 0) || (burst_len < 0) || (burst_len > burst_every)) {
+        printf("Usage: %s [-p period_us] [-n cycles] [-b burst_every] [-l burst_len] [-v]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) load shedding demo v1.4\n\n");
+    printf("period %i us, control logic 30 %% of period, 80 %% in bursts of %i every %i cycles, "
+        "diagnostic export 30 %%\n\n", period_us, burst_len, burst_every);
+
+    run("optional task always run", 0, period_us, cycles, burst_every, burst_len);
+    run("load shedding", 1, period_us, cycles, burst_every, burst_len);
+
+    return 0;
+}
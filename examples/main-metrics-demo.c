@@ -0,0 +1,231 @@
+/***************************************************************************//**
+ * @file main-metrics-demo.c
+ * @brief libmonarco - Metrics Exporter Example
+ *
+ * This example runs a periodic cycle against the simulated HAT with injected
+ * CRC faults and dropped SDC requests, and serves metrics on a Unix socket.
+ * A watchdog is attached, its overruns (e.g. the cycles delayed by the
+ * self-scrape below) are exported as `monarco_cycle_overruns_total`.
+ * While the cycle runs, the example scrapes the socket itself like Prometheus
+ * would (HTTP GET) and prints the last scrape. Scrape with another client
+ * during the run, e.g.:
+ *
+ *   curl -s --unix-socket /tmp/monarco-metrics.sock http://localhost/metrics
+ *   socat - UNIX-CONNECT:/tmp/monarco-metrics.sock
+ *
+ * Before that, the cost of the counters in monarco_main() is measured by
+ * back-to-back cycles without and with metrics attached.
+ *
+ * Usage: monarco-metrics-demo [-p period_us] [-n cycles] [-o socket]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "src/monarco.h"
+#include "src/monarco_metrics.h"
+#include "src/monarco_wdt.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+static const monarco_sdc_item_t sdc_table[] = {
+    MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
+    MONARCO_SDC_ITEM_READ_PERIODIC(WDTIMEOUT, 5),
+    MONARCO_SDC_ITEM_READ_PERIODIC(FWVERL, 50),
+    MONARCO_SDC_ITEM_READ_PERIODIC(HWVERL, 50),
+};
+
+static char scrape_buf[65536];
+
+static inline int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(struct timespec *ts, int64_t add_ns)
+{
+    ts->tv_nsec += add_ns;
+    while (ts->tv_nsec >= 1000000000) {
+        ts->tv_nsec -= 1000000000;
+        ts->tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL);
+}
+
+static void setup(monarco_cxt_t *cxt, monarco_sim_t *sim, int faults)
+{
+    monarco_sim_init(sim);
+    if (faults) {
+        sim->fault_crc_rate = 0.002;
+        sim->fault_drop_rate = 0.01;
+    }
+    monarco_init_transfer(cxt, monarco_sim_transfer, sim, NULL);
+    monarco_sdc_init(cxt, sizeof(sdc_table) / sizeof(sdc_table[0]) + MONARCO_WDT_ITEMS);
+    monarco_sdc_load(cxt, sdc_table, sizeof(sdc_table) / sizeof(sdc_table[0]));
+}
+
+/* Mean cost of monarco_main() back to back (ns) */
+static double cycle_cost(int with_metrics, int cycles)
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    static monarco_metrics_t metrics;
+    int i;
+
+    setup(&cxt, &sim, 0);
+    if (with_metrics) {
+        monarco_metrics_init(&metrics, &cxt, 1000);
+    }
+
+    int64_t t0 = now_ns();
+    for (i = 0; i < cycles; i++) {
+        monarco_main(&cxt);
+    }
+    double ns = (double)(now_ns() - t0) / cycles;
+
+    monarco_metrics_exit(&cxt);
+    monarco_exit(&cxt);
+
+    return ns;
+}
+
+/* Scrape `path` by HTTP GET into `scrape_buf`, returns body length or -1 */
+static int scrape(const char *path)
+{
+    struct sockaddr_un addr;
+    const char *req = "GET /metrics HTTP/1.0\r\n\r\n";
+    int len = 0;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if ((connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (write(fd, req, strlen(req)) < 0)) {
+        close(fd);
+        return -1;
+    }
+
+    while (len < (int)sizeof(scrape_buf) - 1) {
+        ssize_t n = read(fd, scrape_buf + len, sizeof(scrape_buf) - 1 - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    scrape_buf[len] = 0;
+    close(fd);
+
+    char *body = strstr(scrape_buf, "\r\n\r\n");
+    if ((strncmp(scrape_buf, "HTTP/1.0 200", 12) != 0) || (body == NULL)) {
+        return -1;
+    }
+
+    memmove(scrape_buf, body + 4, strlen(body + 4) + 1);
+    return strlen(scrape_buf);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    static monarco_metrics_t metrics;
+    static monarco_wdt_t wdt;
+    const char *path = "/tmp/monarco-metrics.sock";
+    int period_us = 1000;
+    int cycles = 5000;
+    int scrapes = 0;
+    int scrape_len = -1;
+    int64_t scrape_ns = 0;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "p:n:o:h")) != -1) {
+        switch (opt) {
+        case 'p': period_us = atoi(optarg); break;
+        case 'n': cycles = atoi(optarg); break;
+        case 'o': path = optarg; break;
+        default: printf("Usage: %s [-p period_us] [-n cycles] [-o socket]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((period_us <= 0) || (cycles <= 0)) {
+        printf("Usage: %s [-p period_us] [-n cycles] [-o socket]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) metrics exporter demo v1.5\n\n");
+
+    double base = cycle_cost(0, 200000);
+    double with = cycle_cost(1, 200000);
+    printf("monarco_main() back to back: %.1f ns without metrics, %.1f ns with metrics (%+.1f ns)\n\n", base, with, with - base);
+
+    setup(&cxt, &sim, 1);
+    monarco_metrics_init(&metrics, &cxt, period_us);
+    monarco_wdt_init(&wdt, &cxt, period_us, NULL);
+    wdt.recover_cycles = 10;
+    if (monarco_metrics_serve(&metrics, path) != 0) {
+        printf("Failed to serve metrics on %s\n", path);
+        return -1;
+    }
+
+    printf("serving on %s, %i cycles of %i us\n\n", path, cycles, period_us);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    for (i = 1; i <= cycles; i++) {
+        sleep_until(&ts, period_us * 1000LL);
+
+        cxt.tx_data.dout = (i >> 8) & 0x0F;
+        monarco_main(&cxt);
+
+        // self-scrape from the cycle thread between cycles, only to show the output
+        if ((i % 1000) == 0) {
+            int64_t t0 = now_ns();
+            scrape_len = scrape(path);
+            scrape_ns += now_ns() - t0;
+            scrapes++;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+        }
+    }
+
+    if (scrape_len < 0) {
+        printf("Scrape failed\n");
+    }
+    else {
+        printf("%s\n", scrape_buf);
+        printf("%i scrapes of %i bytes, %.2f ms each\n\n", scrapes, scrape_len, scrapes ? scrape_ns / 1e6 / scrapes : 0.0);
+    }
+
+    monarco_metrics_exit(&cxt);
+    monarco_exit(&cxt);
+
+    return (scrape_len < 0) ? -1 : 0;
+}
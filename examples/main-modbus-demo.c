@@ -0,0 +1,352 @@
+/***************************************************************************//**
+ * @file main-modbus-demo.c
+ * @brief libmonarco - Modbus RTU Master Example with pseudo-terminal slave
+ *
+ * This example runs the Modbus RTU master of libmonarco against stand-in slaves
+ * on a pseudo-terminal, so it works on any Linux host without RS-485 hardware.
+ *
+ * The master polls a plan of reads and writes from the 1 ms I/O cycle of
+ * a simulated HAT. A slave thread on the other side of the pseudo-terminal
+ * emulates slaves 1..3 and paces its responses by the wire time at the
+ * configured baudrate. Slave 4 is missing, so its requests time out, and
+ * register 900 of slave 1 answers with an exception.
+ *
+ * Transaction rate, bus utilization and statistics are printed at the end.
+ * To talk to real slaves, pass the host UART connected to the HAT, e.g. `-d /dev/serial0`.
+ *
+ * Usage: monarco-modbus-demo [-b baud/100] [-t seconds] [-d device]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "src/monarco.h"
+#include "src/monarco_modbus.h"
+#include "src/monarco_crc.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+#define CYCLE_NS 1000000
+
+/* Process image */
+enum {
+    IMG_S1_HOLDING = 0, /* 10 registers */
+    IMG_S2_INPUT = 10, /* 32 registers */
+    IMG_S3_SETPOINTS = 42, /* 4 registers */
+    IMG_S1_COMMAND = 46, /* 1 register */
+    IMG_S4_STATUS = 47, /* 2 registers */
+    IMG_S1_BAD = 49, /* 1 register */
+    IMG_SIZE = 50
+};
+
+static uint16_t image[IMG_SIZE];
+
+/* Polling plan */
+static monarco_modbus_poll_t plan[] = {
+    { .slave = 1, .function = MONARCO_MODBUS_FC_READ_HOLDING, .address = 0, .count = 10, .image = IMG_S1_HOLDING, .factor = 1 },
+    { .slave = 2, .function = MONARCO_MODBUS_FC_READ_INPUT, .address = 0, .count = 32, .image = IMG_S2_INPUT, .factor = 1 },
+    { .slave = 3, .function = MONARCO_MODBUS_FC_WRITE_MULTIPLE, .address = 100, .count = 4, .image = IMG_S3_SETPOINTS, .factor = 2 },
+    { .slave = 1, .function = MONARCO_MODBUS_FC_WRITE_SINGLE, .address = 20, .count = 1, .image = IMG_S1_COMMAND },
+    { .slave = 4, .function = MONARCO_MODBUS_FC_READ_HOLDING, .address = 0, .count = 2, .image = IMG_S4_STATUS, .factor = 10 },
+    { .slave = 1, .function = MONARCO_MODBUS_FC_READ_HOLDING, .address = 900, .count = 1, .image = IMG_S1_BAD, .factor = 10 },
+};
+
+#define PLAN_SIZE ((int)(sizeof(plan) / sizeof(plan[0])))
+#define PLAN_S1_COMMAND 3
+
+static const monarco_sdc_item_t sdc_table[] = {
+    MONARCO_SDC_ITEM_WRITE(RS485BAUD, 96),
+    MONARCO_SDC_ITEM_WRITE(RS485MODE, MONARCO_SDC_RS485_DEFAULT_MODE),
+};
+
+/*
+ * Stand-in slaves on the master side of the pseudo-terminal
+ */
+
+static int pty_fd;
+static uint32_t slave_char_ns;
+static atomic_int slave_stop;
+static atomic_uint slave_bytes;
+static uint16_t slave_regs[4][1000]; /* slaves 1..3 */
+
+static void sleep_ns(int64_t ns)
+{
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+    nanosleep(&ts, NULL);
+}
+
+/* Read exactly `len` bytes, returns 0 on stop request */
+static int slave_read(uint8_t *buf, int len)
+{
+    int got = 0;
+
+    while (got < len) {
+        struct pollfd pfd = { .fd = pty_fd, .events = POLLIN };
+        if (atomic_load(&slave_stop)) {
+            return 0;
+        }
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        ssize_t n = read(pty_fd, &buf[got], len - got);
+        if (n > 0) {
+            got += n;
+        }
+    }
+
+    return 1;
+}
+
+static void *slave_thread(void *arg)
+{
+    uint8_t req[MONARCO_MODBUS_ADU_SIZE];
+    uint8_t resp[MONARCO_MODBUS_ADU_SIZE];
+    uint32_t tick = 0;
+    int i;
+
+    (void)arg;
+
+    while (slave_read(req, 8)) {
+        int req_len = 8;
+        int resp_len;
+
+        if (req[1] == MONARCO_MODBUS_FC_WRITE_MULTIPLE) {
+            if (!slave_read(&req[8], req[6] + 1)) {
+                break;
+            }
+            req_len += req[6] + 1;
+        }
+
+        atomic_fetch_add(&slave_bytes, req_len);
+
+        uint16_t crc = monarco_crc16((const char *)req, req_len - 2);
+        if ((req[req_len - 2] != (crc & 0xFF)) || (req[req_len - 1] != (crc >> 8))) {
+            tcflush(pty_fd, TCIFLUSH);
+            continue;
+        }
+
+        int slave = req[0];
+        int addr = (req[2] << 8) | req[3];
+        int count = (req[4] << 8) | req[5];
+
+        if ((slave < 1) || (slave > 3)) {
+            continue; /* missing slave, no response */
+        }
+
+        uint16_t *regs = slave_regs[slave];
+
+        // input registers of slave 2 are changing
+        tick++;
+        for (i = 0; i < 32; i++) {
+            slave_regs[2][500 + i] = tick + i;
+        }
+
+        resp[0] = slave;
+        resp[1] = req[1];
+
+        if (req[1] == MONARCO_MODBUS_FC_WRITE_SINGLE) {
+            count = 1;
+        }
+
+        if (addr + count > ((req[1] == MONARCO_MODBUS_FC_READ_INPUT) ? 32 : 200)) {
+            resp[1] |= 0x80;
+            resp[2] = 0x02; /* Illegal Data Address */
+            resp_len = 3;
+        }
+        else {
+            switch (req[1]) {
+            case MONARCO_MODBUS_FC_READ_HOLDING:
+            case MONARCO_MODBUS_FC_READ_INPUT:
+                if (req[1] == MONARCO_MODBUS_FC_READ_INPUT) {
+                    addr += 500;
+                }
+                resp[2] = count * 2;
+                for (i = 0; i < count; i++) {
+                    resp[3 + i * 2] = regs[addr + i] >> 8;
+                    resp[4 + i * 2] = regs[addr + i] & 0xFF;
+                }
+                resp_len = 3 + count * 2;
+                break;
+            case MONARCO_MODBUS_FC_WRITE_SINGLE:
+                regs[addr] = (req[4] << 8) | req[5];
+                memcpy(&resp[2], &req[2], 4);
+                resp_len = 6;
+                break;
+            case MONARCO_MODBUS_FC_WRITE_MULTIPLE:
+                for (i = 0; i < count; i++) {
+                    regs[addr + i] = (req[7 + i * 2] << 8) | req[8 + i * 2];
+                }
+                memcpy(&resp[2], &req[2], 4);
+                resp_len = 6;
+                break;
+            default:
+                resp[1] |= 0x80;
+                resp[2] = 0x01; /* Illegal Function */
+                resp_len = 3;
+            }
+        }
+
+        crc = monarco_crc16((const char *)resp, resp_len);
+        resp[resp_len++] = crc & 0xFF;
+        resp[resp_len++] = crc >> 8;
+
+        // pace by wire time of request and response, as on a real bus
+        sleep_ns((int64_t)(req_len + resp_len) * slave_char_ns);
+
+        if (write(pty_fd, resp, resp_len) == resp_len) {
+            atomic_fetch_add(&slave_bytes, resp_len);
+        }
+    }
+
+    return NULL;
+}
+
+static void print_stats(const monarco_modbus_t *mb, double seconds)
+{
+    const monarco_modbus_stats_t *st = &mb->stats;
+    int i;
+
+    printf("\nTransactions: %u requests, %u responses (%u exceptions), %u timeouts, %u CRC errors, %u invalid\n",
+        st->requests, st->responses, st->exceptions, st->timeouts, st->crc_errors, st->invalid);
+    printf("Throughput: %.1f transactions/s, bus utilization %.1f %% (%u bytes TX, %u bytes RX)\n",
+        st->requests / seconds, 100.0 * (st->bytes_tx + st->bytes_rx) * mb->char_ns / (seconds * 1e9), st->bytes_tx, st->bytes_rx);
+    printf("HAT diagnostics: %u bytes received, %u framing errors, %u parity errors\n",
+        st->hat_rx_bytes, st->hat_framing_errors, st->hat_parity_errors);
+
+    printf("\n%-6s %-5s %-4s %-5s %-6s %-6s %-8s %s\n", "entry", "slave", "FC", "addr", "count", "done", "errors", "status");
+    for (i = 0; i < PLAN_SIZE; i++) {
+        printf("%-6i %-5u 0x%02X %-5u %-6u %-6u %-8u %u (exception %u)\n", i, plan[i].slave, plan[i].function,
+            plan[i].address, plan[i].count, plan[i].done, plan[i].errors, plan[i].status, plan[i].exception);
+    }
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    monarco_modbus_t mb;
+    pthread_t thread;
+    const char *device = NULL;
+    int baud = 384;
+    int seconds = 3;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "b:t:d:h")) != -1) {
+        switch (opt) {
+        case 'b': baud = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'd': device = optarg; break;
+        default: printf("Usage: %s [-b baud/100] [-t seconds] [-d device]\n", argv[0]); return -1;
+        }
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) Modbus RTU master demo v1.4\n\n");
+
+    monarco_sim_init(&sim);
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_init(&cxt, 2 + 3);
+    monarco_sdc_load(&cxt, sdc_table, 2);
+    monarco_sdc_write(&cxt, 0, baud);
+
+    /* Stand-in slaves on a pseudo-terminal unless a real UART is given */
+
+    if (device == NULL) {
+        if (((pty_fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0) || (grantpt(pty_fd) < 0) || (unlockpt(pty_fd) < 0)) {
+            printf("Failed to create pseudo-terminal\n");
+            return -1;
+        }
+        device = ptsname(pty_fd);
+    }
+
+    if (monarco_modbus_init(&mb, &cxt, device, baud, MONARCO_SDC_RS485_DEFAULT_MODE, 20) != 0) {
+        printf("Failed to initialize Modbus master on %s\n", device);
+        return -1;
+    }
+
+    if (monarco_modbus_plan(&mb, plan, PLAN_SIZE, image, IMG_SIZE) != 0) {
+        printf("Invalid polling plan\n");
+        return -1;
+    }
+
+    printf("Device %s, %i Bd, character %u ns, inter-frame gap %u ns\n", device, baud * 100, mb.char_ns, mb.gap_ns);
+
+    for (i = 0; i < 10; i++) {
+        slave_regs[1][i] = 1000 + i;
+    }
+
+    if (pty_fd > 0) {
+        slave_char_ns = mb.char_ns;
+        pthread_create(&thread, NULL, slave_thread, NULL);
+    }
+
+    /* I/O cycle */
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    int cycles = seconds * (1000000000 / CYCLE_NS);
+
+    for (i = 0; i < cycles; i++) {
+        // setpoints for slave 3 follow the cycle counter, command to slave 1 each 100 ms
+        image[IMG_S3_SETPOINTS] = i;
+        image[IMG_S3_SETPOINTS + 3] = ~i;
+        if ((i % 100) == 0) {
+            image[IMG_S1_COMMAND] = i / 100;
+            monarco_modbus_request(&mb, PLAN_S1_COMMAND);
+        }
+
+        // HAT line counters follow the bus traffic
+        sim.regs[MONARCO_SDC_REG_RS485RXCNT] = (uint16_t)atomic_load(&slave_bytes);
+
+        monarco_main(&cxt);
+
+        next.tv_nsec += CYCLE_NS;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    /* Results */
+
+    print_stats(&mb, seconds);
+
+    printf("\nImage: slave 1 holding[0..3] = %u %u %u %u, slave 2 input[0..3] = %u %u %u %u\n",
+        image[0], image[1], image[2], image[3], image[IMG_S2_INPUT], image[IMG_S2_INPUT + 1], image[IMG_S2_INPUT + 2], image[IMG_S2_INPUT + 3]);
+
+    if (pty_fd > 0) {
+        printf("Slave 1 command register = %u, slave 3 setpoints = %u .. %u\n", slave_regs[1][20], slave_regs[3][100], slave_regs[3][103]);
+        atomic_store(&slave_stop, 1);
+        pthread_join(thread, NULL);
+        close(pty_fd);
+    }
+
+    monarco_exit(&cxt);
+
+    return 0;
+}
@@ -0,0 +1,258 @@
+/***************************************************************************//**
+ * @file main-sdc-block-bench.c
+ * @brief libmonarco - SDC Block Transactions Benchmark
+ *
+ * This tool compares reads of multi-register values on the simulated HAT -
+ * the MCU ID (MCUID1..MCUID4) and the four RS-485 diagnostic counters - as
+ * independent SDC Items requested together, as blocks (`monarco_block.h`)
+ * and as verified blocks, the groups in turns. Background periodic STATUS
+ * reads share the SDC. RS-485 traffic is simulated between frames: each
+ * message of a request and its echo adds the same byte count to RS485RXCNT
+ * and RS485TXCNT, so a coherent snapshot has both counters equal.
+ *
+ * Reported are frames per read of both groups, torn results (counters not
+ * equal or MCU ID not matching), of them torn results reported as coherent
+ * (independent Items are taken as coherent by the application, blocks claim
+ * coherence only when verified, so 0 for both block modes), and reads
+ * repeated by verification.
+ *
+ * Usage: monarco-sdc-block-bench [-n reads] [-m message_every_frames] [-e fault_rate]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "src/monarco.h"
+#include "src/monarco_block.h"
+#include "src/monarco_sdc.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+/* Read modes */
+enum {
+    MODE_ITEMS, /* Independent SDC Items */
+    MODE_BLOCK, /* Blocks */
+    MODE_VERIFY, /* Blocks with MONARCO_BLOCK_VERIFY */
+};
+
+static const char *mode_names[] = { "independent Items", "blocks", "verified blocks" };
+
+static const uint16_t mcuid_regs[] = {
+    MONARCO_SDC_REG_MCUID1, MONARCO_SDC_REG_MCUID2, MONARCO_SDC_REG_MCUID3, MONARCO_SDC_REG_MCUID4,
+};
+
+static const uint16_t rs485_regs[] = {
+    MONARCO_SDC_REG_RS485RXCNT, MONARCO_SDC_REG_RS485TXCNT, MONARCO_SDC_REG_RS485FECNT, MONARCO_SDC_REG_RS485PECNT,
+};
+
+static const monarco_sdc_item_t sdc_table[] = {
+    MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 4),
+};
+
+/* Group read in one of the modes */
+typedef struct {
+    const uint16_t *regs;
+    int first; /* MODE_ITEMS - index of the first Item */
+    monarco_block_t block; /* MODE_BLOCK, MODE_VERIFY */
+    uint32_t start; /* Frame of the request */
+    uint32_t reads;
+    uint64_t frames;
+    uint32_t torn;
+    uint32_t torn_coherent;
+} group_t;
+
+static uint32_t rng = 1;
+
+static inline uint32_t rand_next(void)
+{
+    rng = rng * 1103515245 + 12345;
+    return rng >> 16;
+}
+
+static void group_add(monarco_cxt_t *cxt, group_t *g, const uint16_t *regs, int mode)
+{
+    int i;
+
+    g->regs = regs;
+    if (mode == MODE_ITEMS) {
+        g->first = cxt->sdc_size;
+        for (i = 0; i < 4; i++) {
+            monarco_sdc_item_t item = { .address = regs[i] };
+            monarco_sdc_add(cxt, &item);
+        }
+    }
+    else {
+        monarco_block_add(cxt, &g->block, regs, 4, (mode == MODE_VERIFY) ? MONARCO_BLOCK_VERIFY : 0);
+    }
+}
+
+static void group_request(monarco_cxt_t *cxt, group_t *g, int mode)
+{
+    int i;
+
+    g->start = cxt->stats.cycles;
+    if (mode == MODE_ITEMS) {
+        for (i = 0; i < 4; i++) {
+            monarco_sdc_request(cxt, g->first + i);
+        }
+    }
+    else {
+        monarco_block_read(cxt, &g->block);
+    }
+}
+
+/* Collect the result when done, returns 1 when done */
+static int group_collect(monarco_cxt_t *cxt, monarco_sim_t *sim, group_t *g, int mode)
+{
+    uint16_t values[4];
+    int coherent;
+    int i;
+
+    if (mode == MODE_ITEMS) {
+        for (i = 0; i < 4; i++) {
+            if (!monarco_sdc_done(cxt, g->first + i)) {
+                return 0;
+            }
+            values[i] = monarco_sdc_value(cxt, g->first + i);
+        }
+        // nothing tells the application whether the values belong together
+        coherent = 1;
+    }
+    else {
+        if (!monarco_block_done(&g->block)) {
+            return 0;
+        }
+        for (i = 0; i < 4; i++) {
+            values[i] = g->block.values[i];
+        }
+        coherent = g->block.coherent;
+    }
+
+    int torn;
+    if (g->regs == rs485_regs) {
+        torn = values[0] != values[1];
+    }
+    else {
+        torn = 0;
+        for (i = 0; i < 4; i++) {
+            torn |= values[i] != sim->regs[g->regs[i]];
+        }
+    }
+
+    g->reads++;
+    g->frames += cxt->stats.cycles - g->start;
+    g->torn += torn;
+    g->torn_coherent += torn && coherent;
+
+    return 1;
+}
+
+static void run(int mode, int reads, int message_every, double fault_rate)
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    group_t mcuid = { 0 };
+    group_t rs485 = { 0 };
+    int next_message = 1;
+    int i;
+
+    monarco_sim_init(&sim);
+    sim.fault_crc_rate = fault_rate;
+    sim.fault_drop_rate = fault_rate;
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_init(&cxt, 1 + 2 * 8);
+    monarco_sdc_load(&cxt, sdc_table, sizeof(sdc_table) / sizeof(sdc_table[0]));
+
+    group_add(&cxt, &mcuid, mcuid_regs, mode);
+    group_add(&cxt, &rs485, rs485_regs, mode);
+
+    // groups are read in turns, so frames per read are not shared
+    group_t *active = &mcuid;
+    group_request(&cxt, active, mode);
+
+    for (i = 0; (rs485.reads < (uint32_t)reads) && (i < reads * 1000); i++) {
+        // RS-485 message and its echo, a rare framing or parity error
+        if (--next_message == 0) {
+            uint16_t bytes = 4 + rand_next() % 60;
+            sim.regs[MONARCO_SDC_REG_RS485RXCNT] += bytes;
+            sim.regs[MONARCO_SDC_REG_RS485TXCNT] += bytes;
+            if ((rand_next() % 100) == 0) {
+                sim.regs[MONARCO_SDC_REG_RS485FECNT + (rand_next() & 1)]++;
+            }
+            next_message = 1 + rand_next() % (2 * message_every);
+        }
+
+        monarco_main(&cxt);
+
+        if (group_collect(&cxt, &sim, active, mode)) {
+            active = (active == &mcuid) ? &rs485 : &mcuid;
+            group_request(&cxt, active, mode);
+        }
+    }
+
+    printf("%s:\n", mode_names[mode]);
+    printf("  MCU ID           %5u reads, %5.2f frames/read, torn %u, torn reported coherent %u\n",
+        mcuid.reads, mcuid.reads ? (double)mcuid.frames / mcuid.reads : 0.0, mcuid.torn, mcuid.torn_coherent);
+    printf("  RS-485 counters  %5u reads, %5.2f frames/read, torn %u, torn reported coherent %u\n",
+        rs485.reads, rs485.reads ? (double)rs485.frames / rs485.reads : 0.0, rs485.torn, rs485.torn_coherent);
+    printf("  SDC requests %u, resends %u, timeouts %u", cxt.stats.sdc_requests, cxt.stats.sdc_resends, cxt.stats.sdc_timeouts);
+    if (mode != MODE_ITEMS) {
+        printf(", reads repeated after change %u, incoherent %u", mcuid.block.torn + rs485.block.torn,
+            mcuid.block.incoherent + rs485.block.incoherent);
+    }
+    printf("\n\n");
+
+    monarco_exit(&cxt);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    int reads = 10000;
+    int message_every = 20;
+    double fault_rate = 0.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:e:h")) != -1) {
+        switch (opt) {
+        case 'n': reads = atoi(optarg); break;
+        case 'm': message_every = atoi(optarg); break;
+        case 'e': fault_rate = atof(optarg); break;
+        default: printf("Usage: %s [-n reads] [-m message_every_frames] [-e fault_rate]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((reads <= 0) || (message_every <= 0) || (fault_rate < 0.0) || (fault_rate >= 1.0)) {
+        printf("Usage: %s [-n reads] [-m message_every_frames] [-e fault_rate]\n", argv[0]);
+        return -1;
+    }
+
+    // injected CRC faults would flood error prints
+    if (fault_rate > 0.0) {
+        monarco_platform_dprint_flags = 0;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) SDC block transactions benchmark v1.4\n\n");
+    printf("RS-485 message every %i frames on average, CRC and SDC drop fault rate %.3f\n\n", message_every, fault_rate);
+
+    run(MODE_ITEMS, reads, message_every, fault_rate);
+    run(MODE_BLOCK, reads, message_every, fault_rate);
+    run(MODE_VERIFY, reads, message_every, fault_rate);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/***************************************************************************//**
+ * @file main-sdc-cache-bench.c
+ * @brief libmonarco - SDC Register Cache Benchmark
+ *
+ * This tool compares SDC bandwidth use with and without the register cache
+ * on the simulated HAT. The SDC Items table has six periodic reads, and
+ * the application re-requests two config writes with unchanged values every
+ * few cycles, but consumes only RS485RXCNT, which changes in every frame.
+ *
+ * Reported are SDC transactions, requests completed from the cache, skipped
+ * periodic reads and staleness of the consumed value (cycles).
+ *
+ * Usage: monarco-sdc-cache-bench [-n cycles] [-a max_age]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "src/monarco.h"
+#include "src/monarco_cache.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+enum {
+    ITEM_STATUS, ITEM_FWVERL, ITEM_RXCNT, ITEM_TXCNT, ITEM_FECNT, ITEM_PECNT,
+    ITEM_W_WDTIMEOUT, ITEM_W_RS485BAUD,
+    ITEM_COUNT
+};
+
+static const monarco_sdc_item_t sdc_table[ITEM_COUNT] = {
+    [ITEM_STATUS] = MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
+    [ITEM_FWVERL] = MONARCO_SDC_ITEM_READ_PERIODIC(FWVERL, 1),
+    [ITEM_RXCNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485RXCNT, 1),
+    [ITEM_TXCNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485TXCNT, 1),
+    [ITEM_FECNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485FECNT, 1),
+    [ITEM_PECNT] = MONARCO_SDC_ITEM_READ_PERIODIC(RS485PECNT, 1),
+    [ITEM_W_WDTIMEOUT] = MONARCO_SDC_ITEM_WRITE(WDTIMEOUT, 100),
+    [ITEM_W_RS485BAUD] = MONARCO_SDC_ITEM_WRITE(RS485BAUD, 384),
+};
+
+static void run(int use_cache, int cycles, uint32_t max_age)
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    uint64_t stale_sum = 0;
+    int stale_max = 0;
+    int i;
+
+    monarco_sim_init(&sim);
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_load(&cxt, sdc_table, ITEM_COUNT);
+
+    if (use_cache) {
+        monarco_cache_init(&cxt, 1000);
+        monarco_cache_max_age(&cxt, MONARCO_SDC_REG_RS485RXCNT, max_age);
+    }
+
+    for (i = 0; i < cycles; i++) {
+        // RS485RXCNT changes in every frame
+        sim.regs[MONARCO_SDC_REG_RS485RXCNT] = (uint16_t)i;
+
+        // application re-applies its configuration with unchanged values
+        if ((i % 5) == 0) {
+            monarco_sdc_write(&cxt, ITEM_W_WDTIMEOUT, 100);
+            monarco_sdc_write(&cxt, ITEM_W_RS485BAUD, 384);
+        }
+
+        monarco_main(&cxt);
+
+        uint16_t rxcnt = use_cache ? monarco_cache_read(&cxt, ITEM_RXCNT) : monarco_sdc_value(&cxt, ITEM_RXCNT);
+        int stale = (uint16_t)(i - rxcnt);
+
+        if (i >= 100) {
+            stale_sum += stale;
+            if (stale > stale_max) {
+                stale_max = stale;
+            }
+        }
+    }
+
+    printf("%-8s %8u %8u %8u %8u %10.2f %8i\n", use_cache ? "cache" : "none",
+        sim.sdc_reads + sim.sdc_writes, sim.sdc_writes, cxt.stats.sdc_cached, cxt.stats.sdc_skipped,
+        (double)stale_sum / (cycles - 100), stale_max);
+
+    monarco_exit(&cxt);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    int cycles = 100000;
+    int max_age = 2;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:a:h")) != -1) {
+        switch (opt) {
+        case 'n': cycles = atoi(optarg); break;
+        case 'a': max_age = atoi(optarg); break;
+        default: printf("Usage: %s [-n cycles] [-a max_age]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((cycles <= 100) || (max_age < 0)) {
+        printf("Usage: %s [-n cycles] [-a max_age]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) SDC register cache benchmark v1.4\n\n");
+    printf("%-8s %8s %8s %8s %8s %10s %8s\n", "cache", "SDC tx", "writes", "cached", "skipped", "stale avg", "max");
+
+    run(0, cycles, max_age);
+    run(1, cycles, max_age);
+
+    return 0;
+}
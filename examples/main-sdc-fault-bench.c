@@ -0,0 +1,308 @@
+/***************************************************************************//**
+ * @file main-sdc-fault-bench.c
+ * @brief libmonarco - SDC Fault Injection Benchmark
+ *
+ * This tool measures how the Service Data Channel (SDC) of libmonarco behaves
+ * under protocol errors. It runs `monarco_main()` against the simulated HAT
+ * with fault injection - corrupted CRC, dropped SDC requests, unknown register
+ * errors, delayed and reordered SDC responses - as fast as possible, using
+ * cycle count as virtual time.
+ *
+ * Workload is a set of SDC write and read Items, each one re-triggered as soon
+ * as it completes. For each fault scenario the tool reports effective SDC
+ * transactions per second at nominal cycle period, error results, wrong
+ * results (read value different from register content, i.e. stale response
+ * accepted), transaction latency in cycles (mean, p99, max), duplicate writes
+ * seen by the HAT, driver timeout counts and recovery time - frames from an
+ * injected fault to the next on-time completion (response processed in the
+ * cycle right after its request was sent).
+ *
+ * Usage: monarco-sdc-fault-bench [-n cycles] [-P period_ms] [-S seed]
+ *            [-c crc] [-x drop] [-u unknown] [-D delay] [-F frames] [-o reorder]
+ *
+ * Without fault options, a sweep over all fault kinds and rates is run.
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/monarco.h"
+#include "src/monarco_sdc.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* No debug prints, timeouts and errors are counted in statistics */
+int monarco_platform_dprint_flags = 0;
+
+/* Context data for libmonarco. */
+static monarco_cxt_t cxt;
+
+/* Simulated HAT with fault injection */
+static monarco_sim_t sim;
+
+/* Transaction latency histogram size in cycles, last bin collects overflows */
+#define LATENCY_BINS 1024
+
+/* SDC workload - writes with alternating values and read-back of written registers */
+enum {
+    ITEM_W_CONFIG1, ITEM_W_WDTIMEOUT, ITEM_W_RS485BAUD, ITEM_W_RS485MODE,
+    ITEM_R_WDTIMEOUT, ITEM_R_RS485BAUD, ITEM_R_FWVERL, ITEM_R_STATUS,
+    ITEM_COUNT
+};
+
+static const monarco_sdc_item_t sdc_table[ITEM_COUNT] = {
+    [ITEM_W_CONFIG1] = MONARCO_SDC_ITEM_WRITE(HWCONFIG1, 0),
+    [ITEM_W_WDTIMEOUT] = MONARCO_SDC_ITEM_WRITE(WDTIMEOUT, 100),
+    [ITEM_W_RS485BAUD] = MONARCO_SDC_ITEM_WRITE(RS485BAUD, 96),
+    [ITEM_W_RS485MODE] = MONARCO_SDC_ITEM_WRITE(RS485MODE, MONARCO_SDC_RS485_DEFAULT_MODE),
+    [ITEM_R_WDTIMEOUT] = MONARCO_SDC_ITEM_READ(WDTIMEOUT),
+    [ITEM_R_RS485BAUD] = MONARCO_SDC_ITEM_READ(RS485BAUD),
+    [ITEM_R_FWVERL] = MONARCO_SDC_ITEM_READ(FWVERL),
+    [ITEM_R_STATUS] = MONARCO_SDC_ITEM_READ(STATUS),
+};
+
+/* Fault scenario */
+typedef struct {
+    const char *name;
+    double crc, drop, unknown, delay, reorder;
+    int delay_frames;
+} scenario_t;
+
+/* Scenario results */
+typedef struct {
+    uint32_t done, errors, wrong;
+    uint32_t latency[LATENCY_BINS];
+    uint64_t latency_sum;
+    uint32_t latency_max;
+    uint64_t recovery_sum;
+    uint32_t recovery_count, recovery_max;
+} result_t;
+
+/* New value for write Item `idx`, alternating between two valid values */
+static uint16_t write_value(int idx, uint32_t n)
+{
+    switch (idx) {
+    case ITEM_W_CONFIG1: return (n & 1) ? MONARCO_SDC_CONFIG1_RS485TERM : 0;
+    case ITEM_W_WDTIMEOUT: return 100 + (n % 50);
+    case ITEM_W_RS485BAUD: return (n & 1) ? 384 : 96;
+    default: return (n & 1) ? (MONARCO_SDC_RS485_MODE_PARITY_EVEN | MONARCO_SDC_RS485_MODE_DATABITS_8) : MONARCO_SDC_RS485_DEFAULT_MODE;
+    }
+}
+
+static uint32_t latency_percentile(const result_t *r, double p)
+{
+    uint64_t target = (uint64_t)(p / 100.0 * r->done + 0.5);
+    uint64_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < LATENCY_BINS; i++) {
+        sum += r->latency[i];
+        if (sum >= target) {
+            return i;
+        }
+    }
+    return LATENCY_BINS - 1;
+}
+
+static void run_scenario(const scenario_t *sc, int cycles, double period_ms, uint32_t seed)
+{
+    static result_t r;
+    uint32_t requested_at[ITEM_COUNT];
+    uint32_t n_writes[ITEM_COUNT];
+    uint32_t faults = 0, sdc_requests = 0, sdc_done = 0;
+    int fault_cycle = 0, request_cycle = 0, recovering = 0;
+    int c, i;
+
+    memset(&r, 0, sizeof(r));
+    memset(n_writes, 0, sizeof(n_writes));
+
+    monarco_sim_init(&sim);
+    sim.fault_seed = seed;
+    sim.fault_crc_rate = sc->crc;
+    sim.fault_drop_rate = sc->drop;
+    sim.fault_unknown_rate = sc->unknown;
+    sim.fault_delay_rate = sc->delay;
+    sim.fault_delay_frames = sc->delay_frames;
+    sim.fault_reorder_rate = sc->reorder;
+
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_load(&cxt, sdc_table, ITEM_COUNT);
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        requested_at[i] = 0;
+    }
+
+    for (c = 1; c <= cycles; c++) {
+        monarco_main(&cxt);
+
+        // Recovery time - from the cycle a fault is injected to the next on-time completion
+        uint32_t f = sim.faults_crc + sim.faults_drop + sim.faults_delay + sim.faults_reorder;
+        if ((f != faults) && !recovering) {
+            recovering = 1;
+            fault_cycle = c;
+        }
+        faults = f;
+        if (recovering && (cxt.stats.sdc_done != sdc_done) && (request_cycle == c - 1) && (c > fault_cycle)) {
+            uint32_t recovery = c - fault_cycle;
+            r.recovery_sum += recovery;
+            r.recovery_count++;
+            if (recovery > r.recovery_max) {
+                r.recovery_max = recovery;
+            }
+            recovering = 0;
+        }
+        sdc_done = cxt.stats.sdc_done;
+        if (cxt.stats.sdc_requests != sdc_requests) {
+            request_cycle = c;
+        }
+        sdc_requests = cxt.stats.sdc_requests;
+
+        for (i = 0; i < ITEM_COUNT; i++) {
+            if (!monarco_sdc_done(&cxt, i)) {
+                continue;
+            }
+
+            uint32_t latency = c - requested_at[i];
+            r.done++;
+            r.latency[latency < LATENCY_BINS ? latency : LATENCY_BINS - 1]++;
+            r.latency_sum += latency;
+            if (latency > r.latency_max) {
+                r.latency_max = latency;
+            }
+
+            if (monarco_sdc_error(&cxt, i)) {
+                r.errors++;
+            }
+            else if (monarco_sdc_value(&cxt, i) != sim.regs[sdc_table[i].address]) {
+                r.wrong++;
+            }
+
+            // Re-trigger immediately - continuous demand
+            requested_at[i] = c;
+            if (i < ITEM_R_WDTIMEOUT) {
+                monarco_sdc_write(&cxt, i, write_value(i, ++n_writes[i]));
+            }
+            else {
+                monarco_sdc_request(&cxt, i);
+            }
+        }
+    }
+
+    double seconds = cycles * period_ms / 1000.0;
+
+    printf("%-22s %9.1f %7u %7u %7.2f %5u %5u %8u %8u %7u %6.2f %5u\n", sc->name,
+        r.done / seconds, r.errors, r.wrong,
+        r.done ? (double)r.latency_sum / r.done : 0.0, latency_percentile(&r, 99), r.latency_max,
+        sim.sdc_dup_writes, cxt.stats.sdc_timeouts, sim.faults_reorder,
+        r.recovery_count ? (double)r.recovery_sum / r.recovery_count : 0.0, r.recovery_max);
+
+    monarco_exit(&cxt);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n"
+        "  -n N      number of cycles per scenario (default 100000)\n"
+        "  -P MS     nominal cycle period for rate conversion (default 5)\n"
+        "  -S SEED   PRNG seed (default 1)\n"
+        "  -c RATE   probability of corrupted CRC\n"
+        "  -x RATE   probability of dropped SDC request\n"
+        "  -u RATE   probability of unknown register error\n"
+        "  -D RATE   probability of delayed SDC response\n"
+        "  -F N      maximal delay in frames (default 4)\n"
+        "  -o RATE   probability of reordered SDC response\n"
+        "Without fault options, a sweep over all fault kinds and rates is run.\n", prog);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    static const double rates[] = { 0.01, 0.05, 0.10, 0.25 };
+    scenario_t custom = { .name = "custom", .delay_frames = 4 };
+    int use_custom = 0;
+    int cycles = 100000;
+    double period_ms = 5;
+    uint32_t seed = 1;
+    int opt;
+    unsigned int i;
+
+    while ((opt = getopt(argc, argv, "n:P:S:c:x:u:D:F:o:h")) != -1) {
+        switch (opt) {
+        case 'n': cycles = atoi(optarg); break;
+        case 'P': period_ms = atof(optarg); break;
+        case 'S': seed = strtoul(optarg, NULL, 10); break;
+        case 'c': custom.crc = atof(optarg); use_custom = 1; break;
+        case 'x': custom.drop = atof(optarg); use_custom = 1; break;
+        case 'u': custom.unknown = atof(optarg); use_custom = 1; break;
+        case 'D': custom.delay = atof(optarg); use_custom = 1; break;
+        case 'F': custom.delay_frames = atoi(optarg); break;
+        case 'o': custom.reorder = atof(optarg); use_custom = 1; break;
+        default: usage(argv[0]); return -1;
+        }
+    }
+
+    if ((cycles < 1) || (period_ms <= 0)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) SDC fault injection benchmark v1.5\n\n");
+    printf("Cycles per scenario: %i, nominal period: %.3f ms, SDC items: %i\n\n", cycles, period_ms, ITEM_COUNT);
+    printf("%-22s %9s %7s %7s %7s %5s %5s %8s %8s %7s %6s %5s\n", "scenario", "trans/s", "errors", "wrong",
+        "lat", "p99", "max", "dupwr", "timeouts", "reorder", "rec", "rmax");
+
+    if (use_custom) {
+        run_scenario(&custom, cycles, period_ms, seed);
+        return 0;
+    }
+
+    scenario_t base = { .name = "no faults" };
+    run_scenario(&base, cycles, period_ms, seed);
+
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        char name[6][32];
+        scenario_t sc[6] = {
+            { .name = name[0], .crc = rates[i] },
+            { .name = name[1], .drop = rates[i] },
+            { .name = name[2], .unknown = rates[i] },
+            { .name = name[3], .delay = rates[i], .delay_frames = 4 },
+            { .name = name[4], .reorder = rates[i] },
+            { .name = name[5], .crc = rates[i], .drop = rates[i], .delay = rates[i], .delay_frames = 4, .reorder = rates[i] },
+        };
+        snprintf(name[0], sizeof(name[0]), "crc %.0f%%", rates[i] * 100);
+        snprintf(name[1], sizeof(name[1]), "drop %.0f%%", rates[i] * 100);
+        snprintf(name[2], sizeof(name[2]), "unknown-reg %.0f%%", rates[i] * 100);
+        snprintf(name[3], sizeof(name[3]), "delay<=4 %.0f%%", rates[i] * 100);
+        snprintf(name[4], sizeof(name[4]), "reorder %.0f%%", rates[i] * 100);
+        snprintf(name[5], sizeof(name[5]), "mixed %.0f%%", rates[i] * 100);
+
+        int k;
+        for (k = 0; k < 6; k++) {
+            run_scenario(&sc[k], cycles, period_ms, seed);
+        }
+    }
+
+    printf("\ntrans/s - completed SDC transactions per second at nominal period\n"
+        "errors  - transactions completed with error result\n"
+        "wrong   - successful results not matching register content (stale response accepted)\n"
+        "lat/p99/max - transaction latency in cycles from trigger to completion\n"
+        "dupwr   - write requests processed twice by the HAT\n"
+        "timeouts - driver SDC timeouts (MONARCO_SDC_TIMEOUT_CYCLES)\n"
+        "reorder - injected SDC responses held back a frame\n"
+        "rec/rmax - recovery time in frames from an injected fault to the next on-time completion (mean, max)\n");
+
+    return 0;
+}
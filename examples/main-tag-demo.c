@@ -0,0 +1,187 @@
+/***************************************************************************//**
+ * @file main-tag-demo.c
+ * @brief libmonarco - Named Tag Database Example
+ *
+ * This example shows how SCADA or HMI layers can address I/O points of Monarco
+ * HAT by name ("DIN3", "AOUT2", "CNT1", "RS485BAUD", ...).
+ *
+ * The tag database is built once with two application tags aliasing built-in
+ * fields - "PUMP_RUN" on DOUT1 and "TANK_LEVEL" on AIN1 scaled to 0..100 %.
+ * Tag names are resolved to ids once, then all tags of several HATs are read
+ * in bulk each cycle as scaled values, and some outputs are written by name.
+ *
+ * Resolution and bulk read/write time is measured and printed at the end.
+ *
+ * The example runs against simulated HATs, so it works on any Linux host.
+ *
+ * Usage: monarco-tag-demo [-H hats] [-n cycles]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "src/monarco.h"
+#include "src/monarco_tag.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+#define HATS_MAX 16
+
+/* Contexts and simulated HATs */
+static monarco_cxt_t cxt[HATS_MAX];
+static monarco_sim_t sim[HATS_MAX];
+
+/* Application tags - aliases of built-in fields with own scaling */
+static const monarco_tag_t app_tags[] = {
+    MONARCO_TAG_TX_BIT("PUMP_RUN", dout, 0),
+    MONARCO_TAG_RX_VALUE("TANK_LEVEL", ain1, MONARCO_TAG_U16, 100.0 / 4095, 0),
+};
+
+/* Tags polled from each HAT */
+static const char * const poll_names[] = {
+    "DIN1", "DIN2", "DIN3", "DIN4", "CNT1", "CNT2", "AIN1", "AIN2",
+    "DOUT1", "DOUT2", "DOUT3", "DOUT4", "AOUT1", "AOUT2", "PWM1A", "PWM2A",
+    "LED1", "LED2", "LED3", "LED4", "STATUS", "WDTIMEOUT", "RS485BAUD", "FWVERL",
+    "PUMP_RUN", "TANK_LEVEL",
+};
+
+#define POLL_COUNT ((int)(sizeof(poll_names) / sizeof(poll_names[0])))
+
+/* SDC Items, so that SDC tags have values */
+static const monarco_sdc_item_t sdc_table[] = {
+    MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 10),
+    MONARCO_SDC_ITEM_READ(FWVERL),
+    MONARCO_SDC_ITEM_READ(RS485BAUD),
+    MONARCO_SDC_ITEM_WRITE(WDTIMEOUT, 100),
+};
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    monarco_tagdb_t db;
+    int hats = 4;
+    int cycles = 10000;
+    int poll_ids[POLL_COUNT];
+    double values[POLL_COUNT];
+    int opt, h, c, i;
+
+    while ((opt = getopt(argc, argv, "H:n:h")) != -1) {
+        switch (opt) {
+        case 'H': hats = atoi(optarg); break;
+        case 'n': cycles = atoi(optarg); break;
+        default: printf("Usage: %s [-H hats] [-n cycles]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((hats < 1) || (hats > HATS_MAX) || (cycles < 1)) {
+        printf("Usage: %s [-H hats] [-n cycles]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) tag database demo v1.4\n\n");
+
+    if (monarco_tagdb_init(&db, app_tags, sizeof(app_tags) / sizeof(app_tags[0])) != 0) {
+        printf("Failed to build tag database\n");
+        return -1;
+    }
+
+    printf("Tags: %i, hash slots: %u, buckets: %u, seed: %u\n", db.count, db.mask + 1, db.buckets, db.seed);
+
+    for (h = 0; h < hats; h++) {
+        monarco_sim_init(&sim[h]);
+        sim[h].ain1 = 1000 + h * 500;
+        sim[h].cnt1 = h;
+        monarco_init_transfer(&cxt[h], monarco_sim_transfer, &sim[h], NULL);
+        monarco_sdc_load(&cxt[h], sdc_table, sizeof(sdc_table) / sizeof(sdc_table[0]));
+    }
+
+    // all HATs have the same SDC Items
+    monarco_tagdb_bind(&db, &cxt[0]);
+
+    /* Resolve names once, measure lookup time */
+
+    int64_t t0 = now_ns();
+    int rounds = 100000 / POLL_COUNT;
+    for (i = 0; i < rounds; i++) {
+        if (monarco_tag_resolve(&db, poll_names, POLL_COUNT, poll_ids) != 0) {
+            printf("Unknown tag name\n");
+            return -1;
+        }
+    }
+    int64_t t_resolve = now_ns() - t0;
+
+    int write_ids[3] = { monarco_tag_find(&db, "PUMP_RUN"), monarco_tag_find(&db, "AOUT1"), monarco_tag_find(&db, "LEDMASK") };
+
+    /* Cyclic operation - write some outputs by name, poll all tags of all HATs */
+
+    int64_t t_read = 0, t_write = 0;
+    int failed = 0;
+
+    for (c = 0; c < cycles; c++) {
+        for (h = 0; h < hats; h++) {
+            double out[3] = { (c / 100 + h) & 1, 2.5 + h, 0xFF };
+
+            t0 = now_ns();
+            failed += monarco_tag_write(&db, &cxt[h], write_ids, 3, out);
+            t_write += now_ns() - t0;
+
+            monarco_main(&cxt[h]);
+
+            t0 = now_ns();
+            monarco_tag_read(&db, &cxt[h], poll_ids, POLL_COUNT, values);
+            t_read += now_ns() - t0;
+        }
+    }
+
+    /* Print last values */
+
+    printf("\n%-12s", "tag");
+    for (h = 0; h < hats; h++) {
+        printf(" %10s%i", "HAT", h);
+    }
+    printf("\n");
+
+    for (i = 0; i < POLL_COUNT; i++) {
+        printf("%-12s", poll_names[i]);
+        for (h = 0; h < hats; h++) {
+            monarco_tag_read(&db, &cxt[h], &poll_ids[i], 1, &values[i]);
+            printf(" %11.3f", values[i]);
+        }
+        printf("\n");
+    }
+
+    printf("\nName lookup: %.1f ns/tag\n", (double)t_resolve / (rounds * POLL_COUNT));
+    printf("Bulk read: %.1f ns/tag (%i tags x %i HATs per cycle: %.2f us)\n",
+        (double)t_read / ((int64_t)cycles * hats * POLL_COUNT), POLL_COUNT, hats, (double)t_read / cycles / 1000.0);
+    printf("Bulk write: %.1f ns/tag, failed writes: %i\n", (double)t_write / ((int64_t)cycles * hats * 3), failed);
+
+    for (h = 0; h < hats; h++) {
+        monarco_exit(&cxt[h]);
+    }
+    monarco_tagdb_exit(&db);
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/***************************************************************************//**
+ * @file main-warm-start-bench.c
+ * @brief libmonarco - Warm-start Snapshot Benchmark
+ *
+ * This tool measures restart-to-first-good-cycle time: the number of cycles
+ * until all one-shot SDC Items (identity reads and config writes, the same
+ * table as the 'complex' example) are done. The simulated HAT keeps running
+ * between restarts of the driver context, as a real HAT keeps running
+ * while the application process restarts.
+ *
+ * Scenarios: cold start (snapshot is saved), warm restart, warm restart
+ * with changed configuration, HAT power cycle and a different HAT. Then
+ * a table configuring write-only registers only (no sentinel to detect
+ * a power cycle) is started cold and after a HAT power cycle.
+ *
+ * Usage: monarco-warm-start-bench [-f snapshot_file]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "src/monarco.h"
+#include "src/monarco_warm.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error debug prints for monarco_platform.h */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR;
+
+#define MAX_CYCLES 1000
+
+enum {
+    SDC_STATUS,
+    SDC_FW_VER_LO, SDC_FW_VER_HI,
+    SDC_HW_VER_LO, SDC_HW_VER_HI,
+    SDC_MCU_ID_1, SDC_MCU_ID_2, SDC_MCU_ID_3, SDC_MCU_ID_4,
+    SDC_CONFIG1,
+    SDC_RS485_BAUD, SDC_RS485_MODE,
+    SDC_CNT1_MODE, SDC_CNT2_MODE,
+    SDC_COUNT
+};
+
+static const monarco_sdc_item_t sdc_table[SDC_COUNT] = {
+    [SDC_STATUS] = MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
+    [SDC_FW_VER_LO] = MONARCO_SDC_ITEM_READ(FWVERL),
+    [SDC_FW_VER_HI] = MONARCO_SDC_ITEM_READ(FWVERH),
+    [SDC_HW_VER_LO] = MONARCO_SDC_ITEM_READ(HWVERL),
+    [SDC_HW_VER_HI] = MONARCO_SDC_ITEM_READ(HWVERH),
+    [SDC_MCU_ID_1] = MONARCO_SDC_ITEM_READ(MCUID1),
+    [SDC_MCU_ID_2] = MONARCO_SDC_ITEM_READ(MCUID2),
+    [SDC_MCU_ID_3] = MONARCO_SDC_ITEM_READ(MCUID3),
+    [SDC_MCU_ID_4] = MONARCO_SDC_ITEM_READ(MCUID4),
+    [SDC_CONFIG1] = MONARCO_SDC_ITEM_WRITE(HWCONFIG1, MONARCO_SDC_CONFIG1_RS485TERM | MONARCO_SDC_CONFIG1_AI1V | MONARCO_SDC_CONFIG1_AI2V),
+    [SDC_RS485_BAUD] = MONARCO_SDC_ITEM_WRITE(RS485BAUD, 384),
+    [SDC_RS485_MODE] = MONARCO_SDC_ITEM_WRITE(RS485MODE, MONARCO_SDC_RS485_DEFAULT_MODE),
+    [SDC_CNT1_MODE] = MONARCO_SDC_ITEM_WRITE(CNT1CFG, MONARCO_SDC_COUNTER_MODE_PCNT | MONARCO_SDC_COUNTER_EDGE_BOTH),
+    [SDC_CNT2_MODE] = MONARCO_SDC_ITEM_WRITE(CNT2CFG, MONARCO_SDC_COUNTER_MODE_QUAD),
+};
+
+/* Identity reads and write-only counter configuration only, no readable register for the sentinel */
+#define SDC_WO_COUNT (SDC_CONFIG1 + 2)
+
+static const monarco_sdc_item_t sdc_table_wo[SDC_WO_COUNT] = {
+    [SDC_STATUS] = MONARCO_SDC_ITEM_READ_PERIODIC(STATUS, 1),
+    [SDC_FW_VER_LO] = MONARCO_SDC_ITEM_READ(FWVERL),
+    [SDC_FW_VER_HI] = MONARCO_SDC_ITEM_READ(FWVERH),
+    [SDC_HW_VER_LO] = MONARCO_SDC_ITEM_READ(HWVERL),
+    [SDC_HW_VER_HI] = MONARCO_SDC_ITEM_READ(HWVERH),
+    [SDC_MCU_ID_1] = MONARCO_SDC_ITEM_READ(MCUID1),
+    [SDC_MCU_ID_2] = MONARCO_SDC_ITEM_READ(MCUID2),
+    [SDC_MCU_ID_3] = MONARCO_SDC_ITEM_READ(MCUID3),
+    [SDC_MCU_ID_4] = MONARCO_SDC_ITEM_READ(MCUID4),
+    [SDC_CONFIG1] = MONARCO_SDC_ITEM_WRITE(CNT1CFG, MONARCO_SDC_COUNTER_MODE_PCNT | MONARCO_SDC_COUNTER_EDGE_BOTH),
+    [SDC_CONFIG1 + 1] = MONARCO_SDC_ITEM_WRITE(CNT2CFG, MONARCO_SDC_COUNTER_MODE_QUAD),
+};
+
+static const char *warm_state_str[] = { "cold", "pending", "hit", "miss" };
+
+static monarco_sim_t sim;
+
+/* One driver lifetime - start with Items `table`, run until configured, save snapshot; returns cycles to the
+ * first good cycle. `rs485_baud` replaces the RS485BAUD value of `sdc_table`, 0 = `table` without RS485BAUD.
+ */
+static int run_start(const char *name, const char *path, const monarco_sdc_item_t *table, int count, uint16_t rs485_baud)
+{
+    monarco_cxt_t cxt;
+    monarco_warm_t warm;
+    int cycles, i;
+
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_init(&cxt, count + MONARCO_WARM_CHECK_ITEMS);
+    monarco_sdc_load(&cxt, table, count);
+    if (rs485_baud) {
+        monarco_sdc_write(&cxt, SDC_RS485_BAUD, rs485_baud);
+    }
+
+    monarco_warm_start(&warm, &cxt, path);
+
+    uint32_t reads = sim.sdc_reads, writes = sim.sdc_writes;
+
+    for (cycles = 1; cycles <= MAX_CYCLES; cycles++) {
+        monarco_main(&cxt);
+
+        if (monarco_warm_poll(&warm) == MONARCO_WARM_PENDING) {
+            continue;
+        }
+
+        for (i = 0; i < cxt.sdc_size; i++) {
+            if (!monarco_sdc_done(&cxt, i) || monarco_sdc_error(&cxt, i)) {
+                break;
+            }
+        }
+        if (i == cxt.sdc_size) {
+            break;
+        }
+    }
+
+    printf("%-22s %-6s %6i %6i %8u %8u   MCUID=%04X%04X%04X%04X\n", name, warm_state_str[warm.state], warm.held, cycles,
+        sim.sdc_reads - reads, sim.sdc_writes - writes,
+        monarco_sdc_value(&cxt, SDC_MCU_ID_4), monarco_sdc_value(&cxt, SDC_MCU_ID_3),
+        monarco_sdc_value(&cxt, SDC_MCU_ID_2), monarco_sdc_value(&cxt, SDC_MCU_ID_1));
+
+    if ((rs485_baud && (sim.regs[MONARCO_SDC_REG_RS485BAUD] != rs485_baud))
+            || (sim.regs[MONARCO_SDC_REG_CNT1CFG] != (MONARCO_SDC_COUNTER_MODE_PCNT | MONARCO_SDC_COUNTER_EDGE_BOTH))
+            || (sim.regs[MONARCO_SDC_REG_CNT2CFG] != MONARCO_SDC_COUNTER_MODE_QUAD)) {
+        printf("ERROR: HAT configuration not applied\n");
+    }
+
+    monarco_warm_save(&cxt, path);
+    monarco_exit(&cxt);
+
+    return cycles;
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    const char *path = "/tmp/monarco-warm-start.bin";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:h")) != -1) {
+        switch (opt) {
+        case 'f': path = optarg; break;
+        default: printf("Usage: %s [-f snapshot_file]\n", argv[0]); return -1;
+        }
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) warm-start benchmark v1.5\n\n");
+
+    unlink(path);
+    monarco_sim_init(&sim);
+
+    printf("%-22s %-6s %6s %6s %8s %8s\n", "scenario", "warm", "held", "cycles", "SDC rd", "SDC wr");
+
+    int cold = run_start("cold start", path, sdc_table, SDC_COUNT, 384);
+    int warm = run_start("restart", path, sdc_table, SDC_COUNT, 384);
+    run_start("restart, new baudrate", path, sdc_table, SDC_COUNT, 192);
+
+    monarco_sim_init(&sim);
+    run_start("HAT power cycle", path, sdc_table, SDC_COUNT, 192);
+
+    sim.regs[MONARCO_SDC_REG_MCUID1] ^= 0x1234;
+    run_start("different HAT", path, sdc_table, SDC_COUNT, 192);
+
+    unlink(path);
+    monarco_sim_init(&sim);
+    run_start("cold, write-only cfg", path, sdc_table_wo, SDC_WO_COUNT, 0);
+    run_start("restart, no sentinel", path, sdc_table_wo, SDC_WO_COUNT, 0);
+
+    monarco_sim_init(&sim);
+    run_start("power cycle, no sent.", path, sdc_table_wo, SDC_WO_COUNT, 0);
+
+    printf("\nRestart-to-first-good-cycle: %i cycles cold, %i cycles warm (%.0f %% less)\n", cold, warm, 100.0 * (cold - warm) / cold);
+
+    unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/***************************************************************************//**
+ * @file main-watchdog-demo.c
+ * @brief libmonarco - Process Data Watchdog Tuning and Safe-State Example
+ *
+ * This example runs a periodic cycle against the simulated HAT, which switches
+ * outputs off on its process data watchdog timeout like the real one. The
+ * application drives DOUT1..DOUT4 on. Every few hundred cycles the host stalls
+ * for 20, 60 or 150 ms in turn.
+ *
+ * The cycle is run twice - with the HAT power-on watchdog timeout (100 ms), and
+ * with `monarco_wdt.h` attached, which programs the timeout from the measured
+ * cycle intervals and sends the safe-state profile (outputs off) after overrun.
+ * Reported is the fault reaction time of each stall - from the last frame before
+ * the stall to outputs off, either by the HAT watchdog or by the safe-state frame.
+ *
+ * Usage: monarco-watchdog-demo [-p period_us] [-n cycles] [-s stall_every]
+ *
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. https://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "src/monarco.h"
+#include "src/monarco_wdt.h"
+#include "src/monarco_sim.h"
+#include "monarco_platform.h"
+
+/* Enable error, warning and info debug prints for monarco_platform.h - tuning and safe state are reported */
+int monarco_platform_dprint_flags = MONARCO_DPF_ERROR | MONARCO_DPF_WARNING | MONARCO_DPF_INFO;
+
+static const int stall_ms[] = { 20, 60, 150 };
+
+static void sleep_until(struct timespec *ts, int64_t add_ns)
+{
+    ts->tv_nsec += add_ns;
+    while (ts->tv_nsec >= 1000000000) {
+        ts->tv_nsec -= 1000000000;
+        ts->tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL);
+}
+
+static void run(const char *name, int tuned, int period_us, int cycles, int stall_every)
+{
+    monarco_cxt_t cxt;
+    monarco_sim_t sim;
+    monarco_wdt_t wdt;
+    int stalls = 0;
+    int i;
+
+    monarco_sim_init(&sim);
+    monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, NULL);
+    monarco_sdc_init(&cxt, 4);
+
+    if (tuned) {
+        monarco_wdt_init(&wdt, &cxt, period_us, NULL);
+        wdt.learn_cycles = stall_every / 2;
+        wdt.recover_cycles = 10;
+    }
+
+    printf("%s:\n", name);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    for (i = 1; i <= cycles; i++) {
+        sleep_until(&ts, period_us * 1000LL);
+
+        cxt.tx_data.dout = 0x0F;
+        monarco_main(&cxt);
+
+        if ((i % stall_every) != 0) {
+            continue;
+        }
+
+        // host stall, e.g. blocked by a swapped-out page or a long handler
+        int ms = stall_ms[stalls++ % 3];
+        uint64_t last_ns = sim.wdt_last_ns;
+        uint32_t trips = sim.wdt_trips;
+
+        sleep_until(&ts, ms * 1000000LL);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        cxt.tx_data.dout = 0x0F;
+        monarco_main(&cxt);
+
+        if (sim.wdt_trips != trips) {
+            printf("  stall %3i ms: outputs off by HAT watchdog after %6.1f ms\n", ms, (sim.wdt_trip_ns - last_ns) / 1e6);
+        }
+        else if (sim.outputs.dout == 0) {
+            printf("  stall %3i ms: outputs off by safe-state frame after %6.1f ms\n", ms, (sim.wdt_last_ns - last_ns) / 1e6);
+        }
+        else {
+            printf("  stall %3i ms: outputs kept for %6.1f ms, then driven from stale state\n", ms, (sim.wdt_last_ns - last_ns) / 1e6);
+        }
+    }
+
+    printf("  WDTIMEOUT %u ms", sim.regs[MONARCO_SDC_REG_WDTIMEOUT]);
+    if (tuned) {
+        printf(" (longest of %u intervals %.2f ms), overruns %u, safe-state frames %u",
+            wdt.measured, wdt.max_interval_ns / 1e6, wdt.overruns, wdt.safe_cycles);
+        monarco_wdt_exit(&cxt);
+    }
+    printf("\n\n");
+
+    monarco_exit(&cxt);
+}
+
+/*
+ * Application Main
+ */
+int main(int argc, char *argv[])
+{
+    int period_us = 5000;
+    int cycles = 1200;
+    int stall_every = 200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:s:h")) != -1) {
+        switch (opt) {
+        case 'p': period_us = atoi(optarg); break;
+        case 'n': cycles = atoi(optarg); break;
+        case 's': stall_every = atoi(optarg); break;
+        default: printf("Usage: %s [-p period_us] [-n cycles] [-s stall_every]\n", argv[0]); return -1;
+        }
+    }
+
+    if ((period_us <= 0) || (cycles <= 0) || (stall_every < 20)) {
+        printf("Usage: %s [-p period_us] [-n cycles] [-s stall_every]\n", argv[0]);
+        return -1;
+    }
+
+    printf("\n### Monarco HAT C library (libmonarco) watchdog demo v1.4\n\n");
+
+    run("HAT power-on watchdog", 0, period_us, cycles, stall_every);
+    run("tuned watchdog and safe state", 1, period_us, cycles, stall_every);
+
+    return 0;
+}
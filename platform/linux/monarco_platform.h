@@ -39,9 +39,17 @@
 
 extern int monarco_platform_dprint_flags;
 
+#ifdef MONARCO_NO_DPRINT
+/* Debug prints compiled out (e.g. `make DPRINT=0`), no runtime flags check in the cycle */
+#define MONARCO_DPRINT(flags, fmtstr, ...) do { (void)cxt; } while (0)
+#else
+/* Prints of flags in `cxt->dprint_shed` are suppressed and counted under load shedding, see monarco_shed.h */
 #define MONARCO_DPRINT(flags, fmtstr, ...) do { \
-    if ((flags) & monarco_platform_dprint_flags) \
+    if (((flags) & monarco_platform_dprint_flags) && ((flags) & cxt->dprint_shed)) \
+        cxt->stats.shed_prints++; \
+    else if ((flags) & monarco_platform_dprint_flags) \
         printf("%s[%s] " fmtstr, cxt->platform == NULL ? "" : (char *)(cxt->platform), MONARCO_DPF_TO_STR(flags), ##__VA_ARGS__); \
     } while (0)
+#endif
 
 #endif
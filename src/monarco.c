@@ -16,6 +16,7 @@
 #include <limits.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -24,22 +25,69 @@
 
 #include "monarco_crc.h"
 #include "monarco_util.h"
+#include "monarco_trace.h"
+#include "monarco_cmdq.h"
+#include "monarco_ctrl.h"
+#include "monarco_modbus.h"
+#include "monarco_cache.h"
+#include "monarco_clock.h"
+#include "monarco_wdt.h"
+#include "monarco_shed.h"
+#include "monarco_metrics.h"
+#include "monarco_rate.h"
+#include "monarco_block.h"
 #include "monarco_platform.h"
 
+/* Persistent SPI transaction structures, `transfer[i]` receives into `rx_buf[i]` */
+struct monarco_spi_s {
+    struct spi_ioc_transfer transfer[3];
+};
 
-int monarco_init(monarco_cxt_t *cxt, const char *spi_device, uint32_t spi_clkfreq, void *platform)
+/* Initialize data structures of the context */
+static void monarco_init_data(monarco_cxt_t *cxt, void *platform)
 {
     cxt->platform = platform;
 
-    /* Initialize data structures */
-
-    memset(&cxt->sdc_items, 0, sizeof(cxt->sdc_items));
     memset(&cxt->tx_data, 0, sizeof(monarco_struct_tx_t));
-    memset(&cxt->rx_data, 0, sizeof(monarco_struct_rx_t));
+    memset(cxt->rx_buf, 0, sizeof(cxt->rx_buf));
+    cxt->rx_data = &cxt->rx_buf[0];
+    cxt->rx_prev = &cxt->rx_buf[1];
+    cxt->rx_next = 2;
 
     cxt->sdc_size = 0;
+    cxt->sdc_capacity = 0;
     cxt->sdc_idx = 0;
+    cxt->sdc_sched = NULL;
+    cxt->sdc_address = NULL;
+    cxt->sdc_value = NULL;
+    cxt->sdc_pipe = -1;
     cxt->err_throttle_crc = 0;
+    memset(&cxt->stats, 0, sizeof(monarco_stats_t));
+    cxt->spi_fd = -1;
+    cxt->transfer = NULL;
+    cxt->transfer_arg = NULL;
+    cxt->trace = NULL;
+    cxt->cmdq = NULL;
+    cxt->ctrl_loops = NULL;
+    cxt->ctrl_count = 0;
+    cxt->modbus = NULL;
+    cxt->cache = NULL;
+    cxt->spi = NULL;
+    cxt->clock = NULL;
+    cxt->wdt = NULL;
+    cxt->shed = NULL;
+    cxt->shed_sdc_factor = 0;
+    cxt->dprint_shed = 0;
+    cxt->metrics = NULL;
+    cxt->rate = NULL;
+    cxt->blocks = NULL;
+}
+
+int monarco_init(monarco_cxt_t *cxt, const char *spi_device, uint32_t spi_clkfreq, void *platform)
+{
+    /* Initialize data structures */
+
+    monarco_init_data(cxt, platform);
 
     /* Open SPI device */
 
@@ -67,13 +115,164 @@ int monarco_init(monarco_cxt_t *cxt, const char *spi_device, uint32_t spi_clkfre
         return -4;
     }
 
+    /* Prepare SPI transaction structures once, one per RX buffer */
+
+    if ((cxt->spi = calloc(1, sizeof(struct monarco_spi_s))) == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_init: Failed to allocate SPI transfers\n");
+        close(cxt->spi_fd);
+        cxt->spi_fd = -1;
+        return -5;
+    }
+
+    int i;
+    for (i = 0; i < 3; i++) {
+        cxt->spi->transfer[i].tx_buf = (unsigned long)&(cxt->tx_data);
+        cxt->spi->transfer[i].rx_buf = (unsigned long)&(cxt->rx_buf[i]);
+        cxt->spi->transfer[i].len = MONARCO_STRUCT_SIZE;
+        cxt->spi->transfer[i].delay_usecs = 0;
+        cxt->spi->transfer[i].speed_hz = 0;
+        cxt->spi->transfer[i].bits_per_word = 8;
+    }
+
     MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_init: OK\n");
 
     return 0;
 }
 
+int monarco_init_transfer(monarco_cxt_t *cxt, monarco_transfer_fn_t transfer, void *transfer_arg, void *platform)
+{
+    monarco_init_data(cxt, platform);
+
+    if (transfer == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_init_transfer: No transfer function\n");
+        return -1;
+    }
+
+    cxt->transfer = transfer;
+    cxt->transfer_arg = transfer_arg;
+
+    MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_init_transfer: OK\n");
+
+    return 0;
+}
+
+int monarco_sdc_init(monarco_cxt_t *cxt, int capacity)
+{
+    if ((capacity < 0) || (capacity > MONARCO_SDC_ITEMS_SIZE)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_init: Invalid SDC items capacity %i\n", capacity);
+        return -1;
+    }
+
+    free(cxt->sdc_sched);
+
+    cxt->sdc_size = 0;
+    cxt->sdc_capacity = 0;
+    cxt->sdc_idx = 0;
+    cxt->sdc_pipe = -1;
+    cxt->sdc_sched = NULL;
+    cxt->sdc_address = NULL;
+    cxt->sdc_value = NULL;
+    cxt->blocks = NULL;
+
+    if (capacity == 0) {
+        return 0;
+    }
+
+    /* Single block - hot scheduling state first, cold addresses and values after it */
+    char *mem = calloc(capacity, sizeof(monarco_sdc_sched_t) + 2 * sizeof(uint16_t));
+    if (mem == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_init: Failed to allocate %i SDC items\n", capacity);
+        return -1;
+    }
+
+    cxt->sdc_sched = (monarco_sdc_sched_t *)mem;
+    cxt->sdc_address = (uint16_t *)(mem + capacity * sizeof(monarco_sdc_sched_t));
+    cxt->sdc_value = cxt->sdc_address + capacity;
+    cxt->sdc_capacity = capacity;
+
+    return 0;
+}
+
+/* Check SDC Item against the register map */
+static int monarco_sdc_check(monarco_cxt_t *cxt, const monarco_sdc_item_t *item, int idx)
+{
+    const monarco_sdc_reg_info_t *reg = monarco_sdc_reg_info(item->address);
+
+    if (reg == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_check: SDC item %i ADDR=0x%03X unknown register\n", idx, item->address);
+        return -1;
+    }
+    if (!(reg->access & (item->write ? MONARCO_SDC_ACCESS_W : MONARCO_SDC_ACCESS_R))) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_check: SDC item %i %s is not %s\n", idx, reg->name, item->write ? "writable" : "readable");
+        return -1;
+    }
+    if (item->write && ((item->value < reg->min) || (item->value > reg->max))) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_check: SDC item %i %s value %u out of range\n", idx, reg->name, item->value);
+        return -1;
+    }
+    if ((item->factor < 0) || (item->factor > UINT16_MAX)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_check: SDC item %i %s invalid factor %i\n", idx, reg->name, item->factor);
+        return -1;
+    }
+
+    return 0;
+}
+
+int monarco_sdc_add(monarco_cxt_t *cxt, const monarco_sdc_item_t *item)
+{
+    int idx = cxt->sdc_size;
+
+    if (idx >= cxt->sdc_capacity) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_add: SDC items storage full (%i)\n", cxt->sdc_capacity);
+        return -1;
+    }
+
+    if (monarco_sdc_check(cxt, item, idx) != 0) {
+        return -1;
+    }
+
+    cxt->sdc_sched[idx].factor = item->factor;
+    cxt->sdc_sched[idx].counter = 0;
+    cxt->sdc_sched[idx].busy = 0;
+    cxt->sdc_sched[idx].flags = (item->write ? MONARCO_SDC_F_WRITE : 0) | (item->request ? MONARCO_SDC_F_REQUEST : 0);
+    cxt->sdc_address[idx] = item->address;
+    cxt->sdc_value[idx] = item->value;
+
+    cxt->sdc_size++;
+
+    return idx;
+}
+
+int monarco_sdc_load(monarco_cxt_t *cxt, const monarco_sdc_item_t *items, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (monarco_sdc_check(cxt, &items[i], i) != 0) {
+            return -1;
+        }
+    }
+
+    if (cxt->sdc_capacity < count) {
+        if (monarco_sdc_init(cxt, count) != 0) {
+            return -1;
+        }
+    }
+
+    cxt->sdc_size = 0;
+    cxt->sdc_idx = 0;
+    cxt->sdc_pipe = -1;
+    cxt->blocks = NULL;
+
+    for (i = 0; i < count; i++) {
+        monarco_sdc_add(cxt, &items[i]);
+    }
+
+    return 0;
+}
+
 /* Send Service Data Channel (SDC) request
- *   Invoked at each monarco_main(), scan over cxt->sdc_items and process the active ones.
+ *   Invoked at each monarco_main(), scan over SDC Items scheduling state and process the active ones.
  */
 static void monarco_sdc_tx(monarco_cxt_t *cxt)
 {
@@ -83,39 +282,93 @@ static void monarco_sdc_tx(monarco_cxt_t *cxt)
         return;
     }
 
-    monarco_sdc_item_t *item;
+    monarco_sdc_sched_t *sched;
+
+    // response preceding the Item sent ahead was missed, the Item is requested again in order
+    if (cxt->sdc_pipe >= 0) {
+        cxt->sdc_sched[cxt->sdc_pipe].busy = 0;
+        cxt->sdc_sched[cxt->sdc_pipe].flags |= MONARCO_SDC_F_REQUEST;
+        cxt->sdc_pipe = -1;
+        cxt->tx_data.sdc_req.value = cxt->sdc_value[cxt->sdc_idx];
+        cxt->tx_data.sdc_req.address = cxt->sdc_address[cxt->sdc_idx];
+        cxt->tx_data.sdc_req.write = (cxt->sdc_sched[cxt->sdc_idx].flags & MONARCO_SDC_F_WRITE) ? 1 : 0;
+    }
 
-    item = &cxt->sdc_items[cxt->sdc_idx];
+    sched = &cxt->sdc_sched[cxt->sdc_idx];
 
     /* Wait for response to previous request */
 
     // FIXME: do not send each request two times (oportunistic tx strategy) - can be problem especially as duplicate writes!
-    if (item->busy > 0) {
-        if (item->busy < INT_MAX) {
-            item->busy++;
+    if (sched->busy > 0) {
+        if (sched->busy < UINT8_MAX) {
+            sched->busy++;
         }
-        if (item->busy == 10) {
+
+        // block read - the response is due in this frame, send the next register of the block ahead instead of resending
+        if ((sched->busy == 2) && (sched->flags & MONARCO_SDC_F_CHAIN) && (cxt->sdc_idx + 1 < cxt->sdc_size)) {
+            monarco_sdc_sched_t *next = &cxt->sdc_sched[cxt->sdc_idx + 1];
+
+            if ((next->flags & MONARCO_SDC_F_REQUEST) && (next->busy == 0)) {
+                cxt->sdc_pipe = cxt->sdc_idx + 1;
+                cxt->tx_data.sdc_req.value = cxt->sdc_value[cxt->sdc_pipe];
+                cxt->tx_data.sdc_req.address = cxt->sdc_address[cxt->sdc_pipe];
+                cxt->tx_data.sdc_req.write = 0;
+
+                next->busy = 1;
+                next->flags &= ~MONARCO_SDC_F_REQUEST;
+
+                cxt->stats.sdc_requests++;
+                if (cxt->metrics != NULL) {
+                    monarco_metrics_sdc(cxt, cxt->sdc_address[cxt->sdc_pipe])->requests++;
+                }
+                return;
+            }
+        }
+
+        cxt->stats.sdc_resends++;
+        if (cxt->metrics != NULL) {
+            monarco_metrics_sdc(cxt, cxt->sdc_address[cxt->sdc_idx])->retries++;
+        }
+        if (sched->busy == MONARCO_SDC_TIMEOUT_CYCLES) {
+            cxt->stats.sdc_timeouts++;
+            if (cxt->metrics != NULL) {
+                monarco_metrics_sdc(cxt, cxt->sdc_address[cxt->sdc_idx])->timeouts++;
+            }
             MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_tx: SDC item %i %c ADDR=0x%03X timeout\n",
-                    cxt->sdc_idx, item->write ? 'W' : 'R', item->address);
+                    cxt->sdc_idx, (sched->flags & MONARCO_SDC_F_WRITE) ? 'W' : 'R', cxt->sdc_address[cxt->sdc_idx]);
         }
         return;
     }
 
-    /* Iterate over cxt->sdc_items, check for request trigger events */
+    /* Iterate over hot scheduling state, check for request trigger events */
+
+    MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_SDC_SCAN);
 
     while (1) {
+        sched = &cxt->sdc_sched[cxt->sdc_idx];
+
         // Cyclic trigger each factor-th cycle
-        if (cxt->sdc_items[cxt->sdc_idx].factor > 0) {
-            cxt->sdc_items[cxt->sdc_idx].counter++;
-            if(cxt->sdc_items[cxt->sdc_idx].counter == cxt->sdc_items[cxt->sdc_idx].factor) {
-                cxt->sdc_items[cxt->sdc_idx].counter = 0;
-                break;
+        if (sched->factor > 0) {
+            sched->counter++;
+            if ((sched->counter >= sched->factor) && cxt->shed_sdc_factor && (sched->factor >= cxt->shed_sdc_factor)) {
+                // low-priority Item deferred by load shedding, triggers in the first scan after restore
+                sched->counter = sched->factor - 1;
+                cxt->stats.shed_sdc++;
+            }
+            else if (sched->counter >= sched->factor) {
+                sched->counter = 0;
+                // refresh of cached register nobody reads is skipped
+                if ((cxt->cache == NULL) || monarco_cache_due(cxt, cxt->sdc_idx)) {
+                    break;
+                }
             }
         }
 
-        // Explicit trigger
-        if(cxt->sdc_items[cxt->sdc_idx].request != 0) {
-            break;
+        // Explicit trigger, completed from cache if possible
+        if (sched->flags & MONARCO_SDC_F_REQUEST) {
+            if ((cxt->cache == NULL) || (sched->flags & MONARCO_SDC_F_BLOCK) || !monarco_cache_hit(cxt, cxt->sdc_idx)) {
+                break;
+            }
         }
 
         // Move to next Item
@@ -126,25 +379,31 @@ static void monarco_sdc_tx(monarco_cxt_t *cxt)
 
         // Wrap-over detection
         if (cxt->sdc_idx == idx_last) {
+            MONARCO_TRACE_END(cxt, MONARCO_TRACE_SDC_SCAN, cxt->sdc_size);
             MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_sdc_tx: No SDC request in this cycle\n");
             return;
         }
     }
 
-    /* Fill Item into cxt->tx_data.sdc_req */
+    MONARCO_TRACE_END(cxt, MONARCO_TRACE_SDC_SCAN, (cxt->sdc_idx - idx_last + cxt->sdc_size) % cxt->sdc_size + 1);
 
-    item = &cxt->sdc_items[cxt->sdc_idx];
+    /* Fill Item into cxt->tx_data.sdc_req */
 
-    cxt->tx_data.sdc_req.value = item->value;
-    cxt->tx_data.sdc_req.address = item->address;
-    cxt->tx_data.sdc_req.write = item->write;
+    cxt->tx_data.sdc_req.value = cxt->sdc_value[cxt->sdc_idx];
+    cxt->tx_data.sdc_req.address = cxt->sdc_address[cxt->sdc_idx];
+    cxt->tx_data.sdc_req.write = (sched->flags & MONARCO_SDC_F_WRITE) ? 1 : 0;
     cxt->tx_data.sdc_req.error = 0;
     cxt->tx_data.sdc_req.reserved = 0;
 
-    item->busy = 1;
-    item->request = 0;
+    sched->busy = 1;
+    sched->flags &= ~MONARCO_SDC_F_REQUEST;
+
+    cxt->stats.sdc_requests++;
+    if (cxt->metrics != NULL) {
+        monarco_metrics_sdc(cxt, cxt->tx_data.sdc_req.address)->requests++;
+    }
 
-    // printf("SDC_TX[%2i]: 0x%03X = W%X E%X 0x%04X\n", cxt->sdc_idx, item->address, item->write, item->error, item->value);
+    // printf("SDC_TX[%2i]: 0x%03X = F%02X 0x%04X\n", cxt->sdc_idx, cxt->sdc_address[cxt->sdc_idx], sched->flags, cxt->sdc_value[cxt->sdc_idx]);
 }
 
 /* Receive Service Data Channel (SDC) response
@@ -155,80 +414,162 @@ static void monarco_sdc_rx(monarco_cxt_t *cxt)
         return;
     }
 
-    monarco_sdc_item_t *item = &cxt->sdc_items[cxt->sdc_idx];
+    monarco_sdc_sched_t *sched = &cxt->sdc_sched[cxt->sdc_idx];
+    uint16_t address = cxt->sdc_address[cxt->sdc_idx];
+    int write = (sched->flags & MONARCO_SDC_F_WRITE) ? 1 : 0;
 
-    if ((cxt->rx_data.sdc_resp.address != item->address) || (cxt->rx_data.sdc_resp.write != item->write)) {
+    if ((cxt->rx_data->sdc_resp.address != address) || (cxt->rx_data->sdc_resp.write != write)) {
         return;
     }
 
-    if ((cxt->rx_data.sdc_resp.write == 1) && (cxt->rx_data.sdc_resp.error == 0) && (cxt->rx_data.sdc_resp.value != item->value)) {
+    if ((cxt->rx_data->sdc_resp.write == 1) && (cxt->rx_data->sdc_resp.error == 0) && (cxt->rx_data->sdc_resp.value != cxt->sdc_value[cxt->sdc_idx])) {
         return;
     }
 
-    if (cxt->rx_data.sdc_resp.error && (!item->error || (item->value != cxt->rx_data.sdc_resp.value))) {
+    if (cxt->rx_data->sdc_resp.error && (!(sched->flags & MONARCO_SDC_F_ERROR) || (cxt->sdc_value[cxt->sdc_idx] != cxt->rx_data->sdc_resp.value))) {
         MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_sdc_rx: SDC item %i %c ADDR=0x%03X ERROR=0x%04X\n",
-                cxt->sdc_idx, item->write ? 'W' : 'R', item->address, cxt->rx_data.sdc_resp.value);
+                cxt->sdc_idx, write ? 'W' : 'R', address, cxt->rx_data->sdc_resp.value);
     }
 
-    item->busy = 0;
-    item->done = 1;
+    sched->busy = 0;
+    sched->flags = (sched->flags & ~MONARCO_SDC_F_ERROR) | MONARCO_SDC_F_DONE | (cxt->rx_data->sdc_resp.error ? MONARCO_SDC_F_ERROR : 0);
+
+    cxt->sdc_value[cxt->sdc_idx] = cxt->rx_data->sdc_resp.value;
+
+    if (cxt->cache != NULL) {
+        monarco_cache_update(cxt, cxt->sdc_idx, cxt->rx_data->sdc_resp.error);
+    }
 
-    item->value = cxt->rx_data.sdc_resp.value;
-    item->error = cxt->rx_data.sdc_resp.error;
+    cxt->stats.sdc_done++;
+    if (cxt->rx_data->sdc_resp.error) {
+        cxt->stats.sdc_errors++;
+    }
+    if (cxt->metrics != NULL) {
+        monarco_metrics_sdc_t *m = monarco_metrics_sdc(cxt, address);
+        m->done++;
+        m->errors += cxt->rx_data->sdc_resp.error ? 1 : 0;
+    }
 
-    // Move to next Item
+    // Move to next Item, the one sent ahead is waiting for response now
     cxt->sdc_idx++;
     if (cxt->sdc_idx == cxt->sdc_size) {
         cxt->sdc_idx = 0;
     }
+    cxt->sdc_pipe = -1;
 
-    // printf("SDC_RX[%2i]: 0x%03X = W%X E%X 0x%04X\n", cxt->sdc_idx, item->address, item->write, item->error, item->value);
+    // printf("SDC_RX[%2i]: 0x%03X = F%02X 0x%04X\n", cxt->sdc_idx, address, sched->flags, cxt->sdc_value[cxt->sdc_idx]);
 }
 
-int monarco_main(monarco_cxt_t *cxt)
+/* One cycle of monarco_main(), traced as a whole by the caller
+ *   `sdc` is a constant in each caller, so the SDC and block branches are compiled out of the PDC variant.
+ *   Optional hooks are tested at runtime in both variants, they keep working after switching to monarco_main_pdc().
+ */
+static inline __attribute__((always_inline)) int monarco_main_cycle(monarco_cxt_t *cxt, const int sdc)
 {
-    monarco_struct_rx_t rx_data;
+    monarco_struct_rx_t *rx = &cxt->rx_buf[cxt->rx_next];
+    monarco_struct_tx_t *tx = &cxt->tx_data;
 
-    if (cxt->spi_fd <= 0) {
+    if ((cxt->spi_fd <= 0) && (cxt->transfer == NULL)) {
         MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_main: SPI not open, exiting\n");
         return -1;
     }
 
+    // one cycle-start timestamp for all hooks measuring the cycle
+    if ((cxt->wdt != NULL) || (cxt->shed != NULL) || (cxt->metrics != NULL) || (cxt->rate != NULL)) {
+        cxt->cycle_ns = monarco_now_ns();
+    }
+
+    // evaluate cycle pressure, defer optional work
+    if (cxt->shed != NULL) {
+        monarco_shed_begin(cxt);
+    }
+
     // prepare SDC request
-    monarco_sdc_tx(cxt);
+    if (sdc) {
+        MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_SDC_TX);
+        monarco_sdc_tx(cxt);
+        MONARCO_TRACE_END(cxt, MONARCO_TRACE_SDC_TX, cxt->sdc_idx);
+    }
+
+    // apply output commands queued by other threads
+    if (cxt->cmdq != NULL) {
+        MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_CMDQ);
+        int cmds = monarco_cmdq_apply(cxt);
+        MONARCO_TRACE_END(cxt, MONARCO_TRACE_CMDQ, cmds);
+    }
+
+    // measure cycle interval, the safe-state frame is sent instead of `tx_data` after overrun
+    if (cxt->wdt != NULL) {
+        tx = monarco_wdt_cycle(cxt);
+    }
 
     // calculate CRC
-    cxt->tx_data.crc = monarco_crc16((const char *)&(cxt->tx_data), MONARCO_STRUCT_SIZE - 2);
-
-    // SPI transaction structure
-    struct spi_ioc_transfer transfer = {
-        .tx_buf = (unsigned long)&(cxt->tx_data),
-        .rx_buf = (unsigned long)&(rx_data),
-        .len = MONARCO_STRUCT_SIZE,
-        .delay_usecs = 0,
-        .speed_hz = 0,
-        .bits_per_word = 8,
-    };
-
-    // perform SPI transaction
-    int rc = ioctl(cxt->spi_fd, SPI_IOC_MESSAGE(1), &transfer);
-
-    if (rc < 1) {
-        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_main: Failed to send SPI message: %i: %s\n", errno, strerror(errno));
-        return -2;
+    MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_CRC_TX);
+    tx->crc = monarco_crc16((const char *)tx, MONARCO_STRUCT_SIZE - 2);
+    MONARCO_TRACE_END(cxt, MONARCO_TRACE_CRC_TX, 0);
+
+    MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_TRANSFER);
+
+    if (cxt->clock != NULL) {
+        monarco_clock_before(cxt);
+    }
+
+    if (cxt->metrics != NULL) {
+        monarco_metrics_before(cxt);
+    }
+
+    if (cxt->transfer != NULL) {
+        // alternative transport
+        if (cxt->transfer(cxt->transfer_arg, tx, rx) < 0) {
+            MONARCO_TRACE_END(cxt, MONARCO_TRACE_TRANSFER, 1);
+            if (cxt->metrics != NULL) {
+                cxt->metrics->transfer_failures++;
+            }
+            MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_main: Failed to transfer frame\n");
+            return -2;
+        }
+    }
+    else {
+        // perform SPI transaction prepared by monarco_init()
+        cxt->spi->transfer[cxt->rx_next].tx_buf = (unsigned long)tx;
+        int rc = ioctl(cxt->spi_fd, SPI_IOC_MESSAGE(1), &cxt->spi->transfer[cxt->rx_next]);
+
+        if (rc < 1) {
+            MONARCO_TRACE_END(cxt, MONARCO_TRACE_TRANSFER, 1);
+            if (cxt->metrics != NULL) {
+                cxt->metrics->transfer_failures++;
+            }
+            MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_main: Failed to send SPI message: %i: %s\n", errno, strerror(errno));
+            return -2;
+        }
     }
 
+    if (cxt->clock != NULL) {
+        monarco_clock_after(cxt);
+    }
+
+    if (cxt->metrics != NULL) {
+        monarco_metrics_after(cxt);
+    }
+
+    MONARCO_TRACE_END(cxt, MONARCO_TRACE_TRANSFER, 0);
+
+    cxt->stats.cycles++;
+
     // monarco_util_dump_tx(&cxt->tx_data);
-    // monarco_util_dump_rx(&cxt->rx_data);
+    // monarco_util_dump_rx(rx);
 
     // check CRC
-    if (rx_data.crc != monarco_crc16((const char *)&(rx_data), MONARCO_STRUCT_SIZE - 2)) {
+    MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_CRC_RX);
+    if (rx->crc != monarco_crc16((const char *)rx, MONARCO_STRUCT_SIZE - 2)) {
+        MONARCO_TRACE_END(cxt, MONARCO_TRACE_CRC_RX, 1);
         if (cxt->err_throttle_crc == 0) {
             MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_main: Invalid RX CRC\n");
         }
         if (cxt->err_throttle_crc < INT_MAX) {
             cxt->err_throttle_crc++;
         }
+        cxt->stats.crc_errors++;
         return -3;
     }
     else if (cxt->err_throttle_crc) {
@@ -236,21 +577,98 @@ int monarco_main(monarco_cxt_t *cxt)
         cxt->err_throttle_crc = 0;
     }
 
-    // copy data only if CRC OK
-    cxt->rx_data = rx_data;
+    // publish frame only if CRC OK - latest becomes previous, the oldest buffer receives the next frame
+    cxt->rx_next = (int)(cxt->rx_prev - cxt->rx_buf);
+    cxt->rx_prev = cxt->rx_data;
+    cxt->rx_data = rx;
+    MONARCO_TRACE_END(cxt, MONARCO_TRACE_CRC_RX, 0);
+
+    if (cxt->clock != NULL) {
+        monarco_clock_update(cxt);
+    }
+
+    // input activity selects the next cycle period
+    if (cxt->rate != NULL) {
+        monarco_rate_update(cxt);
+    }
+
+    // run control loops on fresh inputs, outputs are sent by the next frame
+    if (cxt->ctrl_count > 0) {
+        MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_CTRL);
+        monarco_ctrl_run(cxt);
+        MONARCO_TRACE_END(cxt, MONARCO_TRACE_CTRL, cxt->ctrl_count);
+    }
 
     // process SDC response
-    monarco_sdc_rx(cxt);
+    if (sdc) {
+        MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_SDC_RX);
+        monarco_sdc_rx(cxt);
+        MONARCO_TRACE_END(cxt, MONARCO_TRACE_SDC_RX, cxt->sdc_idx);
+
+        if (cxt->blocks != NULL) {
+            monarco_block_update(cxt);
+        }
+    }
 
     return 0;
 }
 
+int monarco_main(monarco_cxt_t *cxt)
+{
+    MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_MAIN);
+
+    int rc = monarco_main_cycle(cxt, 1);
+
+    // Modbus master runs each cycle, independently of the frame result
+    if (cxt->modbus != NULL) {
+        MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_MODBUS);
+        int finished = monarco_modbus_run(cxt);
+        MONARCO_TRACE_END(cxt, MONARCO_TRACE_MODBUS, finished);
+    }
+
+    // deadline check and optional tasks
+    if (cxt->shed != NULL) {
+        monarco_shed_end(cxt);
+    }
+
+    MONARCO_TRACE_END(cxt, MONARCO_TRACE_MAIN, (uint32_t)-rc);
+
+    return rc;
+}
+
+int monarco_main_pdc(monarco_cxt_t *cxt)
+{
+    MONARCO_TRACE_BEGIN(cxt, MONARCO_TRACE_MAIN);
+
+    int rc = monarco_main_cycle(cxt, 0);
+
+    if (cxt->shed != NULL) {
+        monarco_shed_end(cxt);
+    }
+
+    MONARCO_TRACE_END(cxt, MONARCO_TRACE_MAIN, (uint32_t)-rc);
+
+    return rc;
+}
+
 int monarco_exit(monarco_cxt_t *cxt)
 {
+    // the exporter thread reads the context, stop it first
+    monarco_metrics_exit(cxt);
+
     if (cxt->spi_fd > 0) {
         close(cxt->spi_fd);
     }
 
+    monarco_sdc_init(cxt, 0);
+    monarco_trace_exit(cxt);
+    monarco_cmdq_exit(cxt);
+    monarco_modbus_exit(cxt);
+    monarco_cache_exit(cxt);
+
+    free(cxt->spi);
+    cxt->spi = NULL;
+
     MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_exit: OK\n");
 
     return 0;
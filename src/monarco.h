@@ -14,8 +14,16 @@
 #define LIBMONARCO_H_
 
 #include <stdint.h>
+#include <time.h>
 #include "monarco_struct.h"
+#include "monarco_sdc.h"
 
+/* Number of cycles without SDC response after which the request is reported as timed out */
+#ifndef MONARCO_SDC_TIMEOUT_CYCLES
+#define MONARCO_SDC_TIMEOUT_CYCLES 10
+#endif
+
+/* Maximal capacity of SDC Items storage, see monarco_sdc_init() */
 #ifndef MONARCO_SDC_ITEMS_SIZE
 #define MONARCO_SDC_ITEMS_SIZE 256
 #endif
@@ -26,48 +34,213 @@ extern "C" {
 
 /* Service Data Channel Item Structure
  *   You can define a set of items which can be read/write periodically or one-shot.
+ *   This is a descriptor used for loading items into the context, runtime state of the items is kept
+ *   in the context storage and accessed by monarco_sdc_*() functions using the item index.
  */
 typedef struct {
     uint16_t address; /* Register Address, see MONARCO_SDC_REG_* */
-    uint16_t value; /* Register Value, or Error Code if `.error = 1` */
-    int factor; /* If `factor>0`, this Item is communicated periodically each `factor-th` scan over SDC Items Array */
-    int counter; /* Private, counter for factor cycles */
-    int busy; /* Private, counter of busy cycles after request before response */
+    uint16_t value; /* Register Value to be written, or initial value of Read Item */
+    int factor; /* If `factor>0`, this Item is communicated periodically each `factor-th` scan over SDC Items Array, max 65535 */
     unsigned int write : 1; /* 0 = Read Item, 1 = Write Item */
     unsigned int request : 1; /* 1 = Trigger one-shot action, cleared automatically when request for this Item is sent */
-    unsigned int done : 1; /* 1 = Indication of completion, should be cleared by user with (or before) next trigger */
-    unsigned int error : 1; /* 0 = Success result, 1 = Error result (`value` contains Error Code) */
 } monarco_sdc_item_t;
 
+/* Compile-time checked SDC Item initializers
+ *   Intended for statically initialized constant tables loaded by `monarco_sdc_load()`, `name` is suffix
+ *   of MONARCO_SDC_REG_*. Access rights and value range are checked against MONARCO_SDC_REG_MAP,
+ *   so e.g. a write to a read-only register fails to build. `value` has to be a constant expression.
+ */
+#define MONARCO_SDC_CHECK_(cond) (0 * sizeof(char[(cond) ? 1 : -1]))
+
+#define MONARCO_SDC_ITEM_READ(name) { \
+    .address = MONARCO_SDC_REG_##name + MONARCO_SDC_CHECK_(MONARCO_SDC_ACC_##name & MONARCO_SDC_ACCESS_R), \
+    .request = 1 }
+
+#define MONARCO_SDC_ITEM_READ_PERIODIC(name, fct) { \
+    .address = MONARCO_SDC_REG_##name + MONARCO_SDC_CHECK_(MONARCO_SDC_ACC_##name & MONARCO_SDC_ACCESS_R), \
+    .factor = (fct) + MONARCO_SDC_CHECK_((fct) > 0 && (fct) <= 0xFFFF) }
+
+#define MONARCO_SDC_ITEM_WRITE(name, val) { \
+    .address = MONARCO_SDC_REG_##name + MONARCO_SDC_CHECK_(MONARCO_SDC_ACC_##name & MONARCO_SDC_ACCESS_W), \
+    .value = (val) + MONARCO_SDC_CHECK_((val) >= MONARCO_SDC_MIN_##name && (val) <= MONARCO_SDC_MAX_##name), \
+    .write = 1, \
+    .request = 1 }
+
+/* SDC Item runtime flags, see monarco_sdc_sched_t */
+#define MONARCO_SDC_F_WRITE   0x01 /* 0 = Read Item, 1 = Write Item */
+#define MONARCO_SDC_F_REQUEST 0x02 /* Trigger one-shot action, cleared automatically when request for this Item is sent */
+#define MONARCO_SDC_F_DONE    0x04 /* Indication of completion, cleared by monarco_sdc_request() / monarco_sdc_write() */
+#define MONARCO_SDC_F_ERROR   0x08 /* Error result, value contains Error Code */
+#define MONARCO_SDC_F_BLOCK   0x10 /* Member of a block transaction, never completed from register cache, see monarco_block.h */
+#define MONARCO_SDC_F_CHAIN   0x20 /* Read followed by the next Item of its block, which is sent ahead while waiting for the response */
+
+/* SDC Item scheduling state - hot part of SDC Items storage scanned in each cycle, packed to 6 bytes */
+typedef struct {
+    uint16_t factor; /* Periodic factor, 0 = one-shot only */
+    uint16_t counter; /* Counter for factor cycles */
+    uint8_t busy; /* Counter of busy cycles after request before response, saturated */
+    uint8_t flags; /* MONARCO_SDC_F_* */
+} monarco_sdc_sched_t;
+
+/* Communication Statistics, counters are only incremented by monarco_main() */
+typedef struct {
+    uint32_t cycles; /* Number of monarco_main() calls with transfer */
+    uint32_t crc_errors; /* Frames rejected due to invalid RX CRC */
+    uint32_t sdc_requests; /* SDC requests issued (first transmission) */
+    uint32_t sdc_resends; /* SDC requests re-sent while waiting for response */
+    uint32_t sdc_done; /* SDC transactions completed */
+    uint32_t sdc_errors; /* SDC transactions completed with error result */
+    uint32_t sdc_timeouts; /* SDC requests without response for MONARCO_SDC_TIMEOUT_CYCLES */
+    uint32_t sdc_cached; /* SDC requests completed from register cache without transaction */
+    uint32_t sdc_skipped; /* Periodic SDC reads skipped, cached register not consumed */
+    uint32_t shed_cycles; /* Cycles with load shedding active, see monarco_shed.h */
+    uint32_t shed_sdc; /* Periodic SDC triggers deferred by load shedding */
+    uint32_t shed_prints; /* Debug prints suppressed by load shedding */
+    uint32_t shed_tasks; /* Optional task executions skipped by load shedding */
+    uint32_t deadline_misses; /* Frame exchanges completed after the cycle deadline */
+} monarco_stats_t;
+
+/* Transfer Function
+ *   Alternative transport for one complete frame exchange, e.g. simulated HAT (see monarco_sim.h).
+ *   Returns 0 on success, negative value on failure.
+ */
+typedef int (*monarco_transfer_fn_t)(void *transfer_arg, const monarco_struct_tx_t *tx, monarco_struct_rx_t *rx);
+
 /* Monarco Context Structure
- *   Normally only members `tx_data`, `rx_data`, `sdc_items` and `sdc_size` should be accessed outside monarco.c.
+ *   Normally only members `tx_data`, `rx_data`, `rx_prev` and `sdc_size` should be accessed outside monarco.c,
+ *   SDC Items are accessed by monarco_sdc_*() functions.
+ *   Frames are received into `rx_buf` and validated in place, a valid frame is published by swapping
+ *   `rx_data` / `rx_prev` pointers without any copy. Published frames stay unchanged during the next
+ *   two monarco_main() calls. The context holds pointers into itself, do not copy or move it after init.
  */
 typedef struct {
     void *platform;
     monarco_struct_tx_t tx_data; /* Output Process Data (from Host to Monarco HAT) */
-    monarco_struct_rx_t rx_data; /* Input Process Data (to Host from Monarco HAT) */
+    const monarco_struct_rx_t *rx_data; /* Input Process Data (to Host from Monarco HAT) of the latest valid frame */
+    const monarco_struct_rx_t *rx_prev; /* Input Process Data of the previous valid frame, e.g. for deltas */
+    monarco_struct_rx_t rx_buf[3]; /* Private, RX buffers - latest, previous and the one being received */
+    int rx_next; /* Private, index of `rx_buf` receiving the next frame */
     int spi_fd; /* Private */
-    int sdc_size; /* Number of valid SDC Items in `sdc_items` array */
+    monarco_transfer_fn_t transfer; /* Private, alternative transport, NULL = SPI device */
+    void *transfer_arg; /* Private, argument of `transfer` */
+    int sdc_size; /* Number of valid SDC Items */
+    int sdc_capacity; /* Private, capacity of SDC Items storage */
     int sdc_idx; /* Private, index of current SDC Item */
-    monarco_sdc_item_t sdc_items[MONARCO_SDC_ITEMS_SIZE]; /* SDC Items Array, see description of monarco_sdc_item_t */
+    monarco_sdc_sched_t *sdc_sched; /* Private, SDC Items scheduling state (hot) */
+    uint16_t *sdc_address; /* Private, SDC Items register addresses (cold) */
+    uint16_t *sdc_value; /* Private, SDC Items register values or error codes (cold) */
+    int sdc_pipe; /* Private, Item sent ahead in the latest frame while waiting for response of `sdc_idx`, -1 = none */
     int err_throttle_crc; /* Private */
+    monarco_stats_t stats; /* Communication Statistics, read-only */
+    struct monarco_trace_s *trace; /* Private, trace ring, see monarco_trace.h */
+    struct monarco_cmdq_s *cmdq; /* Private, output command queue, see monarco_cmdq.h */
+    struct monarco_ctrl_loop_s *ctrl_loops; /* Private, control loops, see monarco_ctrl.h */
+    int ctrl_count; /* Private, number of `ctrl_loops` */
+    struct monarco_modbus_s *modbus; /* Private, Modbus RTU master, see monarco_modbus.h */
+    struct monarco_cache_s *cache; /* Private, SDC register cache, see monarco_cache.h */
+    struct monarco_spi_s *spi; /* Private, persistent SPI transfers, one per RX buffer */
+    struct monarco_clock_s *clock; /* Private, frame timestamps and sample clock model, see monarco_clock.h */
+    struct monarco_wdt_s *wdt; /* Private, process data watchdog tuning and safe state, see monarco_wdt.h */
+    struct monarco_shed_s *shed; /* Private, adaptive load shedding, see monarco_shed.h */
+    uint16_t shed_sdc_factor; /* Private, periodic SDC Items with factor >= this are deferred, 0 = none */
+    int dprint_shed; /* Private, debug print flags suppressed by load shedding */
+    struct monarco_metrics_s *metrics; /* Private, metrics exporter counters, see monarco_metrics.h */
+    struct monarco_rate_s *rate; /* Private, adaptive cycle rate, see monarco_rate.h */
+    struct monarco_block_s *blocks; /* Private, SDC block transactions, see monarco_block.h */
+    int64_t cycle_ns; /* Start of the latest cycle, monarco_now_ns(), taken once per cycle when wdt, shed, metrics or rate is attached, read-only */
 } monarco_cxt_t ;
 
+/* CLOCK_MONOTONIC (ns), time base of `cycle_ns` and the cycle hooks */
+static inline int64_t monarco_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 /* Monarco Initialization
  *   Connect to `*spi_device` with `spi_clkfreq` clock frequency (Hz)
  *   and provide some `*platform` data - for generic linux platform it is a debug print prefix.
  */
 int monarco_init(monarco_cxt_t *cxt, const char *spi_device, uint32_t spi_clkfreq, void *platform);
 
+/* Monarco Initialization with Alternative Transport
+ *   Same as `monarco_init()`, but frames are exchanged by `transfer(transfer_arg, ...)` instead of SPI device,
+ *   e.g. `monarco_init_transfer(&cxt, monarco_sim_transfer, &sim, "sim: ")` when no HAT is present.
+ */
+int monarco_init_transfer(monarco_cxt_t *cxt, monarco_transfer_fn_t transfer, void *transfer_arg, void *platform);
+
+/* SDC Items Storage Initialization
+ *   Allocate storage for `capacity` SDC Items (max MONARCO_SDC_ITEMS_SIZE), call after `monarco_init()`.
+ *   Previously defined items are discarded.
+ */
+int monarco_sdc_init(monarco_cxt_t *cxt, int capacity);
+
+/* Add SDC Item
+ *   Append `*item` to SDC Items storage, returns index of the new item or -1 when full or invalid.
+ */
+int monarco_sdc_add(monarco_cxt_t *cxt, const monarco_sdc_item_t *item);
+
+/* Load SDC Items
+ *   Replace SDC Items by `count` items from constant table `*items` (see MONARCO_SDC_ITEM_*), storage
+ *   is allocated by `monarco_sdc_init(cxt, count)` if not yet done. Items are validated against the register map,
+ *   returns -1 on invalid item.
+ */
+int monarco_sdc_load(monarco_cxt_t *cxt, const monarco_sdc_item_t *items, int count);
+
+/* SDC Item `idx` value - register value, or Error Code if monarco_sdc_error() */
+static inline uint16_t monarco_sdc_value(const monarco_cxt_t *cxt, int idx)
+{
+    return cxt->sdc_value[idx];
+}
+
+/* SDC Item `idx` completion indication */
+static inline int monarco_sdc_done(const monarco_cxt_t *cxt, int idx)
+{
+    return (cxt->sdc_sched[idx].flags & MONARCO_SDC_F_DONE) != 0;
+}
+
+/* SDC Item `idx` error result indication */
+static inline int monarco_sdc_error(const monarco_cxt_t *cxt, int idx)
+{
+    return (cxt->sdc_sched[idx].flags & MONARCO_SDC_F_ERROR) != 0;
+}
+
+/* Trigger one-shot action of SDC Item `idx` */
+static inline void monarco_sdc_request(monarco_cxt_t *cxt, int idx)
+{
+    cxt->sdc_sched[idx].flags = (cxt->sdc_sched[idx].flags & ~MONARCO_SDC_F_DONE) | MONARCO_SDC_F_REQUEST;
+}
+
+/* Set `value` of Write Item `idx` and trigger its one-shot action */
+static inline void monarco_sdc_write(monarco_cxt_t *cxt, int idx, uint16_t value)
+{
+    cxt->sdc_value[idx] = value;
+    monarco_sdc_request(cxt, idx);
+}
+
 /* Monarco Main
  *   Performs one SPI transaction with Monarco HAT - exchange of complete input and output process data
  *   and single new service data reqeust and response to previous request.
  *   Have to be called periodically, at least faster than process data watchod timeout (default 100 ms)!
+ *   See monarco_wdt.h for timeout derived from the cycle period and safe-state outputs after overrun,
+ *   monarco_shed.h for deferring optional work when the cycle approaches its deadline.
  */
 int monarco_main(monarco_cxt_t *cxt);
 
+/* Monarco Main, Process Data Only
+ *   Same as `monarco_main()`, but specialized at compile time without Service Data Channel and Modbus master,
+ *   for nodes which do not use SDC after startup configuration. SDC Items keep their state and the HAT keeps
+ *   receiving the last SDC request. Switch over when all requested SDC Items are done, `monarco_main()`
+ *   may be called again any time later. Only SDC (with blocks) and Modbus are left out - the optional hooks
+ *   (shed, cmdq, wdt, clock, metrics, rate, ctrl) are still tested each cycle and run when attached.
+ *   Debug prints are compiled out by MONARCO_NO_DPRINT in both variants.
+ */
+int monarco_main_pdc(monarco_cxt_t *cxt);
+
 /* Monarco Cleanup
- *   Free all resources allocated by `monarco_init()`.
+ *   Free all resources allocated by `monarco_init()`, `monarco_sdc_init()`, `monarco_trace_init()`, `monarco_cmdq_init()` and `monarco_cache_init()`,
+ *   closes UART of Modbus master attached by `monarco_modbus_init()`, stops the exporter thread of `monarco_metrics_serve()`.
  */
 int monarco_exit(monarco_cxt_t *cxt);
 
@@ -0,0 +1,181 @@
+/***************************************************************************//**
+ * @file monarco_block.c
+ * @brief libmonarco - SDC Block Transactions
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_block.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "monarco_sdc.h"
+#include "monarco_platform.h"
+
+int monarco_block_add(monarco_cxt_t *cxt, monarco_block_t *block, const uint16_t *addresses, int count, int flags)
+{
+    int pass, i;
+
+    if ((count <= 0) || (count > MONARCO_BLOCK_REGS_MAX) || ((flags & MONARCO_BLOCK_WRITE) && (flags & MONARCO_BLOCK_VERIFY))) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_block_add: Invalid block of %i registers, flags 0x%02X\n", count, flags);
+        return -1;
+    }
+
+    memset(block, 0, sizeof(monarco_block_t));
+    block->first = cxt->sdc_size;
+    block->count = count;
+    block->items = (flags & MONARCO_BLOCK_VERIFY) ? 2 * count : count;
+    block->flags = flags;
+    block->state = MONARCO_BLOCK_IDLE;
+    block->retries = MONARCO_BLOCK_RETRIES;
+
+    if (cxt->sdc_size + block->items > cxt->sdc_capacity) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_block_add: No room for %i SDC items\n", block->items);
+        return -1;
+    }
+
+    for (pass = 0; pass < block->items / count; pass++) {
+        for (i = 0; i < count; i++) {
+            const monarco_sdc_reg_info_t *reg = monarco_sdc_reg_info(addresses[i]);
+            monarco_sdc_item_t item = { .address = addresses[i], .write = (flags & MONARCO_BLOCK_WRITE) ? 1 : 0 };
+
+            // placeholder value of Write Item within the register range, set by monarco_block_write()
+            item.value = (reg != NULL) ? reg->min : 0;
+
+            if (monarco_sdc_add(cxt, &item) < 0) {
+                cxt->sdc_size = block->first;
+                return -1;
+            }
+        }
+    }
+
+    // reads of the block are chained, the last one closes it
+    for (i = 0; i < block->items; i++) {
+        cxt->sdc_sched[block->first + i].flags |= MONARCO_SDC_F_BLOCK;
+        if (!(flags & MONARCO_BLOCK_WRITE) && (i < block->items - 1)) {
+            cxt->sdc_sched[block->first + i].flags |= MONARCO_SDC_F_CHAIN;
+        }
+    }
+
+    block->next = cxt->blocks;
+    cxt->blocks = block;
+
+    MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_block_add: %s block of %i registers from ADDR=0x%03X, items %i..%i\n",
+        (flags & MONARCO_BLOCK_WRITE) ? "Write" : "Read", count, addresses[0], block->first, block->first + block->items - 1);
+
+    return 0;
+}
+
+/* Trigger all Items of the block */
+static void monarco_block_start(monarco_cxt_t *cxt, monarco_block_t *block)
+{
+    int i;
+
+    for (i = 0; i < block->items; i++) {
+        monarco_sdc_request(cxt, block->first + i);
+    }
+
+    // the scan stopped inside the block, start from its first Item to keep the order
+    if ((cxt->sdc_idx > block->first) && (cxt->sdc_idx < block->first + block->items)
+        && (cxt->sdc_sched[cxt->sdc_idx].busy == 0) && (cxt->sdc_pipe < 0)) {
+        cxt->sdc_idx = block->first;
+    }
+
+    block->state = MONARCO_BLOCK_BUSY;
+}
+
+int monarco_block_read(monarco_cxt_t *cxt, monarco_block_t *block)
+{
+    if ((block->flags & MONARCO_BLOCK_WRITE) || (block->state == MONARCO_BLOCK_BUSY)) {
+        return -1;
+    }
+
+    block->attempt = 0;
+    block->start_cycle = cxt->stats.cycles;
+    monarco_block_start(cxt, block);
+
+    return 0;
+}
+
+int monarco_block_write(monarco_cxt_t *cxt, monarco_block_t *block, const uint16_t *values)
+{
+    int i;
+
+    if (!(block->flags & MONARCO_BLOCK_WRITE) || (block->state == MONARCO_BLOCK_BUSY)) {
+        return -1;
+    }
+
+    if (values != NULL) {
+        memcpy(block->values, values, block->count * sizeof(uint16_t));
+    }
+    for (i = 0; i < block->count; i++) {
+        cxt->sdc_value[block->first + i] = block->values[i];
+    }
+
+    block->attempt = 0;
+    block->start_cycle = cxt->stats.cycles;
+    monarco_block_start(cxt, block);
+
+    return 0;
+}
+
+/* Complete the block when all its Items are done */
+static void monarco_block_complete(monarco_cxt_t *cxt, monarco_block_t *block)
+{
+    const monarco_sdc_sched_t *sched = &cxt->sdc_sched[block->first];
+    const uint16_t *value = &cxt->sdc_value[block->first];
+    int error = 0;
+    int i;
+
+    for (i = 0; i < block->items; i++) {
+        if ((sched[i].flags & (MONARCO_SDC_F_DONE | MONARCO_SDC_F_REQUEST)) != MONARCO_SDC_F_DONE) {
+            return;
+        }
+        error |= (sched[i].flags & MONARCO_SDC_F_ERROR) ? 1 : 0;
+    }
+
+    // the last pass holds the result
+    if (!(block->flags & MONARCO_BLOCK_WRITE)) {
+        memcpy(block->values, value + block->items - block->count, block->count * sizeof(uint16_t));
+    }
+
+    block->error = error;
+    block->complete = !error;
+    block->coherent = (block->flags & MONARCO_BLOCK_VERIFY) && !error;
+
+    if (block->coherent && (memcmp(value, value + block->count, block->count * sizeof(uint16_t)) != 0)) {
+        block->coherent = 0;
+        if (block->attempt < block->retries) {
+            block->attempt++;
+            block->torn++;
+            MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_block: Block from ADDR=0x%03X changed mid-read, retry %u\n",
+                cxt->sdc_address[block->first], block->attempt);
+            monarco_block_start(cxt, block);
+            return;
+        }
+    }
+
+    block->state = MONARCO_BLOCK_DONE;
+    block->frames = cxt->stats.cycles - block->start_cycle;
+    block->transactions++;
+    if ((block->flags & MONARCO_BLOCK_VERIFY) && !block->coherent) {
+        block->incoherent++;
+    }
+}
+
+void monarco_block_update(monarco_cxt_t *cxt)
+{
+    monarco_block_t *block;
+
+    for (block = cxt->blocks; block != NULL; block = block->next) {
+        if (block->state == MONARCO_BLOCK_BUSY) {
+            monarco_block_complete(cxt, block);
+        }
+    }
+}
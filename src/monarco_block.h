@@ -0,0 +1,104 @@
+/***************************************************************************//**
+ * @file monarco_block.h
+ * @brief libmonarco - SDC Block Transactions
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_BLOCK_H_
+#define LIBMONARCO_BLOCK_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* A block reads or writes a group of registers holding one logical value (e.g. FWVERL/FWVERH, MCUID1..MCUID4,
+ * RS-485 diagnostic counters) with one completion. `monarco_block_add()` appends consecutive SDC Items for the
+ * group, `monarco_block_read()` / `monarco_block_write()` triggers all of them at once, so they are sent
+ * back-to-back without Items of other registers in between. Reads are pipelined - the next register is requested
+ * in the frame carrying the response to the previous one, so a block of N registers takes about N + 1 frames
+ * instead of 2 N. Block Items are never completed from the register cache (monarco_cache.h).
+ * A block is `complete` when all registers were transferred without error. With MONARCO_BLOCK_VERIFY the group
+ * is read twice in a row and the result is also `coherent` when both passes are equal - every register held its
+ * value over an instant between the passes. Otherwise, e.g. a counter changed mid-read, the block is read again up
+ * to `retries` times. Without MONARCO_BLOCK_VERIFY nothing proves coherence and `coherent` stays 0, `complete`
+ * is enough for constant groups and writes.
+ */
+
+/* Maximal number of registers in one block */
+#define MONARCO_BLOCK_REGS_MAX 8
+
+/* Default number of repeated reads of a block changed mid-read */
+#ifndef MONARCO_BLOCK_RETRIES
+#define MONARCO_BLOCK_RETRIES 4
+#endif
+
+/* Block flags */
+#define MONARCO_BLOCK_WRITE  0x01 /* Write block, 0 = read block */
+#define MONARCO_BLOCK_VERIFY 0x02 /* Read the group twice, retry when passes differ, for registers changing at runtime */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Block state */
+enum {
+    MONARCO_BLOCK_IDLE, /* Not requested yet */
+    MONARCO_BLOCK_BUSY, /* Transaction in progress */
+    MONARCO_BLOCK_DONE, /* Completed, see `complete`, `coherent` and `error` */
+};
+
+/* SDC Block Transaction, owned by the application */
+typedef struct monarco_block_s {
+    int first; /* Index of the first SDC Item of the block */
+    int count; /* Number of registers */
+    int items; /* Number of SDC Items, `count` or 2 `count` with MONARCO_BLOCK_VERIFY */
+    int flags; /* MONARCO_BLOCK_* */
+    int state; /* MONARCO_BLOCK_*, read-only */
+    int complete; /* Completed with all registers transferred without error, read-only */
+    int coherent; /* Completed with `values` verified consistent by MONARCO_BLOCK_VERIFY, read-only */
+    int error; /* Completed with error result of a register, `values` hold the results, read-only */
+    uint16_t values[MONARCO_BLOCK_REGS_MAX]; /* Register values read, or to write by monarco_block_write() */
+    uint32_t retries; /* Reads repeated after the group changed mid-read, MONARCO_BLOCK_RETRIES */
+    uint32_t attempt; /* Private, reads repeated in the current transaction */
+    uint32_t start_cycle; /* Private, `cxt->stats.cycles` at request */
+    uint32_t frames; /* Frames taken by the latest transaction */
+    uint32_t transactions; /* Completed transactions */
+    uint32_t torn; /* Reads repeated due to change mid-read */
+    uint32_t incoherent; /* MONARCO_BLOCK_VERIFY transactions completed without coherent result */
+    struct monarco_block_s *next; /* Private, next block of the context */
+} monarco_block_t;
+
+/* Append block `*block` owned by the application for `count` registers `addresses[]` (max MONARCO_BLOCK_REGS_MAX),
+ *   `flags` MONARCO_BLOCK_*. Call after `monarco_sdc_load()`, the storage needs capacity for `count` Items, 2 `count`
+ *   with MONARCO_BLOCK_VERIFY. Blocks are detached by `monarco_sdc_init()` / `monarco_sdc_load()`.
+ *   Returns -1 on invalid block or register, no room for Items.
+ */
+int monarco_block_add(monarco_cxt_t *cxt, monarco_block_t *block, const uint16_t *addresses, int count, int flags);
+
+/* Start reading read block `*block`, returns -1 when it is a write block or busy */
+int monarco_block_read(monarco_cxt_t *cxt, monarco_block_t *block);
+
+/* Start writing `values[]` (NULL = `block->values`) by write block `*block`, returns -1 when it is a read block or busy */
+int monarco_block_write(monarco_cxt_t *cxt, monarco_block_t *block, const uint16_t *values);
+
+/* Block completion indication */
+static inline int monarco_block_done(const monarco_block_t *block)
+{
+    return block->state == MONARCO_BLOCK_DONE;
+}
+
+/* Internal hook of monarco_main() */
+
+/* Complete busy blocks, repeat torn reads, called after SDC response is processed */
+void monarco_block_update(monarco_cxt_t *cxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,205 @@
+/***************************************************************************//**
+ * @file monarco_cache.c
+ * @brief libmonarco - SDC Register Cache
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "monarco_platform.h"
+
+/* Cache entry of one register */
+typedef struct {
+    uint16_t value; /* Last known register value */
+    uint8_t valid; /* `value` is valid */
+    uint8_t consumed; /* Read by monarco_cache_read() since the last fetch */
+    uint32_t stamp; /* Cycle of the last fetch or confirmed write */
+    uint32_t max_age; /* Max age for reads (cycles), 0 = reads not cached */
+} monarco_cache_entry_t;
+
+/* Register cache - entries in register map order, direct lookup by address */
+struct monarco_cache_s {
+    int size; /* Number of entries */
+    int addr_limit; /* Size of `slot` */
+    int8_t *slot; /* Entry index by register address, -1 = not in map */
+    monarco_cache_entry_t *entries;
+};
+
+int monarco_cache_init(monarco_cxt_t *cxt, uint32_t default_max_age)
+{
+    const monarco_sdc_reg_info_t *map;
+    int count = monarco_sdc_reg_map(&map);
+    int addr_limit = 0;
+    int i;
+
+    monarco_cache_exit(cxt);
+
+    for (i = 0; i < count; i++) {
+        if (map[i].address >= addr_limit) {
+            addr_limit = map[i].address + 1;
+        }
+    }
+
+    struct monarco_cache_s *cache = calloc(1, sizeof(struct monarco_cache_s) + addr_limit + count * sizeof(monarco_cache_entry_t));
+    if (cache == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_cache_init: Failed to allocate cache\n");
+        return -1;
+    }
+
+    cache->size = count;
+    cache->addr_limit = addr_limit;
+    cache->entries = (monarco_cache_entry_t *)(cache + 1);
+    cache->slot = (int8_t *)(cache->entries + count);
+
+    memset(cache->slot, -1, addr_limit);
+    for (i = 0; i < count; i++) {
+        cache->slot[map[i].address] = i;
+        cache->entries[i].max_age = default_max_age;
+    }
+
+    cxt->cache = cache;
+
+    return 0;
+}
+
+void monarco_cache_exit(monarco_cxt_t *cxt)
+{
+    free(cxt->cache);
+    cxt->cache = NULL;
+}
+
+static inline monarco_cache_entry_t *monarco_cache_entry(const monarco_cxt_t *cxt, uint16_t address)
+{
+    const struct monarco_cache_s *cache = cxt->cache;
+
+    if ((cache == NULL) || (address >= cache->addr_limit) || (cache->slot[address] < 0)) {
+        return NULL;
+    }
+
+    return &cache->entries[(int)cache->slot[address]];
+}
+
+int monarco_cache_max_age(monarco_cxt_t *cxt, uint16_t address, uint32_t max_age)
+{
+    monarco_cache_entry_t *e = monarco_cache_entry(cxt, address);
+
+    if (e == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_cache_max_age: ADDR=0x%03X not cached\n", address);
+        return -1;
+    }
+
+    e->max_age = max_age;
+
+    return 0;
+}
+
+void monarco_cache_invalidate(monarco_cxt_t *cxt)
+{
+    int i;
+
+    if (cxt->cache == NULL) {
+        return;
+    }
+
+    for (i = 0; i < cxt->cache->size; i++) {
+        cxt->cache->entries[i].valid = 0;
+    }
+}
+
+static inline int monarco_cache_fresh(const monarco_cxt_t *cxt, const monarco_cache_entry_t *e)
+{
+    return e->valid && (e->max_age > 0) && (cxt->stats.cycles - e->stamp < e->max_age);
+}
+
+uint16_t monarco_cache_read(monarco_cxt_t *cxt, int idx)
+{
+    monarco_cache_entry_t *e = monarco_cache_entry(cxt, cxt->sdc_address[idx]);
+    monarco_sdc_sched_t *sched = &cxt->sdc_sched[idx];
+
+    if (e == NULL) {
+        return cxt->sdc_value[idx];
+    }
+
+    e->consumed = 1;
+
+    if ((e->max_age > 0) && !monarco_cache_fresh(cxt, e) && !(sched->flags & MONARCO_SDC_F_WRITE) && (sched->busy == 0)) {
+        sched->flags |= MONARCO_SDC_F_REQUEST;
+    }
+
+    return e->valid ? e->value : cxt->sdc_value[idx];
+}
+
+int monarco_cache_hit(monarco_cxt_t *cxt, int idx)
+{
+    monarco_cache_entry_t *e = monarco_cache_entry(cxt, cxt->sdc_address[idx]);
+    monarco_sdc_sched_t *sched = &cxt->sdc_sched[idx];
+
+    if ((e == NULL) || !e->valid) {
+        return 0;
+    }
+
+    if (sched->flags & MONARCO_SDC_F_WRITE) {
+        if (e->value != cxt->sdc_value[idx]) {
+            return 0;
+        }
+    }
+    else {
+        if (!monarco_cache_fresh(cxt, e)) {
+            return 0;
+        }
+        cxt->sdc_value[idx] = e->value;
+    }
+
+    sched->flags = (sched->flags & ~(MONARCO_SDC_F_REQUEST | MONARCO_SDC_F_ERROR)) | MONARCO_SDC_F_DONE;
+    cxt->stats.sdc_cached++;
+
+    return 1;
+}
+
+int monarco_cache_due(monarco_cxt_t *cxt, int idx)
+{
+    monarco_cache_entry_t *e = monarco_cache_entry(cxt, cxt->sdc_address[idx]);
+
+    if ((e == NULL) || (e->max_age == 0) || (cxt->sdc_sched[idx].flags & MONARCO_SDC_F_WRITE)) {
+        return 1;
+    }
+
+    if (!e->valid || e->consumed) {
+        return 1;
+    }
+
+    cxt->stats.sdc_skipped++;
+
+    return 0;
+}
+
+void monarco_cache_update(monarco_cxt_t *cxt, int idx, int error)
+{
+    monarco_cache_entry_t *e = monarco_cache_entry(cxt, cxt->sdc_address[idx]);
+
+    if (e == NULL) {
+        return;
+    }
+
+    if (error) {
+        e->valid = 0;
+        return;
+    }
+
+    e->value = cxt->sdc_value[idx];
+    e->valid = 1;
+    e->stamp = cxt->stats.cycles;
+    if (!(cxt->sdc_sched[idx].flags & MONARCO_SDC_F_WRITE)) {
+        e->consumed = 0;
+    }
+}
@@ -0,0 +1,69 @@
+/***************************************************************************//**
+ * @file monarco_cache.h
+ * @brief libmonarco - SDC Register Cache
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_CACHE_H_
+#define LIBMONARCO_CACHE_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* SDC carries one register per frame, so each transaction saved is bandwidth for registers that matter.
+ * The cache keeps the last known value of each register of MONARCO_SDC_REG_MAP, shared by all SDC Items
+ * with the same address. When the cache is initialized by `monarco_cache_init()`, `monarco_main()`:
+ *  - completes requested Write Items without transaction when the cached value already matches,
+ *  - completes requested Read Items from the cache when the value is younger than register max age,
+ *  - sends periodic Read Items of registers with max age only when the value was consumed by
+ *    `monarco_cache_read()` since the last fetch - registers nobody reads are not refreshed.
+ * Registers without max age (0) are never served from the cache for reading, Items of other registers
+ * behave as without the cache. Error responses invalidate the entry.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate register cache of `cxt`, `default_max_age` (cycles) applies to all registers until changed
+ *   by monarco_cache_max_age(), 0 = reads are not cached. Returns -1 on allocation failure.
+ */
+int monarco_cache_init(monarco_cxt_t *cxt, uint32_t default_max_age);
+
+/* Free register cache of `cxt` */
+void monarco_cache_exit(monarco_cxt_t *cxt);
+
+/* Set max age (cycles) of register `address`, 0 = reads are not cached, returns -1 for unknown register */
+int monarco_cache_max_age(monarco_cxt_t *cxt, uint16_t address, uint32_t max_age);
+
+/* Invalidate all entries, e.g. after HAT reset - next requests go to the HAT */
+void monarco_cache_invalidate(monarco_cxt_t *cxt);
+
+/* Read-through value of SDC Item `idx`
+ *   Returns the cached register value (or Item value when not cached) and marks the register as consumed.
+ *   When the value is older than max age, a refresh of Read Item `idx` is requested in the background.
+ */
+uint16_t monarco_cache_read(monarco_cxt_t *cxt, int idx);
+
+/* Internal hooks of monarco_main() */
+
+/* Complete requested Item `idx` from the cache, returns 1 when no transaction is needed */
+int monarco_cache_hit(monarco_cxt_t *cxt, int idx);
+
+/* Periodic Item `idx` is due for transaction, returns 0 when the refresh is not needed */
+int monarco_cache_due(monarco_cxt_t *cxt, int idx);
+
+/* Update the cache by completed transaction of Item `idx` */
+void monarco_cache_update(monarco_cxt_t *cxt, int idx, int error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
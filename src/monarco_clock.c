@@ -0,0 +1,157 @@
+/***************************************************************************//**
+ * @file monarco_clock.c
+ * @brief libmonarco - Frame Timestamps and Sample Clock Model
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_clock.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "monarco_platform.h"
+
+int monarco_clock_init(monarco_clock_t *clk, monarco_cxt_t *cxt, uint32_t nominal_period_us)
+{
+    memset(clk, 0, sizeof(monarco_clock_t));
+    clk->cxt = cxt;
+    clk->alpha = MONARCO_CLOCK_ALPHA;
+    clk->beta = clk->alpha * clk->alpha / (2.0 - clk->alpha);
+    clk->nominal_ns = nominal_period_us * 1000.0;
+    clk->period_ns = clk->nominal_ns;
+
+    cxt->clock = clk;
+
+    MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_clock_init: Nominal period %u us\n", nominal_period_us);
+
+    return 0;
+}
+
+void monarco_clock_exit(monarco_cxt_t *cxt)
+{
+    cxt->clock = NULL;
+}
+
+const monarco_clock_stamp_t *monarco_clock_stamp(const monarco_cxt_t *cxt)
+{
+    if (cxt->clock == NULL) {
+        return NULL;
+    }
+
+    return &cxt->clock->stamps[cxt->rx_data - cxt->rx_buf];
+}
+
+const monarco_clock_stamp_t *monarco_clock_stamp_prev(const monarco_cxt_t *cxt)
+{
+    if (cxt->clock == NULL) {
+        return NULL;
+    }
+
+    return &cxt->clock->stamps[cxt->rx_prev - cxt->rx_buf];
+}
+
+double monarco_clock_dt(const monarco_cxt_t *cxt)
+{
+    const monarco_clock_t *clk = cxt->clock;
+
+    if ((clk == NULL) || (clk->state < 2)) {
+        return 0.0;
+    }
+
+    const monarco_clock_stamp_t *cur = monarco_clock_stamp(cxt);
+    const monarco_clock_stamp_t *prev = monarco_clock_stamp_prev(cxt);
+
+    return (cur->sample_ns - prev->sample_ns) * 1e-9;
+}
+
+double monarco_clock_drift_ppm(const monarco_clock_t *clk)
+{
+    if ((clk->nominal_ns <= 0.0) || (clk->state < 2)) {
+        return 0.0;
+    }
+
+    return (clk->period_ns - clk->nominal_ns) / clk->nominal_ns * 1e6;
+}
+
+void monarco_clock_update(monarco_cxt_t *cxt)
+{
+    monarco_clock_t *clk = cxt->clock;
+    monarco_clock_stamp_t *st = &clk->stamps[cxt->rx_data - cxt->rx_buf];
+    uint8_t sign_of_life = cxt->rx_data->status_byte.sign_of_life;
+
+    st->mid_ns = st->before_ns + (st->after_ns - st->before_ns) / 2;
+
+    clk->frames++;
+
+    if (clk->state == 0) {
+        clk->seq = 0;
+        clk->phase_ns = st->mid_ns;
+        clk->state = (clk->period_ns > 0.0) ? 2 : 1;
+    }
+    else {
+        /* HAT transfers since the latest frame - host transfers, corrected to match 2-bit sign of life */
+
+        uint32_t host = cxt->stats.cycles - clk->cycles;
+        uint32_t hat = host + ((uint32_t)(sign_of_life - clk->sign_of_life - host) & 3);
+        int slip = (hat != host);
+
+        if (slip) {
+            clk->slips++;
+        }
+
+        clk->seq += hat;
+
+        if (clk->state == 1) {
+            // learn the period from the first two frames
+            clk->period_ns = (double)(st->mid_ns - clk->phase_ns) / hat;
+            clk->phase_ns = st->mid_ns;
+            clk->state = 2;
+        }
+        else {
+            /* The sample instant lies within the transfer, only a prediction outside of it is an error,
+             * so one-sided delays of the timestamps (e.g. preemption right after the transfer) do not pull the grid */
+
+            double predicted = clk->phase_ns + clk->period_ns * hat;
+            double residual = 0.0;
+
+            if (predicted < st->before_ns) {
+                residual = (double)(st->before_ns - predicted);
+            }
+            else if (predicted > st->after_ns) {
+                residual = (double)(st->after_ns - predicted);
+            }
+
+            if (slip || (fabs(residual) > MONARCO_CLOCK_RESYNC_PERIODS * clk->period_ns)) {
+                clk->phase_ns = st->mid_ns;
+                clk->resyncs++;
+            }
+            else {
+                clk->phase_ns = llround(predicted + clk->alpha * residual);
+                clk->period_ns += clk->beta * residual / hat;
+                clk->jitter_ns += (fabs(residual) - clk->jitter_ns) / 64.0;
+            }
+        }
+    }
+
+    clk->cycles = cxt->stats.cycles;
+    clk->sign_of_life = sign_of_life;
+
+    st->seq = clk->seq;
+
+    // tracked instant, bounded by the transfer
+    int64_t sample_ns = clk->phase_ns;
+    if (sample_ns < st->before_ns) {
+        sample_ns = st->before_ns;
+    }
+    else if (sample_ns > st->after_ns) {
+        sample_ns = st->after_ns;
+    }
+    st->sample_ns = sample_ns + MONARCO_CLOCK_SAMPLE_OFFSET_NS;
+}
@@ -0,0 +1,126 @@
+/***************************************************************************//**
+ * @file monarco_clock.h
+ * @brief libmonarco - Frame Timestamps and Sample Clock Model
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_CLOCK_H_
+#define LIBMONARCO_CLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "monarco.h"
+
+/* When a clock is attached by `monarco_clock_init()`, `monarco_main()` takes CLOCK_MONOTONIC_RAW timestamps
+ * right before and after each transfer and every accepted frame carries them, see `monarco_clock_stamp()`.
+ * The HAT increments `sign_of_life` with each transfer, so frames are numbered by HAT transfer count even
+ * across rejected frames. An alpha-beta tracker fits a uniform grid over this count into the transfer
+ * intervals: the grid position, bounded by the transfer, is the sample instant without the delay of the
+ * timestamps, the tracked spacing is the true sample period on the raw oscillator, and its deviation from
+ * nominal is the drift.
+ * Use `monarco_clock_dt()` instead of the nominal period for derivatives and frequencies.
+ */
+
+/* Offset of HAT input sampling relative to the transfer midpoint (ns), depends on HAT firmware */
+#ifndef MONARCO_CLOCK_SAMPLE_OFFSET_NS
+#define MONARCO_CLOCK_SAMPLE_OFFSET_NS 0
+#endif
+
+/* Default position gain of the tracker, velocity gain is derived for critical damping */
+#ifndef MONARCO_CLOCK_ALPHA
+#define MONARCO_CLOCK_ALPHA 0.05
+#endif
+
+/* Residual in periods after which the tracker is resynchronized to the measured midpoint */
+#ifndef MONARCO_CLOCK_RESYNC_PERIODS
+#define MONARCO_CLOCK_RESYNC_PERIODS 2.0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Timestamps of one frame, CLOCK_MONOTONIC_RAW ns */
+typedef struct {
+    int64_t before_ns; /* Right before the transfer */
+    int64_t after_ns; /* Right after the transfer */
+    int64_t mid_ns; /* Midpoint of the transfer */
+    int64_t sample_ns; /* Estimated HAT-side sample instant, tracked */
+    uint32_t seq; /* HAT transfer count unwrapped from `sign_of_life` */
+} monarco_clock_stamp_t;
+
+/* Sample Clock Model */
+typedef struct monarco_clock_s {
+    monarco_cxt_t *cxt; /* Attached context */
+    monarco_clock_stamp_t stamps[3]; /* Private, timestamps of each of `cxt->rx_buf` */
+    double alpha; /* Position gain, MONARCO_CLOCK_ALPHA */
+    double beta; /* Velocity gain */
+    double nominal_ns; /* Nominal period (ns), 0 = learned from the first frames */
+    double period_ns; /* Estimated sample period (ns) */
+    int64_t phase_ns; /* Estimated sample instant of the latest frame, without offset */
+    double jitter_ns; /* Mean absolute residual of the grid outside of transfers (ns) */
+    uint32_t seq; /* HAT transfer count of the latest frame */
+    uint32_t cycles; /* Private, `cxt->stats.cycles` at the latest frame */
+    uint8_t sign_of_life; /* Private, `sign_of_life` of the latest frame */
+    uint8_t state; /* Private, 0 = no frame, 1 = phase only, 2 = tracking */
+    uint32_t frames; /* Frames accepted by the model */
+    uint32_t slips; /* Frames with HAT transfer count not matching host transfers */
+    uint32_t resyncs; /* Tracker resynchronizations after slip or large residual */
+} monarco_clock_t;
+
+/* Attach clock model `*clk` owned by the application to `cxt`, `nominal_period_us` is the intended cycle period,
+ *   0 = learned from the first two frames. Tracker gains `alpha` / `beta` may be changed afterwards.
+ */
+int monarco_clock_init(monarco_clock_t *clk, monarco_cxt_t *cxt, uint32_t nominal_period_us);
+
+/* Detach clock model from `cxt` */
+void monarco_clock_exit(monarco_cxt_t *cxt);
+
+/* Timestamps of the latest valid frame `cxt->rx_data`, NULL without clock model */
+const monarco_clock_stamp_t *monarco_clock_stamp(const monarco_cxt_t *cxt);
+
+/* Timestamps of the previous valid frame `cxt->rx_prev`, NULL without clock model */
+const monarco_clock_stamp_t *monarco_clock_stamp_prev(const monarco_cxt_t *cxt);
+
+/* True sample spacing of `cxt->rx_prev` and `cxt->rx_data` (s), 0 before two frames were tracked */
+double monarco_clock_dt(const monarco_cxt_t *cxt);
+
+/* Drift of the estimated sample period from nominal (ppm) */
+double monarco_clock_drift_ppm(const monarco_clock_t *clk);
+
+/* Internal hooks of monarco_main() */
+
+/* CLOCK_MONOTONIC_RAW (ns) */
+static inline int64_t monarco_clock_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Timestamp before the transfer into `cxt->rx_buf[cxt->rx_next]` */
+static inline void monarco_clock_before(monarco_cxt_t *cxt)
+{
+    cxt->clock->stamps[cxt->rx_next].before_ns = monarco_clock_now();
+}
+
+/* Timestamp after the transfer into `cxt->rx_buf[cxt->rx_next]` */
+static inline void monarco_clock_after(monarco_cxt_t *cxt)
+{
+    cxt->clock->stamps[cxt->rx_next].after_ns = monarco_clock_now();
+}
+
+/* Update the model by the frame just published as `cxt->rx_data` */
+void monarco_clock_update(monarco_cxt_t *cxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,210 @@
+/***************************************************************************//**
+ * @file monarco_cmdq.c
+ * @brief libmonarco - Output Command Queue
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_cmdq.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "monarco_platform.h"
+
+#define MONARCO_CMDQ_CACHE_LINE 64
+
+/* Ring cell - command with sequence number, see monarco_cmdq_push() */
+typedef struct {
+    atomic_uint seq;
+    monarco_cmd_t cmd;
+} monarco_cmdq_cell_t;
+
+/* Bounded multi-producer single-consumer ring (per-cell sequence numbers),
+ * producer and consumer positions are kept in separate cache lines.
+ */
+struct monarco_cmdq_s {
+    monarco_cmdq_cell_t *cells;
+    uint32_t mask;
+    _Alignas(MONARCO_CMDQ_CACHE_LINE) atomic_uint enqueue_pos;
+    atomic_uint pushed;
+    atomic_uint rejected;
+    _Alignas(MONARCO_CMDQ_CACHE_LINE) unsigned int dequeue_pos;
+    atomic_uint applied;
+    atomic_uint max_batch;
+};
+
+int monarco_cmdq_init(monarco_cxt_t *cxt, uint32_t capacity)
+{
+    uint32_t size = 2;
+    uint32_t i;
+
+    while ((size < capacity) && (size < 0x10000000U)) {
+        size <<= 1;
+    }
+
+    monarco_cmdq_exit(cxt);
+
+    struct monarco_cmdq_s *q = aligned_alloc(MONARCO_CMDQ_CACHE_LINE, sizeof(struct monarco_cmdq_s));
+    if (q == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_cmdq_init: Failed to allocate queue\n");
+        return -1;
+    }
+    memset(q, 0, sizeof(struct monarco_cmdq_s));
+
+    q->cells = malloc(size * sizeof(monarco_cmdq_cell_t));
+    if (q->cells == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_cmdq_init: Failed to allocate %u commands\n", size);
+        free(q);
+        return -1;
+    }
+    memset(q->cells, 0, size * sizeof(monarco_cmdq_cell_t));
+
+    for (i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+    }
+
+    q->mask = size - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    q->dequeue_pos = 0;
+
+    cxt->cmdq = q;
+
+    return 0;
+}
+
+void monarco_cmdq_exit(monarco_cxt_t *cxt)
+{
+    if (cxt->cmdq != NULL) {
+        free(cxt->cmdq->cells);
+        free(cxt->cmdq);
+        cxt->cmdq = NULL;
+    }
+}
+
+/* Check command target field and operation */
+static int monarco_cmdq_check(const monarco_cmd_t *cmd)
+{
+    switch (cmd->op) {
+    case MONARCO_CMD_WRITE8:
+        return (cmd->field >= MONARCO_CMD_FIELD(control_byte)) && (cmd->field <= MONARCO_CMD_FIELD(dout));
+    case MONARCO_CMD_WRITE16:
+        return (cmd->field >= MONARCO_CMD_FIELD(pwm1_div)) && (cmd->field <= MONARCO_CMD_FIELD(aout2))
+            && (((cmd->field - MONARCO_CMD_FIELD(pwm1_div)) & 1) == 0);
+    default:
+        return 0;
+    }
+}
+
+int monarco_cmdq_push(monarco_cxt_t *cxt, const monarco_cmd_t *cmd)
+{
+    struct monarco_cmdq_s *q = cxt->cmdq;
+    monarco_cmdq_cell_t *cell;
+    unsigned int pos;
+
+    if (!monarco_cmdq_check(cmd)) {
+        return -2;
+    }
+
+    if (q == NULL) {
+        return -1;
+    }
+
+    /* Claim cell at enqueue position, its sequence equals the position when free */
+
+    pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        cell = &q->cells[pos & q->mask];
+        unsigned int seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int dif = (int)(seq - pos);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            atomic_fetch_add_explicit(&q->rejected, 1, memory_order_relaxed);
+            return -1;
+        }
+        else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    /* Publish command to the consumer */
+
+    cell->cmd = *cmd;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    atomic_fetch_add_explicit(&q->pushed, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+int monarco_cmdq_apply(monarco_cxt_t *cxt)
+{
+    struct monarco_cmdq_s *q = cxt->cmdq;
+    uint8_t *tx = (uint8_t *)&cxt->tx_data;
+    unsigned int n;
+
+    if (q == NULL) {
+        return 0;
+    }
+
+    /* At most one ring of commands per cycle, producers cannot extend the drain indefinitely */
+
+    for (n = 0; n <= q->mask; n++) {
+        unsigned int pos = q->dequeue_pos;
+        monarco_cmdq_cell_t *cell = &q->cells[pos & q->mask];
+
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1) {
+            break; /* empty, or next command not yet published */
+        }
+
+        const monarco_cmd_t *cmd = &cell->cmd;
+
+        if (cmd->op == MONARCO_CMD_WRITE8) {
+            tx[cmd->field] = (tx[cmd->field] & ~cmd->mask) | (cmd->value & cmd->mask);
+        }
+        else {
+            memcpy(&tx[cmd->field], &cmd->value, sizeof(uint16_t));
+        }
+
+        atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+        q->dequeue_pos = pos + 1;
+    }
+
+    if (n > 0) {
+        atomic_fetch_add_explicit(&q->applied, n, memory_order_relaxed);
+        if (n > atomic_load_explicit(&q->max_batch, memory_order_relaxed)) {
+            atomic_store_explicit(&q->max_batch, n, memory_order_relaxed);
+        }
+    }
+
+    return n;
+}
+
+void monarco_cmdq_stats(monarco_cxt_t *cxt, monarco_cmdq_stats_t *stats)
+{
+    struct monarco_cmdq_s *q = cxt->cmdq;
+
+    memset(stats, 0, sizeof(monarco_cmdq_stats_t));
+
+    if (q == NULL) {
+        return;
+    }
+
+    stats->pushed = atomic_load_explicit(&q->pushed, memory_order_relaxed);
+    stats->rejected = atomic_load_explicit(&q->rejected, memory_order_relaxed);
+    stats->applied = atomic_load_explicit(&q->applied, memory_order_relaxed);
+    stats->max_batch = atomic_load_explicit(&q->max_batch, memory_order_relaxed);
+}
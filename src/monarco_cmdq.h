@@ -0,0 +1,113 @@
+/***************************************************************************//**
+ * @file monarco_cmdq.h
+ * @brief libmonarco - Output Command Queue
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_CMDQ_H_
+#define LIBMONARCO_CMDQ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "monarco.h"
+
+/* Output commands may be pushed from any thread, `monarco_main()` drains the queue and applies
+ * the commands to `tx_data` in push order just before the TX CRC is calculated, so all commands
+ * pushed before the drain are sent in the same frame and the last writer of a field wins.
+ * The queue is a bounded lock-free ring, producers never block and the cycle never waits for them.
+ * A push to a full queue fails and the command is not accepted - it is never dropped silently.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Output Command Operations */
+enum {
+    MONARCO_CMD_WRITE8, /* field = (field & ~mask) | (value & mask), for 8-bit fields */
+    MONARCO_CMD_WRITE16, /* field = value, for 16-bit fields */
+};
+
+/* Output field identifier for monarco_cmdq_*() - offset of `member` in monarco_struct_tx_t,
+ *   8-bit fields: control_byte, led_mask, led_value, dout; 16-bit fields: pwm*, aout1, aout2.
+ */
+#define MONARCO_CMD_FIELD(member) ((uint8_t)offsetof(monarco_struct_tx_t, member))
+
+/* Output Command, 8 bytes */
+typedef struct {
+    uint8_t op; /* MONARCO_CMD_* */
+    uint8_t field; /* Target field, see MONARCO_CMD_FIELD() */
+    uint16_t mask; /* Bits to be written by MONARCO_CMD_WRITE8 */
+    uint16_t value; /* New value */
+    uint16_t reserved;
+} monarco_cmd_t;
+
+/* Output Command Queue Statistics */
+typedef struct {
+    uint32_t pushed; /* Commands accepted */
+    uint32_t rejected; /* Commands rejected because the queue was full */
+    uint32_t applied; /* Commands applied to `tx_data` */
+    uint32_t max_batch; /* Maximal number of commands applied in one cycle */
+} monarco_cmdq_stats_t;
+
+/* Output Command Queue Initialization
+ *   Allocate queue for `capacity` commands (rounded up to power of 2) and attach it to `cxt`,
+ *   call after `monarco_init()` and before producers are started.
+ */
+int monarco_cmdq_init(monarco_cxt_t *cxt, uint32_t capacity);
+
+/* Free the queue, producers have to be stopped before. Called by monarco_exit(). */
+void monarco_cmdq_exit(monarco_cxt_t *cxt);
+
+/* Push command, thread-safe and lock-free
+ *   Returns 0 on success, -1 when the queue is full or not initialized, -2 on invalid command.
+ */
+int monarco_cmdq_push(monarco_cxt_t *cxt, const monarco_cmd_t *cmd);
+
+/* Apply queued commands to `cxt->tx_data`, returns number of applied commands
+ *   Called by monarco_main() before TX CRC, only from the cycle thread.
+ */
+int monarco_cmdq_apply(monarco_cxt_t *cxt);
+
+/* Read queue statistics */
+void monarco_cmdq_stats(monarco_cxt_t *cxt, monarco_cmdq_stats_t *stats);
+
+/* Set bits `mask` of 8-bit output field, e.g. monarco_cmdq_set_bits(&cxt, MONARCO_CMD_FIELD(dout), 0x01) */
+static inline int monarco_cmdq_set_bits(monarco_cxt_t *cxt, uint8_t field, uint8_t mask)
+{
+    monarco_cmd_t cmd = { .op = MONARCO_CMD_WRITE8, .field = field, .mask = mask, .value = mask };
+    return monarco_cmdq_push(cxt, &cmd);
+}
+
+/* Clear bits `mask` of 8-bit output field */
+static inline int monarco_cmdq_clear_bits(monarco_cxt_t *cxt, uint8_t field, uint8_t mask)
+{
+    monarco_cmd_t cmd = { .op = MONARCO_CMD_WRITE8, .field = field, .mask = mask, .value = 0 };
+    return monarco_cmdq_push(cxt, &cmd);
+}
+
+/* Write bits `mask` of 8-bit output field to `value`, other bits are kept */
+static inline int monarco_cmdq_write_bits(monarco_cxt_t *cxt, uint8_t field, uint8_t mask, uint8_t value)
+{
+    monarco_cmd_t cmd = { .op = MONARCO_CMD_WRITE8, .field = field, .mask = mask, .value = value };
+    return monarco_cmdq_push(cxt, &cmd);
+}
+
+/* Set 16-bit output field - analog output, PWM frequency or duty cycle (see monarco_util.h for conversions) */
+static inline int monarco_cmdq_set_u16(monarco_cxt_t *cxt, uint8_t field, uint16_t value)
+{
+    monarco_cmd_t cmd = { .op = MONARCO_CMD_WRITE16, .field = field, .value = value };
+    return monarco_cmdq_push(cxt, &cmd);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+/***************************************************************************//**
+ * @file monarco_cosim.c
+ * @brief libmonarco - Virtual-Clock Co-Simulation with Plant Models
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_cosim.h"
+
+#include <stddef.h>
+#include <math.h>
+
+#include "monarco_util.h"
+
+int monarco_cosim_init(monarco_cosim_t *cs, monarco_sim_t *sim, monarco_plant_t *plants, int count, uint32_t period_us)
+{
+    if ((sim == NULL) || (count < 0) || ((plants == NULL) && (count > 0)) || (period_us == 0)) {
+        return -1;
+    }
+
+    cs->sim = sim;
+    cs->plants = plants;
+    cs->plant_count = count;
+    cs->period_ns = period_us * 1000ULL;
+    cs->substeps = 1;
+    cs->now_ns = 0;
+    cs->frames = 0;
+
+    sim->clock_ns = &cs->now_ns;
+
+    return 0;
+}
+
+double monarco_cosim_output(const monarco_sim_t *sim, int channel)
+{
+    const monarco_struct_tx_t *out = &sim->outputs;
+
+    switch (channel) {
+    case MONARCO_CTRL_OUT_AOUT1: return monarco_util_ain_10v_to_real(out->aout1);
+    case MONARCO_CTRL_OUT_AOUT2: return monarco_util_ain_10v_to_real(out->aout2);
+    case MONARCO_CTRL_OUT_PWM1A: return out->pwm1a_dc / 65535.0;
+    case MONARCO_CTRL_OUT_PWM1B: return out->pwm1b_dc / 65535.0;
+    case MONARCO_CTRL_OUT_PWM1C: return out->pwm1c_dc / 65535.0;
+    case MONARCO_CTRL_OUT_PWM2A: return out->pwm2a_dc / 65535.0;
+    default: return 0.0;
+    }
+}
+
+void monarco_cosim_input(monarco_sim_t *sim, int channel, double value)
+{
+    switch (channel) {
+    case MONARCO_CTRL_IN_AIN1: sim->ain1 = monarco_util_aout_volts_to_u16(value); break;
+    case MONARCO_CTRL_IN_AIN2: sim->ain2 = monarco_util_aout_volts_to_u16(value); break;
+    case MONARCO_CTRL_IN_CNT1: sim->cnt1 = (uint32_t)(int64_t)floor(value) & 0xFFFF; break;
+    case MONARCO_CTRL_IN_CNT2: sim->cnt2 = (uint32_t)(int64_t)floor(value) & 0xFFFF; break;
+    default: break;
+    }
+}
+
+/* Advance counter input `channel` by `counts` */
+static void monarco_cosim_count(monarco_sim_t *sim, int channel, int64_t counts)
+{
+    if (channel == MONARCO_CTRL_IN_CNT1) {
+        sim->cnt1 = (uint32_t)(sim->cnt1 + counts) & 0xFFFF;
+    }
+    else if (channel == MONARCO_CTRL_IN_CNT2) {
+        sim->cnt2 = (uint32_t)(sim->cnt2 + counts) & 0xFFFF;
+    }
+}
+
+/* Advance plant by `dt` (s) with HAT outputs held */
+static void monarco_cosim_step(monarco_plant_t *plant, monarco_sim_t *sim, double dt)
+{
+    double u = (plant->input == MONARCO_PLANT_NONE) ? 0.0 : monarco_cosim_output(sim, plant->input);
+
+    switch (plant->type) {
+    case MONARCO_PLANT_LOOPBACK:
+        sim->din = (sim->din & ~plant->dout_mask) | (sim->outputs.dout & plant->dout_mask);
+        if (plant->output != MONARCO_PLANT_NONE) {
+            monarco_cosim_input(sim, plant->output, u);
+        }
+        break;
+
+    case MONARCO_PLANT_LAG: {
+        double y_inf = plant->gain * u + plant->offset;
+        // exact solution for input held over the step
+        plant->state = (plant->tau > 0.0) ? y_inf + (plant->state - y_inf) * exp(-dt / plant->tau) : y_inf;
+        monarco_cosim_input(sim, plant->output, plant->state);
+        break;
+    }
+
+    case MONARCO_PLANT_ENCODER: {
+        double counts = plant->state + (plant->offset + plant->gain * u) * dt;
+        double whole = floor(counts);
+        plant->state = counts - whole;
+        monarco_cosim_count(sim, plant->output, (int64_t)whole);
+        break;
+    }
+
+    case MONARCO_PLANT_CUSTOM:
+        if (plant->step != NULL) {
+            plant->step(plant, sim, dt);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+int monarco_cosim_transfer(void *arg, const monarco_struct_tx_t *tx, monarco_struct_rx_t *rx)
+{
+    monarco_cosim_t *cs = (monarco_cosim_t *)arg;
+    int substeps = (cs->substeps > 0) ? cs->substeps : 1;
+    double dt = cs->period_ns * 1e-9 / substeps;
+    int i, j;
+
+    // HAT latches inputs and accepts outputs at the current process time
+    int rc = monarco_sim_transfer(cs->sim, tx, rx);
+
+    for (i = 0; i < substeps; i++) {
+        for (j = 0; j < cs->plant_count; j++) {
+            monarco_cosim_step(&cs->plants[j], cs->sim, dt);
+        }
+    }
+
+    cs->now_ns += cs->period_ns;
+    cs->frames++;
+
+    return rc;
+}
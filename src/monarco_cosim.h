@@ -0,0 +1,99 @@
+/***************************************************************************//**
+ * @file monarco_cosim.h
+ * @brief libmonarco - Virtual-Clock Co-Simulation with Plant Models
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_COSIM_H_
+#define LIBMONARCO_COSIM_H_
+
+#include <stdint.h>
+#include "monarco_struct.h"
+#include "monarco_sim.h"
+#include "monarco_ctrl.h"
+
+/* Co-simulation runs the cycle against the simulated HAT (monarco_sim.h) wired to plant models, on a virtual
+ * clock instead of wall-clock time. Each transfer is one cycle period of process time: the HAT latches its
+ * inputs and accepts the outputs, then plants are integrated over the period with these outputs held, so the
+ * outputs of a frame show in the inputs of the next one like with a real process. The application calls
+ * `monarco_main()` back to back without sleeping and reads process time by `monarco_cosim_time()`, so hours
+ * of process time run in seconds. The simulated HAT watchdog runs on the virtual clock too.
+ * Plants are evaluated in table order, e.g. a loopback after a lag sees the lag output of this period.
+ * Note the library modules measuring host time (`monarco_clock.h`, `monarco_wdt.h`) keep measuring wall-clock.
+ */
+
+/* Channel not connected */
+#define MONARCO_PLANT_NONE 0xFF
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Plant model types */
+enum {
+    MONARCO_PLANT_LOOPBACK, /* Wiring - `dout_mask` bits of DOUT to the same DIN bits, analog `input` to `output` */
+    MONARCO_PLANT_LAG, /* First-order lag - tau * dy/dt + y = gain * input + offset */
+    MONARCO_PLANT_ENCODER, /* Pulse generator - counter advanced at rate offset + gain * input (counts/s), may be negative */
+    MONARCO_PLANT_CUSTOM, /* Model step function of the application */
+};
+
+/* Plant Model
+ *   `input` is an output channel of the HAT MONARCO_CTRL_OUT_* - AOUT in V, PWM duty cycle 0..1 - or MONARCO_PLANT_NONE
+ *   for input 0, `output` is an input channel MONARCO_CTRL_IN_* - AIN in V (clamped to 0..10 V), COUNTER in counts.
+ */
+typedef struct monarco_plant_s {
+    uint8_t type; /* MONARCO_PLANT_* */
+    uint8_t input; /* MONARCO_CTRL_OUT_* or MONARCO_PLANT_NONE */
+    uint8_t output; /* MONARCO_CTRL_IN_* or MONARCO_PLANT_NONE */
+    uint8_t dout_mask; /* LOOPBACK - wired digital channels */
+    double gain; /* LAG - static gain, ENCODER - counts/s per input unit */
+    double offset; /* LAG - output offset (V), ENCODER - counts/s at zero input */
+    double tau; /* LAG - time constant (s), 0 = static */
+    double state; /* LAG - output, ENCODER - fractional count, initial value may be set */
+    void (*step)(struct monarco_plant_s *plant, monarco_sim_t *sim, double dt); /* CUSTOM - advance model by `dt` (s) */
+    void *arg; /* CUSTOM - model data */
+} monarco_plant_t;
+
+/* Co-Simulation Context, owned by the application */
+typedef struct {
+    monarco_sim_t *sim; /* Simulated HAT */
+    monarco_plant_t *plants; /* Plant models */
+    int plant_count; /* Number of `plants` */
+    uint64_t period_ns; /* Process time of one transfer (ns) */
+    int substeps; /* Integration steps per period, 1 by default - exact for LAG and ENCODER */
+    uint64_t now_ns; /* Virtual clock - process time of the next transfer (ns) */
+    uint64_t frames; /* Number of transfers */
+} monarco_cosim_t;
+
+/* Initialize co-simulation of `*sim` (initialized by monarco_sim_init()) with `count` plants `*plants` owned
+ *   by the application and cycle period `period_us` of process time, the virtual clock starts at 0.
+ *   Then `monarco_init_transfer(&cxt, monarco_cosim_transfer, cs, ...)`. Returns -1 on invalid arguments.
+ */
+int monarco_cosim_init(monarco_cosim_t *cs, monarco_sim_t *sim, monarco_plant_t *plants, int count, uint32_t period_us);
+
+/* Exchange one frame and advance process time by one period, `cs` is monarco_cosim_t *, see monarco_transfer_fn_t */
+int monarco_cosim_transfer(void *cs, const monarco_struct_tx_t *tx, monarco_struct_rx_t *rx);
+
+/* Process time (s) */
+static inline double monarco_cosim_time(const monarco_cosim_t *cs)
+{
+    return cs->now_ns * 1e-9;
+}
+
+/* Value of HAT output channel MONARCO_CTRL_OUT_* of the last accepted frame - AOUT in V, PWM duty cycle 0..1 */
+double monarco_cosim_output(const monarco_sim_t *sim, int channel);
+
+/* Set HAT input channel MONARCO_CTRL_IN_* - AIN in V (clamped to 0..10 V), COUNTER in counts (16-bit wrap) */
+void monarco_cosim_input(monarco_sim_t *sim, int channel, double value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
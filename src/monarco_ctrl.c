@@ -0,0 +1,339 @@
+/***************************************************************************//**
+ * @file monarco_ctrl.c
+ * @brief libmonarco - Control Blocks
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_ctrl.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "monarco_platform.h"
+
+/* Q16.16 helpers, products are done in 64 bits */
+#define Q_MUL(a, b) (((int64_t)(a) * (b)) >> 16)
+#define Q_TO_INT(q) ((int32_t)(((q) + (MONARCO_CTRL_Q_ONE / 2)) >> 16))
+
+static int32_t monarco_ctrl_q(double x)
+{
+    double q = x * MONARCO_CTRL_Q_ONE;
+
+    if (q > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (q < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t)(q >= 0 ? q + 0.5 : q - 0.5);
+}
+
+/*
+ * PID
+ */
+
+void monarco_ctrl_pid_f_init(monarco_ctrl_pid_f_t *pid, float kp, float ki, float kd, float kaw, float out_min, float out_max, float ts)
+{
+    memset(pid, 0, sizeof(monarco_ctrl_pid_f_t));
+    pid->kp = kp;
+    pid->ki_ts = ki * ts;
+    pid->kd_ts = (ts > 0) ? kd / ts : 0;
+    pid->kaw_ts = kaw * ts;
+    pid->out_min = out_min;
+    pid->out_max = out_max;
+}
+
+float monarco_ctrl_pid_f_step(monarco_ctrl_pid_f_t *pid, float sp, float pv)
+{
+    float e = sp - pv;
+
+    if (!pid->started) {
+        pid->pv_prev = pv;
+        pid->started = 1;
+    }
+
+    float u_unsat = pid->kp * e + pid->integ - pid->kd_ts * (pv - pid->pv_prev);
+    float u = u_unsat;
+
+    if (u > pid->out_max) {
+        u = pid->out_max;
+    }
+    else if (u < pid->out_min) {
+        u = pid->out_min;
+    }
+
+    if (pid->kaw_ts > 0) {
+        // back-calculation - integrator tracks the saturated output
+        pid->integ += pid->ki_ts * e + pid->kaw_ts * (u - u_unsat);
+    }
+    else if ((u == u_unsat) || ((u_unsat > u) != (e > 0))) {
+        // conditional integration - only when it drives the output out of saturation
+        pid->integ += pid->ki_ts * e;
+    }
+
+    pid->pv_prev = pv;
+
+    return u;
+}
+
+void monarco_ctrl_pid_q_init(monarco_ctrl_pid_q_t *pid, double kp, double ki, double kd, double kaw, int32_t out_min, int32_t out_max, double ts)
+{
+    memset(pid, 0, sizeof(monarco_ctrl_pid_q_t));
+    pid->kp = monarco_ctrl_q(kp);
+    pid->ki_ts = monarco_ctrl_q(ki * ts);
+    pid->kd_ts = (ts > 0) ? monarco_ctrl_q(kd / ts) : 0;
+    pid->kaw_ts = monarco_ctrl_q(kaw * ts);
+    pid->out_min = out_min;
+    pid->out_max = out_max;
+}
+
+int32_t monarco_ctrl_pid_q_step(monarco_ctrl_pid_q_t *pid, int32_t sp, int32_t pv)
+{
+    int64_t e = (int64_t)sp - pv;
+
+    if (!pid->started) {
+        pid->pv_prev = pv;
+        pid->started = 1;
+    }
+
+    int64_t u_unsat = (int64_t)pid->kp * e + pid->integ - (int64_t)pid->kd_ts * ((int64_t)pv - pid->pv_prev);
+    int64_t u = u_unsat;
+
+    if (u > ((int64_t)pid->out_max << 16)) {
+        u = (int64_t)pid->out_max << 16;
+    }
+    else if (u < ((int64_t)pid->out_min << 16)) {
+        u = (int64_t)pid->out_min << 16;
+    }
+
+    if (pid->kaw_ts > 0) {
+        pid->integ += (int64_t)pid->ki_ts * e + Q_MUL(pid->kaw_ts, u - u_unsat);
+    }
+    else if ((u == u_unsat) || ((u_unsat > u) != (e > 0))) {
+        pid->integ += (int64_t)pid->ki_ts * e;
+    }
+
+    pid->pv_prev = pv;
+
+    return Q_TO_INT(u);
+}
+
+/*
+ * Lead/Lag
+ *   Tustin: y[n] = b0*x[n] + b1*x[n-1] - a1*y[n-1]
+ *   b0 = k*(2*t_lead/ts + 1)/d, b1 = k*(1 - 2*t_lead/ts)/d, a1 = (1 - 2*t_lag/ts)/d, d = 2*t_lag/ts + 1
+ */
+
+static void monarco_ctrl_leadlag_coef(double k, double t_lead, double t_lag, double ts, double *b0, double *b1, double *a1)
+{
+    double d = 2 * t_lag / ts + 1;
+
+    *b0 = k * (2 * t_lead / ts + 1) / d;
+    *b1 = k * (1 - 2 * t_lead / ts) / d;
+    *a1 = (1 - 2 * t_lag / ts) / d;
+}
+
+void monarco_ctrl_leadlag_f_init(monarco_ctrl_leadlag_f_t *ll, float k, float t_lead, float t_lag, float ts)
+{
+    double b0, b1, a1;
+
+    memset(ll, 0, sizeof(monarco_ctrl_leadlag_f_t));
+    monarco_ctrl_leadlag_coef(k, t_lead, t_lag, ts, &b0, &b1, &a1);
+    ll->b0 = b0;
+    ll->b1 = b1;
+    ll->a1 = a1;
+}
+
+float monarco_ctrl_leadlag_f_step(monarco_ctrl_leadlag_f_t *ll, float x)
+{
+    if (!ll->started) {
+        // start from steady state for input `x`
+        ll->x_prev = x;
+        ll->y_prev = (ll->b0 + ll->b1) / (1 + ll->a1) * x;
+        ll->started = 1;
+    }
+
+    float y = ll->b0 * x + ll->b1 * ll->x_prev - ll->a1 * ll->y_prev;
+
+    ll->x_prev = x;
+    ll->y_prev = y;
+
+    return y;
+}
+
+void monarco_ctrl_leadlag_q_init(monarco_ctrl_leadlag_q_t *ll, double k, double t_lead, double t_lag, double ts)
+{
+    double b0, b1, a1;
+
+    memset(ll, 0, sizeof(monarco_ctrl_leadlag_q_t));
+    monarco_ctrl_leadlag_coef(k, t_lead, t_lag, ts, &b0, &b1, &a1);
+    ll->b0 = monarco_ctrl_q(b0);
+    ll->b1 = monarco_ctrl_q(b1);
+    ll->a1 = monarco_ctrl_q(a1);
+}
+
+int32_t monarco_ctrl_leadlag_q_step(monarco_ctrl_leadlag_q_t *ll, int32_t x)
+{
+    if (!ll->started) {
+        ll->x_prev = x;
+        ll->y_prev = (MONARCO_CTRL_Q_ONE + ll->a1) ? ((int64_t)ll->b0 + ll->b1) * x * MONARCO_CTRL_Q_ONE / (MONARCO_CTRL_Q_ONE + ll->a1) : 0;
+        ll->started = 1;
+    }
+
+    int64_t y = (int64_t)ll->b0 * x + (int64_t)ll->b1 * ll->x_prev - Q_MUL(ll->a1, ll->y_prev);
+
+    ll->x_prev = x;
+    ll->y_prev = y;
+
+    return Q_TO_INT(y);
+}
+
+/*
+ * Rate Limiter
+ */
+
+void monarco_ctrl_rate_f_init(monarco_ctrl_rate_f_t *rl, float rise, float fall, float ts)
+{
+    memset(rl, 0, sizeof(monarco_ctrl_rate_f_t));
+    rl->rise_ts = rise * ts;
+    rl->fall_ts = fall * ts;
+}
+
+float monarco_ctrl_rate_f_step(monarco_ctrl_rate_f_t *rl, float x)
+{
+    if (!rl->started) {
+        rl->y = x;
+        rl->started = 1;
+    }
+    else if (x > rl->y + rl->rise_ts) {
+        rl->y += rl->rise_ts;
+    }
+    else if (x < rl->y - rl->fall_ts) {
+        rl->y -= rl->fall_ts;
+    }
+    else {
+        rl->y = x;
+    }
+
+    return rl->y;
+}
+
+void monarco_ctrl_rate_q_init(monarco_ctrl_rate_q_t *rl, double rise, double fall, double ts)
+{
+    memset(rl, 0, sizeof(monarco_ctrl_rate_q_t));
+    rl->rise_ts = monarco_ctrl_q(rise * ts);
+    rl->fall_ts = monarco_ctrl_q(fall * ts);
+}
+
+int32_t monarco_ctrl_rate_q_step(monarco_ctrl_rate_q_t *rl, int32_t x)
+{
+    int64_t xq = (int64_t)x << 16;
+
+    if (!rl->started) {
+        rl->y = xq;
+        rl->started = 1;
+    }
+    else if (xq > rl->y + rl->rise_ts) {
+        rl->y += rl->rise_ts;
+    }
+    else if (xq < rl->y - rl->fall_ts) {
+        rl->y -= rl->fall_ts;
+    }
+    else {
+        rl->y = xq;
+    }
+
+    return Q_TO_INT(rl->y);
+}
+
+/*
+ * Control Loops
+ */
+
+int monarco_ctrl_attach(monarco_cxt_t *cxt, monarco_ctrl_loop_t *loops, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if ((loops[i].input > MONARCO_CTRL_IN_CNT2) || (loops[i].output > MONARCO_CTRL_OUT_PWM2A)) {
+            MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_ctrl_attach: Loop %i invalid channel\n", i);
+            return -1;
+        }
+    }
+
+    cxt->ctrl_loops = (count > 0) ? loops : NULL;
+    cxt->ctrl_count = (count > 0) ? count : 0;
+
+    return 0;
+}
+
+static inline int32_t monarco_ctrl_input(const monarco_cxt_t *cxt, int input)
+{
+    switch (input) {
+    case MONARCO_CTRL_IN_AIN1: return cxt->rx_data->ain1;
+    case MONARCO_CTRL_IN_AIN2: return cxt->rx_data->ain2;
+    case MONARCO_CTRL_IN_CNT1: return (int32_t)cxt->rx_data->cnt1;
+    default: return (int32_t)cxt->rx_data->cnt2;
+    }
+}
+
+static inline void monarco_ctrl_output(monarco_cxt_t *cxt, int output, int32_t raw)
+{
+    int32_t max = (output <= MONARCO_CTRL_OUT_AOUT2) ? 4095 : 65535;
+    uint16_t v = (raw < 0) ? 0 : (raw > max) ? max : raw;
+
+    switch (output) {
+    case MONARCO_CTRL_OUT_AOUT1: cxt->tx_data.aout1 = v; break;
+    case MONARCO_CTRL_OUT_AOUT2: cxt->tx_data.aout2 = v; break;
+    case MONARCO_CTRL_OUT_PWM1A: cxt->tx_data.pwm1a_dc = v; break;
+    case MONARCO_CTRL_OUT_PWM1B: cxt->tx_data.pwm1b_dc = v; break;
+    case MONARCO_CTRL_OUT_PWM1C: cxt->tx_data.pwm1c_dc = v; break;
+    default: cxt->tx_data.pwm2a_dc = v; break;
+    }
+}
+
+void monarco_ctrl_run(monarco_cxt_t *cxt)
+{
+    int i;
+
+    for (i = 0; i < cxt->ctrl_count; i++) {
+        monarco_ctrl_loop_t *loop = &cxt->ctrl_loops[i];
+
+        if (!loop->enabled) {
+            continue;
+        }
+
+        int32_t raw = monarco_ctrl_input(cxt, loop->input);
+
+        if (loop->fixed) {
+            int32_t u = loop->pid_q ? monarco_ctrl_pid_q_step(loop->pid_q, loop->sp_q, raw) : raw;
+            if (loop->leadlag_q) {
+                u = monarco_ctrl_leadlag_q_step(loop->leadlag_q, u);
+            }
+            if (loop->rate_q) {
+                u = monarco_ctrl_rate_q_step(loop->rate_q, u);
+            }
+            loop->out_raw = u;
+        }
+        else {
+            float pv = raw * (loop->in_scale != 0 ? loop->in_scale : 1.0f) + loop->in_offset;
+            float u = loop->pid_f ? monarco_ctrl_pid_f_step(loop->pid_f, loop->sp_f, pv) : pv;
+            if (loop->leadlag_f) {
+                u = monarco_ctrl_leadlag_f_step(loop->leadlag_f, u);
+            }
+            if (loop->rate_f) {
+                u = monarco_ctrl_rate_f_step(loop->rate_f, u);
+            }
+            u = u * (loop->out_scale != 0 ? loop->out_scale : 1.0f) + loop->out_offset;
+            loop->out_raw = (u >= INT32_MAX) ? INT32_MAX : (u <= INT32_MIN) ? INT32_MIN : (int32_t)(u + (u >= 0 ? 0.5f : -0.5f));
+        }
+
+        monarco_ctrl_output(cxt, loop->output, loop->out_raw);
+    }
+}
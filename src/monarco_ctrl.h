@@ -0,0 +1,168 @@
+/***************************************************************************//**
+ * @file monarco_ctrl.h
+ * @brief libmonarco - Control Blocks
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_CTRL_H_
+#define LIBMONARCO_CTRL_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* Control blocks - PID with anti-windup, lead/lag and rate limiter - in float and fixed-point (Q16.16)
+ * variants. All state is kept in structures owned by the application, blocks never allocate memory.
+ * Blocks can be used standalone, or chained into control loops attached by `monarco_ctrl_attach()`,
+ * which `monarco_main()` runs right after a frame with valid CRC is received. Loop outputs are written
+ * to `tx_data` inside the driver cycle and sent by the next frame, without passing through the application.
+ * `*_init()` functions precompute coefficients from sample time `ts` (s) and may use floating point,
+ * `*_step()` functions of the fixed-point variant use only integer arithmetic.
+ */
+
+/* Fixed-point Q16.16 one */
+#define MONARCO_CTRL_Q_ONE (1 << 16)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Loop input channels */
+enum {
+    MONARCO_CTRL_IN_AIN1, /* rx_data->ain1 */
+    MONARCO_CTRL_IN_AIN2, /* rx_data->ain2 */
+    MONARCO_CTRL_IN_CNT1, /* rx_data->cnt1 */
+    MONARCO_CTRL_IN_CNT2, /* rx_data->cnt2 */
+};
+
+/* Loop output channels, values are clamped to the channel range */
+enum {
+    MONARCO_CTRL_OUT_AOUT1, /* tx_data.aout1, 0..4095 */
+    MONARCO_CTRL_OUT_AOUT2, /* tx_data.aout2, 0..4095 */
+    MONARCO_CTRL_OUT_PWM1A, /* tx_data.pwm1a_dc, 0..65535 */
+    MONARCO_CTRL_OUT_PWM1B, /* tx_data.pwm1b_dc, 0..65535 */
+    MONARCO_CTRL_OUT_PWM1C, /* tx_data.pwm1c_dc, 0..65535 */
+    MONARCO_CTRL_OUT_PWM2A, /* tx_data.pwm2a_dc, 0..65535 */
+};
+
+/* PID Controller, float
+ *   u = kp*e + ki*integral(e) - kd*d(pv)/dt, derivative on measurement, output limited to [out_min, out_max].
+ *   Anti-windup by back-calculation with tracking gain `kaw` (1/s), `kaw = 0` stops integration while saturated.
+ */
+typedef struct {
+    float kp; /* Proportional gain */
+    float ki_ts; /* Private, ki * ts */
+    float kd_ts; /* Private, kd / ts */
+    float kaw_ts; /* Private, kaw * ts */
+    float out_min; /* Output low limit */
+    float out_max; /* Output high limit */
+    float integ; /* State, integral term */
+    float pv_prev; /* State, previous process value */
+    int started; /* State, 0 = first step after reset */
+} monarco_ctrl_pid_f_t;
+
+/* PID Controller, fixed-point - gains Q16.16, process values and output in integer units */
+typedef struct {
+    int32_t kp; /* Proportional gain, Q16.16 */
+    int32_t ki_ts; /* Private, ki * ts, Q16.16 */
+    int32_t kd_ts; /* Private, kd / ts, Q16.16 */
+    int32_t kaw_ts; /* Private, kaw * ts, Q16.16 */
+    int32_t out_min; /* Output low limit */
+    int32_t out_max; /* Output high limit */
+    int64_t integ; /* State, integral term, Q16.16 */
+    int32_t pv_prev; /* State, previous process value */
+    int started; /* State, 0 = first step after reset */
+} monarco_ctrl_pid_q_t;
+
+/* Lead/Lag Compensator, float - H(s) = k * (t_lead*s + 1) / (t_lag*s + 1), Tustin discretization */
+typedef struct {
+    float b0, b1, a1; /* Private, difference equation coefficients */
+    float x_prev; /* State, previous input */
+    float y_prev; /* State, previous output */
+    int started; /* State, 0 = first step after reset */
+} monarco_ctrl_leadlag_f_t;
+
+/* Lead/Lag Compensator, fixed-point */
+typedef struct {
+    int32_t b0, b1, a1; /* Private, difference equation coefficients, Q16.16 */
+    int32_t x_prev; /* State, previous input */
+    int64_t y_prev; /* State, previous output, Q16.16 */
+    int started; /* State, 0 = first step after reset */
+} monarco_ctrl_leadlag_q_t;
+
+/* Rate Limiter, float - output follows input with slope limited to `rise` and `fall` (units/s) */
+typedef struct {
+    float rise_ts; /* Private, maximal increase per step */
+    float fall_ts; /* Private, maximal decrease per step */
+    float y; /* State, output */
+    int started; /* State, 0 = first step after reset */
+} monarco_ctrl_rate_f_t;
+
+/* Rate Limiter, fixed-point */
+typedef struct {
+    int64_t rise_ts; /* Private, maximal increase per step, Q16.16 */
+    int64_t fall_ts; /* Private, maximal decrease per step, Q16.16 */
+    int64_t y; /* State, output, Q16.16 */
+    int started; /* State, 0 = first step after reset */
+} monarco_ctrl_rate_q_t;
+
+/* PID init with gains `kp`, `ki` (1/s), `kd` (s), anti-windup gain `kaw` (1/s), output limits and sample time `ts` (s), step returns output */
+void monarco_ctrl_pid_f_init(monarco_ctrl_pid_f_t *pid, float kp, float ki, float kd, float kaw, float out_min, float out_max, float ts);
+float monarco_ctrl_pid_f_step(monarco_ctrl_pid_f_t *pid, float sp, float pv);
+void monarco_ctrl_pid_q_init(monarco_ctrl_pid_q_t *pid, double kp, double ki, double kd, double kaw, int32_t out_min, int32_t out_max, double ts);
+int32_t monarco_ctrl_pid_q_step(monarco_ctrl_pid_q_t *pid, int32_t sp, int32_t pv);
+
+/* Lead/lag init with gain `k` and time constants `t_lead`, `t_lag` (s), first step starts from steady state */
+void monarco_ctrl_leadlag_f_init(monarco_ctrl_leadlag_f_t *ll, float k, float t_lead, float t_lag, float ts);
+float monarco_ctrl_leadlag_f_step(monarco_ctrl_leadlag_f_t *ll, float x);
+void monarco_ctrl_leadlag_q_init(monarco_ctrl_leadlag_q_t *ll, double k, double t_lead, double t_lag, double ts);
+int32_t monarco_ctrl_leadlag_q_step(monarco_ctrl_leadlag_q_t *ll, int32_t x);
+
+/* Rate limiter init with maximal slopes `rise`, `fall` (units/s, positive), first step passes input through */
+void monarco_ctrl_rate_f_init(monarco_ctrl_rate_f_t *rl, float rise, float fall, float ts);
+float monarco_ctrl_rate_f_step(monarco_ctrl_rate_f_t *rl, float x);
+void monarco_ctrl_rate_q_init(monarco_ctrl_rate_q_t *rl, double rise, double fall, double ts);
+int32_t monarco_ctrl_rate_q_step(monarco_ctrl_rate_q_t *rl, int32_t x);
+
+/* Control Loop
+ *   input channel -> [PID] -> [lead/lag] -> [rate limiter] -> output channel, unused blocks are NULL.
+ *   Float loops scale raw input by `pv = raw * in_scale + in_offset` and output by `raw = u * out_scale + out_offset`
+ *   (scale 0 means 1), fixed-point loops work in raw channel units. Without PID block the setpoint is ignored
+ *   and the input is passed to the following blocks.
+ */
+typedef struct monarco_ctrl_loop_s {
+    uint8_t input; /* MONARCO_CTRL_IN_* */
+    uint8_t output; /* MONARCO_CTRL_OUT_* */
+    uint8_t fixed; /* 0 = float blocks (`*_f`), 1 = fixed-point blocks (`*_q`) */
+    uint8_t enabled; /* Loop runs only when nonzero, output channel is left untouched otherwise */
+    float sp_f; /* Setpoint of float loop, in scaled units */
+    int32_t sp_q; /* Setpoint of fixed-point loop, in raw input units */
+    float in_scale, in_offset; /* Float loop input scaling */
+    float out_scale, out_offset; /* Float loop output scaling */
+    monarco_ctrl_pid_f_t *pid_f; /* Blocks of float loop, or NULL */
+    monarco_ctrl_leadlag_f_t *leadlag_f;
+    monarco_ctrl_rate_f_t *rate_f;
+    monarco_ctrl_pid_q_t *pid_q; /* Blocks of fixed-point loop, or NULL */
+    monarco_ctrl_leadlag_q_t *leadlag_q;
+    monarco_ctrl_rate_q_t *rate_q;
+    int32_t out_raw; /* Last output written to the channel, read-only */
+} monarco_ctrl_loop_t;
+
+/* Attach `count` control loops `*loops` owned by the application, run by each monarco_main() with valid input data.
+ *   Pass NULL / 0 to detach. Loop outputs own their channels, do not write them from the application.
+ */
+int monarco_ctrl_attach(monarco_cxt_t *cxt, monarco_ctrl_loop_t *loops, int count);
+
+/* Run attached loops once, called by monarco_main() */
+void monarco_ctrl_run(monarco_cxt_t *cxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+/***************************************************************************//**
+ * @file monarco_event.c
+ * @brief libmonarco - Event Loop Integration
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_event.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "monarco_platform.h"
+
+int monarco_event_init(monarco_event_t *ev, monarco_cxt_t *cxt, uint32_t period_us)
+{
+    memset(ev, 0, sizeof(monarco_event_t));
+    ev->cxt = cxt;
+    ev->event_fd = -1;
+    ev->sdc_done = cxt->stats.sdc_done + cxt->stats.sdc_cached;
+
+    ev->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ev->timer_fd < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_event_init: Failed to create timerfd: %i: %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    ev->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ev->event_fd < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_event_init: Failed to create eventfd: %i: %s\n", errno, strerror(errno));
+        monarco_event_exit(ev);
+        return -1;
+    }
+
+    if (monarco_event_period(ev, period_us) < 0) {
+        monarco_event_exit(ev);
+        return -1;
+    }
+
+    return 0;
+}
+
+int monarco_event_period(monarco_event_t *ev, uint32_t period_us)
+{
+    monarco_cxt_t *cxt = ev->cxt;
+    struct itimerspec its;
+
+    if (period_us == 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_event_period: Invalid period\n");
+        return -1;
+    }
+
+    // relative first expiration, then the kernel keeps absolute deadlines spaced by the interval
+    its.it_interval.tv_sec = period_us / 1000000;
+    its.it_interval.tv_nsec = (period_us % 1000000) * 1000;
+    its.it_value = its.it_interval;
+
+    if (timerfd_settime(ev->timer_fd, 0, &its, NULL) < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_event_period: Failed to arm timerfd: %i: %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    ev->period_us = period_us;
+
+    return 0;
+}
+
+int monarco_event_cycle(monarco_event_t *ev)
+{
+    monarco_cxt_t *cxt = ev->cxt;
+    uint64_t expirations;
+    uint32_t events = 0;
+
+    if (read(ev->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        if (errno == EAGAIN) {
+            return 0;
+        }
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_event_cycle: Failed to read timerfd: %i: %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    uint64_t missed = expirations - 1;
+
+    ev->expirations += expirations;
+    if (missed > 0) {
+        ev->missed += missed;
+        ev->overruns++;
+        if (missed > ev->max_missed) {
+            ev->max_missed = (missed < UINT32_MAX) ? (uint32_t)missed : UINT32_MAX;
+        }
+    }
+
+    ev->last_rc = monarco_main(cxt);
+
+    events |= (ev->last_rc == 0) ? MONARCO_EVENT_RX : MONARCO_EVENT_ERROR;
+
+    uint32_t sdc_done = cxt->stats.sdc_done + cxt->stats.sdc_cached;
+    if (sdc_done != ev->sdc_done) {
+        ev->sdc_done = sdc_done;
+        events |= MONARCO_EVENT_SDC;
+    }
+
+    // publish mask before the wakeup, a consumer woken by the previous write may already take it
+    __atomic_fetch_or(&ev->pending, events, __ATOMIC_RELEASE);
+
+    uint64_t one = 1;
+    if ((write(ev->event_fd, &one, sizeof(one)) != sizeof(one)) && (errno != EAGAIN)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_event_cycle: Failed to signal eventfd: %i: %s\n", errno, strerror(errno));
+    }
+
+    return (missed < INT32_MAX) ? (int)missed : INT32_MAX;
+}
+
+uint32_t monarco_event_take(monarco_event_t *ev)
+{
+    uint64_t count;
+
+    // reset eventfd first, events published later keep it readable, EAGAIN when nothing was signalled
+    ssize_t rc = read(ev->event_fd, &count, sizeof(count));
+    (void)rc;
+
+    return __atomic_exchange_n(&ev->pending, 0, __ATOMIC_ACQUIRE);
+}
+
+void monarco_event_exit(monarco_event_t *ev)
+{
+    if (ev->timer_fd >= 0) {
+        close(ev->timer_fd);
+        ev->timer_fd = -1;
+    }
+
+    if (ev->event_fd >= 0) {
+        close(ev->event_fd);
+        ev->event_fd = -1;
+    }
+}
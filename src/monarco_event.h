@@ -0,0 +1,77 @@
+/***************************************************************************//**
+ * @file monarco_event.h
+ * @brief libmonarco - Event Loop Integration
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_EVENT_H_
+#define LIBMONARCO_EVENT_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* Drives the cycle from an existing poll / epoll event loop instead of a dedicated thread sleeping
+ * in clock_nanosleep(). Two non-blocking file descriptors are exposed:
+ *  - `timer_fd` - timerfd with absolute cycle deadlines, when readable call `monarco_event_cycle()`,
+ *    which runs `monarco_main()` once, however many deadlines expired since the last call,
+ *  - `event_fd` - eventfd readable when there are results to consume, call `monarco_event_take()`
+ *    to get MONARCO_EVENT_* mask. It may be watched by the same loop or by another thread.
+ * Deadlines expired without a cycle are counted as missed, so overruns of the loop stay visible.
+ */
+
+/* Events signalled by `event_fd` */
+#define MONARCO_EVENT_RX    0x01 /* New input process data with valid CRC in `cxt->rx_data` */
+#define MONARCO_EVENT_SDC   0x02 /* One or more SDC Items completed, see monarco_sdc_done() */
+#define MONARCO_EVENT_ERROR 0x04 /* Cycle failed, `last_rc` holds monarco_main() result */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Event Loop Driver */
+typedef struct {
+    monarco_cxt_t *cxt; /* Driven context */
+    int timer_fd; /* timerfd of cycle deadlines, watch for readability */
+    int event_fd; /* eventfd of MONARCO_EVENT_*, watch for readability */
+    uint32_t period_us; /* Cycle period (us) */
+    uint32_t pending; /* Private, MONARCO_EVENT_* not yet taken, accessed atomically */
+    uint32_t sdc_done; /* Private, SDC completions seen by the last cycle */
+    int last_rc; /* Result of the last monarco_main() */
+    uint64_t expirations; /* Timer expirations in total */
+    uint64_t missed; /* Expirations without own cycle - deadline overruns */
+    uint32_t overruns; /* Cycles started after one or more missed deadlines */
+    uint32_t max_missed; /* Maximal number of deadlines missed in a row */
+} monarco_event_t;
+
+/* Create timer and event descriptors driving `cxt` each `period_us` microseconds, the first
+ *   deadline is one period from now. Returns -1 when a descriptor cannot be created.
+ */
+int monarco_event_init(monarco_event_t *ev, monarco_cxt_t *cxt, uint32_t period_us);
+
+/* Change the cycle period, the next deadline is one `period_us` from now */
+int monarco_event_period(monarco_event_t *ev, uint32_t period_us);
+
+/* Run one cycle when `timer_fd` is readable
+ *   Consumes timer expirations and runs `monarco_main()` once, then signals results by `event_fd`.
+ *   Returns number of deadlines missed since the previous cycle (0 on time), 0 without running
+ *   the cycle on spurious wakeup, or -1 when the timer cannot be read.
+ */
+int monarco_event_cycle(monarco_event_t *ev);
+
+/* Take pending events when `event_fd` is readable, returns MONARCO_EVENT_* mask, may be called from another thread */
+uint32_t monarco_event_take(monarco_event_t *ev);
+
+/* Close timer and event descriptors */
+void monarco_event_exit(monarco_event_t *ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
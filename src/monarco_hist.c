@@ -0,0 +1,622 @@
+/***************************************************************************//**
+ * @file monarco_hist.c
+ * @brief libmonarco - Columnar Compressed Historian
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_hist.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define MONARCO_HIST_MAGIC 0x3148534DU /* "MSH1" */
+
+/* Encoded size limit of one sample - varint token and varint repeat count */
+#define MONARCO_HIST_SAMPLE_MAX 15
+
+/* Index file header, followed by block records */
+typedef struct {
+    uint32_t magic; /* MONARCO_HIST_MAGIC */
+    uint32_t record_size; /* sizeof(monarco_hist_block_t) */
+} monarco_hist_header_t;
+
+/* Value columns in monarco_struct_rx_t */
+static const struct {
+    uint8_t offset;
+    uint8_t size;
+} monarco_hist_fields[MONARCO_HIST_COLUMNS] = {
+    [MONARCO_HIST_STATUS] = { offsetof(monarco_struct_rx_t, status_byte), 1 },
+    [MONARCO_HIST_RESERVED1] = { offsetof(monarco_struct_rx_t, reserved1), 2 },
+    [MONARCO_HIST_DIN] = { offsetof(monarco_struct_rx_t, din), 1 },
+    [MONARCO_HIST_CNT1] = { offsetof(monarco_struct_rx_t, cnt1), 4 },
+    [MONARCO_HIST_CNT2] = { offsetof(monarco_struct_rx_t, cnt2), 4 },
+    [MONARCO_HIST_CNT3] = { offsetof(monarco_struct_rx_t, cnt3), 4 },
+    [MONARCO_HIST_AIN1] = { offsetof(monarco_struct_rx_t, ain1), 2 },
+    [MONARCO_HIST_AIN2] = { offsetof(monarco_struct_rx_t, ain2), 2 },
+};
+
+static inline uint32_t monarco_hist_field(const monarco_struct_rx_t *rx, int column)
+{
+    const uint8_t *p = (const uint8_t *)rx + monarco_hist_fields[column].offset;
+    uint16_t u16;
+    uint32_t u32;
+
+    if (column == MONARCO_HIST_STATUS) {
+        // sign_of_life counts transfers, implied by sample order
+        return *p & 0x3F;
+    }
+
+    switch (monarco_hist_fields[column].size) {
+    case 1: return *p;
+    case 2: memcpy(&u16, p, 2); return u16;
+    default: memcpy(&u32, p, 4); return u32;
+    }
+}
+
+static inline uint8_t *monarco_hist_put_varint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/* Returns pointer past the varint, NULL when truncated */
+static inline const uint8_t *monarco_hist_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t r = 0;
+    int shift = 0;
+
+    while ((p < end) && (shift < 64)) {
+        uint8_t b = *p++;
+        r |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return p;
+        }
+        shift += 7;
+    }
+
+    return NULL;
+}
+
+/* Encode time column `*t` or value column `*v` (the other one NULL), returns encoded size
+ *   Each token is zigzag difference to the previous sample shifted by one, low bit set when followed
+ *   by count of further samples with the same difference.
+ */
+static size_t monarco_hist_encode(uint8_t *out, const int64_t *t, const uint32_t *v, uint32_t count)
+{
+    uint8_t *p = out;
+    int64_t prev = 0;
+    uint32_t i = 0;
+
+#define MONARCO_HIST_VAL(k) (t ? t[k] : (int64_t)v[k])
+
+    while (i < count) {
+        int64_t d = MONARCO_HIST_VAL(i) - prev;
+        uint32_t run = 1;
+
+        while ((i + run < count) && (MONARCO_HIST_VAL(i + run) - MONARCO_HIST_VAL(i + run - 1) == d)) {
+            run++;
+        }
+
+        uint64_t zz = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+        p = monarco_hist_put_varint(p, (zz << 1) | (run > 1));
+        if (run > 1) {
+            p = monarco_hist_put_varint(p, run - 1);
+        }
+
+        prev = MONARCO_HIST_VAL(i + run - 1);
+        i += run;
+    }
+
+#undef MONARCO_HIST_VAL
+
+    return p - out;
+}
+
+/* Decode `count` samples, returns -1 on corrupted data */
+static int monarco_hist_decode(const uint8_t *in, size_t size, int64_t *out, uint32_t count)
+{
+    const uint8_t *p = in;
+    const uint8_t *end = in + size;
+    int64_t prev = 0;
+    uint32_t i = 0;
+
+    while (i < count) {
+        uint64_t token, run = 0;
+
+        if ((p = monarco_hist_get_varint(p, end, &token)) == NULL) {
+            return -1;
+        }
+        if ((token & 1) && ((p = monarco_hist_get_varint(p, end, &run)) == NULL)) {
+            return -1;
+        }
+        if (i + 1 + run > count) {
+            return -1;
+        }
+
+        uint64_t zz = token >> 1;
+        int64_t d = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+
+        for (run++; run > 0; run--) {
+            prev += d;
+            out[i++] = prev;
+        }
+    }
+
+    return 0;
+}
+
+/* Size encoding / decoding buffers for blocks of `samples` */
+static int monarco_hist_reserve(monarco_hist_t *hist, uint32_t samples)
+{
+    if (samples <= hist->buf_samples) {
+        return 0;
+    }
+
+    uint8_t *buf = realloc(hist->buf, (size_t)samples * MONARCO_HIST_SAMPLE_MAX);
+    if (buf == NULL) {
+        return -1;
+    }
+    hist->buf = buf;
+
+    int64_t *dec = realloc(hist->dec, (size_t)samples * 2 * sizeof(int64_t));
+    if (dec == NULL) {
+        return -1;
+    }
+    hist->dec = dec;
+
+    hist->buf_samples = samples;
+
+    return 0;
+}
+
+static FILE *monarco_hist_fopen(const char *path, const char *ext)
+{
+    char name[256];
+
+    snprintf(name, sizeof(name), "%s%s", path, ext);
+
+    FILE *f = fopen(name, "r+b");
+    if ((f == NULL) && (errno == ENOENT)) {
+        f = fopen(name, "w+b");
+    }
+
+    return f;
+}
+
+/* Encoded size of block, 0 when a column size is out of limits */
+static uint64_t monarco_hist_block_size(const monarco_hist_block_t *blk)
+{
+    uint64_t size = 0;
+    int i;
+
+    for (i = 0; i <= MONARCO_HIST_COLUMNS; i++) {
+        if ((blk->size[i] == 0) || (blk->size[i] > (uint64_t)blk->count * MONARCO_HIST_SAMPLE_MAX)) {
+            return 0;
+        }
+        size += blk->size[i];
+    }
+
+    return size;
+}
+
+/* Load index, drop records of blocks not completely written */
+static int monarco_hist_load(monarco_hist_t *hist)
+{
+    monarco_hist_header_t hdr = { .magic = MONARCO_HIST_MAGIC, .record_size = sizeof(monarco_hist_block_t) };
+    monarco_hist_header_t file_hdr;
+
+    fseeko(hist->idx, 0, SEEK_END);
+    off_t idx_size = ftello(hist->idx);
+    fseeko(hist->dat, 0, SEEK_END);
+    uint64_t dat_size = ftello(hist->dat);
+
+    if (idx_size < (off_t)sizeof(hdr)) {
+        rewind(hist->idx);
+        if ((fwrite(&hdr, sizeof(hdr), 1, hist->idx) != 1) || (fflush(hist->idx) != 0)) {
+            return -2;
+        }
+        idx_size = sizeof(hdr);
+    }
+    else {
+        rewind(hist->idx);
+        if ((fread(&file_hdr, sizeof(file_hdr), 1, hist->idx) != 1) || (memcmp(&file_hdr, &hdr, sizeof(hdr)) != 0)) {
+            return -2;
+        }
+    }
+
+    uint32_t count = (idx_size - sizeof(hdr)) / sizeof(monarco_hist_block_t);
+
+    hist->block_capacity = count + 64;
+    if ((hist->blocks = malloc(hist->block_capacity * sizeof(monarco_hist_block_t))) == NULL) {
+        return -1;
+    }
+    if (fread(hist->blocks, sizeof(monarco_hist_block_t), count, hist->idx) != count) {
+        return -2;
+    }
+
+    uint32_t max_count = 0;
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < count; i++) {
+        const monarco_hist_block_t *blk = &hist->blocks[i];
+        if ((blk->offset != hist->dat_size) || (monarco_hist_block_size(blk) == 0) || (blk->offset + monarco_hist_block_size(blk) > dat_size)
+            || ((i > 0) && (blk->t_first < hist->blocks[i - 1].t_last))) {
+            break;
+        }
+        hist->dat_size += monarco_hist_block_size(blk);
+        hist->samples += blk->count;
+        for (k = 0; k <= MONARCO_HIST_COLUMNS; k++) {
+            hist->column_bytes[k] += blk->size[k];
+        }
+        max_count = (blk->count > max_count) ? blk->count : max_count;
+    }
+
+    if ((i < count) || ((off_t)(sizeof(hdr) + count * sizeof(monarco_hist_block_t)) != idx_size) || (hist->dat_size != dat_size)) {
+        fflush(hist->idx);
+        if ((ftruncate(fileno(hist->idx), sizeof(hdr) + i * sizeof(monarco_hist_block_t)) != 0)
+            || (ftruncate(fileno(hist->dat), hist->dat_size) != 0)) {
+            return -2;
+        }
+    }
+
+    hist->block_count = i;
+
+    return monarco_hist_reserve(hist, max_count);
+}
+
+int monarco_hist_open(monarco_hist_t *hist, const char *path, uint32_t block_samples)
+{
+    int i;
+
+    memset(hist, 0, sizeof(monarco_hist_t));
+
+    if (path == NULL) {
+        return -1;
+    }
+
+    hist->block_samples = block_samples ? block_samples : MONARCO_HIST_BLOCK_SAMPLES;
+
+    if (((hist->idx = monarco_hist_fopen(path, ".idx")) == NULL) || ((hist->dat = monarco_hist_fopen(path, ".dat")) == NULL)) {
+        monarco_hist_close(hist);
+        return -2;
+    }
+
+    int rc = monarco_hist_load(hist);
+
+    if ((rc == 0) && (monarco_hist_reserve(hist, hist->block_samples) == 0)) {
+        hist->pend_t = malloc(hist->block_samples * sizeof(int64_t));
+        for (i = 0; i < MONARCO_HIST_COLUMNS; i++) {
+            hist->pend_v[i] = malloc(hist->block_samples * sizeof(uint32_t));
+            rc |= (hist->pend_v[i] == NULL);
+        }
+        rc = ((hist->pend_t == NULL) || rc) ? -1 : 0;
+    }
+    else if (rc == 0) {
+        rc = -1;
+    }
+
+    if (rc < 0) {
+        monarco_hist_close(hist);
+        return rc;
+    }
+
+    return 0;
+}
+
+int monarco_hist_flush(monarco_hist_t *hist)
+{
+    monarco_hist_block_t *blk;
+    uint32_t n = hist->pend_count;
+    uint32_t i;
+    int c;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    if (hist->block_count == hist->block_capacity) {
+        blk = realloc(hist->blocks, hist->block_capacity * 2 * sizeof(monarco_hist_block_t));
+        if (blk == NULL) {
+            return -1;
+        }
+        hist->blocks = blk;
+        hist->block_capacity *= 2;
+    }
+
+    blk = &hist->blocks[hist->block_count];
+    memset(blk, 0, sizeof(monarco_hist_block_t));
+    blk->t_first = hist->pend_t[0];
+    blk->t_last = hist->pend_t[n - 1];
+    blk->offset = hist->dat_size;
+    blk->count = n;
+
+    // a failed write is repeated from the end of the last block
+    clearerr(hist->dat);
+    clearerr(hist->idx);
+    if (fseeko(hist->dat, hist->dat_size, SEEK_SET) != 0) {
+        return -2;
+    }
+
+    for (c = -1; c < MONARCO_HIST_COLUMNS; c++) {
+        size_t size = (c < 0) ? monarco_hist_encode(hist->buf, hist->pend_t, NULL, n)
+                              : monarco_hist_encode(hist->buf, NULL, hist->pend_v[c], n);
+
+        if (fwrite(hist->buf, 1, size, hist->dat) != size) {
+            return -2;
+        }
+        blk->size[c + 1] = size;
+
+        if (c < 0) {
+            continue;
+        }
+
+        monarco_hist_summary_t *sum = &blk->sum[c];
+        sum->min = sum->max = hist->pend_v[c][0];
+        for (i = 0; i < n; i++) {
+            int64_t v = hist->pend_v[c][i];
+            sum->min = (v < sum->min) ? v : sum->min;
+            sum->max = (v > sum->max) ? v : sum->max;
+            sum->sum += v;
+        }
+    }
+
+    // payload first, the index record makes the block visible
+    if ((fflush(hist->dat) != 0) || (fseeko(hist->idx, 0, SEEK_END) != 0)
+        || (fwrite(blk, sizeof(monarco_hist_block_t), 1, hist->idx) != 1) || (fflush(hist->idx) != 0)) {
+        return -2;
+    }
+
+    for (c = 0; c <= MONARCO_HIST_COLUMNS; c++) {
+        hist->column_bytes[c] += blk->size[c];
+    }
+    hist->dat_size += monarco_hist_block_size(blk);
+    hist->block_count++;
+    hist->pend_count = 0;
+
+    return 0;
+}
+
+int monarco_hist_close(monarco_hist_t *hist)
+{
+    int rc = 0;
+    int i;
+
+    if (hist->dat && hist->idx && hist->pend_t) {
+        rc = monarco_hist_flush(hist);
+    }
+    if (hist->dat && (fclose(hist->dat) != 0)) {
+        rc = -2;
+    }
+    if (hist->idx && (fclose(hist->idx) != 0)) {
+        rc = -2;
+    }
+
+    free(hist->blocks);
+    free(hist->pend_t);
+    for (i = 0; i < MONARCO_HIST_COLUMNS; i++) {
+        free(hist->pend_v[i]);
+    }
+    free(hist->buf);
+    free(hist->dec);
+    memset(hist, 0, sizeof(monarco_hist_t));
+
+    return rc;
+}
+
+int monarco_hist_append(monarco_hist_t *hist, int64_t t_ms, const monarco_struct_rx_t *rx)
+{
+    uint32_t n = hist->pend_count;
+    int written = 0;
+    int c;
+
+    if (((n > 0) && (t_ms < hist->pend_t[n - 1]))
+        || ((n == 0) && (hist->block_count > 0) && (t_ms < hist->blocks[hist->block_count - 1].t_last))) {
+        return -1;
+    }
+
+    // the unwritten block stayed full after a file error, samples are dropped until it is written
+    if (n == hist->block_samples) {
+        if (monarco_hist_flush(hist) != 0) {
+            hist->dropped++;
+            return -2;
+        }
+        n = 0;
+        written = 1;
+    }
+
+    hist->pend_t[n] = t_ms;
+    for (c = 0; c < MONARCO_HIST_COLUMNS; c++) {
+        hist->pend_v[c][n] = monarco_hist_field(rx, c);
+    }
+    hist->pend_count++;
+    hist->samples++;
+
+    if (hist->pend_count < hist->block_samples) {
+        return written;
+    }
+
+    return (monarco_hist_flush(hist) == 0) ? 1 : -2;
+}
+
+/* Read and decode encoded column `k` (0 = time, 1.. = value columns) of block `*blk` into `*out` */
+static int monarco_hist_load_column(monarco_hist_t *hist, const monarco_hist_block_t *blk, int k, int64_t *out)
+{
+    uint64_t offset = blk->offset;
+    int i;
+
+    for (i = 0; i < k; i++) {
+        offset += blk->size[i];
+    }
+
+    if ((fseeko(hist->dat, offset, SEEK_SET) != 0) || (fread(hist->buf, 1, blk->size[k], hist->dat) != blk->size[k])) {
+        return -2;
+    }
+
+    return (monarco_hist_decode(hist->buf, blk->size[k], out, blk->count) == 0) ? 0 : -2;
+}
+
+/* Decode time and value column of block `i` into `dec[0..count)` and `dec[count..2*count)` */
+static int monarco_hist_load_block(monarco_hist_t *hist, uint32_t i, int column)
+{
+    const monarco_hist_block_t *blk = &hist->blocks[i];
+
+    hist->decoded_blocks++;
+
+    if ((monarco_hist_load_column(hist, blk, 0, hist->dec) != 0)
+        || (monarco_hist_load_column(hist, blk, column + 1, hist->dec + blk->count) != 0)) {
+        return -2;
+    }
+
+    return 0;
+}
+
+/* First block with samples at or after `t` */
+static uint32_t monarco_hist_find(const monarco_hist_t *hist, int64_t t)
+{
+    uint32_t lo = 0, hi = hist->block_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (hist->blocks[mid].t_last < t) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static inline void monarco_hist_point_add(monarco_hist_point_t *pt, int64_t v)
+{
+    pt->min = (v < pt->min) ? v : pt->min;
+    pt->max = (v > pt->max) ? v : pt->max;
+    pt->mean += v;
+    pt->count++;
+}
+
+int64_t monarco_hist_query(monarco_hist_t *hist, int column, int64_t t_from, int64_t t_to, int buckets, monarco_hist_point_t *out)
+{
+    int64_t total = 0;
+    uint32_t i, k;
+    int b;
+
+    if ((column < 0) || (column >= MONARCO_HIST_COLUMNS) || (t_to <= t_from) || (buckets <= 0) || (out == NULL)) {
+        return -1;
+    }
+
+    int64_t width = (t_to - t_from + buckets - 1) / buckets;
+
+    for (b = 0; b < buckets; b++) {
+        out[b].t = t_from + b * width;
+        out[b].count = 0;
+        out[b].min = INT64_MAX;
+        out[b].max = INT64_MIN;
+        out[b].mean = 0.0;
+    }
+
+    for (i = monarco_hist_find(hist, t_from); (i < hist->block_count) && (hist->blocks[i].t_first < t_to); i++) {
+        const monarco_hist_block_t *blk = &hist->blocks[i];
+
+        if ((blk->t_first >= t_from) && (blk->t_last < t_to) && (blk->t_last - blk->t_first < width)) {
+            // whole block within range and not longer than bucket - from the summary, to bucket of its middle
+            monarco_hist_point_t *pt = &out[(blk->t_first / 2 + blk->t_last / 2 - t_from) / width];
+            pt->min = (blk->sum[column].min < pt->min) ? blk->sum[column].min : pt->min;
+            pt->max = (blk->sum[column].max > pt->max) ? blk->sum[column].max : pt->max;
+            pt->mean += blk->sum[column].sum;
+            pt->count += blk->count;
+            total += blk->count;
+            continue;
+        }
+
+        if (monarco_hist_load_block(hist, i, column) != 0) {
+            return -2;
+        }
+        for (k = 0; k < blk->count; k++) {
+            int64_t t = hist->dec[k];
+            if ((t >= t_from) && (t < t_to)) {
+                monarco_hist_point_add(&out[(t - t_from) / width], hist->dec[blk->count + k]);
+                total++;
+            }
+        }
+    }
+
+    for (k = 0; k < hist->pend_count; k++) {
+        int64_t t = hist->pend_t[k];
+        if ((t >= t_from) && (t < t_to)) {
+            monarco_hist_point_add(&out[(t - t_from) / width], hist->pend_v[column][k]);
+            total++;
+        }
+    }
+
+    for (b = 0; b < buckets; b++) {
+        if (out[b].count > 0) {
+            out[b].mean /= out[b].count;
+        }
+    }
+
+    return total;
+}
+
+int monarco_hist_read(monarco_hist_t *hist, int column, int64_t t_from, int64_t t_to, int64_t *t, uint32_t *v, int max)
+{
+    int n = 0;
+    uint32_t i, k;
+
+    if ((column < 0) || (column >= MONARCO_HIST_COLUMNS) || (t == NULL) || (v == NULL) || (max < 0)) {
+        return -1;
+    }
+
+    for (i = monarco_hist_find(hist, t_from); (i < hist->block_count) && (hist->blocks[i].t_first < t_to) && (n < max); i++) {
+        const monarco_hist_block_t *blk = &hist->blocks[i];
+
+        if (monarco_hist_load_block(hist, i, column) != 0) {
+            return -2;
+        }
+        for (k = 0; (k < blk->count) && (n < max); k++) {
+            if ((hist->dec[k] >= t_from) && (hist->dec[k] < t_to)) {
+                t[n] = hist->dec[k];
+                v[n] = hist->dec[blk->count + k];
+                n++;
+            }
+        }
+    }
+
+    for (k = 0; (k < hist->pend_count) && (n < max); k++) {
+        if ((hist->pend_t[k] >= t_from) && (hist->pend_t[k] < t_to)) {
+            t[n] = hist->pend_t[k];
+            v[n] = hist->pend_v[column][k];
+            n++;
+        }
+    }
+
+    return n;
+}
+
+int monarco_hist_span(const monarco_hist_t *hist, int64_t *t_first, int64_t *t_last)
+{
+    if (hist->samples == 0) {
+        return -1;
+    }
+
+    *t_first = (hist->block_count > 0) ? hist->blocks[0].t_first : hist->pend_t[0];
+    *t_last = (hist->pend_count > 0) ? hist->pend_t[hist->pend_count - 1] : hist->blocks[hist->block_count - 1].t_last;
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/***************************************************************************//**
+ * @file monarco_hist.h
+ * @brief libmonarco - Columnar Compressed Historian
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_HIST_H_
+#define LIBMONARCO_HIST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "monarco_struct.h"
+
+/* The historian stores process data samples (`monarco_struct_rx_t` with a timestamp) for long-term trending.
+ * Samples are collected into blocks of `block_samples`, each field of the frame is a separate column.
+ * A full block is encoded column by column - difference to the previous sample (zigzag varint), with runs
+ * of equal differences stored once with repeat count, so constant fields take a few bytes per block and slowly
+ * changing inputs about one byte per sample. Column payloads are appended to `<path>.dat`, block summaries
+ * (time span, per-column min / max / sum) to fixed-size records of `<path>.idx`, loaded at open.
+ * Range queries downsample into time buckets: a block shorter than a bucket is merged from its summary into
+ * the bucket of its middle, so trends over days are served from the index alone with bucket edges resolved
+ * to one block. Blocks cut by the range ends, all blocks when buckets are shorter than blocks, and the unwritten
+ * block are decoded and binned exactly. Blocks are written by stdio from `monarco_hist_append()` when full, call it from
+ * a lower priority task than the cycle when the storage is slow.
+ */
+
+/* Default number of samples per block, 82 s at 50 Hz */
+#define MONARCO_HIST_BLOCK_SAMPLES 4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Columns - fields of monarco_struct_rx_t, except SDC response and CRC */
+enum {
+    MONARCO_HIST_STATUS, /* status_byte without sign_of_life bits */
+    MONARCO_HIST_RESERVED1, /* reserved1 */
+    MONARCO_HIST_DIN, /* din */
+    MONARCO_HIST_CNT1, /* cnt1 */
+    MONARCO_HIST_CNT2, /* cnt2 */
+    MONARCO_HIST_CNT3, /* cnt3 */
+    MONARCO_HIST_AIN1, /* ain1 */
+    MONARCO_HIST_AIN2, /* ain2 */
+    MONARCO_HIST_COLUMNS,
+};
+
+/* Column Summary of a block or a query bucket */
+typedef struct {
+    int64_t min; /* Minimal value */
+    int64_t max; /* Maximal value */
+    int64_t sum; /* Sum of values, mean = sum / count */
+} monarco_hist_summary_t;
+
+/* Block Index Record, stored in `<path>.idx` */
+typedef struct {
+    int64_t t_first; /* Timestamp of the first sample (ms) */
+    int64_t t_last; /* Timestamp of the last sample (ms) */
+    uint64_t offset; /* Offset of the block in `<path>.dat` */
+    uint32_t count; /* Number of samples */
+    uint32_t size[MONARCO_HIST_COLUMNS + 1]; /* Encoded size of the time column and of each value column */
+    monarco_hist_summary_t sum[MONARCO_HIST_COLUMNS]; /* Summary of each value column */
+} monarco_hist_block_t;
+
+/* Query Bucket - downsampled point */
+typedef struct {
+    int64_t t; /* Bucket start (ms) */
+    uint32_t count; /* Number of samples, 0 = no data, other members undefined */
+    int64_t min; /* Minimal value */
+    int64_t max; /* Maximal value */
+    double mean; /* Mean value */
+} monarco_hist_point_t;
+
+/* Historian, owned by the application */
+typedef struct {
+    FILE *dat; /* Private, column payloads */
+    FILE *idx; /* Private, block index */
+    uint32_t block_samples; /* Samples per block */
+    monarco_hist_block_t *blocks; /* Private, index of written blocks */
+    uint32_t block_count; /* Number of written blocks */
+    uint32_t block_capacity; /* Private, allocated index records */
+    uint64_t dat_size; /* Private, end of the last block in `<path>.dat` */
+    int64_t *pend_t; /* Private, timestamps of the unwritten block */
+    uint32_t *pend_v[MONARCO_HIST_COLUMNS]; /* Private, columns of the unwritten block */
+    uint32_t pend_count; /* Number of samples of the unwritten block */
+    uint8_t *buf; /* Private, encoding / decoding buffer */
+    int64_t *dec; /* Private, decoded time and value column */
+    uint32_t buf_samples; /* Private, capacity of buffers in samples */
+    uint64_t samples; /* Number of stored samples, including the unwritten block */
+    uint64_t dropped; /* Number of samples dropped while the full unwritten block could not be written */
+    uint64_t column_bytes[MONARCO_HIST_COLUMNS + 1]; /* Encoded bytes of the time column and of each value column */
+    uint64_t decoded_blocks; /* Number of blocks decoded by queries */
+} monarco_hist_t;
+
+/* Open historian `<path>.idx` / `<path>.dat`, created when missing, for appending and queries. Index records
+ *   beyond the end of payload data (interrupted write) are dropped. `block_samples` 0 = MONARCO_HIST_BLOCK_SAMPLES,
+ *   it applies to new blocks only. Returns -1 on invalid arguments or allocation failure, -2 on file error.
+ */
+int monarco_hist_open(monarco_hist_t *hist, const char *path, uint32_t block_samples);
+
+/* Write the unwritten block and close the historian. Returns -2 on file error. */
+int monarco_hist_close(monarco_hist_t *hist);
+
+/* Append sample `*rx` taken at `t_ms` (ms, e.g. CLOCK_REALTIME), timestamps must not decrease.
+ *   Returns 1 when a block was written, 0 when buffered, -1 on decreasing timestamp, -2 on file error.
+ *   A block which failed to write (e.g. storage full) stays unwritten and is written again by the next call,
+ *   while it fails the sample is not stored, counted in `dropped`, and -2 is returned.
+ */
+int monarco_hist_append(monarco_hist_t *hist, int64_t t_ms, const monarco_struct_rx_t *rx);
+
+/* Write the unwritten block now, e.g. before shutdown. Returns -2 on file error. */
+int monarco_hist_flush(monarco_hist_t *hist);
+
+/* Downsample column MONARCO_HIST_* over time range [`t_from`, `t_to`) into `buckets` points `*out` of equal length,
+ *   blocks shorter than a bucket are binned as a whole, see above.
+ *   Returns number of samples in the range, -1 on invalid arguments, -2 on file error.
+ */
+int64_t monarco_hist_query(monarco_hist_t *hist, int column, int64_t t_from, int64_t t_to, int buckets, monarco_hist_point_t *out);
+
+/* Read raw samples of column MONARCO_HIST_* in time range [`t_from`, `t_to`), at most `max` into `*t` and `*v`.
+ *   Returns number of samples read, -1 on invalid arguments, -2 on file error.
+ */
+int monarco_hist_read(monarco_hist_t *hist, int column, int64_t t_from, int64_t t_to, int64_t *t, uint32_t *v, int max);
+
+/* Time span of stored samples into `*t_first` / `*t_last` (ms), returns -1 when empty */
+int monarco_hist_span(const monarco_hist_t *hist, int64_t *t_first, int64_t *t_last);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
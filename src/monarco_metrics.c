@@ -0,0 +1,354 @@
+/***************************************************************************//**
+ * @file monarco_metrics.c
+ * @brief libmonarco - Metrics Exporter in Prometheus Text Format
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_metrics.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "monarco_wdt.h"
+#include "monarco_platform.h"
+
+/* Request of a client is awaited at most this long, then plain text is sent (ms) */
+#define MONARCO_METRICS_REQUEST_TIMEOUT_MS 100
+
+const int64_t monarco_metrics_le_ns[MONARCO_METRICS_BUCKETS] = {
+    10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000,
+    5000000, 10000000, 20000000, 50000000, 100000000, 200000000, 500000000, 1000000000,
+};
+
+/* Text being rendered, `len` keeps counting beyond `size` */
+typedef struct {
+    char *buf;
+    int size;
+    int len;
+} monarco_metrics_text_t;
+
+/* Counter written by the cycle thread */
+static inline uint32_t monarco_metrics_rd(const uint32_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void monarco_metrics_printf(monarco_metrics_text_t *text, const char *fmt, ...)
+{
+    va_list ap;
+    int room = (text->len < text->size) ? text->size - text->len : 0;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(room ? text->buf + text->len : NULL, room, fmt, ap);
+    va_end(ap);
+
+    if (n > 0) {
+        text->len += n;
+    }
+}
+
+static void monarco_metrics_head(monarco_metrics_text_t *text, const char *name, const char *type, const char *help)
+{
+    monarco_metrics_printf(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void monarco_metrics_counter(monarco_metrics_text_t *text, const char *name, const char *help, uint32_t value)
+{
+    monarco_metrics_head(text, name, "counter", help);
+    monarco_metrics_printf(text, "%s %u\n", name, value);
+}
+
+static void monarco_metrics_histogram(monarco_metrics_text_t *text, const char *name, const char *help,
+    const monarco_metrics_hist_t *hist)
+{
+    uint64_t count = 0;
+    int i;
+
+    monarco_metrics_head(text, name, "histogram", help);
+
+    // cumulative buckets, the total is taken from the same reads
+    for (i = 0; i <= MONARCO_METRICS_BUCKETS; i++) {
+        count += monarco_metrics_rd(&hist->count[i]);
+        if (i < MONARCO_METRICS_BUCKETS) {
+            monarco_metrics_printf(text, "%s_bucket{le=\"%g\"} %llu\n", name, monarco_metrics_le_ns[i] / 1e9, (unsigned long long)count);
+        }
+        else {
+            monarco_metrics_printf(text, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)count);
+        }
+    }
+
+    monarco_metrics_printf(text, "%s_sum %.9f\n%s_count %llu\n", name,
+        __atomic_load_n(&hist->sum_ns, __ATOMIC_RELAXED) / 1e9, name, (unsigned long long)count);
+}
+
+/* Per-register SDC counter `offset` of monarco_metrics_sdc_t, addresses without any request are omitted */
+static void monarco_metrics_sdc_counter(monarco_metrics_text_t *text, const monarco_metrics_t *metrics,
+    const char *name, const char *help, size_t offset)
+{
+    int addr;
+
+    monarco_metrics_head(text, name, "counter", help);
+
+    for (addr = 0; addr < MONARCO_METRICS_SDC_ADDRESSES; addr++) {
+        const monarco_metrics_sdc_t *sdc = &metrics->sdc[addr];
+
+        if (monarco_metrics_rd(&sdc->requests) == 0) {
+            continue;
+        }
+        monarco_metrics_printf(text, "%s{address=\"0x%03X\"} %u\n", name, addr,
+            monarco_metrics_rd((const uint32_t *)((const char *)sdc + offset)));
+    }
+}
+
+int monarco_metrics_render(monarco_metrics_t *metrics, char *buf, int size)
+{
+    const monarco_stats_t *stats = &metrics->cxt->stats;
+    monarco_metrics_text_t text = { .buf = buf, .size = size, .len = 0 };
+
+    monarco_metrics_counter(&text, "monarco_cycles_total", "Frame exchanges with the HAT.", monarco_metrics_rd(&stats->cycles));
+    monarco_metrics_histogram(&text, "monarco_cycle_period_seconds", "Interval between cycle starts.", &metrics->period);
+    if (metrics->cxt->wdt != NULL) {
+        monarco_metrics_counter(&text, "monarco_cycle_overruns_total", "Cycle intervals treated as overrun by the watchdog.",
+            monarco_metrics_rd(&metrics->cxt->wdt->overruns));
+    }
+    monarco_metrics_head(&text, "monarco_cycle_nominal_period_seconds", "gauge", "Nominal cycle period.");
+    monarco_metrics_printf(&text, "monarco_cycle_nominal_period_seconds %g\n", metrics->period_ns / 1e9);
+    monarco_metrics_counter(&text, "monarco_deadline_misses_total", "Frame exchanges completed after the cycle deadline (load shedding).",
+        monarco_metrics_rd(&stats->deadline_misses));
+
+    monarco_metrics_histogram(&text, "monarco_transfer_duration_seconds", "Duration of the frame transfer (SPI ioctl).", &metrics->transfer);
+    monarco_metrics_counter(&text, "monarco_transfer_failures_total", "Failed frame transfers.",
+        monarco_metrics_rd(&metrics->transfer_failures));
+    monarco_metrics_counter(&text, "monarco_crc_errors_total", "Frames rejected due to invalid RX CRC.", monarco_metrics_rd(&stats->crc_errors));
+
+    monarco_metrics_counter(&text, "monarco_sdc_retries_all_total", "SDC requests re-sent while waiting for response, all registers.",
+        monarco_metrics_rd(&stats->sdc_resends));
+    monarco_metrics_counter(&text, "monarco_sdc_timeouts_all_total", "SDC requests without response, all registers.",
+        monarco_metrics_rd(&stats->sdc_timeouts));
+    monarco_metrics_counter(&text, "monarco_sdc_cached_total", "SDC requests completed from the register cache.",
+        monarco_metrics_rd(&stats->sdc_cached));
+
+    monarco_metrics_sdc_counter(&text, metrics, "monarco_sdc_requests_total", "SDC requests issued.",
+        offsetof(monarco_metrics_sdc_t, requests));
+    monarco_metrics_sdc_counter(&text, metrics, "monarco_sdc_retries_total", "SDC requests re-sent while waiting for response.",
+        offsetof(monarco_metrics_sdc_t, retries));
+    monarco_metrics_sdc_counter(&text, metrics, "monarco_sdc_transactions_total", "SDC transactions completed.",
+        offsetof(monarco_metrics_sdc_t, done));
+    monarco_metrics_sdc_counter(&text, metrics, "monarco_sdc_errors_total", "SDC transactions completed with error result.",
+        offsetof(monarco_metrics_sdc_t, errors));
+    monarco_metrics_sdc_counter(&text, metrics, "monarco_sdc_timeouts_total", "SDC requests without response.",
+        offsetof(monarco_metrics_sdc_t, timeouts));
+
+    monarco_metrics_counter(&text, "monarco_metrics_scrapes_total", "Scrapes served by the exporter.", metrics->scrapes);
+
+    return text.len;
+}
+
+/* Serve one client - wait shortly for a request, reply with HTTP to GET, plain text otherwise */
+static void monarco_metrics_client(monarco_metrics_t *metrics, int fd, char **buf, int *size)
+{
+    char req[512];
+    int http = 0;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    if (poll(&pfd, 1, MONARCO_METRICS_REQUEST_TIMEOUT_MS) == 1) {
+        ssize_t n = recv(fd, req, sizeof(req) - 1, MSG_DONTWAIT);
+        http = (n >= 4) && (memcmp(req, "GET ", 4) == 0);
+    }
+
+    metrics->scrapes++;
+
+    int len = monarco_metrics_render(metrics, *buf, *size);
+    if (len >= *size) {
+        char *grown = realloc(*buf, len + 1024);
+        if (grown == NULL) {
+            return;
+        }
+        *buf = grown;
+        *size = len + 1024;
+        len = monarco_metrics_render(metrics, *buf, *size);
+    }
+
+    if (http) {
+        char head[160];
+        int n = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %i\r\nConnection: close\r\n\r\n", len);
+        if (send(fd, head, n, MSG_NOSIGNAL) != n) {
+            return;
+        }
+    }
+
+    int sent = 0;
+    while (sent < len) {
+        ssize_t n = send(fd, *buf + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;
+        }
+        sent += n;
+    }
+}
+
+static void *monarco_metrics_thread(void *arg)
+{
+    monarco_metrics_t *metrics = arg;
+    int size = 16384;
+    char *buf = malloc(size);
+
+    // lowest priority of SCHED_OTHER, the thread itself was created with SCHED_OTHER
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+
+    while (buf != NULL) {
+        struct pollfd pfd[2] = {
+            { .fd = metrics->listen_fd, .events = POLLIN },
+            { .fd = metrics->stop_fd, .events = POLLIN },
+        };
+
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (pfd[1].revents) {
+            break;
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(metrics->listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                monarco_metrics_client(metrics, fd, &buf, &size);
+                close(fd);
+            }
+        }
+    }
+
+    free(buf);
+
+    return NULL;
+}
+
+int monarco_metrics_init(monarco_metrics_t *metrics, monarco_cxt_t *cxt, uint32_t period_us)
+{
+    memset(metrics, 0, sizeof(monarco_metrics_t));
+    metrics->cxt = cxt;
+    metrics->period_ns = period_us * 1000LL;
+    metrics->listen_fd = -1;
+    metrics->stop_fd = -1;
+
+    cxt->metrics = metrics;
+
+    MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_metrics_init: Period %u us\n", period_us);
+
+    return 0;
+}
+
+int monarco_metrics_serve(monarco_metrics_t *metrics, const char *path)
+{
+    monarco_cxt_t *cxt = metrics->cxt;
+    struct sockaddr_un addr;
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = 0 };
+
+    if (path == NULL) {
+        path = MONARCO_METRICS_PATH;
+    }
+
+    if ((metrics->listen_fd >= 0) || (strlen(path) >= sizeof(addr.sun_path))) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_metrics_serve: Already serving or path too long\n");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    strcpy(metrics->path, path);
+
+    metrics->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (metrics->listen_fd < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_metrics_serve: Failed to create socket: %i: %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    unlink(path);
+
+    if ((bind(metrics->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(metrics->listen_fd, 4) < 0)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_metrics_serve: Failed to listen on %s: %i: %s\n", path, errno, strerror(errno));
+        close(metrics->listen_fd);
+        metrics->listen_fd = -1;
+        return -1;
+    }
+
+    metrics->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (metrics->stop_fd < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_metrics_serve: Failed to create eventfd: %i: %s\n", errno, strerror(errno));
+        close(metrics->listen_fd);
+        metrics->listen_fd = -1;
+        unlink(path);
+        return -1;
+    }
+
+    // not inherited from a realtime caller
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+
+    int rc = pthread_create(&metrics->thread, &attr, monarco_metrics_thread, metrics);
+    pthread_attr_destroy(&attr);
+
+    if (rc != 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_metrics_serve: Failed to create thread: %i: %s\n", rc, strerror(rc));
+        close(metrics->stop_fd);
+        close(metrics->listen_fd);
+        metrics->stop_fd = -1;
+        metrics->listen_fd = -1;
+        unlink(path);
+        return -2;
+    }
+
+    MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_metrics_serve: Serving on %s\n", path);
+
+    return 0;
+}
+
+void monarco_metrics_exit(monarco_cxt_t *cxt)
+{
+    monarco_metrics_t *metrics = cxt->metrics;
+
+    if (metrics == NULL) {
+        return;
+    }
+
+    if (metrics->listen_fd >= 0) {
+        uint64_t one = 1;
+        if (write(metrics->stop_fd, &one, sizeof(one)) == sizeof(one)) {
+            pthread_join(metrics->thread, NULL);
+        }
+        close(metrics->stop_fd);
+        close(metrics->listen_fd);
+        unlink(metrics->path);
+        metrics->stop_fd = -1;
+        metrics->listen_fd = -1;
+    }
+
+    cxt->metrics = NULL;
+}
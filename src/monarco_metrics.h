@@ -0,0 +1,140 @@
+/***************************************************************************//**
+ * @file monarco_metrics.h
+ * @brief libmonarco - Metrics Exporter in Prometheus Text Format
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_METRICS_H_
+#define LIBMONARCO_METRICS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "monarco.h"
+
+/* When metrics are attached by `monarco_metrics_init()`, `monarco_main()` only increments counters - cycle
+ * period and transfer (ioctl) duration histograms and per-register SDC counters. They are written
+ * by the cycle alone and lie on their own cache lines, apart from the exporter state. `monarco_metrics_serve()`
+ * starts a SCHED_OTHER thread at the lowest priority listening on a Unix domain socket, which renders the
+ * counters and `cxt.stats` in Prometheus exposition format (version 0.0.4) to each client - as an HTTP response
+ * when the client sends a GET request (e.g. `curl --unix-socket`), as plain text otherwise (e.g. `socat`).
+ * Counters are read without locking, so a scrape may see a histogram a few cycles apart from other series.
+ * The cycle period is taken from `cxt->cycle_ns`, overruns are those of the attached watchdog (monarco_wdt.h).
+ */
+
+/* Number of histogram buckets, 1-2-5 series from 10 us to 1 s, plus +Inf */
+#define MONARCO_METRICS_BUCKETS 16
+
+/* Number of SDC register addresses with counters, full 12-bit address space */
+#define MONARCO_METRICS_SDC_ADDRESSES 0x1000
+
+/* Default socket path */
+#ifndef MONARCO_METRICS_PATH
+#define MONARCO_METRICS_PATH "/run/monarco-metrics.sock"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Histogram, `count[i]` is the number of observations in bucket `i` only (not cumulative) */
+typedef struct {
+    uint32_t count[MONARCO_METRICS_BUCKETS + 1]; /* Observations per bucket, last one +Inf */
+    uint64_t sum_ns; /* Sum of observations (ns) */
+} monarco_metrics_hist_t;
+
+/* SDC Counters of one register address */
+typedef struct {
+    uint32_t requests; /* Requests issued */
+    uint32_t retries; /* Requests re-sent while waiting for response */
+    uint32_t done; /* Transactions completed */
+    uint32_t errors; /* Transactions completed with error result */
+    uint32_t timeouts; /* Requests without response for MONARCO_SDC_TIMEOUT_CYCLES */
+} monarco_metrics_sdc_t;
+
+/* Metrics, owned by the application */
+typedef struct monarco_metrics_s {
+    /* Realtime part, written only by monarco_main() */
+    monarco_metrics_hist_t period __attribute__((aligned(64))); /* Interval between cycle starts */
+    monarco_metrics_hist_t transfer; /* Duration of the frame transfer (ioctl) */
+    uint32_t transfer_failures; /* Failed transfers, not in `transfer` */
+    int64_t last_ns; /* Private, start of the previous cycle, 0 = none */
+    int64_t before_ns; /* Private, start of the latest transfer */
+    monarco_metrics_sdc_t sdc[MONARCO_METRICS_SDC_ADDRESSES] __attribute__((aligned(64))); /* SDC counters by register address */
+    /* Exporter part */
+    monarco_cxt_t *cxt __attribute__((aligned(64))); /* Attached context */
+    int64_t period_ns; /* Nominal cycle period (ns) */
+    char path[108]; /* Private, socket path */
+    int listen_fd; /* Private, listening socket, -1 = not serving */
+    int stop_fd; /* Private, eventfd stopping the thread */
+    pthread_t thread; /* Private, exporter thread */
+    uint32_t scrapes; /* Number of served scrapes */
+} monarco_metrics_t;
+
+/* Attach metrics `*metrics` owned by the application to `cxt`, `period_us` is the nominal cycle period */
+int monarco_metrics_init(monarco_metrics_t *metrics, monarco_cxt_t *cxt, uint32_t period_us);
+
+/* Start the exporter thread on Unix socket `path` (NULL = MONARCO_METRICS_PATH), an existing socket file
+ *   is replaced. Call from the main thread before the realtime loop. Returns -1 on socket error, -2 on thread error.
+ */
+int monarco_metrics_serve(monarco_metrics_t *metrics, const char *path);
+
+/* Stop the exporter thread, remove the socket and detach metrics from `cxt` */
+void monarco_metrics_exit(monarco_cxt_t *cxt);
+
+/* Render all metrics in Prometheus text format into `*buf` of `size` bytes, as served to clients.
+ *   Returns length of the text, or the required size when it does not fit (like snprintf).
+ */
+int monarco_metrics_render(monarco_metrics_t *metrics, char *buf, int size);
+
+/* Internal hooks of monarco_main() */
+
+/* Upper bounds of histogram buckets (ns) */
+extern const int64_t monarco_metrics_le_ns[MONARCO_METRICS_BUCKETS];
+
+/* Count `ns` into histogram */
+static inline void monarco_metrics_observe(monarco_metrics_hist_t *hist, int64_t ns)
+{
+    int i = 0;
+
+    while ((i < MONARCO_METRICS_BUCKETS) && (ns > monarco_metrics_le_ns[i])) {
+        i++;
+    }
+    hist->count[i]++;
+    hist->sum_ns += ns;
+}
+
+/* Cycle interval from the cycle start and timestamp before the transfer */
+static inline void monarco_metrics_before(monarco_cxt_t *cxt)
+{
+    monarco_metrics_t *metrics = cxt->metrics;
+
+    if (metrics->last_ns != 0) {
+        monarco_metrics_observe(&metrics->period, cxt->cycle_ns - metrics->last_ns);
+    }
+    metrics->last_ns = cxt->cycle_ns;
+    metrics->before_ns = monarco_now_ns();
+}
+
+/* Transfer duration, called after a successful transfer */
+static inline void monarco_metrics_after(monarco_cxt_t *cxt)
+{
+    monarco_metrics_observe(&cxt->metrics->transfer, monarco_now_ns() - cxt->metrics->before_ns);
+}
+
+/* SDC counters of register `address` */
+static inline monarco_metrics_sdc_t *monarco_metrics_sdc(monarco_cxt_t *cxt, uint16_t address)
+{
+    return &cxt->metrics->sdc[address & (MONARCO_METRICS_SDC_ADDRESSES - 1)];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
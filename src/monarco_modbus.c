@@ -0,0 +1,493 @@
+/***************************************************************************//**
+ * @file monarco_modbus.c
+ * @brief libmonarco - Modbus RTU Master on RS-485 port
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_modbus.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+
+#include "monarco_crc.h"
+#include "monarco_platform.h"
+
+/* termios speed for baudrate `bd`, 0 when not supported */
+static speed_t monarco_modbus_speed(uint32_t bd)
+{
+    switch (bd) {
+    case 300: return B300;
+    case 600: return B600;
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    default: return 0;
+    }
+}
+
+int monarco_modbus_init(monarco_modbus_t *mb, monarco_cxt_t *cxt, const char *device, uint16_t baud, uint16_t mode, int diag_factor)
+{
+    uint32_t bd = (uint32_t)baud * 100;
+    int parity = mode & (3 << MONARCO_SDC_RS485_MODE_PARITY__SHIFT);
+    int databits = mode & (3 << MONARCO_SDC_RS485_MODE_DATABITS__SHIFT);
+    int stopbits = mode & (3 << MONARCO_SDC_RS485_MODE_STOPBITS__SHIFT);
+    speed_t speed = monarco_modbus_speed(bd);
+    int i;
+
+    if (cxt->modbus == mb) {
+        monarco_modbus_exit(cxt);
+    }
+
+    memset(mb, 0, sizeof(monarco_modbus_t));
+    mb->cxt = cxt;
+    mb->fd = -1;
+    mb->sdc_diag = -1;
+    mb->turnaround_us = MONARCO_MODBUS_TURNAROUND_US;
+
+    if ((speed == 0) || (databits != MONARCO_SDC_RS485_MODE_DATABITS_8) || (parity == (3 << MONARCO_SDC_RS485_MODE_PARITY__SHIFT))) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_init: Unsupported RS-485 configuration %u Bd, mode 0x%02X\n", bd, mode);
+        return -1;
+    }
+
+    /* Character time - start bit, 8 data bits, parity and stop bits (0.5 and 1.5 rounded up) */
+
+    int bits = 1 + 8 + ((parity != MONARCO_SDC_RS485_MODE_PARITY_NONE) ? 1 : 0)
+        + ((stopbits >= MONARCO_SDC_RS485_MODE_STOPBITS_1_5) ? 2 : 1);
+
+    mb->char_ns = (uint32_t)((uint64_t)bits * 1000000000ULL / bd);
+    mb->gap_ns = (bd > 19200) ? 1750000 : (mb->char_ns * 7 / 2);
+
+    /* Open and configure the UART - raw mode, non-blocking reads */
+
+    if ((mb->fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_init: Failed to open %s: %i: %s\n", device, errno, strerror(errno));
+        return -2;
+    }
+
+    struct termios tio;
+
+    if (tcgetattr(mb->fd, &tio) < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_init: Failed to get attributes of %s: %i: %s\n", device, errno, strerror(errno));
+        close(mb->fd);
+        mb->fd = -1;
+        return -2;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(PARENB | PARODD | CSTOPB | CRTSCTS);
+    if (parity == MONARCO_SDC_RS485_MODE_PARITY_EVEN) {
+        tio.c_cflag |= PARENB;
+    }
+    else if (parity == MONARCO_SDC_RS485_MODE_PARITY_ODD) {
+        tio.c_cflag |= PARENB | PARODD;
+    }
+    if (stopbits >= MONARCO_SDC_RS485_MODE_STOPBITS_1_5) {
+        tio.c_cflag |= CSTOPB;
+    }
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    if (tcsetattr(mb->fd, TCSANOW, &tio) < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_init: Failed to configure %s: %i: %s\n", device, errno, strerror(errno));
+        close(mb->fd);
+        mb->fd = -1;
+        return -2;
+    }
+
+    tcflush(mb->fd, TCIOFLUSH);
+
+    /* HAT line diagnostics by SDC */
+
+    if (diag_factor > 0) {
+        static const uint16_t diag_regs[3] = { MONARCO_SDC_REG_RS485RXCNT, MONARCO_SDC_REG_RS485FECNT, MONARCO_SDC_REG_RS485PECNT };
+        monarco_sdc_item_t item = { .factor = (diag_factor > 0xFFFF) ? 0xFFFF : diag_factor };
+
+        if (cxt->sdc_size + 3 > cxt->sdc_capacity) {
+            MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_init: No room for SDC diagnostic Items\n");
+            close(mb->fd);
+            mb->fd = -1;
+            return -3;
+        }
+
+        for (i = 0; i < 3; i++) {
+            item.address = diag_regs[i];
+            int idx = monarco_sdc_add(cxt, &item);
+            if (i == 0) {
+                mb->sdc_diag = idx;
+            }
+        }
+    }
+
+    monarco_modbus_exit(cxt);
+    cxt->modbus = mb;
+
+    MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_modbus_init: %s %u Bd, char %u ns, gap %u ns\n", device, bd, mb->char_ns, mb->gap_ns);
+
+    return 0;
+}
+
+int monarco_modbus_plan(monarco_modbus_t *mb, monarco_modbus_poll_t *plan, int count, uint16_t *image, int image_size)
+{
+    monarco_cxt_t *cxt = mb->cxt;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        const monarco_modbus_poll_t *p = &plan[i];
+        int max;
+
+        switch (p->function) {
+        case MONARCO_MODBUS_FC_READ_HOLDING:
+        case MONARCO_MODBUS_FC_READ_INPUT:
+            max = 125;
+            break;
+        case MONARCO_MODBUS_FC_WRITE_SINGLE:
+            max = 1;
+            break;
+        case MONARCO_MODBUS_FC_WRITE_MULTIPLE:
+            max = 123;
+            break;
+        default:
+            max = 0;
+        }
+
+        if ((p->slave < 1) || (p->slave > 247) || (p->count < 1) || (p->count > max)
+                || ((int)p->image + p->count > image_size) || ((uint32_t)p->address + p->count > 0x10000)) {
+            MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_plan: Entry %i invalid\n", i);
+            return -1;
+        }
+    }
+
+    mb->plan = (count > 0) ? plan : NULL;
+    mb->plan_size = (count > 0) ? count : 0;
+    mb->image = image;
+    mb->image_size = image_size;
+    mb->busy = 0;
+    mb->idx = 0;
+
+    for (i = 0; i < count; i++) {
+        plan[i].counter = 0;
+        plan[i].status = MONARCO_MODBUS_ST_NONE;
+        plan[i].exception = 0;
+        plan[i].done = 0;
+        plan[i].errors = 0;
+    }
+
+    return 0;
+}
+
+static inline void monarco_modbus_put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static inline uint16_t monarco_modbus_get16(const uint8_t *p)
+{
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+/* Build request of plan entry `p` into `tx_buf`, returns frame length and sets expected response length */
+static int monarco_modbus_build(monarco_modbus_t *mb, const monarco_modbus_poll_t *p)
+{
+    uint8_t *b = mb->tx_buf;
+    int len;
+    int i;
+
+    b[0] = p->slave;
+    b[1] = p->function;
+    monarco_modbus_put16(&b[2], p->address);
+
+    switch (p->function) {
+    case MONARCO_MODBUS_FC_WRITE_SINGLE:
+        monarco_modbus_put16(&b[4], mb->image[p->image]);
+        len = 6;
+        mb->rx_expect = 8;
+        break;
+    case MONARCO_MODBUS_FC_WRITE_MULTIPLE:
+        monarco_modbus_put16(&b[4], p->count);
+        b[6] = p->count * 2;
+        for (i = 0; i < p->count; i++) {
+            monarco_modbus_put16(&b[7 + i * 2], mb->image[p->image + i]);
+        }
+        len = 7 + p->count * 2;
+        mb->rx_expect = 8;
+        break;
+    default:
+        monarco_modbus_put16(&b[4], p->count);
+        len = 6;
+        mb->rx_expect = 5 + p->count * 2;
+    }
+
+    uint16_t crc = monarco_crc16((const char *)b, len);
+    b[len++] = crc & 0xFF;
+    b[len++] = crc >> 8;
+
+    return len;
+}
+
+/* Validate complete response in `rx_buf` against plan entry `p`, update process image, returns MONARCO_MODBUS_ST_* */
+static int monarco_modbus_parse(monarco_modbus_t *mb, monarco_modbus_poll_t *p)
+{
+    const uint8_t *b = mb->rx_buf;
+    int len = mb->rx_len;
+    int i;
+
+    uint16_t crc = monarco_crc16((const char *)b, len - 2);
+    if ((b[len - 2] != (crc & 0xFF)) || (b[len - 1] != (crc >> 8))) {
+        return MONARCO_MODBUS_ST_CRC;
+    }
+
+    if (b[0] != p->slave) {
+        return MONARCO_MODBUS_ST_INVALID;
+    }
+
+    if (b[1] == (p->function | 0x80)) {
+        p->exception = b[2];
+        return MONARCO_MODBUS_ST_EXCEPTION;
+    }
+
+    if (b[1] != p->function) {
+        return MONARCO_MODBUS_ST_INVALID;
+    }
+
+    switch (p->function) {
+    case MONARCO_MODBUS_FC_WRITE_SINGLE:
+        if (memcmp(&b[2], &mb->tx_buf[2], 4) != 0) {
+            return MONARCO_MODBUS_ST_INVALID;
+        }
+        break;
+    case MONARCO_MODBUS_FC_WRITE_MULTIPLE:
+        if ((monarco_modbus_get16(&b[2]) != p->address) || (monarco_modbus_get16(&b[4]) != p->count)) {
+            return MONARCO_MODBUS_ST_INVALID;
+        }
+        break;
+    default:
+        if (b[2] != p->count * 2) {
+            return MONARCO_MODBUS_ST_INVALID;
+        }
+        for (i = 0; i < p->count; i++) {
+            mb->image[p->image + i] = monarco_modbus_get16(&b[3 + i * 2]);
+        }
+    }
+
+    return MONARCO_MODBUS_ST_OK;
+}
+
+/* Finish transaction of current entry with `status` */
+static void monarco_modbus_finish(monarco_modbus_t *mb, int status, int64_t now)
+{
+    monarco_cxt_t *cxt = mb->cxt;
+    monarco_modbus_poll_t *p = &mb->plan[mb->idx];
+
+    if ((status != p->status) && (status != MONARCO_MODBUS_ST_OK)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_run: Entry %i slave %u FC%02X ADDR=%u status %i exception %u\n",
+                mb->idx, p->slave, p->function, p->address, status, p->exception);
+    }
+
+    p->status = status;
+
+    switch (status) {
+    case MONARCO_MODBUS_ST_OK:
+        p->done++;
+        mb->stats.responses++;
+        break;
+    case MONARCO_MODBUS_ST_EXCEPTION:
+        p->errors++;
+        mb->stats.responses++;
+        mb->stats.exceptions++;
+        break;
+    case MONARCO_MODBUS_ST_TIMEOUT:
+        p->errors++;
+        mb->stats.timeouts++;
+        break;
+    case MONARCO_MODBUS_ST_CRC:
+        p->errors++;
+        mb->stats.crc_errors++;
+        break;
+    default:
+        p->errors++;
+        mb->stats.invalid++;
+    }
+
+    mb->busy = 0;
+    mb->idle_ns = now + mb->gap_ns;
+
+    mb->idx++;
+    if (mb->idx >= mb->plan_size) {
+        mb->idx = 0;
+    }
+}
+
+/* Receive available response bytes, returns 1 when the response is complete */
+static int monarco_modbus_rx(monarco_modbus_t *mb)
+{
+    while (mb->rx_len < mb->rx_expect) {
+        ssize_t n = read(mb->fd, &mb->rx_buf[mb->rx_len], mb->rx_expect - mb->rx_len);
+        if (n <= 0) {
+            break;
+        }
+        mb->rx_len += n;
+        mb->stats.bytes_rx += n;
+
+        // exception response is shorter
+        if ((mb->rx_len >= 2) && (mb->rx_buf[1] & 0x80)) {
+            mb->rx_expect = 5;
+            if (mb->rx_len > 5) {
+                mb->rx_len = 5;
+            }
+        }
+    }
+
+    return mb->rx_len >= mb->rx_expect;
+}
+
+/* Find next due plan entry starting at `idx`, returns 0 when none is due in one pass */
+static int monarco_modbus_next(monarco_modbus_t *mb)
+{
+    int i;
+
+    for (i = 0; i < mb->plan_size; i++) {
+        monarco_modbus_poll_t *p = &mb->plan[mb->idx];
+
+        if (p->factor > 0) {
+            p->counter++;
+            if (p->counter >= p->factor) {
+                p->counter = 0;
+                p->request = 0;
+                return 1;
+            }
+        }
+
+        if (p->request) {
+            p->request = 0;
+            return 1;
+        }
+
+        mb->idx++;
+        if (mb->idx >= mb->plan_size) {
+            mb->idx = 0;
+        }
+    }
+
+    return 0;
+}
+
+/* Accumulate HAT diagnostic counters, 16-bit registers wrap around */
+static void monarco_modbus_diag(monarco_modbus_t *mb)
+{
+    monarco_cxt_t *cxt = mb->cxt;
+    uint32_t *counters[3] = { &mb->stats.hat_rx_bytes, &mb->stats.hat_framing_errors, &mb->stats.hat_parity_errors };
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        int idx = mb->sdc_diag + i;
+
+        if (!monarco_sdc_done(cxt, idx) || monarco_sdc_error(cxt, idx)) {
+            continue;
+        }
+
+        uint16_t v = monarco_sdc_value(cxt, idx);
+
+        if (mb->diag_valid & (1 << i)) {
+            *counters[i] += (uint16_t)(v - mb->diag_last[i]);
+        }
+        mb->diag_last[i] = v;
+        mb->diag_valid |= 1 << i;
+    }
+}
+
+int monarco_modbus_run(monarco_cxt_t *cxt)
+{
+    monarco_modbus_t *mb = cxt->modbus;
+    int finished = 0;
+
+    if ((mb == NULL) || (mb->fd < 0)) {
+        return 0;
+    }
+
+    if (mb->sdc_diag >= 0) {
+        monarco_modbus_diag(mb);
+    }
+
+    if (mb->plan_size == 0) {
+        return 0;
+    }
+
+    int64_t now = monarco_now_ns();
+
+    /* Response to the pending request */
+
+    if (mb->busy) {
+        if (monarco_modbus_rx(mb)) {
+            monarco_modbus_finish(mb, monarco_modbus_parse(mb, &mb->plan[mb->idx]), now);
+            finished++;
+        }
+        else if (now >= mb->deadline_ns) {
+            monarco_modbus_finish(mb, MONARCO_MODBUS_ST_TIMEOUT, now);
+            finished++;
+        }
+        else {
+            return 0;
+        }
+    }
+
+    /* Next request after inter-frame silence */
+
+    if ((now < mb->idle_ns) || !monarco_modbus_next(mb)) {
+        return finished;
+    }
+
+    monarco_modbus_poll_t *p = &mb->plan[mb->idx];
+    int len = monarco_modbus_build(mb, p);
+
+    // drop late bytes of previous responses
+    tcflush(mb->fd, TCIFLUSH);
+
+    ssize_t n = write(mb->fd, mb->tx_buf, len);
+    if (n != len) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_modbus_run: Failed to write request: %i: %s\n", errno, strerror(errno));
+        mb->idle_ns = now + mb->gap_ns;
+        return finished;
+    }
+
+    mb->stats.requests++;
+    mb->stats.bytes_tx += len;
+    mb->busy = 1;
+    mb->rx_len = 0;
+    mb->deadline_ns = now + (int64_t)(len + mb->rx_expect) * mb->char_ns + mb->gap_ns + (int64_t)mb->turnaround_us * 1000;
+
+    return finished;
+}
+
+void monarco_modbus_exit(monarco_cxt_t *cxt)
+{
+    monarco_modbus_t *mb = cxt->modbus;
+
+    if (mb == NULL) {
+        return;
+    }
+
+    if (mb->fd >= 0) {
+        close(mb->fd);
+        mb->fd = -1;
+    }
+
+    cxt->modbus = NULL;
+}
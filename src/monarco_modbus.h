@@ -0,0 +1,148 @@
+/***************************************************************************//**
+ * @file monarco_modbus.h
+ * @brief libmonarco - Modbus RTU Master on RS-485 port
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_MODBUS_H_
+#define LIBMONARCO_MODBUS_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* RS-485 port of Monarco HAT is connected to the host UART (e.g. /dev/serial0), the HAT only switches the line
+ * direction and counts line diagnostics. The master runs a non-blocking state machine on the host UART,
+ * attached to the context by `monarco_modbus_init()` and advanced by each `monarco_main()`: a finished response
+ * is parsed into the process image and the next request of the polling plan is sent as soon as the inter-frame
+ * silence elapses, without any blocking read. Character and response timing is derived from the same
+ * RS485BAUD / RS485MODE values which configure the HAT, so host UART and HAT always agree.
+ */
+
+/* Slave response time allowance (us) added to the wire time of request and response */
+#ifndef MONARCO_MODBUS_TURNAROUND_US
+#define MONARCO_MODBUS_TURNAROUND_US 50000
+#endif
+
+/* Maximal RTU frame size */
+#define MONARCO_MODBUS_ADU_SIZE 256
+
+/* Supported function codes */
+#define MONARCO_MODBUS_FC_READ_HOLDING 0x03 /* Read Holding Registers, max 125 */
+#define MONARCO_MODBUS_FC_READ_INPUT 0x04 /* Read Input Registers, max 125 */
+#define MONARCO_MODBUS_FC_WRITE_SINGLE 0x06 /* Write Single Register, `count` = 1 */
+#define MONARCO_MODBUS_FC_WRITE_MULTIPLE 0x10 /* Write Multiple Registers, max 123 */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Transaction result */
+enum {
+    MONARCO_MODBUS_ST_NONE, /* Not yet communicated */
+    MONARCO_MODBUS_ST_OK, /* Valid response, image updated (read) or write confirmed */
+    MONARCO_MODBUS_ST_TIMEOUT, /* No complete response before the deadline */
+    MONARCO_MODBUS_ST_CRC, /* Response with invalid CRC */
+    MONARCO_MODBUS_ST_EXCEPTION, /* Exception response, see `exception` */
+    MONARCO_MODBUS_ST_INVALID, /* Response not matching the request */
+};
+
+/* Polling Plan Entry
+ *   Registers `address`..`address+count-1` of `slave` are read into, or written from,
+ *   process image registers `image`..`image+count-1`. Entries are polled in order, an entry
+ *   with `factor > 0` each `factor-th` pass over the plan, any entry once by monarco_modbus_request().
+ */
+typedef struct {
+    uint8_t slave; /* Slave address, 1..247 */
+    uint8_t function; /* MONARCO_MODBUS_FC_* */
+    uint16_t address; /* First register address (protocol address, 0-based) */
+    uint16_t count; /* Number of registers */
+    uint16_t image; /* Index of the first register in the process image */
+    uint16_t factor; /* Periodic factor, 0 = one-shot only */
+    uint16_t counter; /* Private, counter for factor passes */
+    uint8_t request; /* Private, one-shot trigger */
+    uint8_t status; /* Last result MONARCO_MODBUS_ST_*, read-only */
+    uint8_t exception; /* Last exception code, read-only */
+    uint32_t done; /* Number of successful transactions, read-only */
+    uint32_t errors; /* Number of failed transactions, read-only */
+} monarco_modbus_poll_t;
+
+/* Master Statistics */
+typedef struct {
+    uint32_t requests; /* Requests sent */
+    uint32_t responses; /* Valid responses, including exceptions */
+    uint32_t timeouts; /* Requests without complete response */
+    uint32_t crc_errors; /* Responses with invalid CRC */
+    uint32_t exceptions; /* Exception responses */
+    uint32_t invalid; /* Responses not matching the request */
+    uint32_t bytes_tx; /* Bytes written to the UART */
+    uint32_t bytes_rx; /* Bytes read from the UART */
+    uint32_t hat_rx_bytes; /* HAT RS485RXCNT increments since init */
+    uint32_t hat_framing_errors; /* HAT RS485FECNT increments since init */
+    uint32_t hat_parity_errors; /* HAT RS485PECNT increments since init */
+} monarco_modbus_stats_t;
+
+/* Modbus RTU Master, owned by the application */
+typedef struct monarco_modbus_s {
+    monarco_cxt_t *cxt; /* Context the master is attached to */
+    int fd; /* Private, UART file descriptor */
+    monarco_modbus_poll_t *plan; /* Private, polling plan */
+    int plan_size; /* Private, number of `plan` entries */
+    uint16_t *image; /* Private, process image */
+    int image_size; /* Private, number of `image` registers */
+    uint32_t char_ns; /* Character time on the wire (ns) */
+    uint32_t gap_ns; /* Inter-frame silence t3.5 (ns) */
+    uint32_t turnaround_us; /* Slave response time allowance (us), MONARCO_MODBUS_TURNAROUND_US by default */
+    int busy; /* Private, 1 = waiting for response to entry `idx` */
+    int idx; /* Private, current plan entry */
+    int rx_len; /* Private, received bytes of the response */
+    int rx_expect; /* Private, expected response length */
+    int64_t deadline_ns; /* Private, response deadline */
+    int64_t idle_ns; /* Private, earliest time of the next request */
+    int sdc_diag; /* Private, index of the first of three SDC diagnostic Items, -1 = none */
+    uint16_t diag_last[3]; /* Private, last raw values of SDC diagnostic counters */
+    uint8_t diag_valid; /* Private, `diag_last` valid mask */
+    uint8_t tx_buf[MONARCO_MODBUS_ADU_SIZE]; /* Private */
+    uint8_t rx_buf[MONARCO_MODBUS_ADU_SIZE]; /* Private */
+    monarco_modbus_stats_t stats; /* Statistics, read-only */
+} monarco_modbus_t;
+
+/* Modbus Master Initialization
+ *   Open UART `*device` configured by `baud` (unit 100 Bd, format of MONARCO_SDC_REG_RS485BAUD) and `mode`
+ *   (MONARCO_SDC_REG_RS485MODE format, 8 data bits required) and attach the master to `cxt`, the same values
+ *   should be written to the HAT by SDC. With `diag_factor > 0` periodic SDC Read Items of RS485RXCNT,
+ *   RS485FECNT and RS485PECNT are appended to the SDC Items of `cxt` (call after `monarco_sdc_load()`,
+ *   storage needs capacity for 3 more Items). Returns -1 on unsupported configuration, -2 when the UART
+ *   cannot be opened or configured, -3 when SDC Items cannot be added.
+ */
+int monarco_modbus_init(monarco_modbus_t *mb, monarco_cxt_t *cxt, const char *device, uint16_t baud, uint16_t mode, int diag_factor);
+
+/* Set polling plan of `count` entries `*plan` and process image of `image_size` registers `*image`,
+ *   both owned by the application. Returns -1 on invalid entry.
+ */
+int monarco_modbus_plan(monarco_modbus_t *mb, monarco_modbus_poll_t *plan, int count, uint16_t *image, int image_size);
+
+/* Trigger one-shot transaction of plan entry `idx` */
+static inline void monarco_modbus_request(monarco_modbus_t *mb, int idx)
+{
+    mb->plan[idx].request = 1;
+}
+
+/* Advance the state machine of the master attached to `cxt`, called by monarco_main().
+ *   Never blocks, returns number of transactions finished in this call.
+ */
+int monarco_modbus_run(monarco_cxt_t *cxt);
+
+/* Close UART and detach the master from `cxt` */
+void monarco_modbus_exit(monarco_cxt_t *cxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+/***************************************************************************//**
+ * @file monarco_rate.c
+ * @brief libmonarco - Adaptive Cycle Rate
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_rate.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "monarco_wdt.h"
+#include "monarco_platform.h"
+
+/* Idle period within the HAT watchdog timeout */
+static int64_t monarco_rate_idle_ns(monarco_rate_t *rate)
+{
+    monarco_cxt_t *cxt = rate->cxt;
+    uint16_t timeout_ms = rate->wdt_timeout_ms;
+
+    // WDTIMEOUT tuned by the watchdog, until then the HAT keeps its previous timeout
+    if ((cxt->wdt != NULL) && (cxt->wdt->timeout_ms != 0)) {
+        timeout_ms = cxt->wdt->timeout_ms;
+    }
+
+    int64_t limit_ns = (int64_t)(MONARCO_RATE_WDT_FRACTION * timeout_ms * 1000000LL);
+    if (limit_ns < rate->fast_ns) {
+        limit_ns = rate->fast_ns;
+    }
+
+    return (rate->idle_ns < limit_ns) ? rate->idle_ns : limit_ns;
+}
+
+/* Take inputs of the latest frame as reference of the activity */
+static void monarco_rate_reference(monarco_rate_t *rate, const monarco_struct_rx_t *rx)
+{
+    rate->ref_din = rx->din;
+    rate->ref_cnt[0] = rx->cnt1;
+    rate->ref_cnt[1] = rx->cnt2;
+    rate->ref_ain[0] = rx->ain1;
+    rate->ref_ain[1] = rx->ain2;
+    rate->ref_valid = 1;
+}
+
+/* Analog input moved beyond `deadband` from `ref`, 0 = not watched */
+static inline int monarco_rate_ain_moved(uint16_t value, uint16_t ref, uint16_t deadband)
+{
+    return deadband && (((value > ref) ? value - ref : ref - value) > deadband);
+}
+
+/* Activity since the reference */
+static int monarco_rate_activity(monarco_rate_t *rate, const monarco_struct_rx_t *rx)
+{
+    return ((rx->din ^ rate->ref_din) & rate->din_mask)
+        || ((rate->cnt_mask & 0x01) && (rx->cnt1 != rate->ref_cnt[0]))
+        || ((rate->cnt_mask & 0x02) && (rx->cnt2 != rate->ref_cnt[1]))
+        || monarco_rate_ain_moved(rx->ain1, rate->ref_ain[0], rate->ain_deadband[0])
+        || monarco_rate_ain_moved(rx->ain2, rate->ref_ain[1], rate->ain_deadband[1]);
+}
+
+static void monarco_rate_fast(monarco_rate_t *rate, int64_t now)
+{
+    monarco_cxt_t *cxt = rate->cxt;
+
+    if (rate->mode != MONARCO_RATE_FAST) {
+        rate->mode = MONARCO_RATE_FAST;
+        rate->bursts++;
+        MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_rate: Fast %lli us\n", (long long)(rate->fast_ns / 1000));
+    }
+    rate->active_ns = now;
+    rate->period_ns = rate->fast_ns;
+}
+
+int monarco_rate_init(monarco_rate_t *rate, monarco_cxt_t *cxt, uint32_t fast_us, uint32_t idle_us)
+{
+    if ((fast_us == 0) || (idle_us < fast_us)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_rate_init: Invalid cycle periods\n");
+        return -1;
+    }
+
+    memset(rate, 0, sizeof(monarco_rate_t));
+    rate->cxt = cxt;
+    rate->fast_ns = fast_us * 1000LL;
+    rate->idle_ns = idle_us * 1000LL;
+    rate->dwell_ns = MONARCO_RATE_DWELL_MS * 1000000LL;
+    rate->din_mask = 0x0F;
+    rate->cnt_mask = 0x03;
+    rate->ain_deadband[0] = MONARCO_RATE_AIN_DEADBAND;
+    rate->ain_deadband[1] = MONARCO_RATE_AIN_DEADBAND;
+    rate->wdt_timeout_ms = MONARCO_RATE_WDT_TIMEOUT_MS;
+    rate->mode = MONARCO_RATE_IDLE;
+
+    // the longest nominal interval is idle now, tune WDTIMEOUT on it, overruns follow the selected period
+    if (cxt->wdt != NULL) {
+        cxt->wdt->period_ns = rate->idle_ns;
+        monarco_wdt_retune(cxt);
+    }
+
+    cxt->rate = rate;
+    rate->period_ns = monarco_rate_idle_ns(rate);
+    rate->selected_ns = rate->period_ns;
+
+    if (rate->period_ns < rate->idle_ns) {
+        MONARCO_DPRINT(MONARCO_DPF_WARNING, "monarco_rate_init: Idle period limited to %lli us by watchdog timeout\n",
+            (long long)(rate->period_ns / 1000));
+    }
+
+    MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_rate_init: Fast %u us, idle %lli us\n", fast_us, (long long)(rate->period_ns / 1000));
+
+    return 0;
+}
+
+void monarco_rate_exit(monarco_cxt_t *cxt)
+{
+    cxt->rate = NULL;
+}
+
+void monarco_rate_kick(monarco_cxt_t *cxt)
+{
+    if (cxt->rate != NULL) {
+        monarco_rate_fast(cxt->rate, monarco_now_ns());
+    }
+}
+
+void monarco_rate_update(monarco_cxt_t *cxt)
+{
+    monarco_rate_t *rate = cxt->rate;
+    int64_t now = cxt->cycle_ns;
+
+    if (rate->last_ns != 0) {
+        rate->mode_ns[rate->mode] += now - rate->last_ns;
+    }
+    rate->last_ns = now;
+    rate->mode_cycles[rate->mode]++;
+
+    if (!rate->ref_valid) {
+        monarco_rate_reference(rate, cxt->rx_data);
+    }
+    else if (monarco_rate_activity(rate, cxt->rx_data)) {
+        monarco_rate_reference(rate, cxt->rx_data);
+        monarco_rate_fast(rate, now);
+        rate->selected_ns = rate->period_ns;
+        return;
+    }
+
+    if ((rate->mode == MONARCO_RATE_FAST) && (now - rate->active_ns >= rate->dwell_ns)) {
+        rate->mode = MONARCO_RATE_IDLE;
+        MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_rate: Idle\n");
+    }
+
+    if (rate->mode == MONARCO_RATE_IDLE) {
+        rate->period_ns = monarco_rate_idle_ns(rate);
+    }
+    rate->selected_ns = rate->period_ns;
+}
@@ -0,0 +1,106 @@
+/***************************************************************************//**
+ * @file monarco_rate.h
+ * @brief libmonarco - Adaptive Cycle Rate
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_RATE_H_
+#define LIBMONARCO_RATE_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* The application sleeps `period_ns` after each cycle start instead of a fixed period. When the adaptive
+ * rate is attached by `monarco_rate_init()`, `monarco_main()` compares each published frame with the inputs
+ * of the latest activity - DIN bits of `din_mask`, counters of `cnt_mask` and analog inputs moved by more than
+ * `ain_deadband`. Activity switches to the fast period at once, `dwell_ns` without activity returns to the idle
+ * period. The idle period is kept within MONARCO_RATE_WDT_FRACTION of the HAT watchdog timeout - WDTIMEOUT
+ * programmed by an attached `monarco_wdt.h`, which is re-based on the idle period by `monarco_rate_init()`,
+ * or `wdt_timeout_ms` set by the application (power-on default of the HAT). Overruns of the attached watchdog
+ * are judged against the period selected for each interval, so a host stall at the fast rate is caught
+ * within a few fast periods. Time and cycles spent in each
+ * mode are counted in `mode_ns` and `mode_cycles`.
+ */
+
+/* Default dwell time of the fast rate after the latest activity (ms) */
+#ifndef MONARCO_RATE_DWELL_MS
+#define MONARCO_RATE_DWELL_MS 500
+#endif
+
+/* Default analog input deadband (raw units, about 0.1 V / 0.2 mA) */
+#ifndef MONARCO_RATE_AIN_DEADBAND
+#define MONARCO_RATE_AIN_DEADBAND 40
+#endif
+
+/* Default HAT watchdog timeout when no watchdog is attached (ms), power-on WDTIMEOUT */
+#ifndef MONARCO_RATE_WDT_TIMEOUT_MS
+#define MONARCO_RATE_WDT_TIMEOUT_MS 100
+#endif
+
+/* Longest idle period as a part of the HAT watchdog timeout */
+#ifndef MONARCO_RATE_WDT_FRACTION
+#define MONARCO_RATE_WDT_FRACTION 0.4
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Rate modes */
+enum {
+    MONARCO_RATE_IDLE, /* No recent input activity, idle period */
+    MONARCO_RATE_FAST, /* Input activity within `dwell_ns`, fast period */
+};
+
+/* Adaptive Cycle Rate, owned by the application */
+typedef struct monarco_rate_s {
+    monarco_cxt_t *cxt; /* Attached context */
+    int64_t fast_ns; /* Fast cycle period (ns) */
+    int64_t idle_ns; /* Idle cycle period (ns), limited by the watchdog timeout */
+    int64_t dwell_ns; /* Fast rate held after the latest activity (ns), MONARCO_RATE_DWELL_MS */
+    uint8_t din_mask; /* DIN bits watched for edges, all by default */
+    uint8_t cnt_mask; /* Counters watched for changes, bit 0 = CNT1, bit 1 = CNT2, both by default */
+    uint16_t ain_deadband[2]; /* AIN1 / AIN2 change treated as activity (raw units), 0 = not watched, MONARCO_RATE_AIN_DEADBAND */
+    uint16_t wdt_timeout_ms; /* HAT watchdog timeout without attached watchdog, MONARCO_RATE_WDT_TIMEOUT_MS */
+    int mode; /* MONARCO_RATE_*, read-only */
+    int64_t period_ns; /* Period until the next cycle start, read-only */
+    int64_t selected_ns; /* Private, period selected by the latest update, the interval up to the next cycle */
+    int ref_valid; /* Private, reference inputs are set */
+    uint8_t ref_din; /* Private, DIN of the latest activity */
+    uint32_t ref_cnt[2]; /* Private, counters of the latest activity */
+    uint16_t ref_ain[2]; /* Private, analog inputs of the latest activity */
+    int64_t active_ns; /* Private, instant of the latest activity */
+    int64_t last_ns; /* Private, start of the previous cycle, 0 = none */
+    uint64_t mode_ns[MONARCO_RATE_FAST + 1]; /* Time spent in each mode (ns) */
+    uint32_t mode_cycles[MONARCO_RATE_FAST + 1]; /* Cycles run in each mode */
+    uint32_t bursts; /* Switches from idle to fast */
+} monarco_rate_t;
+
+/* Attach adaptive rate `*rate` owned by the application to `cxt`, call after `monarco_wdt_init()` if used.
+ *   `fast_us` and `idle_us` are cycle periods, idle >= fast. The rate starts idle. `dwell_ns`, `din_mask`,
+ *   `cnt_mask`, `ain_deadband` and `wdt_timeout_ms` may be changed afterwards. Returns -1 on invalid periods.
+ */
+int monarco_rate_init(monarco_rate_t *rate, monarco_cxt_t *cxt, uint32_t fast_us, uint32_t idle_us);
+
+/* Detach adaptive rate from `cxt`, `period_ns` stays at its last value */
+void monarco_rate_exit(monarco_cxt_t *cxt);
+
+/* Switch to the fast rate now as if inputs changed, e.g. on an application event */
+void monarco_rate_kick(monarco_cxt_t *cxt);
+
+/* Internal hook of monarco_main() */
+
+/* Detect input activity and select the period, called after a valid frame is published */
+void monarco_rate_update(monarco_cxt_t *cxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
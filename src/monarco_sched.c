@@ -0,0 +1,208 @@
+/***************************************************************************//**
+ * @file monarco_sched.c
+ * @brief libmonarco - Multi-rate Task Scheduler
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_sched.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t monarco_sched_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int monarco_sched_gcd(int a, int b)
+{
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Compare two tasks by priority, rate-monotonic for equal priority */
+static int monarco_sched_before(const monarco_task_t *a, const monarco_task_t *b)
+{
+    if (a->priority != b->priority) {
+        return a->priority < b->priority;
+    }
+    return a->period < b->period;
+}
+
+/* Place task `task` into the load profile `load` over `hyper` cycles */
+static void monarco_sched_place(monarco_task_t *task, uint64_t *load, int hyper)
+{
+    uint64_t weight = task->budget_ns ? task->budget_ns : 1;
+    int period = task->period < hyper ? task->period : hyper;
+    int s;
+
+    if (task->phase == MONARCO_SCHED_PHASE_AUTO) {
+        uint64_t best_peak = UINT64_MAX;
+        uint64_t best_sum = UINT64_MAX;
+        int best_phase = 0;
+        int phase;
+
+        for (phase = 0; phase < period; phase++) {
+            uint64_t peak = 0;
+            uint64_t sum = 0;
+            for (s = phase; s < hyper; s += task->period) {
+                if (load[s] > peak) {
+                    peak = load[s];
+                }
+                sum += load[s];
+            }
+            if ((peak < best_peak) || ((peak == best_peak) && (sum < best_sum))) {
+                best_peak = peak;
+                best_sum = sum;
+                best_phase = phase;
+            }
+        }
+
+        task->phase = best_phase;
+    }
+
+    for (s = task->phase; s < hyper; s += task->period) {
+        load[s] += weight;
+    }
+}
+
+int monarco_sched_init(monarco_sched_t *sched, monarco_task_t *tasks, int count, uint32_t cycle_budget_ns)
+{
+    int hyper = 1;
+    int i, j;
+
+    if ((count < 0) || (count > MONARCO_SCHED_TASKS_MAX)) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if ((tasks[i].fn == NULL) || (tasks[i].period < 1)) {
+            return -1;
+        }
+        if ((tasks[i].phase != MONARCO_SCHED_PHASE_AUTO) && ((tasks[i].phase < 0) || (tasks[i].phase >= tasks[i].period))) {
+            return -1;
+        }
+    }
+
+    memset(sched, 0, sizeof(monarco_sched_t));
+    sched->tasks = tasks;
+    sched->count = count;
+    sched->cycle_budget_ns = cycle_budget_ns;
+
+    /* Priority order - insertion sort, stable for equal keys */
+
+    for (i = 0; i < count; i++) {
+        j = i;
+        while ((j > 0) && monarco_sched_before(&tasks[i], &tasks[sched->order[j - 1]])) {
+            sched->order[j] = sched->order[j - 1];
+            j--;
+        }
+        sched->order[j] = i;
+    }
+
+    /* Hyperperiod, limited to MONARCO_SCHED_HYPERPERIOD_MAX */
+
+    for (i = 0; i < count; i++) {
+        long lcm = (long)hyper / monarco_sched_gcd(hyper, tasks[i].period) * tasks[i].period;
+        hyper = lcm > MONARCO_SCHED_HYPERPERIOD_MAX ? MONARCO_SCHED_HYPERPERIOD_MAX : (int)lcm;
+    }
+
+    /* Phase assignment - fixed phases first, then automatic ones in priority order */
+
+    uint64_t *load = calloc(hyper, sizeof(uint64_t));
+    if (load == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (tasks[sched->order[i]].phase != MONARCO_SCHED_PHASE_AUTO) {
+            monarco_sched_place(&tasks[sched->order[i]], load, hyper);
+        }
+    }
+    for (i = 0; i < count; i++) {
+        if (tasks[sched->order[i]].phase == MONARCO_SCHED_PHASE_AUTO) {
+            monarco_sched_place(&tasks[sched->order[i]], load, hyper);
+        }
+    }
+
+    free(load);
+
+    monarco_sched_reset_stats(sched);
+
+    return 0;
+}
+
+int monarco_sched_run(monarco_sched_t *sched)
+{
+    uint64_t t_cycle = 0;
+    int overruns = 0;
+    int i;
+
+    for (i = 0; i < sched->count; i++) {
+        monarco_task_t *task = &sched->tasks[sched->order[i]];
+
+        if ((int)(sched->tick % task->period) != task->phase) {
+            continue;
+        }
+
+        uint64_t t_start = monarco_sched_now_ns();
+        task->fn(task->arg, sched->tick);
+        uint64_t t_exec = monarco_sched_now_ns() - t_start;
+
+        task->runs++;
+        task->exec_last_ns = t_exec > UINT32_MAX ? UINT32_MAX : (uint32_t)t_exec;
+        task->exec_total_ns += t_exec;
+        if (task->exec_last_ns > task->exec_max_ns) {
+            task->exec_max_ns = task->exec_last_ns;
+        }
+        if (task->budget_ns && (task->exec_last_ns > task->budget_ns)) {
+            task->overruns++;
+            overruns++;
+        }
+
+        t_cycle += t_exec;
+    }
+
+    sched->cycle_last_ns = t_cycle > UINT32_MAX ? UINT32_MAX : (uint32_t)t_cycle;
+    if (sched->cycle_last_ns > sched->cycle_max_ns) {
+        sched->cycle_max_ns = sched->cycle_last_ns;
+    }
+    if (sched->cycle_budget_ns && (sched->cycle_last_ns > sched->cycle_budget_ns)) {
+        sched->cycle_overruns++;
+    }
+
+    sched->tick++;
+
+    return overruns;
+}
+
+void monarco_sched_reset_stats(monarco_sched_t *sched)
+{
+    int i;
+
+    for (i = 0; i < sched->count; i++) {
+        sched->tasks[i].runs = 0;
+        sched->tasks[i].overruns = 0;
+        sched->tasks[i].exec_last_ns = 0;
+        sched->tasks[i].exec_max_ns = 0;
+        sched->tasks[i].exec_total_ns = 0;
+    }
+
+    sched->cycle_last_ns = 0;
+    sched->cycle_max_ns = 0;
+    sched->cycle_overruns = 0;
+}
@@ -0,0 +1,89 @@
+/***************************************************************************//**
+ * @file monarco_sched.h
+ * @brief libmonarco - Multi-rate Task Scheduler
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_SCHED_H_
+#define LIBMONARCO_SCHED_H_
+
+#include <stdint.h>
+
+/* Maximal number of tasks in one scheduler */
+#ifndef MONARCO_SCHED_TASKS_MAX
+#define MONARCO_SCHED_TASKS_MAX 32
+#endif
+
+/* Maximal hyperperiod (in base cycles) considered by automatic phase assignment */
+#ifndef MONARCO_SCHED_HYPERPERIOD_MAX
+#define MONARCO_SCHED_HYPERPERIOD_MAX 4096
+#endif
+
+/* Task phase is assigned by `monarco_sched_init()` to flatten per-cycle load */
+#define MONARCO_SCHED_PHASE_AUTO (-1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Task function, `tick` is the scheduler base cycle counter */
+typedef void (*monarco_task_fn_t)(void *arg, uint32_t tick);
+
+/* Task Structure
+ *   Task runs in each base cycle where `(tick % period) == phase`. Due tasks run ordered by `priority`
+ *   (lower value first), tasks with equal priority run rate-monotonic (shorter period first).
+ */
+typedef struct {
+    const char *name; /* Task name, for diagnostics only */
+    monarco_task_fn_t fn; /* Task function */
+    void *arg; /* Argument passed to `fn` */
+    int period; /* Period as a multiple of base cycle, >= 1 */
+    int phase; /* Phase offset in base cycles (0..period-1), or MONARCO_SCHED_PHASE_AUTO */
+    int priority; /* Priority, lower value = higher priority */
+    uint32_t budget_ns; /* Expected worst-case execution time, 0 = unknown; used for phase spreading and overrun detection */
+    uint32_t runs; /* Statistics - number of executions */
+    uint32_t overruns; /* Statistics - number of executions longer than `budget_ns` */
+    uint32_t exec_last_ns; /* Statistics - last execution time */
+    uint32_t exec_max_ns; /* Statistics - maximal execution time */
+    uint64_t exec_total_ns; /* Statistics - total execution time */
+} monarco_task_t;
+
+/* Scheduler Context Structure */
+typedef struct {
+    monarco_task_t *tasks; /* Task table provided by the application */
+    int count; /* Number of tasks in `tasks` */
+    uint8_t order[MONARCO_SCHED_TASKS_MAX]; /* Private, task indexes ordered by priority */
+    uint32_t tick; /* Base cycle counter, incremented by each `monarco_sched_run()` */
+    uint32_t cycle_budget_ns; /* Budget for all tasks in one base cycle, 0 = no check */
+    uint32_t cycle_last_ns; /* Statistics - execution time of all tasks in last cycle */
+    uint32_t cycle_max_ns; /* Statistics - maximal execution time of all tasks in one cycle */
+    uint32_t cycle_overruns; /* Statistics - number of cycles exceeding `cycle_budget_ns` */
+} monarco_sched_t;
+
+/* Scheduler Initialization
+ *   Attach task table `*tasks` with `count` entries, order tasks by priority and assign automatic phases.
+ *   Phases are spread over the hyperperiod so that the maximal sum of `budget_ns` (or task count when
+ *   budgets are unknown) due in any single cycle is minimal. Returns -1 on invalid task table.
+ */
+int monarco_sched_init(monarco_sched_t *sched, monarco_task_t *tasks, int count, uint32_t cycle_budget_ns);
+
+/* Scheduler Run
+ *   Run all tasks due in the current base cycle and advance the tick. Call once per I/O cycle,
+ *   typically right before or after `monarco_main()`. Returns number of task overruns in this cycle.
+ */
+int monarco_sched_run(monarco_sched_t *sched);
+
+/* Reset execution statistics of all tasks and of the scheduler. */
+void monarco_sched_reset_stats(monarco_sched_t *sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
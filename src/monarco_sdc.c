@@ -0,0 +1,46 @@
+/***************************************************************************//**
+ * @file monarco_sdc.c
+ * @brief libmonarco - Service Data Channel (SDC) register map
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_sdc.h"
+
+#include <stddef.h>
+
+#define MONARCO_SDC_REG_MAP_INFO_(name, access, width, min, max) \
+    { #name, MONARCO_SDC_REG_##name, MONARCO_SDC_ACCESS_##access, width, min, max },
+
+static const monarco_sdc_reg_info_t monarco_sdc_reg_table[] = {
+    MONARCO_SDC_REG_MAP(MONARCO_SDC_REG_MAP_INFO_)
+};
+
+#define MONARCO_SDC_REG_TABLE_SIZE ((int)(sizeof(monarco_sdc_reg_table) / sizeof(monarco_sdc_reg_table[0])))
+
+const monarco_sdc_reg_info_t *monarco_sdc_reg_info(uint16_t address)
+{
+    int i;
+
+    for (i = 0; i < MONARCO_SDC_REG_TABLE_SIZE; i++) {
+        if (monarco_sdc_reg_table[i].address == address) {
+            return &monarco_sdc_reg_table[i];
+        }
+    }
+
+    return NULL;
+}
+
+int monarco_sdc_reg_map(const monarco_sdc_reg_info_t **table)
+{
+    if (table != NULL) {
+        *table = monarco_sdc_reg_table;
+    }
+
+    return MONARCO_SDC_REG_TABLE_SIZE;
+}
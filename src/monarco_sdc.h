@@ -13,6 +13,8 @@
 #ifndef LIBMONARCO_SDC_H_
 #define LIBMONARCO_SDC_H_
 
+#include <stdint.h>
+
 /* Check SPI protocol documentation for SDC registers details:
  *   https://github.com/monarco/monarco-hat-documentation/blob/master/Monarco_HAT_SPI_Protocol.md
  */
@@ -44,6 +46,63 @@
 #define MONARCO_SDC_REG_CNT1CFG 0x024 /* COUNTER1 Configuration [W], see MONARCO_SDC_COUNTER_MODE_* */
 #define MONARCO_SDC_REG_CNT2CFG 0x025 /* COUNTER2 Configuration [W], see MONARCO_SDC_COUNTER_MODE_* */
 
+/* SDC Register Map
+ *   Declarative description of all known SDC registers, used for compile-time checked SDC Items
+ *   (see MONARCO_SDC_ITEM_* in monarco.h) and for runtime lookup by monarco_sdc_reg_info().
+ *   X(name, access, width, min, max) - `name` is suffix of MONARCO_SDC_REG_*, `access` is R, W or RW,
+ *   `width` is number of significant bits, `min`..`max` is valid range of written value.
+ */
+
+#define MONARCO_SDC_ACCESS_R 0x1
+#define MONARCO_SDC_ACCESS_W 0x2
+#define MONARCO_SDC_ACCESS_RW (MONARCO_SDC_ACCESS_R | MONARCO_SDC_ACCESS_W)
+
+#define MONARCO_SDC_REG_MAP(X) \
+    X(STATUS,     R,  16, 0, 0xFFFF) \
+    X(FWVERL,     R,  16, 0, 0xFFFF) \
+    X(FWVERH,     R,  16, 0, 0xFFFF) \
+    X(HWVERL,     R,  16, 0, 0xFFFF) \
+    X(HWVERH,     R,  16, 0, 0xFFFF) \
+    X(MCUID1,     R,  16, 0, 0xFFFF) \
+    X(MCUID2,     R,  16, 0, 0xFFFF) \
+    X(MCUID3,     R,  16, 0, 0xFFFF) \
+    X(MCUID4,     R,  16, 0, 0xFFFF) \
+    X(HWCONFIG1,  RW,  3, 0, 0x7) \
+    X(WDTIMEOUT,  RW, 16, 0, 0xFFFF) \
+    X(RS485BAUD,  RW, 10, 3, 1000) \
+    X(RS485MODE,  RW,  7, 0, 0x7F) \
+    X(HOSTBAUD,   RW, 10, 0, 1000) \
+    X(RS485RXCNT, R,  16, 0, 0xFFFF) \
+    X(RS485TXCNT, R,  16, 0, 0xFFFF) \
+    X(RS485FECNT, R,  16, 0, 0xFFFF) \
+    X(RS485PECNT, R,  16, 0, 0xFFFF) \
+    X(CNT1CFG,    W,  10, 0, 0x3FF) \
+    X(CNT2CFG,    W,  10, 0, 0x3FF)
+
+/* Per-register constants MONARCO_SDC_ACC_<name>, MONARCO_SDC_MIN_<name>, MONARCO_SDC_MAX_<name> */
+#define MONARCO_SDC_REG_MAP_ENUM_(name, access, width, min, max) \
+    MONARCO_SDC_ACC_##name = MONARCO_SDC_ACCESS_##access, \
+    MONARCO_SDC_MIN_##name = (min), \
+    MONARCO_SDC_MAX_##name = (max),
+
+enum { MONARCO_SDC_REG_MAP(MONARCO_SDC_REG_MAP_ENUM_) };
+
+/* Consistency check of the map itself - valid range has to fit into register width */
+#define MONARCO_SDC_REG_MAP_CHECK_(name, access, width, min, max) \
+    typedef char monarco_sdc_reg_map_check_##name[((min) <= (max) && (max) < (1L << (width))) ? 1 : -1];
+
+MONARCO_SDC_REG_MAP(MONARCO_SDC_REG_MAP_CHECK_)
+
+/* Register description provided by monarco_sdc_reg_info() */
+typedef struct {
+    const char *name; /* Register name, e.g. "RS485BAUD" */
+    uint16_t address; /* Register Address, see MONARCO_SDC_REG_* */
+    uint8_t access; /* MONARCO_SDC_ACCESS_* flags */
+    uint8_t width; /* Number of significant bits */
+    uint16_t min; /* Minimal valid written value */
+    uint16_t max; /* Maximal valid written value */
+} monarco_sdc_reg_info_t;
+
 /* Status Codes */
 
 #define MONARCO_SDC_STATUS_OK 0xABCD
@@ -113,4 +172,18 @@
 #define MONARCO_SDC_RS485_DEFAULT_BAUDRATE 96
 #define MONARCO_SDC_RS485_DEFAULT_MODE (MONARCO_SDC_RS485_MODE_PARITY_NONE | MONARCO_SDC_RS485_MODE_DATABITS_8 | MONARCO_SDC_RS485_MODE_STOPBITS_1_0)
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Return description of SDC register `address` from the register map, or NULL for unknown register. */
+const monarco_sdc_reg_info_t *monarco_sdc_reg_info(uint16_t address);
+
+/* Return number of registers in the register map, `*table` is set to the map itself when not NULL. */
+int monarco_sdc_reg_map(const monarco_sdc_reg_info_t **table);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
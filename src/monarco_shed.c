@@ -0,0 +1,191 @@
+/***************************************************************************//**
+ * @file monarco_shed.c
+ * @brief libmonarco - Adaptive Load Shedding
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_shed.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "monarco_platform.h"
+
+/* Debug prints suppressed from MONARCO_SHED_LOG */
+#define MONARCO_SHED_DPF (MONARCO_DPF_WARNING | MONARCO_DPF_INFO | MONARCO_DPF_VERB | MONARCO_DPF_READ | MONARCO_DPF_WRITE)
+
+/* Decaying peak - follows increases at once, decreases by 1/64 per sample */
+static inline int64_t monarco_shed_peak(int64_t peak, int64_t sample)
+{
+    peak -= peak >> 6;
+    return (sample > peak) ? sample : peak;
+}
+
+/* Apply shedding level to the cycle */
+static void monarco_shed_set(monarco_shed_t *shed, int level)
+{
+    monarco_cxt_t *cxt = shed->cxt;
+
+    shed->level = level;
+    if (level > shed->level_max) {
+        shed->level_max = level;
+    }
+
+    cxt->shed_sdc_factor = (level >= MONARCO_SHED_SDC) ? (shed->sdc_min_factor > 0 ? shed->sdc_min_factor : 1) : 0;
+    cxt->dprint_shed = (level >= MONARCO_SHED_LOG) ? MONARCO_SHED_DPF : 0;
+}
+
+int monarco_shed_init(monarco_shed_t *shed, monarco_cxt_t *cxt, uint32_t period_us)
+{
+    if (period_us == 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_shed_init: Invalid cycle period\n");
+        return -1;
+    }
+
+    memset(shed, 0, sizeof(monarco_shed_t));
+    shed->cxt = cxt;
+    shed->period_ns = period_us * 1000LL;
+    shed->deadline_ns = shed->period_ns;
+    shed->high = MONARCO_SHED_HIGH;
+    shed->low = MONARCO_SHED_LOW;
+    shed->recover_cycles = MONARCO_SHED_RECOVER_CYCLES;
+    shed->sdc_min_factor = 1;
+
+    monarco_shed_set(shed, MONARCO_SHED_NONE);
+    cxt->shed = shed;
+
+    MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_shed_init: Cycle period %u us\n", period_us);
+
+    return 0;
+}
+
+void monarco_shed_exit(monarco_cxt_t *cxt)
+{
+    if (cxt->shed != NULL) {
+        monarco_shed_set(cxt->shed, MONARCO_SHED_NONE);
+        cxt->shed = NULL;
+    }
+}
+
+int monarco_shed_task(monarco_shed_t *shed, monarco_shed_fn_t fn, void *arg, int level)
+{
+    monarco_cxt_t *cxt = shed->cxt;
+
+    if ((fn == NULL) || (level < MONARCO_SHED_SDC) || (level > MONARCO_SHED_TASKS) || (shed->task_count >= MONARCO_SHED_TASKS_MAX)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_shed_task: Invalid task or table full\n");
+        return -1;
+    }
+
+    monarco_shed_task_t *task = &shed->tasks[shed->task_count];
+    memset(task, 0, sizeof(monarco_shed_task_t));
+    task->fn = fn;
+    task->arg = arg;
+    task->level = level;
+
+    return shed->task_count++;
+}
+
+void monarco_shed_begin(monarco_cxt_t *cxt)
+{
+    monarco_shed_t *shed = cxt->shed;
+    int64_t now = cxt->cycle_ns;
+    int level = shed->level;
+
+    shed->entry_ns = now;
+
+    // cycle start on the period grid, early start (e.g. grid drift of the application) moves the grid
+    if (shed->start_ns == 0) {
+        shed->start_ns = now;
+    }
+    else {
+        shed->start_ns += shed->period_ns;
+        if (now < shed->start_ns) {
+            shed->start_ns = now;
+        }
+    }
+
+    int64_t used = now - shed->start_ns;
+
+    shed->pressure = (double)(used + shed->main_peak_ns) / shed->deadline_ns;
+
+    if (shed->pressure >= shed->high) {
+        shed->calm = 0;
+        if (level < MONARCO_SHED_TASKS) {
+            level++;
+        }
+    }
+    else if (shed->pressure < shed->low) {
+        if ((level > MONARCO_SHED_NONE) && (++shed->calm >= shed->recover_cycles)) {
+            shed->calm = 0;
+            level--;
+        }
+    }
+    else {
+        shed->calm = 0;
+    }
+
+    // late by a whole period or more - follow the application grid from now on
+    if (used >= shed->period_ns) {
+        shed->start_ns = now;
+    }
+
+    if (level != shed->level) {
+        monarco_shed_set(shed, level);
+    }
+
+    shed->level_cycles[level]++;
+    if (level > MONARCO_SHED_NONE) {
+        cxt->stats.shed_cycles++;
+    }
+}
+
+void monarco_shed_end(monarco_cxt_t *cxt)
+{
+    monarco_shed_t *shed = cxt->shed;
+    int64_t now = monarco_now_ns();
+    int i;
+
+    if (shed->start_ns == 0) {
+        return;
+    }
+
+    shed->main_peak_ns = monarco_shed_peak(shed->main_peak_ns, now - shed->entry_ns);
+
+    if (now - shed->start_ns > shed->deadline_ns) {
+        cxt->stats.deadline_misses++;
+        shed->calm = 0;
+        if (shed->level != MONARCO_SHED_TASKS) {
+            monarco_shed_set(shed, MONARCO_SHED_TASKS);
+        }
+    }
+
+    // optional tasks, each only when it fits before the next cycle start
+    int64_t next_ns = shed->start_ns + shed->period_ns;
+
+    for (i = 0; i < shed->task_count; i++) {
+        monarco_shed_task_t *task = &shed->tasks[i];
+
+        if ((shed->level >= task->level) || (now + task->peak_ns > next_ns)) {
+            // outlier of the peak ages out while skipped
+            task->peak_ns -= task->peak_ns >> 6;
+            task->skipped++;
+            cxt->stats.shed_tasks++;
+            continue;
+        }
+
+        task->fn(task->arg, shed->tick);
+        task->runs++;
+
+        int64_t done = monarco_now_ns();
+        task->peak_ns = monarco_shed_peak(task->peak_ns, done - now);
+        now = done;
+    }
+
+    shed->tick++;
+}
@@ -0,0 +1,126 @@
+/***************************************************************************//**
+ * @file monarco_shed.h
+ * @brief libmonarco - Adaptive Load Shedding
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_SHED_H_
+#define LIBMONARCO_SHED_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* Cycles start on a grid of the nominal period (the application sleeps until absolute times). When load
+ * shedding is attached by `monarco_shed_init()`, `monarco_main()` takes the time already spent in the current
+ * cycle at its start, adds the peak duration of its own work and compares it with the deadline of the
+ * frame exchange. Pressure over `high` raises the shedding level by one each cycle, a missed deadline
+ * raises it to the maximum at once, and `recover_cycles` cycles under `low` lower it by one:
+ *  - MONARCO_SHED_SDC - periodic SDC Items with factor >= `sdc_min_factor` are deferred (their factor counters
+ *    stop), one-shot requests and the request in flight go on,
+ *  - MONARCO_SHED_LOG - debug prints except errors are suppressed,
+ *  - MONARCO_SHED_TASKS - optional tasks of the application are skipped.
+ * Optional tasks registered by `monarco_shed_task()` run at the end of `monarco_main()` after the frame exchange,
+ * each only below its shedding level and when its peak duration fits before the next cycle start.
+ * Deferred work is counted in `cxt.stats` (`shed_*`, `deadline_misses`).
+ */
+
+/* Maximal number of optional tasks */
+#ifndef MONARCO_SHED_TASKS_MAX
+#define MONARCO_SHED_TASKS_MAX 16
+#endif
+
+/* Default pressure (part of the deadline used) raising the level */
+#ifndef MONARCO_SHED_HIGH
+#define MONARCO_SHED_HIGH 0.75
+#endif
+
+/* Default pressure under which the level is lowered */
+#ifndef MONARCO_SHED_LOW
+#define MONARCO_SHED_LOW 0.5
+#endif
+
+/* Default number of cycles under `low` pressure lowering the level by one */
+#ifndef MONARCO_SHED_RECOVER_CYCLES
+#define MONARCO_SHED_RECOVER_CYCLES 50
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shedding levels, each one includes the lower ones */
+enum {
+    MONARCO_SHED_NONE, /* All work runs */
+    MONARCO_SHED_SDC, /* Low-priority periodic SDC Items deferred */
+    MONARCO_SHED_LOG, /* Debug prints except errors suppressed */
+    MONARCO_SHED_TASKS, /* Optional tasks skipped */
+};
+
+/* Optional task function, `tick` is the cycle counter */
+typedef void (*monarco_shed_fn_t)(void *arg, uint32_t tick);
+
+/* Optional Task */
+typedef struct {
+    monarco_shed_fn_t fn; /* Task function */
+    void *arg; /* Argument passed to `fn` */
+    int level; /* Task is skipped from this shedding level up */
+    int64_t peak_ns; /* Decaying peak execution time (ns), read-only */
+    uint32_t runs; /* Number of executions */
+    uint32_t skipped; /* Number of skipped executions */
+} monarco_shed_task_t;
+
+/* Load Shedding, owned by the application */
+typedef struct monarco_shed_s {
+    monarco_cxt_t *cxt; /* Attached context */
+    int64_t period_ns; /* Nominal cycle period (ns) */
+    int64_t deadline_ns; /* Deadline of the frame exchange from the cycle start (ns), the period by default */
+    double high; /* Pressure raising the level, MONARCO_SHED_HIGH */
+    double low; /* Pressure lowering the level, MONARCO_SHED_LOW */
+    uint32_t recover_cycles; /* Cycles under `low` lowering the level by one, MONARCO_SHED_RECOVER_CYCLES */
+    uint16_t sdc_min_factor; /* Periodic SDC Items with factor >= this are deferred, 1 = all periodic Items */
+    int level; /* MONARCO_SHED_*, read-only */
+    int level_max; /* Highest level reached, read-only */
+    double pressure; /* Pressure of the last cycle, read-only */
+    int64_t start_ns; /* Private, start of the current cycle on the period grid, 0 = none */
+    int64_t entry_ns; /* Private, start of monarco_main() */
+    int64_t main_peak_ns; /* Decaying peak duration of monarco_main() frame exchange (ns), read-only */
+    uint32_t calm; /* Private, consecutive cycles under `low` */
+    uint32_t tick; /* Cycle counter */
+    uint32_t level_cycles[MONARCO_SHED_TASKS + 1]; /* Cycles spent at each level */
+    monarco_shed_task_t tasks[MONARCO_SHED_TASKS_MAX]; /* Optional tasks */
+    int task_count; /* Number of `tasks` */
+} monarco_shed_t;
+
+/* Attach load shedding `*shed` owned by the application to `cxt`, `period_us` is the nominal cycle period.
+ *   `deadline_ns`, `high`, `low`, `recover_cycles` and `sdc_min_factor` may be changed afterwards.
+ *   Returns -1 on invalid period.
+ */
+int monarco_shed_init(monarco_shed_t *shed, monarco_cxt_t *cxt, uint32_t period_us);
+
+/* Detach load shedding from `cxt`, deferred work is restored */
+void monarco_shed_exit(monarco_cxt_t *cxt);
+
+/* Register optional task `fn(arg, tick)` run at the end of each monarco_main(), skipped from shedding `level` up
+ *   (MONARCO_SHED_SDC..MONARCO_SHED_TASKS). Returns task index, or -1 when full or invalid.
+ */
+int monarco_shed_task(monarco_shed_t *shed, monarco_shed_fn_t fn, void *arg, int level);
+
+/* Internal hooks of monarco_main() */
+
+/* Evaluate pressure and apply the shedding level, called at the start of the cycle */
+void monarco_shed_begin(monarco_cxt_t *cxt);
+
+/* Check the deadline and run optional tasks, called at the end of the cycle */
+void monarco_shed_end(monarco_cxt_t *cxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
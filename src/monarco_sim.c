@@ -0,0 +1,250 @@
+/***************************************************************************//**
+ * @file monarco_sim.c
+ * @brief libmonarco - Simulated Monarco HAT
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_sim.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "monarco_crc.h"
+#include "monarco_sdc.h"
+
+static uint64_t monarco_sim_now_ns(const monarco_sim_t *sim)
+{
+    struct timespec ts;
+
+    if (sim->clock_ns != NULL) {
+        return *sim->clock_ns;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void monarco_sim_init(monarco_sim_t *sim)
+{
+    memset(sim, 0, sizeof(monarco_sim_t));
+
+    sim->regs[MONARCO_SDC_REG_STATUS] = MONARCO_SDC_STATUS_OK;
+    sim->regs[MONARCO_SDC_REG_FWVERL] = 0x2006;
+    sim->regs[MONARCO_SDC_REG_FWVERH] = 0x0000;
+    sim->regs[MONARCO_SDC_REG_HWVERL] = 0x0105;
+    sim->regs[MONARCO_SDC_REG_HWVERH] = 0x0000;
+    sim->regs[MONARCO_SDC_REG_MCUID1] = 0x5100;
+    sim->regs[MONARCO_SDC_REG_MCUID2] = 0x0051;
+    sim->regs[MONARCO_SDC_REG_MCUID3] = 0x0F0F;
+    sim->regs[MONARCO_SDC_REG_MCUID4] = 0x5EED;
+    sim->regs[MONARCO_SDC_REG_WDTIMEOUT] = 100;
+    sim->regs[MONARCO_SDC_REG_RS485BAUD] = MONARCO_SDC_RS485_DEFAULT_BAUDRATE;
+    sim->regs[MONARCO_SDC_REG_RS485MODE] = MONARCO_SDC_RS485_DEFAULT_MODE;
+
+    sim->fault_seed = 1;
+}
+
+/* Fault injection - return 1 with probability `rate` (xorshift32 PRNG) */
+static int monarco_sim_fault(monarco_sim_t *sim, double rate)
+{
+    uint32_t x;
+
+    if (rate <= 0) {
+        return 0;
+    }
+
+    x = sim->fault_seed ? sim->fault_seed : 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->fault_seed = x;
+
+    return (x / 4294967296.0) < rate;
+}
+
+/* Put SDC response into the response slot, to be sent in frame `ready_frame`. A response still waiting
+ * answers a superseded request (or a repeated one, answered again now), it is replaced.
+ */
+static void monarco_sim_sdc_queue(monarco_sim_t *sim, const monarco_struct_sdc_t *resp, uint32_t ready_frame)
+{
+    if (sim->sdc_pending.valid) {
+        sim->sdc_superseded++;
+    }
+
+    sim->sdc_pending.resp = *resp;
+    sim->sdc_pending.ready_frame = ready_frame;
+    sim->sdc_pending.valid = 1;
+}
+
+/* Send SDC response ready in frame `frame`, last response is repeated when none is ready */
+static void monarco_sim_sdc_dequeue(monarco_sim_t *sim, uint32_t frame)
+{
+    if (sim->sdc_pending.valid && ((int32_t)(frame - sim->sdc_pending.ready_frame) >= 0)) {
+        sim->sdc_resp = sim->sdc_pending.resp;
+        sim->sdc_pending.valid = 0;
+    }
+}
+
+/* Process SDC request, response is sent in the next frame (or later with injected delay) */
+static void monarco_sim_sdc(monarco_sim_t *sim, const monarco_struct_sdc_t *req)
+{
+    const monarco_sdc_reg_info_t *reg = monarco_sdc_reg_info(req->address);
+    monarco_struct_sdc_t resp = *req;
+    uint32_t ready_frame = sim->frames; /* already incremented - number of the next frame */
+
+    resp.error = 0;
+    resp.reserved = 0;
+
+    if (monarco_sim_fault(sim, sim->fault_drop_rate)) {
+        sim->faults_drop++;
+        return;
+    }
+
+    if ((sim->fault_delay_frames > 0) && monarco_sim_fault(sim, sim->fault_delay_rate)) {
+        ready_frame += 1 + (sim->fault_seed % sim->fault_delay_frames);
+        sim->faults_delay++;
+    }
+    else if (monarco_sim_fault(sim, sim->fault_reorder_rate)) {
+        // the previous response is sent once more before this one - out of order for the host
+        ready_frame++;
+        sim->faults_reorder++;
+    }
+
+    if (monarco_sim_fault(sim, sim->fault_unknown_rate)) {
+        resp.error = 1;
+        resp.value = MONARCO_SDC_ERROR_UNKNOWN_REG;
+        sim->faults_unknown++;
+    }
+    else if ((reg == NULL) || (req->address >= MONARCO_SIM_REGS_SIZE)
+            || !(reg->access & (req->write ? MONARCO_SDC_ACCESS_W : MONARCO_SDC_ACCESS_R))
+            || (req->write && ((req->value < reg->min) || (req->value > reg->max)))) {
+        resp.error = 1;
+        resp.value = MONARCO_SDC_ERROR_UNKNOWN_REG;
+    }
+    else if (req->write) {
+        if ((sim->sdc_writes > 0) && (memcmp(req, &sim->sdc_last_req, sizeof(monarco_struct_sdc_t)) == 0)) {
+            sim->sdc_dup_writes++;
+        }
+        sim->regs[req->address] = req->value;
+        sim->sdc_writes++;
+    }
+    else {
+        resp.value = sim->regs[req->address];
+        sim->sdc_reads++;
+    }
+
+    sim->sdc_last_req = *req;
+
+    monarco_sim_sdc_queue(sim, &resp, ready_frame);
+}
+
+/* Loopback - outputs in flight reaching inputs, before inputs are sampled into the frame */
+static void monarco_sim_loop_inputs(monarco_sim_t *sim, uint64_t now)
+{
+    if (sim->loop_din_mask && (now >= sim->loop_dout_ns)) {
+        sim->din = (sim->din & ~sim->loop_din_mask) | (sim->loop_dout & sim->loop_din_mask);
+    }
+
+    if (sim->loop_ain1) {
+        // the latest sampling instant counts
+        uint64_t sampled = sim->loop_ain_sample_ns ? now - now % sim->loop_ain_sample_ns : now;
+        if (sampled >= sim->loop_aout1_ns) {
+            sim->ain1 = sim->loop_aout1;
+        }
+    }
+}
+
+/* Loopback - changed outputs accepted at `now` start their way to inputs */
+static void monarco_sim_loop_outputs(monarco_sim_t *sim, const monarco_struct_tx_t *tx, uint64_t now)
+{
+    if (sim->loop_din_mask && ((tx->dout ^ sim->loop_dout) & sim->loop_din_mask)) {
+        sim->loop_dout = tx->dout;
+        sim->loop_dout_ns = now + sim->loop_din_delay_ns;
+    }
+
+    if (sim->loop_ain1 && (tx->aout1 != sim->loop_aout1)) {
+        sim->loop_aout1 = tx->aout1;
+        sim->loop_aout1_ns = now + sim->loop_ain_delay_ns;
+    }
+}
+
+int monarco_sim_transfer(void *arg, const monarco_struct_tx_t *tx, monarco_struct_rx_t *rx)
+{
+    monarco_sim_t *sim = (monarco_sim_t *)arg;
+    uint64_t t_start = sim->transfer_ns ? monarco_sim_now_ns(sim) : 0;
+
+    /* HAT TX frame - prepared before the transfer, carries response to the previous request */
+
+    monarco_sim_sdc_dequeue(sim, sim->frames);
+
+    if (sim->loop_din_mask || sim->loop_ain1) {
+        monarco_sim_loop_inputs(sim, monarco_sim_now_ns(sim));
+    }
+
+    memset(rx, 0, sizeof(monarco_struct_rx_t));
+    rx->sdc_resp = sim->sdc_resp;
+    rx->status_byte.sign_of_life = sim->sign_of_life++;
+    rx->status_byte.cnt1_reset_done = sim->outputs.control_byte.cnt1_reset;
+    rx->status_byte.cnt2_reset_done = sim->outputs.control_byte.cnt2_reset;
+    rx->din = sim->din;
+    rx->cnt1 = sim->cnt1;
+    rx->cnt2 = sim->cnt2;
+    rx->ain1 = sim->ain1;
+    rx->ain2 = sim->ain2;
+    rx->crc = monarco_crc16((const char *)rx, MONARCO_STRUCT_SIZE - 2);
+
+    if (monarco_sim_fault(sim, sim->fault_crc_rate)) {
+        rx->crc ^= 0xA5A5;
+        sim->faults_crc++;
+    }
+
+    /* Process data watchdog - outputs off when the host was silent for WDTIMEOUT */
+
+    uint64_t now = monarco_sim_now_ns(sim);
+    uint64_t timeout_ns = sim->regs[MONARCO_SDC_REG_WDTIMEOUT] * 1000000ULL;
+
+    if ((timeout_ns > 0) && (sim->wdt_last_ns > 0) && (now - sim->wdt_last_ns > timeout_ns)) {
+        memset(&sim->outputs, 0, sizeof(monarco_struct_tx_t));
+        sim->wdt_trip_ns = sim->wdt_last_ns + timeout_ns;
+        sim->wdt_trips++;
+    }
+
+    /* HAT RX frame - outputs and SDC request are accepted only with valid CRC */
+
+    sim->frames++;
+
+    if (tx->crc != monarco_crc16((const char *)tx, MONARCO_STRUCT_SIZE - 2)) {
+        sim->crc_errors++;
+        sim->regs[MONARCO_SDC_REG_STATUS] = MONARCO_SDC_STATUS_ERROR_CRC;
+    }
+    else {
+        if (tx->control_byte.cnt1_reset && !sim->outputs.control_byte.cnt1_reset) {
+            sim->cnt1 = 0;
+        }
+        if (tx->control_byte.cnt2_reset && !sim->outputs.control_byte.cnt2_reset) {
+            sim->cnt2 = 0;
+        }
+        if (sim->loop_din_mask || sim->loop_ain1) {
+            monarco_sim_loop_outputs(sim, tx, now);
+        }
+        sim->outputs = *tx;
+        sim->wdt_last_ns = now;
+        sim->regs[MONARCO_SDC_REG_STATUS] = MONARCO_SDC_STATUS_OK;
+        monarco_sim_sdc(sim, &tx->sdc_req);
+    }
+
+    /* Simulated transfer duration */
+
+    if (sim->transfer_ns && (sim->clock_ns == NULL)) {
+        while (monarco_sim_now_ns(sim) - t_start < sim->transfer_ns) {
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/***************************************************************************//**
+ * @file monarco_sim.h
+ * @brief libmonarco - Simulated Monarco HAT
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_SIM_H_
+#define LIBMONARCO_SIM_H_
+
+#include <stdint.h>
+#include "monarco_struct.h"
+
+/* Size of simulated SDC register file, covers all registers of MONARCO_SDC_REG_MAP */
+#define MONARCO_SIM_REGS_SIZE 0x40
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pending SDC response of simulated HAT */
+typedef struct {
+    monarco_struct_sdc_t resp; /* Response */
+    uint32_t ready_frame; /* Frame number when the response is sent */
+    int valid; /* Response waiting for `ready_frame` */
+} monarco_sim_sdc_entry_t;
+
+/* Simulated HAT Structure
+ *   Software stand-in for the Monarco HAT implementing the SPI protocol frames, CRC and SDC register file.
+ *   Like the real HAT, SDC response to a request is returned in the following frame. The HAT has one response
+ *   slot - a response still waiting (delayed, held back) is replaced by the response to the next request.
+ *   Protocol faults can be injected by `fault_*` members, e.g. for SDC throughput measurement under errors.
+ *   Inputs (`din`, `ain1`, ...) are set by the application or a plant model, outputs are in `outputs`.
+ *   Process data watchdog is evaluated at each transfer - when no valid frame came for WDTIMEOUT,
+ *   outputs are switched off as of the timeout instant. With virtual clock `clock_ns`, the watchdog runs on it
+ *   and `transfer_ns` is not waited.
+ *   Loopback wiring `loop_*` feeds accepted outputs back to inputs after configurable internal delays, e.g. to validate
+ *   I/O round-trip latency measurement. Only the latest change of each output is in flight, a faster change replaces it.
+ */
+typedef struct {
+    uint16_t regs[MONARCO_SIM_REGS_SIZE]; /* SDC register file indexed by address */
+    monarco_struct_tx_t outputs; /* Last accepted output process data */
+    uint8_t din; /* Digital inputs */
+    uint32_t cnt1; /* COUNTER1 value */
+    uint32_t cnt2; /* COUNTER2 value */
+    uint16_t ain1; /* Analog input 1 */
+    uint16_t ain2; /* Analog input 2 */
+    uint32_t transfer_ns; /* Simulated duration of one transfer (busy wait), 0 = none */
+    uint8_t loop_din_mask; /* Loopback - DOUT bits wired to the same DIN bits (e.g. 0x04 = DOUT3<>DIN3), 0 = none */
+    uint8_t loop_ain1; /* Loopback - AOUT1 wired to AIN1 */
+    uint32_t loop_din_delay_ns; /* Loopback - internal delay from accepted DOUT to DIN (output driver, input filter) */
+    uint32_t loop_ain_delay_ns; /* Loopback - internal delay from accepted AOUT1 to AIN1 (DAC settling, ADC conversion) */
+    uint32_t loop_ain_sample_ns; /* Loopback - AIN1 sampling period, value held between samples, 0 = continuous */
+    const uint64_t *clock_ns; /* Virtual clock (ns) used instead of CLOCK_MONOTONIC, NULL = none, see monarco_cosim.h */
+    double fault_crc_rate; /* Fault injection - probability of corrupted CRC of a frame sent by HAT */
+    double fault_drop_rate; /* Fault injection - probability of dropped SDC request (no response) */
+    double fault_unknown_rate; /* Fault injection - probability of MONARCO_SDC_ERROR_UNKNOWN_REG response */
+    double fault_reorder_rate; /* Fault injection - probability of SDC response held back a frame, the previous response is sent again in its place */
+    double fault_delay_rate; /* Fault injection - probability of delayed SDC response */
+    int fault_delay_frames; /* Fault injection - maximal additional delay of SDC response in frames */
+    uint32_t fault_seed; /* Fault injection - PRNG state, nonzero */
+    monarco_struct_sdc_t sdc_resp; /* Private, last SDC response sent */
+    monarco_sim_sdc_entry_t sdc_pending; /* Private, response slot - SDC response waiting to be sent */
+    uint8_t sign_of_life; /* Private, frame counter for status byte */
+    uint32_t frames; /* Statistics - number of frames */
+    uint32_t crc_errors; /* Statistics - number of frames with invalid CRC */
+    uint32_t sdc_reads; /* Statistics - number of processed SDC read requests */
+    uint32_t sdc_writes; /* Statistics - number of processed SDC write requests */
+    uint32_t sdc_dup_writes; /* Statistics - number of SDC write requests identical to the previous processed request */
+    uint32_t faults_crc; /* Statistics - injected CRC faults */
+    uint32_t faults_drop; /* Statistics - injected dropped SDC requests */
+    uint32_t faults_unknown; /* Statistics - injected unknown register errors */
+    uint32_t faults_reorder; /* Statistics - injected reordered SDC responses (held back a frame) */
+    uint32_t faults_delay; /* Statistics - injected delayed SDC responses */
+    uint32_t sdc_superseded; /* Statistics - waiting SDC responses replaced by the response to a newer request */
+    uint32_t wdt_trips; /* Statistics - process data watchdog timeouts, outputs were switched off */
+    uint64_t wdt_trip_ns; /* Instant of the latest watchdog timeout (CLOCK_MONOTONIC ns) */
+    uint64_t wdt_last_ns; /* Private, instant of the latest frame with valid CRC */
+    monarco_struct_sdc_t sdc_last_req; /* Private, last processed SDC request */
+    uint8_t loop_dout; /* Private, latest DOUT on its way to DIN */
+    uint16_t loop_aout1; /* Private, latest AOUT1 on its way to AIN1 */
+    uint64_t loop_dout_ns; /* Private, instant `loop_dout` reaches DIN */
+    uint64_t loop_aout1_ns; /* Private, instant `loop_aout1` reaches AIN1 */
+} monarco_sim_t;
+
+/* Initialize simulated HAT with power-on register values, no faults are injected. */
+void monarco_sim_init(monarco_sim_t *sim);
+
+/* Exchange one frame with simulated HAT `sim` (monarco_sim_t *), see monarco_transfer_fn_t. */
+int monarco_sim_transfer(void *sim, const monarco_struct_tx_t *tx, monarco_struct_rx_t *rx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,471 @@
+/***************************************************************************//**
+ * @file monarco_tag.c
+ * @brief libmonarco - Named Tag Database
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_tag.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "monarco_sdc.h"
+#include "monarco_cmdq.h"
+
+/* Number of hash seeds tried before the build fails */
+#define MONARCO_TAG_SEEDS 64
+
+/* Maximal displacement tried per bucket */
+#define MONARCO_TAG_DISP_MAX 0xFFFF
+
+#define MONARCO_TAG_AIN_SCALE (10.0 / 4095) /* Volts in voltage mode */
+#define MONARCO_TAG_AOUT_SCALE (10.0 / 4095) /* Volts */
+#define MONARCO_TAG_PWM_SCALE (1.0 / 65535) /* Duty cycle 0..1 */
+
+/* Built-in process data tags */
+static const monarco_tag_t monarco_tag_builtin[] = {
+    MONARCO_TAG_RX_BIT("DIN1", din, 0),
+    MONARCO_TAG_RX_BIT("DIN2", din, 1),
+    MONARCO_TAG_RX_BIT("DIN3", din, 2),
+    MONARCO_TAG_RX_BIT("DIN4", din, 3),
+    MONARCO_TAG_RX_VALUE("CNT1", cnt1, MONARCO_TAG_U32, 1, 0),
+    MONARCO_TAG_RX_VALUE("CNT2", cnt2, MONARCO_TAG_U32, 1, 0),
+    MONARCO_TAG_RX_VALUE("AIN1", ain1, MONARCO_TAG_U16, MONARCO_TAG_AIN_SCALE, 0),
+    MONARCO_TAG_RX_VALUE("AIN2", ain2, MONARCO_TAG_U16, MONARCO_TAG_AIN_SCALE, 0),
+    MONARCO_TAG_TX_BIT("DOUT1", dout, 0),
+    MONARCO_TAG_TX_BIT("DOUT2", dout, 1),
+    MONARCO_TAG_TX_BIT("DOUT3", dout, 2),
+    MONARCO_TAG_TX_BIT("DOUT4", dout, 3),
+    MONARCO_TAG_TX_VALUE("LEDMASK", led_mask, MONARCO_TAG_U8, 0, 1, 0),
+    MONARCO_TAG_TX_BIT("LED1", led_value, 0),
+    MONARCO_TAG_TX_BIT("LED2", led_value, 1),
+    MONARCO_TAG_TX_BIT("LED3", led_value, 2),
+    MONARCO_TAG_TX_BIT("LED4", led_value, 3),
+    MONARCO_TAG_TX_BIT("LED5", led_value, 4),
+    MONARCO_TAG_TX_BIT("LED6", led_value, 5),
+    MONARCO_TAG_TX_BIT("LED7", led_value, 6),
+    MONARCO_TAG_TX_BIT("LED8", led_value, 7),
+    MONARCO_TAG_TX_VALUE("AOUT1", aout1, MONARCO_TAG_U16, 4095, MONARCO_TAG_AOUT_SCALE, 0),
+    MONARCO_TAG_TX_VALUE("AOUT2", aout2, MONARCO_TAG_U16, 4095, MONARCO_TAG_AOUT_SCALE, 0),
+    MONARCO_TAG_TX_VALUE("PWM1DIV", pwm1_div, MONARCO_TAG_U16, 0, 1, 0),
+    MONARCO_TAG_TX_VALUE("PWM1A", pwm1a_dc, MONARCO_TAG_U16, 0, MONARCO_TAG_PWM_SCALE, 0),
+    MONARCO_TAG_TX_VALUE("PWM1B", pwm1b_dc, MONARCO_TAG_U16, 0, MONARCO_TAG_PWM_SCALE, 0),
+    MONARCO_TAG_TX_VALUE("PWM1C", pwm1c_dc, MONARCO_TAG_U16, 0, MONARCO_TAG_PWM_SCALE, 0),
+    MONARCO_TAG_TX_VALUE("PWM2DIV", pwm2_div, MONARCO_TAG_U16, 0, 1, 0),
+    MONARCO_TAG_TX_VALUE("PWM2A", pwm2a_dc, MONARCO_TAG_U16, 0, MONARCO_TAG_PWM_SCALE, 0),
+};
+
+#define MONARCO_TAG_BUILTIN_COUNT ((int)(sizeof(monarco_tag_builtin) / sizeof(monarco_tag_builtin[0])))
+
+/* FNV-1a with final avalanche, upper half selects the bucket, lower half the slot */
+static inline uint64_t monarco_tag_hash(const char *name, uint32_t seed)
+{
+    uint64_t h = 0xCBF29CE484222325ULL ^ seed;
+
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 0x100000001B3ULL;
+    }
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+static inline uint32_t monarco_tag_slot(uint64_t h, uint32_t disp, uint32_t mask)
+{
+    return ((uint32_t)h ^ (disp * 0x9E3779B1U)) & mask;
+}
+
+/* Try to build displacement table with `seed`, returns 0 on success */
+static int monarco_tag_build(monarco_tagdb_t *db, uint64_t *hash, int *order, int *bucket_start)
+{
+    uint32_t b;
+    int i, k;
+
+    for (i = 0; i < db->count; i++) {
+        hash[i] = monarco_tag_hash(db->tags[i].name, db->seed);
+    }
+
+    /* Group tags by bucket (counting sort) */
+
+    memset(bucket_start, 0, (db->buckets + 1) * sizeof(int));
+    for (i = 0; i < db->count; i++) {
+        bucket_start[(uint32_t)(hash[i] >> 32) % db->buckets + 1]++;
+    }
+    for (b = 0; b < db->buckets; b++) {
+        bucket_start[b + 1] += bucket_start[b];
+    }
+    int *fill = malloc(db->buckets * sizeof(int));
+    if (fill == NULL) {
+        return -2;
+    }
+    memcpy(fill, bucket_start, db->buckets * sizeof(int));
+    for (i = 0; i < db->count; i++) {
+        order[fill[(uint32_t)(hash[i] >> 32) % db->buckets]++] = i;
+    }
+    free(fill);
+
+    for (i = 0; i <= (int)db->mask; i++) {
+        db->slots[i] = -1;
+    }
+
+    /* Place buckets from the largest one, each with the first displacement mapping all its tags to free slots */
+
+    int size;
+    int max_size = 0;
+    for (b = 0; b < db->buckets; b++) {
+        if (bucket_start[b + 1] - bucket_start[b] > max_size) {
+            max_size = bucket_start[b + 1] - bucket_start[b];
+        }
+    }
+
+    for (size = max_size; size > 0; size--) {
+        for (b = 0; b < db->buckets; b++) {
+            int first = bucket_start[b];
+
+            if (bucket_start[b + 1] - first != size) {
+                continue;
+            }
+
+            uint32_t d;
+            for (d = 0; d <= MONARCO_TAG_DISP_MAX; d++) {
+                for (k = 0; k < size; k++) {
+                    uint32_t s = monarco_tag_slot(hash[order[first + k]], d, db->mask);
+                    if (db->slots[s] != -1) {
+                        break;
+                    }
+                    db->slots[s] = order[first + k];
+                }
+                if (k == size) {
+                    break;
+                }
+                while (k-- > 0) {
+                    db->slots[monarco_tag_slot(hash[order[first + k]], d, db->mask)] = -1;
+                }
+            }
+
+            if (d > MONARCO_TAG_DISP_MAX) {
+                return -3;
+            }
+            db->disp[b] = d;
+        }
+    }
+
+    return 0;
+}
+
+int monarco_tagdb_init(monarco_tagdb_t *db, const monarco_tag_t *extra, int extra_count)
+{
+    const monarco_sdc_reg_info_t *regs;
+    int regs_count = monarco_sdc_reg_map(&regs);
+    int i, j;
+
+    memset(db, 0, sizeof(monarco_tagdb_t));
+
+    if ((extra_count < 0) || ((extra_count > 0) && (extra == NULL))) {
+        return -1;
+    }
+
+    db->count = MONARCO_TAG_BUILTIN_COUNT + regs_count + extra_count;
+    if (db->count > INT16_MAX) {
+        return -1;
+    }
+
+    db->tags = malloc(db->count * sizeof(monarco_tag_t));
+    if (db->tags == NULL) {
+        return -2;
+    }
+
+    /* Collect descriptors */
+
+    memcpy(db->tags, monarco_tag_builtin, sizeof(monarco_tag_builtin));
+
+    for (i = 0; i < regs_count; i++) {
+        monarco_tag_t *t = &db->tags[MONARCO_TAG_BUILTIN_COUNT + i];
+        memset(t, 0, sizeof(monarco_tag_t));
+        t->name = regs[i].name;
+        t->area = MONARCO_TAG_SDC;
+        t->type = MONARCO_TAG_U16;
+        t->address = regs[i].address;
+        t->writable = (regs[i].access & MONARCO_SDC_ACCESS_W) ? 1 : 0;
+        t->raw_max = regs[i].max;
+        t->scale = 1;
+    }
+
+    if (extra_count > 0) {
+        memcpy(&db->tags[MONARCO_TAG_BUILTIN_COUNT + regs_count], extra, extra_count * sizeof(monarco_tag_t));
+    }
+
+    for (i = 0; i < db->count; i++) {
+        db->tags[i].sdc_read = -1;
+        db->tags[i].sdc_write = -1;
+    }
+
+    for (i = 0; i < db->count; i++) {
+        const monarco_tag_t *t = &db->tags[i];
+        static const int type_size[] = { 1, 1, 2, 4 };
+
+        if ((t->name == NULL) || (t->area > MONARCO_TAG_SDC) || (t->type > MONARCO_TAG_U32) || (t->bit > 7)
+                || ((t->area != MONARCO_TAG_SDC) && (t->offset + type_size[t->type] > MONARCO_STRUCT_SIZE - 2))) {
+            monarco_tagdb_exit(db);
+            return -1;
+        }
+        for (j = 0; j < i; j++) {
+            if (strcmp(db->tags[i].name, db->tags[j].name) == 0) {
+                monarco_tagdb_exit(db);
+                return -1;
+            }
+        }
+    }
+
+    /* Perfect hash - load factor <= 0.8, ~4 tags per displacement bucket */
+
+    uint32_t size = 1;
+    while (size < (uint32_t)db->count + (uint32_t)db->count / 4) {
+        size <<= 1;
+    }
+    db->mask = size - 1;
+    db->buckets = (db->count + 3) / 4;
+
+    db->disp = calloc(db->buckets, sizeof(uint16_t));
+    db->slots = malloc(size * sizeof(int16_t));
+    uint64_t *hash = malloc(db->count * sizeof(uint64_t));
+    int *order = malloc(db->count * sizeof(int));
+    int *bucket_start = malloc((db->buckets + 1) * sizeof(int));
+
+    int rc = -2;
+
+    if ((db->disp != NULL) && (db->slots != NULL) && (hash != NULL) && (order != NULL) && (bucket_start != NULL)) {
+        for (db->seed = 1; db->seed <= MONARCO_TAG_SEEDS; db->seed++) {
+            if ((rc = monarco_tag_build(db, hash, order, bucket_start)) == 0) {
+                break;
+            }
+        }
+    }
+
+    free(hash);
+    free(order);
+    free(bucket_start);
+
+    if (rc != 0) {
+        monarco_tagdb_exit(db);
+        return rc;
+    }
+
+    return 0;
+}
+
+void monarco_tagdb_exit(monarco_tagdb_t *db)
+{
+    free(db->tags);
+    free(db->disp);
+    free(db->slots);
+    memset(db, 0, sizeof(monarco_tagdb_t));
+}
+
+int monarco_tag_find(const monarco_tagdb_t *db, const char *name)
+{
+    if (db->count == 0) {
+        return -1;
+    }
+
+    uint64_t h = monarco_tag_hash(name, db->seed);
+    int id = db->slots[monarco_tag_slot(h, db->disp[(uint32_t)(h >> 32) % db->buckets], db->mask)];
+
+    if ((id < 0) || (strcmp(db->tags[id].name, name) != 0)) {
+        return -1;
+    }
+
+    return id;
+}
+
+int monarco_tag_resolve(const monarco_tagdb_t *db, const char * const *names, int count, int *ids)
+{
+    int unknown = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        ids[i] = monarco_tag_find(db, names[i]);
+        if (ids[i] < 0) {
+            unknown++;
+        }
+    }
+
+    return unknown;
+}
+
+/* Index of SDC Item for `address` - Read Item preferred, -1 when none, linear scan for monarco_tagdb_bind() */
+static int monarco_tag_sdc_item(const monarco_cxt_t *cxt, uint16_t address, int write)
+{
+    int found = -1;
+    int i;
+
+    for (i = 0; i < cxt->sdc_size; i++) {
+        if (cxt->sdc_address[i] == address) {
+            int is_write = (cxt->sdc_sched[i].flags & MONARCO_SDC_F_WRITE) ? 1 : 0;
+            if (is_write == write) {
+                return i;
+            }
+            if (!write) {
+                found = i;
+            }
+        }
+    }
+
+    return found;
+}
+
+int monarco_tagdb_bind(monarco_tagdb_t *db, const monarco_cxt_t *cxt)
+{
+    int unbound = 0;
+    int i;
+
+    for (i = 0; i < db->count; i++) {
+        monarco_tag_t *t = &db->tags[i];
+
+        if (t->area != MONARCO_TAG_SDC) {
+            continue;
+        }
+
+        t->sdc_read = monarco_tag_sdc_item(cxt, t->address, 0);
+        t->sdc_write = monarco_tag_sdc_item(cxt, t->address, 1);
+        if (t->sdc_read < 0) {
+            unbound++;
+        }
+    }
+
+    return unbound;
+}
+
+/* Bound SDC Item `idx` of tag `*t` when it matches the Item layout of `cxt`, -1 otherwise */
+static inline int monarco_tag_sdc_bound(const monarco_cxt_t *cxt, const monarco_tag_t *t, int idx)
+{
+    return ((idx >= 0) && (idx < cxt->sdc_size) && (cxt->sdc_address[idx] == t->address)) ? idx : -1;
+}
+
+static inline uint32_t monarco_tag_type_max(const monarco_tag_t *t)
+{
+    if (t->raw_max) {
+        return t->raw_max;
+    }
+
+    switch (t->type) {
+    case MONARCO_TAG_BIT: return 1;
+    case MONARCO_TAG_U8: return UINT8_MAX;
+    case MONARCO_TAG_U16: return UINT16_MAX;
+    default: return UINT32_MAX;
+    }
+}
+
+int monarco_tag_read(const monarco_tagdb_t *db, const monarco_cxt_t *cxt, const int *ids, int count, double *values)
+{
+    int failed = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        const monarco_tag_t *t;
+        uint32_t raw = 0;
+
+        if ((ids[i] < 0) || (ids[i] >= db->count)) {
+            values[i] = NAN;
+            failed++;
+            continue;
+        }
+
+        t = &db->tags[ids[i]];
+
+        if (t->area == MONARCO_TAG_SDC) {
+            int idx = monarco_tag_sdc_bound(cxt, t, t->sdc_read);
+            if ((idx < 0) || !monarco_sdc_done(cxt, idx) || monarco_sdc_error(cxt, idx)) {
+                values[i] = NAN;
+                failed++;
+                continue;
+            }
+            raw = monarco_sdc_value(cxt, idx);
+        }
+        else {
+            const uint8_t *base = (t->area == MONARCO_TAG_RX) ? (const uint8_t *)cxt->rx_data : (const uint8_t *)&cxt->tx_data;
+
+            switch (t->type) {
+            case MONARCO_TAG_BIT: raw = (base[t->offset] >> t->bit) & 1; break;
+            case MONARCO_TAG_U8: raw = base[t->offset]; break;
+            case MONARCO_TAG_U16: { uint16_t v; memcpy(&v, &base[t->offset], sizeof(v)); raw = v; break; }
+            default: memcpy(&raw, &base[t->offset], sizeof(raw)); break;
+            }
+        }
+
+        values[i] = raw * (t->scale != 0 ? t->scale : 1.0) + t->bias;
+    }
+
+    return failed;
+}
+
+/* Write raw value of output tag */
+static int monarco_tag_write_tx(monarco_cxt_t *cxt, const monarco_tag_t *t, uint32_t raw)
+{
+    uint8_t *base = (uint8_t *)&cxt->tx_data;
+
+    if (cxt->cmdq != NULL) {
+        switch (t->type) {
+        case MONARCO_TAG_BIT: return monarco_cmdq_write_bits(cxt, t->offset, 1 << t->bit, raw ? (1 << t->bit) : 0);
+        case MONARCO_TAG_U8: return monarco_cmdq_write_bits(cxt, t->offset, 0xFF, raw);
+        case MONARCO_TAG_U16: return monarco_cmdq_set_u16(cxt, t->offset, raw);
+        default: return -1;
+        }
+    }
+
+    switch (t->type) {
+    case MONARCO_TAG_BIT: base[t->offset] = (base[t->offset] & ~(1 << t->bit)) | (raw ? (1 << t->bit) : 0); break;
+    case MONARCO_TAG_U8: base[t->offset] = raw; break;
+    case MONARCO_TAG_U16: { uint16_t v = raw; memcpy(&base[t->offset], &v, sizeof(v)); break; }
+    default: memcpy(&base[t->offset], &raw, sizeof(raw)); break;
+    }
+
+    return 0;
+}
+
+int monarco_tag_write(const monarco_tagdb_t *db, monarco_cxt_t *cxt, const int *ids, int count, const double *values)
+{
+    int failed = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        const monarco_tag_t *t;
+
+        if ((ids[i] < 0) || (ids[i] >= db->count) || !db->tags[ids[i]].writable || isnan(values[i])) {
+            failed++;
+            continue;
+        }
+
+        t = &db->tags[ids[i]];
+
+        double r = round((values[i] - t->bias) / (t->scale != 0 ? t->scale : 1.0));
+        uint32_t max = monarco_tag_type_max(t);
+        uint32_t raw = (r <= 0) ? 0 : (r >= max) ? max : (uint32_t)r;
+
+        if (t->area == MONARCO_TAG_SDC) {
+            const monarco_sdc_reg_info_t *reg = monarco_sdc_reg_info(t->address);
+            int idx = monarco_tag_sdc_bound(cxt, t, t->sdc_write);
+            if ((idx < 0) || !(cxt->sdc_sched[idx].flags & MONARCO_SDC_F_WRITE) || ((reg != NULL) && (raw < reg->min))) {
+                failed++;
+                continue;
+            }
+            monarco_sdc_write(cxt, idx, raw);
+        }
+        else if (monarco_tag_write_tx(cxt, t, raw) != 0) {
+            failed++;
+        }
+    }
+
+    return failed;
+}
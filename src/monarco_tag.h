@@ -0,0 +1,124 @@
+/***************************************************************************//**
+ * @file monarco_tag.h
+ * @brief libmonarco - Named Tag Database
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_TAG_H_
+#define LIBMONARCO_TAG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "monarco.h"
+
+/* I/O points are addressed by name ("DIN3", "AOUT2", "CNT1", "RS485BAUD", ...). The database is built once
+ * by `monarco_tagdb_init()` from built-in process data tags, all registers of MONARCO_SDC_REG_MAP and optional
+ * application tags. Names are indexed by a collision-free perfect hash (hash and displace), so a lookup
+ * is one hash, one displacement and one string compare. Tag descriptors hold only offsets and scaling,
+ * so one database serves any number of contexts (HATs). SDC tags access SDC Items by the index resolved by
+ * `monarco_tagdb_bind()`, valid for all contexts with the same SDC Item layout (e.g. loaded from one table).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tag data area */
+enum {
+    MONARCO_TAG_RX, /* Input Process Data, monarco_struct_rx_t */
+    MONARCO_TAG_TX, /* Output Process Data, monarco_struct_tx_t */
+    MONARCO_TAG_SDC, /* SDC register, value of the SDC Item with the same address */
+};
+
+/* Tag raw data type */
+enum {
+    MONARCO_TAG_BIT, /* single bit `bit` of byte at `offset` */
+    MONARCO_TAG_U8,
+    MONARCO_TAG_U16,
+    MONARCO_TAG_U32,
+};
+
+/* Tag Descriptor
+ *   Scaled value = raw * scale + bias (scale 0 means 1). Written values are rounded and limited to 0..raw_max.
+ */
+typedef struct {
+    const char *name; /* Tag name, unique in the database */
+    uint8_t area; /* MONARCO_TAG_RX / TX / SDC */
+    uint8_t type; /* MONARCO_TAG_BIT / U8 / U16 / U32 */
+    uint8_t offset; /* Byte offset in monarco_struct_rx_t / monarco_struct_tx_t */
+    uint8_t bit; /* Bit number for MONARCO_TAG_BIT */
+    uint16_t address; /* SDC register address for MONARCO_TAG_SDC */
+    int16_t sdc_read; /* Private, SDC Item read by MONARCO_TAG_SDC, -1 = none, see monarco_tagdb_bind() */
+    int16_t sdc_write; /* Private, SDC Write Item written by MONARCO_TAG_SDC, -1 = none */
+    uint8_t writable; /* Tag can be written by monarco_tag_write() */
+    uint32_t raw_max; /* Maximal raw value, 0 = maximum of `type` */
+    double scale; /* Scaling factor from raw value */
+    double bias; /* Offset added after scaling */
+} monarco_tag_t;
+
+/* Descriptor initializers for application tags, `member` is a field of monarco_struct_rx_t / monarco_struct_tx_t */
+#define MONARCO_TAG_RX_BIT(nm, member, b) { .name = (nm), .area = MONARCO_TAG_RX, .type = MONARCO_TAG_BIT, \
+    .offset = offsetof(monarco_struct_rx_t, member), .bit = (b) }
+#define MONARCO_TAG_TX_BIT(nm, member, b) { .name = (nm), .area = MONARCO_TAG_TX, .type = MONARCO_TAG_BIT, \
+    .offset = offsetof(monarco_struct_tx_t, member), .bit = (b), .writable = 1 }
+#define MONARCO_TAG_RX_VALUE(nm, member, tp, sc, bs) { .name = (nm), .area = MONARCO_TAG_RX, .type = (tp), \
+    .offset = offsetof(monarco_struct_rx_t, member), .scale = (sc), .bias = (bs) }
+#define MONARCO_TAG_TX_VALUE(nm, member, tp, mx, sc, bs) { .name = (nm), .area = MONARCO_TAG_TX, .type = (tp), \
+    .offset = offsetof(monarco_struct_tx_t, member), .writable = 1, .raw_max = (mx), .scale = (sc), .bias = (bs) }
+
+/* Tag Database */
+typedef struct {
+    monarco_tag_t *tags; /* All tags, index is the tag id */
+    int count; /* Number of tags */
+    uint32_t seed; /* Private, hash seed */
+    uint32_t buckets; /* Private, number of displacement buckets */
+    uint32_t mask; /* Private, slot table size - 1 */
+    uint16_t *disp; /* Private, displacement per bucket */
+    int16_t *slots; /* Private, tag id per slot, -1 = empty */
+} monarco_tagdb_t;
+
+/* Tag Database Initialization
+ *   Build the database from built-in tags, SDC register map and `extra_count` application tags `*extra`
+ *   (may be NULL), their names have to stay valid. Application tags may alias built-in fields with own names
+ *   and scaling. Returns -1 on invalid or duplicate tag, -2 on allocation failure, -3 when the hash cannot be built.
+ */
+int monarco_tagdb_init(monarco_tagdb_t *db, const monarco_tag_t *extra, int extra_count);
+
+/* Resolve SDC Items of SDC tags in context `cxt` - the Item with the same address, Read Item preferred for reads,
+ *   Write Item for writes. Call after the SDC Items are loaded and again when they change. The indexes serve every
+ *   context with the same SDC Item layout, SDC tags of other contexts fail. Returns number of SDC tags without Item.
+ */
+int monarco_tagdb_bind(monarco_tagdb_t *db, const monarco_cxt_t *cxt);
+
+/* Free the database */
+void monarco_tagdb_exit(monarco_tagdb_t *db);
+
+/* Find tag by name, returns tag id or -1 */
+int monarco_tag_find(const monarco_tagdb_t *db, const char *name);
+
+/* Resolve `count` names into `*ids` (-1 for unknown names), returns number of unknown names */
+int monarco_tag_resolve(const monarco_tagdb_t *db, const char * const *names, int count, int *ids);
+
+/* Bulk read of `count` tags `*ids` from context `cxt` into scaled `*values`
+ *   SDC tags read the value of the bound SDC Item. Unknown ids and SDC tags without a bound Item,
+ *   not done yet or with error result read as NAN. Returns number of failed tags.
+ */
+int monarco_tag_read(const monarco_tagdb_t *db, const monarco_cxt_t *cxt, const int *ids, int count, double *values);
+
+/* Bulk write of `count` scaled `*values` into tags `*ids` of context `cxt`
+ *   Output tags go through the output command queue when it is initialized (see monarco_cmdq.h),
+ *   SDC tags trigger the bound Write Item. Returns number of failed tags.
+ */
+int monarco_tag_write(const monarco_tagdb_t *db, monarco_cxt_t *cxt, const int *ids, int count, const double *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
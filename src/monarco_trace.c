@@ -0,0 +1,169 @@
+/***************************************************************************//**
+ * @file monarco_trace.c
+ * @brief libmonarco - Per-cycle Tracing
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "monarco_platform.h"
+
+static const char *monarco_trace_names[MONARCO_TRACE_USER] = {
+    [MONARCO_TRACE_MAIN] = "monarco_main",
+    [MONARCO_TRACE_SDC_TX] = "sdc_tx",
+    [MONARCO_TRACE_SDC_SCAN] = "sdc_scan",
+    [MONARCO_TRACE_CMDQ] = "cmdq",
+    [MONARCO_TRACE_CRC_TX] = "crc_tx",
+    [MONARCO_TRACE_TRANSFER] = "transfer",
+    [MONARCO_TRACE_CRC_RX] = "crc_rx",
+    [MONARCO_TRACE_CTRL] = "ctrl",
+    [MONARCO_TRACE_SDC_RX] = "sdc_rx",
+    [MONARCO_TRACE_MODBUS] = "modbus",
+    [MONARCO_TRACE_APP] = "app",
+};
+
+static uint64_t monarco_trace_mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int monarco_trace_init(monarco_cxt_t *cxt, uint32_t capacity)
+{
+    uint32_t size = 1;
+
+    while ((size < capacity) && (size < 0x80000000U)) {
+        size <<= 1;
+    }
+
+    monarco_trace_exit(cxt);
+
+    monarco_trace_t *trace = calloc(1, sizeof(monarco_trace_t));
+    if (trace == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_trace_init: Failed to allocate trace\n");
+        return -1;
+    }
+
+    /* Clear explicitly to prefault the ring before realtime use */
+    trace->events = malloc(size * sizeof(monarco_trace_event_t));
+    if (trace->events == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_trace_init: Failed to allocate %u events\n", size);
+        free(trace);
+        return -1;
+    }
+    memset(trace->events, 0, size * sizeof(monarco_trace_event_t));
+
+    trace->mask = size - 1;
+    trace->ref_ticks = monarco_trace_ticks();
+    trace->ref_ns = monarco_trace_mono_ns();
+
+    cxt->trace = trace;
+
+    return 0;
+}
+
+void monarco_trace_exit(monarco_cxt_t *cxt)
+{
+    if (cxt->trace != NULL) {
+        free(cxt->trace->events);
+        free(cxt->trace);
+        cxt->trace = NULL;
+    }
+}
+
+void monarco_trace_clear(monarco_cxt_t *cxt)
+{
+    if (cxt->trace != NULL) {
+        cxt->trace->head = 0;
+        cxt->trace->total = 0;
+    }
+}
+
+/* Write `*s` as JSON string contents, names may come from the application */
+static void monarco_trace_json_str(FILE *f, const char *s)
+{
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if ((c == '"') || (c == '\\')) {
+            fputc('\\', f);
+            fputc(c, f);
+        }
+        else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        }
+        else {
+            fputc(c, f);
+        }
+    }
+}
+
+int monarco_trace_export_chrome(monarco_cxt_t *cxt, FILE *f, const char * const *names, int names_count)
+{
+    monarco_trace_t *trace = cxt->trace;
+    char user_name[32];
+    int exported = 0;
+    int started = 0;
+
+    if (trace == NULL) {
+        return -1;
+    }
+
+    /* Conversion of raw ticks to ns - linear between init reference and now */
+
+    uint64_t now_ticks = monarco_trace_ticks();
+    uint64_t now_ns = monarco_trace_mono_ns();
+    double ns_per_tick = (now_ticks > trace->ref_ticks) ? (double)(now_ns - trace->ref_ns) / (now_ticks - trace->ref_ticks) : 1.0;
+
+    uint64_t count = trace->total < (uint64_t)trace->mask + 1 ? trace->total : (uint64_t)trace->mask + 1;
+    uint32_t idx = trace->head - (uint32_t)count;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    for (; count > 0; count--, idx++) {
+        const monarco_trace_event_t *ev = &trace->events[idx & trace->mask];
+        const char *name;
+
+        /* Start at cycle boundary to avoid unmatched end events of overwritten cycles */
+        if (!started) {
+            if ((ev->id != MONARCO_TRACE_MAIN) || (ev->phase != 'B')) {
+                continue;
+            }
+            started = 1;
+        }
+
+        if (ev->id < MONARCO_TRACE_USER) {
+            name = monarco_trace_names[ev->id];
+        }
+        else if ((names != NULL) && (ev->id - MONARCO_TRACE_USER < names_count) && (names[ev->id - MONARCO_TRACE_USER] != NULL)) {
+            name = names[ev->id - MONARCO_TRACE_USER];
+        }
+        else {
+            snprintf(user_name, sizeof(user_name), "user%u", ev->id - MONARCO_TRACE_USER);
+            name = user_name;
+        }
+
+        double ts_us = ((int64_t)(ev->ticks - trace->ref_ticks) * ns_per_tick + trace->ref_ns) / 1000.0;
+
+        fprintf(f, "%s{\"name\":\"", exported ? ",\n" : "");
+        monarco_trace_json_str(f, name);
+        fprintf(f, "\",\"cat\":\"monarco\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1%s,\"args\":{\"arg\":%u}}",
+            ev->phase, ts_us, ev->phase == 'I' ? ",\"s\":\"t\"" : "", ev->arg);
+        exported++;
+    }
+
+    fprintf(f, "\n]}\n");
+
+    return exported;
+}
@@ -0,0 +1,136 @@
+/***************************************************************************//**
+ * @file monarco_trace.h
+ * @brief libmonarco - Per-cycle Tracing
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_TRACE_H_
+#define LIBMONARCO_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "monarco.h"
+
+/* Tracepoints are compiled in only when MONARCO_TRACE is defined (e.g. `make TRACE=1`),
+ * at runtime they are active after `monarco_trace_init()`. Events are stored into preallocated
+ * ring buffer with raw CPU counter timestamps and converted to Chrome trace event JSON on demand.
+ * The counter is read directly on x86 (TSC), AArch64 and ARMv7-A (virtual counter of the Generic Timer,
+ * Raspberry Pi 2 and newer in 32-bit mode). Cores without the Generic Timer (e.g. Cortex-A8/A9) need
+ * MONARCO_TRACE_NO_CNTVCT. Other targets, including ARMv6 builds (Raspberry Pi 1 / Zero, armhf default
+ * of Raspberry Pi OS), take clock_gettime() at each tracepoint - a vDSO call, several times the cost of
+ * a counter read, which adds to the traced durations.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Trace Event IDs */
+enum {
+    MONARCO_TRACE_MAIN, /* whole monarco_main() */
+    MONARCO_TRACE_SDC_TX, /* monarco_sdc_tx() */
+    MONARCO_TRACE_SDC_SCAN, /* SDC Items scan for next request */
+    MONARCO_TRACE_CMDQ, /* output command queue drain */
+    MONARCO_TRACE_CRC_TX, /* TX CRC calculation */
+    MONARCO_TRACE_TRANSFER, /* SPI ioctl or alternative transport */
+    MONARCO_TRACE_CRC_RX, /* RX CRC validation */
+    MONARCO_TRACE_CTRL, /* control loops, see monarco_ctrl.h */
+    MONARCO_TRACE_SDC_RX, /* monarco_sdc_rx() */
+    MONARCO_TRACE_MODBUS, /* Modbus master state machine, see monarco_modbus.h */
+    MONARCO_TRACE_APP, /* application callback, traced by the application */
+    MONARCO_TRACE_USER, /* first ID free for application specific tracepoints */
+};
+
+/* Trace Event, 16 bytes */
+typedef struct {
+    uint64_t ticks; /* Raw timestamp, see monarco_trace_ticks() */
+    uint16_t id; /* Event ID, MONARCO_TRACE_* */
+    char phase; /* 'B' = begin, 'E' = end, 'I' = instant */
+    uint8_t reserved;
+    uint32_t arg; /* Event argument */
+} monarco_trace_event_t;
+
+/* Trace Ring Buffer */
+typedef struct monarco_trace_s {
+    monarco_trace_event_t *events; /* Preallocated ring */
+    uint32_t mask; /* Capacity - 1, capacity is power of 2 */
+    uint32_t head; /* Index of next event */
+    uint64_t total; /* Number of recorded events, older ones are overwritten */
+    uint64_t ref_ticks; /* Timestamp reference taken at init */
+    uint64_t ref_ns; /* CLOCK_MONOTONIC at `ref_ticks` */
+} monarco_trace_t;
+
+/* Raw timestamp - CPU counter where available in user space, CLOCK_MONOTONIC ns otherwise */
+static inline uint64_t monarco_trace_ticks(void)
+{
+#if defined(__aarch64__)
+    uint64_t v;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r" (v));
+    return v;
+#elif defined(__ARM_ARCH) && (__ARM_ARCH >= 7) && defined(__ARM_ARCH_PROFILE) && (__ARM_ARCH_PROFILE == 'A') \
+    && !defined(MONARCO_TRACE_NO_CNTVCT)
+    uint64_t v;
+    __asm__ volatile("mrrc p15, 1, %Q0, %R0, c14" : "=r" (v));
+    return v;
+#elif defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Record event into ring `*trace` */
+static inline void monarco_trace_record(monarco_trace_t *trace, uint16_t id, char phase, uint32_t arg)
+{
+    monarco_trace_event_t *ev = &trace->events[trace->head & trace->mask];
+
+    ev->ticks = monarco_trace_ticks();
+    ev->id = id;
+    ev->phase = phase;
+    ev->arg = arg;
+    trace->head++;
+    trace->total++;
+}
+
+#ifdef MONARCO_TRACE
+#define MONARCO_TRACE_BEGIN(cxt, id) do { if ((cxt)->trace) monarco_trace_record((cxt)->trace, (id), 'B', 0); } while (0)
+#define MONARCO_TRACE_END(cxt, id, arg) do { if ((cxt)->trace) monarco_trace_record((cxt)->trace, (id), 'E', (arg)); } while (0)
+#define MONARCO_TRACE_INSTANT(cxt, id, arg) do { if ((cxt)->trace) monarco_trace_record((cxt)->trace, (id), 'I', (arg)); } while (0)
+#else
+#define MONARCO_TRACE_BEGIN(cxt, id) do { } while (0)
+#define MONARCO_TRACE_END(cxt, id, arg) do { (void)(arg); } while (0)
+#define MONARCO_TRACE_INSTANT(cxt, id, arg) do { } while (0)
+#endif
+
+/* Allocate trace ring with `capacity` events (rounded up to power of 2) and attach it to `cxt`. */
+int monarco_trace_init(monarco_cxt_t *cxt, uint32_t capacity);
+
+/* Detach and free trace ring of `cxt`. */
+void monarco_trace_exit(monarco_cxt_t *cxt);
+
+/* Discard all recorded events. */
+void monarco_trace_clear(monarco_cxt_t *cxt);
+
+/* Export recorded events as Chrome trace event JSON (loadable by chrome://tracing and Perfetto UI).
+ *   `*names` optionally provides names for IDs starting at MONARCO_TRACE_USER, `names_count` entries (NULL = default
+ *   "userN"), names are JSON-escaped.
+ *   Returns number of exported events, or -1 on error.
+ */
+int monarco_trace_export_chrome(monarco_cxt_t *cxt, FILE *f, const char * const *names, int names_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
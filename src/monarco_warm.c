@@ -0,0 +1,308 @@
+/***************************************************************************//**
+ * @file monarco_warm.c
+ * @brief libmonarco - Warm-start Configuration Snapshot
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_warm.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "monarco_crc.h"
+#include "monarco_platform.h"
+
+#define MONARCO_WARM_MAGIC 0x3153574DU /* "MWS1" */
+
+/* Snapshot file header, followed by `count` entries */
+typedef struct {
+    uint32_t magic; /* MONARCO_WARM_MAGIC */
+    uint16_t count; /* Number of entries */
+    uint16_t crc; /* CRC of entries */
+} monarco_warm_header_t;
+
+/* Find snapshot entry, returns index or -1 */
+static int monarco_warm_find(const monarco_warm_t *warm, uint16_t address, int write)
+{
+    int i;
+
+    for (i = 0; i < warm->count; i++) {
+        if ((warm->entries[i].address == address) && (warm->entries[i].write == write)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int monarco_warm_save(monarco_cxt_t *cxt, const char *path)
+{
+    monarco_warm_entry_t entries[MONARCO_SDC_ITEMS_SIZE];
+    monarco_warm_header_t hdr = { .magic = MONARCO_WARM_MAGIC };
+    int identity = 0;
+    char tmp_path[256];
+    int i;
+
+    for (i = 0; i < cxt->sdc_size; i++) {
+        const monarco_sdc_sched_t *sched = &cxt->sdc_sched[i];
+
+        if ((sched->factor > 0) || !(sched->flags & MONARCO_SDC_F_DONE) || (sched->flags & MONARCO_SDC_F_ERROR)) {
+            continue;
+        }
+
+        entries[hdr.count].address = cxt->sdc_address[i];
+        entries[hdr.count].write = (sched->flags & MONARCO_SDC_F_WRITE) ? 1 : 0;
+        entries[hdr.count].value = cxt->sdc_value[i];
+
+        if (!entries[hdr.count].write && (cxt->sdc_address[i] == MONARCO_SDC_REG_MCUID1)) {
+            identity |= 1;
+        }
+        if (!entries[hdr.count].write && (cxt->sdc_address[i] == MONARCO_SDC_REG_MCUID2)) {
+            identity |= 2;
+        }
+
+        hdr.count++;
+    }
+
+    if (identity != 3) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_warm_save: MCUID1 / MCUID2 not read, HAT identity unknown\n");
+        return -1;
+    }
+
+    hdr.crc = monarco_crc16((const char *)entries, hdr.count * sizeof(monarco_warm_entry_t));
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_warm_save: Failed to create %s: %i: %s\n", tmp_path, errno, strerror(errno));
+        return -2;
+    }
+
+    int ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1)
+        && (fwrite(entries, sizeof(monarco_warm_entry_t), hdr.count, f) == hdr.count)
+        && (fflush(f) == 0) && (fsync(fileno(f)) == 0);
+
+    if ((fclose(f) != 0) || !ok || (rename(tmp_path, path) != 0)) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_warm_save: Failed to write %s: %i: %s\n", path, errno, strerror(errno));
+        unlink(tmp_path);
+        return -2;
+    }
+
+    MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_warm_save: %i entries saved to %s\n", hdr.count, path);
+
+    return 0;
+}
+
+/* Snapshot entry matching one-shot Item `idx` (same register, same value to write), returns index or -1 */
+static int monarco_warm_match(const monarco_warm_t *warm, const monarco_cxt_t *cxt, int idx)
+{
+    const monarco_sdc_sched_t *sched = &cxt->sdc_sched[idx];
+    int write = (sched->flags & MONARCO_SDC_F_WRITE) ? 1 : 0;
+
+    if ((sched->factor > 0) || !(sched->flags & MONARCO_SDC_F_REQUEST)) {
+        return -1;
+    }
+
+    int e = monarco_warm_find(warm, cxt->sdc_address[idx], write);
+    if ((e < 0) || (write && (warm->entries[e].value != cxt->sdc_value[idx]))) {
+        return -1;
+    }
+
+    return e;
+}
+
+/* Load and validate snapshot file, returns number of entries or -1 */
+static int monarco_warm_load(monarco_warm_t *warm, const char *path)
+{
+    monarco_warm_header_t hdr;
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL) {
+        return -1;
+    }
+
+    int ok = (fread(&hdr, sizeof(hdr), 1, f) == 1) && (hdr.magic == MONARCO_WARM_MAGIC) && (hdr.count <= MONARCO_SDC_ITEMS_SIZE)
+        && (fread(warm->entries, sizeof(monarco_warm_entry_t), hdr.count, f) == hdr.count)
+        && (monarco_crc16((const char *)warm->entries, hdr.count * sizeof(monarco_warm_entry_t)) == hdr.crc);
+
+    fclose(f);
+
+    return ok ? hdr.count : -1;
+}
+
+int monarco_warm_start(monarco_warm_t *warm, monarco_cxt_t *cxt, const char *path)
+{
+    uint16_t check_address[MONARCO_WARM_CHECK_ITEMS];
+    int mcuid1, mcuid2;
+    int sentinel = -1;
+    int i;
+
+    memset(warm, 0, sizeof(monarco_warm_t));
+    warm->cxt = cxt;
+    warm->state = MONARCO_WARM_COLD;
+
+    warm->count = monarco_warm_load(warm, path);
+    if (warm->count < 0) {
+        MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_warm_start: No valid snapshot %s, cold start\n", path);
+        warm->count = 0;
+        return warm->state;
+    }
+
+    mcuid1 = monarco_warm_find(warm, MONARCO_SDC_REG_MCUID1, 0);
+    mcuid2 = monarco_warm_find(warm, MONARCO_SDC_REG_MCUID2, 0);
+
+    if ((mcuid1 < 0) || (mcuid2 < 0) || (cxt->sdc_size + MONARCO_WARM_CHECK_ITEMS > cxt->sdc_capacity)) {
+        MONARCO_DPRINT(MONARCO_DPF_WARNING, "monarco_warm_start: Snapshot without identity or no room for verification, cold start\n");
+        return warm->state;
+    }
+
+    /* Sentinel - first readable register written by a matching Item */
+
+    for (i = 0; (i < cxt->sdc_size) && (sentinel < 0); i++) {
+        int e = monarco_warm_match(warm, cxt, i);
+
+        if ((e >= 0) && (cxt->sdc_sched[i].flags & MONARCO_SDC_F_WRITE)) {
+            const monarco_sdc_reg_info_t *reg = monarco_sdc_reg_info(cxt->sdc_address[i]);
+            if ((reg != NULL) && (reg->access & MONARCO_SDC_ACCESS_R)) {
+                sentinel = e;
+            }
+        }
+    }
+
+    /* Hold back one-shot Items matching the snapshot, Write Items only when a power cycle is detected by the sentinel */
+
+    for (i = 0; i < cxt->sdc_size; i++) {
+        int e = monarco_warm_match(warm, cxt, i);
+
+        if ((e < 0) || ((sentinel < 0) && (cxt->sdc_sched[i].flags & MONARCO_SDC_F_WRITE))) {
+            continue;
+        }
+
+        cxt->sdc_sched[i].flags &= ~MONARCO_SDC_F_REQUEST;
+        warm->hold[i] = e + 1;
+        warm->held++;
+    }
+
+    /* Append verification Read Items */
+
+    check_address[0] = MONARCO_SDC_REG_STATUS;
+    warm->check_value[0] = MONARCO_SDC_STATUS_OK;
+    check_address[1] = MONARCO_SDC_REG_MCUID1;
+    warm->check_value[1] = warm->entries[mcuid1].value;
+    check_address[2] = MONARCO_SDC_REG_MCUID2;
+    warm->check_value[2] = warm->entries[mcuid2].value;
+    warm->check_count = 3;
+
+    if (sentinel >= 0) {
+        check_address[3] = warm->entries[sentinel].address;
+        warm->check_value[3] = warm->entries[sentinel].value;
+        warm->check_count = 4;
+    }
+
+    warm->sdc_size = cxt->sdc_size;
+    warm->check_first = cxt->sdc_size;
+
+    for (i = 0; i < warm->check_count; i++) {
+        monarco_sdc_item_t item = { .address = check_address[i], .request = 1 };
+        monarco_sdc_add(cxt, &item);
+    }
+
+    warm->state = MONARCO_WARM_PENDING;
+
+    MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_warm_start: %i Items held, %i verification reads\n", warm->held, warm->check_count);
+
+    return warm->state;
+}
+
+int monarco_warm_poll(monarco_warm_t *warm)
+{
+    monarco_cxt_t *cxt = warm->cxt;
+    int pending = 0;
+    int miss = 0;
+    int i;
+
+    if (warm->state != MONARCO_WARM_PENDING) {
+        return warm->state;
+    }
+
+    for (i = 0; i < warm->check_count; i++) {
+        int idx = warm->check_first + i;
+
+        if (monarco_sdc_done(cxt, idx)) {
+            if (monarco_sdc_error(cxt, idx) || (monarco_sdc_value(cxt, idx) != warm->check_value[i])) {
+                MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_warm_poll: ADDR=0x%03X = 0x%04X, snapshot 0x%04X\n",
+                        cxt->sdc_address[idx], monarco_sdc_value(cxt, idx), warm->check_value[i]);
+                miss = 1;
+            }
+        }
+        else if (cxt->sdc_sched[idx].busy >= MONARCO_SDC_TIMEOUT_CYCLES) {
+            miss = 1;
+        }
+        else {
+            pending = 1;
+        }
+    }
+
+    if (pending && !miss) {
+        return warm->state;
+    }
+
+    /* Decided - complete held Items from the snapshot, or request them for full init */
+
+    for (i = 0; i < warm->sdc_size; i++) {
+        if (warm->hold[i] == 0) {
+            continue;
+        }
+
+        monarco_sdc_sched_t *sched = &cxt->sdc_sched[i];
+
+        if (miss) {
+            sched->flags |= MONARCO_SDC_F_REQUEST;
+        }
+        else {
+            cxt->sdc_value[i] = warm->entries[warm->hold[i] - 1].value;
+            sched->flags = (sched->flags & ~(MONARCO_SDC_F_REQUEST | MONARCO_SDC_F_ERROR)) | MONARCO_SDC_F_DONE;
+        }
+    }
+
+    /* Remove verification Items - retired in place, so Items appended after them keep their indexes */
+
+    int check_end = warm->check_first + warm->check_count;
+
+    for (i = warm->check_first; i < check_end; i++) {
+        cxt->sdc_sched[i].factor = 0;
+        cxt->sdc_sched[i].busy = 0;
+        cxt->sdc_sched[i].flags &= ~MONARCO_SDC_F_REQUEST;
+    }
+
+    // the scan waited for a verification response, a late one is ignored as it does not match the next Item
+    if ((cxt->sdc_idx >= warm->check_first) && (cxt->sdc_idx < check_end)) {
+        cxt->sdc_pipe = -1;
+    }
+
+    // the last Items, truncated
+    if (cxt->sdc_size == check_end) {
+        cxt->sdc_size = warm->check_first;
+        if (cxt->sdc_idx >= cxt->sdc_size) {
+            cxt->sdc_idx = 0;
+        }
+        if (cxt->sdc_pipe >= cxt->sdc_size) {
+            cxt->sdc_pipe = -1;
+        }
+    }
+
+    warm->state = miss ? MONARCO_WARM_MISS : MONARCO_WARM_HIT;
+
+    MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_warm_poll: Warm start %s\n", miss ? "failed, full init" : "verified");
+
+    return warm->state;
+}
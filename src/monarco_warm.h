@@ -0,0 +1,93 @@
+/***************************************************************************//**
+ * @file monarco_warm.h
+ * @brief libmonarco - Warm-start Configuration Snapshot
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_WARM_H_
+#define LIBMONARCO_WARM_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* Each SDC transaction takes two cycles, so a full init sequence (identity reads and config writes) delays
+ * the first cycle with complete configuration. `monarco_warm_save()` persists identity and last applied
+ * configuration - results of all completed one-shot SDC Items. On the next start `monarco_warm_start()`
+ * holds back every one-shot Item whose register and value match the snapshot and verifies the HAT by
+ * a few reads only: STATUS, MCUID1, MCUID2 and read-back of one readable register written by the snapshot
+ * (sentinel, detects HAT power cycle when its applied value differs from the power-on default).
+ * Without a sentinel a power cycle is not detected, so only Read Items are held and all Write Items are
+ * sent - write-only registers (e.g. CNT1CFG) are never completed from the snapshot on their own.
+ * When all checks pass, held Items complete with snapshot values without any transaction,
+ * otherwise they are requested as usual - full init.
+ */
+
+/* Number of SDC Items appended by monarco_warm_start() for verification */
+#define MONARCO_WARM_CHECK_ITEMS 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Warm-start state */
+enum {
+    MONARCO_WARM_COLD, /* No valid snapshot, full init */
+    MONARCO_WARM_PENDING, /* Verification reads in progress */
+    MONARCO_WARM_HIT, /* Verified, held Items completed from the snapshot */
+    MONARCO_WARM_MISS, /* Verification failed, held Items requested - full init */
+};
+
+/* Snapshot Entry - result of one completed SDC Item */
+typedef struct {
+    uint16_t address; /* Register Address */
+    uint16_t write; /* 0 = Read Item, 1 = Write Item */
+    uint16_t value; /* Read or applied value */
+} monarco_warm_entry_t;
+
+/* Warm-start Context, owned by the application */
+typedef struct {
+    monarco_cxt_t *cxt; /* Context */
+    int state; /* MONARCO_WARM_*, read-only */
+    int held; /* Number of Items held back, read-only */
+    int check_first; /* Private, index of the first verification Item */
+    int check_count; /* Private, number of verification Items */
+    int sdc_size; /* Private, number of Items before verification Items were appended */
+    uint16_t check_value[MONARCO_WARM_CHECK_ITEMS]; /* Private, expected values of verification reads */
+    uint16_t hold[MONARCO_SDC_ITEMS_SIZE]; /* Private, index of snapshot entry + 1 for Items held back, 0 = not held */
+    int count; /* Private, number of snapshot entries */
+    monarco_warm_entry_t entries[MONARCO_SDC_ITEMS_SIZE]; /* Private, loaded snapshot */
+} monarco_warm_t;
+
+/* Save Snapshot
+ *   Store results of all completed one-shot SDC Items of `cxt` (without error) into file `*path`,
+ *   call when the init sequence is done. The file is replaced atomically. Returns -1 when MCUID1 / MCUID2
+ *   are not among completed Items, -2 on file error.
+ */
+int monarco_warm_save(monarco_cxt_t *cxt, const char *path);
+
+/* Warm Start
+ *   Load snapshot `*path` and hold back matching one-shot SDC Items of `cxt`, call after `monarco_sdc_load()`.
+ *   Verification Read Items are appended, so the storage needs capacity for MONARCO_WARM_CHECK_ITEMS more Items.
+ *   Returns resulting state - MONARCO_WARM_PENDING, or MONARCO_WARM_COLD when the snapshot is missing,
+ *   invalid or there is no room for verification (Items are left untouched).
+ */
+int monarco_warm_start(monarco_warm_t *warm, monarco_cxt_t *cxt, const char *path);
+
+/* Warm Start Progress
+ *   Call after each monarco_main() while MONARCO_WARM_PENDING, returns current state. Verification Items
+ *   are removed from the context when decided - truncated when they are the last Items, otherwise left
+ *   as idle Items, so Items appended after `monarco_warm_start()` (e.g. blocks, watchdog) keep their indexes.
+ */
+int monarco_warm_poll(monarco_warm_t *warm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+/***************************************************************************//**
+ * @file monarco_wdt.c
+ * @brief libmonarco - Process Data Watchdog Tuning and Safe-State Outputs
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#include "monarco_wdt.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "monarco_rate.h"
+#include "monarco_platform.h"
+
+/* Process data part of the frame - between SDC request and CRC */
+#define MONARCO_WDT_PD_OFFSET offsetof(monarco_struct_tx_t, control_byte)
+#define MONARCO_WDT_PD_SIZE (offsetof(monarco_struct_tx_t, crc) - MONARCO_WDT_PD_OFFSET)
+
+int monarco_wdt_init(monarco_wdt_t *wdt, monarco_cxt_t *cxt, uint32_t period_us, const monarco_struct_tx_t *safe_tx)
+{
+    int i;
+
+    if (period_us == 0) {
+        MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_wdt_init: Invalid cycle period\n");
+        return -1;
+    }
+
+    memset(wdt, 0, sizeof(monarco_wdt_t));
+    wdt->cxt = cxt;
+    if (safe_tx != NULL) {
+        wdt->safe_tx = *safe_tx;
+    }
+    wdt->learn_cycles = MONARCO_WDT_LEARN_CYCLES;
+    wdt->margin = MONARCO_WDT_MARGIN;
+    wdt->period_ns = period_us * 1000LL;
+    wdt->overrun_ns = (int64_t)(MONARCO_WDT_OVERRUN_PERIODS * wdt->period_ns);
+    wdt->state = MONARCO_WDT_LEARN;
+    wdt->sdc_idx = -1;
+
+    // reuse WDTIMEOUT Write Item of the application
+    for (i = 0; i < cxt->sdc_size; i++) {
+        if ((cxt->sdc_address[i] == MONARCO_SDC_REG_WDTIMEOUT) && (cxt->sdc_sched[i].flags & MONARCO_SDC_F_WRITE)) {
+            wdt->sdc_idx = i;
+            break;
+        }
+    }
+
+    if (wdt->sdc_idx < 0) {
+        monarco_sdc_item_t item = { .address = MONARCO_SDC_REG_WDTIMEOUT, .write = 1 };
+
+        // not requested until tuned, the HAT keeps its current timeout
+        if (cxt->sdc_size + MONARCO_WDT_ITEMS > cxt->sdc_capacity) {
+            MONARCO_DPRINT(MONARCO_DPF_ERROR, "monarco_wdt_init: No room for WDTIMEOUT item\n");
+            return -1;
+        }
+        wdt->sdc_idx = monarco_sdc_add(cxt, &item);
+    }
+
+    cxt->wdt = wdt;
+
+    MONARCO_DPRINT(MONARCO_DPF_VERB, "monarco_wdt_init: Period %u us, overrun after %lli us\n",
+        period_us, (long long)(wdt->overrun_ns / 1000));
+
+    return 0;
+}
+
+void monarco_wdt_exit(monarco_cxt_t *cxt)
+{
+    cxt->wdt = NULL;
+}
+
+void monarco_wdt_clear(monarco_cxt_t *cxt)
+{
+    if (cxt->wdt != NULL) {
+        cxt->wdt->safe = 0;
+        cxt->wdt->good = 0;
+    }
+}
+
+void monarco_wdt_retune(monarco_cxt_t *cxt)
+{
+    monarco_wdt_t *wdt = cxt->wdt;
+
+    if (wdt == NULL) {
+        return;
+    }
+
+    wdt->state = MONARCO_WDT_LEARN;
+    wdt->measured = 0;
+    wdt->max_interval_ns = 0;
+}
+
+/* Program WDTIMEOUT from measured intervals */
+static void monarco_wdt_tune(monarco_cxt_t *cxt)
+{
+    monarco_wdt_t *wdt = cxt->wdt;
+    int64_t timeout_ns = (int64_t)(wdt->margin * wdt->max_interval_ns);
+    int64_t min_ns = (int64_t)(MONARCO_WDT_OVERRUN_PERIODS * wdt->period_ns);
+
+    if (timeout_ns < min_ns) {
+        timeout_ns = min_ns;
+    }
+
+    int64_t timeout_ms = (timeout_ns + 999999) / 1000000;
+    if (timeout_ms > UINT16_MAX) {
+        timeout_ms = UINT16_MAX;
+    }
+
+    wdt->timeout_ms = (uint16_t)timeout_ms;
+    wdt->state = MONARCO_WDT_TUNED;
+
+    monarco_sdc_write(cxt, wdt->sdc_idx, wdt->timeout_ms);
+
+    MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_wdt_tune: Longest interval %lli us of %u, WDTIMEOUT %u ms\n",
+        (long long)(wdt->max_interval_ns / 1000), wdt->measured, wdt->timeout_ms);
+}
+
+monarco_struct_tx_t *monarco_wdt_cycle(monarco_cxt_t *cxt)
+{
+    monarco_wdt_t *wdt = cxt->wdt;
+    int64_t now = cxt->cycle_ns;
+    int64_t overrun_ns = wdt->overrun_ns;
+
+    // adaptive rate - the interval is judged against the period selected for it
+    if (cxt->rate != NULL) {
+        overrun_ns = (int64_t)(MONARCO_WDT_OVERRUN_PERIODS * cxt->rate->selected_ns);
+    }
+
+    if (wdt->last_ns != 0) {
+        int64_t interval = now - wdt->last_ns;
+
+        if (interval > wdt->worst_ns) {
+            wdt->worst_ns = interval;
+        }
+
+        if (interval > overrun_ns) {
+            // outputs computed before the stall are stale, send the safe state in this very frame
+            if (!wdt->safe) {
+                wdt->safe = 1;
+                wdt->safe_entries++;
+                MONARCO_DPRINT(MONARCO_DPF_WARNING, "monarco_wdt_cycle: Overrun %lli us, safe state\n", (long long)(interval / 1000));
+            }
+            wdt->good = 0;
+            wdt->overruns++;
+        }
+        else {
+            if (wdt->state == MONARCO_WDT_LEARN) {
+                if (interval > wdt->max_interval_ns) {
+                    wdt->max_interval_ns = interval;
+                }
+                if (++wdt->measured >= wdt->learn_cycles) {
+                    monarco_wdt_tune(cxt);
+                }
+            }
+
+            if (wdt->safe && (wdt->recover_cycles > 0) && (++wdt->good >= wdt->recover_cycles)) {
+                wdt->safe = 0;
+                MONARCO_DPRINT(MONARCO_DPF_INFO, "monarco_wdt_cycle: Safe state released\n");
+            }
+        }
+    }
+
+    wdt->last_ns = now;
+
+    if (!wdt->safe) {
+        return &cxt->tx_data;
+    }
+
+    // SDC request of `tx_data` with the safe-state process data, `tx_data` keeps outputs of the application
+    memcpy(&wdt->safe_frame, &cxt->tx_data, MONARCO_WDT_PD_OFFSET);
+    memcpy((char *)&wdt->safe_frame + MONARCO_WDT_PD_OFFSET, (const char *)&wdt->safe_tx + MONARCO_WDT_PD_OFFSET, MONARCO_WDT_PD_SIZE);
+    wdt->safe_cycles++;
+
+    return &wdt->safe_frame;
+}
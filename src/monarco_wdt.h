@@ -0,0 +1,113 @@
+/***************************************************************************//**
+ * @file monarco_wdt.h
+ * @brief libmonarco - Process Data Watchdog Tuning and Safe-State Outputs
+ *******************************************************************************
+ * @section License
+ * Copyright REX Controls s.r.o. http://www.rexcontrols.com
+ * Author: Vlastimil Setka
+ * This file is covered by the BSD 3-Clause License
+ *   see LICENSE.txt in the root directory of this project
+ *   or <https://opensource.org/licenses/BSD-3-Clause>
+ *******************************************************************************/
+
+#ifndef LIBMONARCO_WDT_H_
+#define LIBMONARCO_WDT_H_
+
+#include <stdint.h>
+#include "monarco.h"
+
+/* The HAT switches outputs off when no frame came for WDTIMEOUT (power-on default 100 ms), regardless
+ * of the cycle period. When a watchdog is attached by `monarco_wdt_init()`, `monarco_main()` measures
+ * the interval between cycles and:
+ *  - after `learn_cycles` intervals programs WDTIMEOUT to `margin` times the longest interval measured,
+ *    but at least MONARCO_WDT_OVERRUN_PERIODS nominal periods, rounded up to whole ms - a few cycles instead of 100 ms,
+ *  - on an interval longer than MONARCO_WDT_OVERRUN_PERIODS nominal periods (overrun, e.g. host stall),
+ *    or periods selected for the interval by an attached adaptive rate (monarco_rate.h),
+ *    sends the safe-state output profile right in the frame of the late cycle, instead of outputs
+ *    computed before the stall. The profile is sent in place of process data of `cxt->tx_data` in every
+ *    cycle until released - after `recover_cycles` cycles without overrun, or by `monarco_wdt_clear()`.
+ *    `cxt->tx_data` is not modified, outputs written by the application meanwhile (including counter
+ *    reset bits) are sent after the release.
+ * Overruns are not measured for tuning. WDTIMEOUT is written by SDC, so tuning is completed by `monarco_main()`
+ * only, not by `monarco_main_pdc()`.
+ */
+
+/* Interval in nominal periods treated as overrun */
+#ifndef MONARCO_WDT_OVERRUN_PERIODS
+#define MONARCO_WDT_OVERRUN_PERIODS 2.5
+#endif
+
+/* Default number of intervals measured before WDTIMEOUT is programmed */
+#ifndef MONARCO_WDT_LEARN_CYCLES
+#define MONARCO_WDT_LEARN_CYCLES 1000
+#endif
+
+/* Default WDTIMEOUT margin over the longest interval measured */
+#ifndef MONARCO_WDT_MARGIN
+#define MONARCO_WDT_MARGIN 2.0
+#endif
+
+/* Number of SDC Items appended by monarco_wdt_init() when there is no WDTIMEOUT Write Item */
+#define MONARCO_WDT_ITEMS 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Watchdog state */
+enum {
+    MONARCO_WDT_LEARN, /* Measuring intervals, WDTIMEOUT not changed yet */
+    MONARCO_WDT_TUNED, /* WDTIMEOUT programmed from measured intervals */
+};
+
+/* Process Data Watchdog, owned by the application */
+typedef struct monarco_wdt_s {
+    monarco_cxt_t *cxt; /* Attached context */
+    monarco_struct_tx_t safe_tx; /* Safe-state output profile, all but `sdc_req` and `crc` is applied */
+    uint32_t learn_cycles; /* Intervals measured before tuning, MONARCO_WDT_LEARN_CYCLES */
+    double margin; /* WDTIMEOUT margin over the longest interval, MONARCO_WDT_MARGIN */
+    uint32_t recover_cycles; /* Cycles without overrun releasing the safe state, 0 = until monarco_wdt_clear() */
+    int64_t period_ns; /* Nominal cycle period, the idle period with adaptive rate (ns), WDTIMEOUT is at least MONARCO_WDT_OVERRUN_PERIODS of it */
+    int64_t overrun_ns; /* Interval treated as overrun at the nominal period (ns), not used with adaptive rate */
+    int sdc_idx; /* Private, WDTIMEOUT Write Item */
+    int state; /* MONARCO_WDT_*, read-only */
+    int safe; /* Safe-state profile is applied, read-only */
+    int64_t last_ns; /* Private, start of the previous cycle, 0 = none */
+    uint32_t measured; /* Intervals measured for tuning */
+    int64_t max_interval_ns; /* Longest interval measured for tuning (ns) */
+    int64_t worst_ns; /* Longest interval including overruns (ns) */
+    uint16_t timeout_ms; /* Programmed WDTIMEOUT, 0 = not yet */
+    uint32_t good; /* Private, cycles without overrun in the safe state */
+    uint32_t overruns; /* Overruns detected */
+    uint32_t safe_entries; /* Transitions into the safe state */
+    uint32_t safe_cycles; /* Frames sent with the safe-state profile */
+    monarco_struct_tx_t safe_frame; /* Private, frame sent in the safe state */
+} monarco_wdt_t;
+
+/* Attach watchdog `*wdt` owned by the application to `cxt`, call after `monarco_sdc_load()`
+ *   `period_us` is the nominal cycle period, `*safe_tx` the safe-state output profile (NULL = all outputs off).
+ *   An existing WDTIMEOUT Write Item is reused, otherwise one is appended, so the storage needs capacity for
+ *   MONARCO_WDT_ITEMS more Items. `learn_cycles`, `margin` and `recover_cycles` may be changed afterwards.
+ *   Returns -1 on invalid period or no room for the Item.
+ */
+int monarco_wdt_init(monarco_wdt_t *wdt, monarco_cxt_t *cxt, uint32_t period_us, const monarco_struct_tx_t *safe_tx);
+
+/* Detach watchdog from `cxt`, WDTIMEOUT keeps the programmed value */
+void monarco_wdt_exit(monarco_cxt_t *cxt);
+
+/* Release the safe state, outputs of `cxt->tx_data` are sent again from the next cycle */
+void monarco_wdt_clear(monarco_cxt_t *cxt);
+
+/* Restart measurement, e.g. after the cycle period was changed, WDTIMEOUT is programmed again when done */
+void monarco_wdt_retune(monarco_cxt_t *cxt);
+
+/* Internal hook of monarco_main() */
+
+/* Measure the cycle interval, called before TX CRC. Returns the frame to send - `cxt->tx_data`, or the safe-state frame */
+monarco_struct_tx_t *monarco_wdt_cycle(monarco_cxt_t *cxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif